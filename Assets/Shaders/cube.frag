@@ -2,7 +2,6 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout (location = 0) in vec2 fragUV;
-layout (location = 1) in vec3 fragColor;
 layout (location = 2) in vec3 fragNormal;
 layout (location = 0) out vec4 outColor;
 
@@ -12,7 +11,6 @@ const vec3 lightDir = normalize(vec3(0.9,-2,1.1));
 
 void main()
 {
-	//outColor = vec4(fragColor*vec3(fragUV,1.0), 1.0);
 	//outColor = vec4(vec3(fragUV,0.0), 1.0);
 	/*
 	vec3 c;
@@ -1,33 +1,37 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+#include "shaderSimData.h"
+
+// Locations are Resource::VertexAttribute, the formats come from the vertex layout of the mesh.
+// The color at location 2 is not read, layouts may leave it out.
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inUV;
-layout(location = 2) in vec3 inColor;
 layout(location = 3) in vec3 inNormal;
 
-struct Object {
-    vec3 position;
-	float padding0;
-    vec3 velocity;
-	float padding1;
-	vec3 accel;
-	float padding2;
-    vec4 rotation;
-};
+// Set by RenderThread::CreateGraphicsPipeline, the normal is then two snorm16 folded on the octahedron
+layout(constant_id = 2) const bool OCTAHEDRAL_NORMALS = false;
 
-layout(binding = 0) uniform UniformBufferObject
+layout(binding = 0) uniform FrameUniforms
 {
-    mat4 vp;
+	mat4 vp;
+	vec4 planes[6];
+	float cullRadius;
 } ubo;
 
-layout(binding = 1) readonly buffer ObjectBuffer
+layout(binding = 1) readonly buffer InstanceBuffer
+{
+	RenderInstance instances[];
+};
+
+// Written by cull.comp, instances are drawn in the order of this list
+layout(binding = 3) readonly buffer VisibleBuffer
 {
-	Object objects[];
+	uint drawArguments[5];
+	uint visible[];
 };
 
 layout (location = 0) out vec2 fragUV;
-layout (location = 1) out vec3 fragColor;
 layout (location = 2) out vec3 fragNormal;
 
 
@@ -48,16 +52,24 @@ vec3 QuatMul(vec4 a, vec3 other)
 	return tmp.xyz;
 }
 
+// Same as Resource::VertexLayouts::DecodeOctahedral
+vec3 DecodeOctahedral(vec2 encoded)
+{
+	vec3 normal = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float fold = max(-normal.z, 0.0);
+	normal.xy += mix(vec2(fold), vec2(-fold), greaterThanEqual(normal.xy, vec2(0.0)));
+	return normalize(normal);
+}
+
 void main()
 {
-	Object data = objects[gl_InstanceIndex];
-	vec3 dest = QuatMul(data.rotation, inPosition);
-	dest += data.position;
+	RenderInstance data = instances[visible[gl_InstanceIndex]];
+	// snorm16 components are off by up to 1/32767, renormalized so the mesh is not scaled
+	vec4 rotation = normalize(vec4(unpackSnorm2x16(data.rotationXY), unpackSnorm2x16(data.rotationZW)));
+	vec3 dest = QuatMul(rotation, inPosition);
+	dest += vec3(data.px, data.py, data.pz);
 	gl_Position = vec4(dest, 1.0) * ubo.vp;
 
 	fragUV = inUV;
-	//float c = clamp(data.padding2 / 5.0, 0.0, 1.0);
-	//fragColor = vec3(c,c,c);
-	fragColor = inColor;
-	fragNormal = QuatMul(data.rotation, inNormal);
+	fragNormal = QuatMul(rotation, OCTAHEDRAL_NORMALS ? DecodeOctahedral(inNormal.xy) : inNormal);
 }
@@ -1,17 +1,66 @@
+#ifndef SHADER_SIM_DATA_H
+#define SHADER_SIM_DATA_H
 
+// Sizes are specialization constants, set from SimParams by RenderThread::CreateComputePipeline.
+// The values below are only defaults, the C++ side uses them to initialize SimParams.
+#ifdef VULKAN
+layout(constant_id = 0) const uint OBJECT_COUNT = 65536;
+layout(constant_id = 1) const uint CHUNK_COUNT_SIDE = 32;
+#else
 const uint OBJECT_COUNT = 65536;
-const uint WORLD_SIZE = 500;
-const uint MAX_GROUP_COUNT = 1024;
 const uint CHUNK_COUNT_SIDE = 32;
-const uint CHUNK_COUNT = CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE;
-const uint MAX_OBJECTS_PER_CHUNK = OBJECT_COUNT * 4 / CHUNK_COUNT + 1;
-const uint SORT_THREAD_COUNT = 64;
-const uint SORT_OBJECT_COUNT = (OBJECT_COUNT + SORT_THREAD_COUNT - 1) / SORT_THREAD_COUNT;
-const uint SORT_THREAD_OBJECT_PER_CHUNK = MAX_OBJECTS_PER_CHUNK / 4 + 1;
-const uint OBJECT_UPDATE_COUNT = (OBJECT_COUNT + CHUNK_COUNT - 1) / CHUNK_COUNT;
-const uint BLOCK_SIZE_Z = (CHUNK_COUNT + MAX_GROUP_COUNT - 1) / MAX_GROUP_COUNT;
-const uint CHUNK_COUNT_SIDE_Z = CHUNK_COUNT_SIDE / BLOCK_SIZE_Z;
+#endif
+const uint WORLD_SIZE = 500;
 
 const float BOID_DIST_MAX = 31.0f;
 const float BOID_DIST_MIN = 8.0f;
 const float BOID_MAX_SPEED = 50.0f;
+
+// Work group sizes, dispatch sizes are derived from them at runtime
+const uint BIN_GROUP_SIZE = 256;
+const uint SIM_GROUP_SIZE = 64;
+const uint SCAN_THREAD_COUNT = 1024;
+const uint CULL_GROUP_SIZE = 256;
+
+// Bytes per boid of the render stream written by pack.comp and read by cube.vert
+const uint RENDER_INSTANCE_SIZE = 20;
+
+#ifdef VULKAN
+const uint CHUNK_COUNT = CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE * CHUNK_COUNT_SIDE;
+const uint SCAN_CELLS_PER_THREAD = (CHUNK_COUNT + SCAN_THREAD_COUNT - 1) / SCAN_THREAD_COUNT;
+
+// Layout of the binning buffer, in uint elements. Simulation::BinningLayout computes the same on the CPU.
+// counts: boids per cell, written by sort0 and cleared by sort1
+// cellOffsets: exclusive scan of counts, with the total at the end
+// objectCells/ranks: cell of each boid and its slot inside that cell
+// sorted: boid ids grouped by cell
+const uint BIN_COUNTS_OFFSET = 0;
+const uint BIN_CELL_OFFSETS_OFFSET = BIN_COUNTS_OFFSET + CHUNK_COUNT;
+const uint BIN_OBJECT_CELLS_OFFSET = BIN_CELL_OFFSETS_OFFSET + CHUNK_COUNT + 1;
+const uint BIN_RANKS_OFFSET = BIN_OBJECT_CELLS_OFFSET + OBJECT_COUNT;
+const uint BIN_SORTED_OFFSET = BIN_RANKS_OFFSET + OBJECT_COUNT;
+
+// Render stream: the position, then the rotation quaternion as two packSnorm2x16 words.
+// Simulation::RenderInstance is the same layout on the CPU.
+struct RenderInstance
+{
+	float px;
+	float py;
+	float pz;
+	uint rotationXY;
+	uint rotationZW;
+};
+
+// Per step parameters, must match SimConstants in RenderThread.hpp
+layout(push_constant) uniform SimConstants
+{
+	float worldSize;
+	float distMax;
+	float distMin;
+	float maxSpeed;
+	float deltaTime;
+	uint tick;
+} sim;
+#endif
+
+#endif
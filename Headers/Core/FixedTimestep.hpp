@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Types.hpp"
+
+namespace Core
+{
+	// Turns variable frame times into a whole number of fixed simulation steps.
+	// Time that would need more than maxSteps in one frame is dropped, so a slow frame
+	// slows the simulation down instead of making every following frame slower.
+	class FixedTimestep
+	{
+	public:
+		FixedTimestep() = default;
+		~FixedTimestep() = default;
+
+		void Init(f64 stepDuration, u32 maxSteps);
+		// Adds the elapsed time and returns how many steps to run now, in [0, maxSteps]
+		u32 Advance(f64 elapsed);
+
+		f64 GetStepDuration() const;
+		// Steps returned by Advance so far, the index of the next step to run
+		u64 GetTickCount() const;
+		// Time dropped because of the maxSteps limit
+		f64 GetDroppedTime() const;
+
+	private:
+		f64 stepDuration = 1 / 144.0;
+		u32 maxSteps = 1;
+		f64 accumulator = 0;
+		f64 droppedTime = 0;
+		u64 tickCount = 0;
+	};
+}
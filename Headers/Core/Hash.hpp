@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Types.hpp"
+
+namespace Core
+{
+	// 64 bit FNV-1a, stable across runs and platforms so it can be stored in files
+	u64 HashBytes(const u8 *data, u64 size);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	const u32 JOB_QUEUE_CAPACITY = 4096;
+	const u32 MAX_PARALLEL_JOBS = 256;
+
+	// Fence for a batch of jobs: incremented on submit, decremented when a job completes.
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+
+		bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+	private:
+		friend class JobSystem;
+		std::atomic<u32> pending = 0;
+	};
+
+	struct Job
+	{
+		void (*function)(void *context, u32 begin, u32 end) = nullptr;
+		void *context = nullptr;
+		u32 begin = 0;
+		u32 end = 0;
+		JobCounter *counter = nullptr;
+
+		// Builds a job calling (object->*Method)(begin, end)
+		template<typename T, void (T::*Method)(u32, u32)>
+		static Job Create(T *object, u32 begin, u32 end);
+	};
+
+	// Chase-Lev deque. Only the owning thread may Push/Pop, any thread may Steal.
+	class WorkStealingQueue
+	{
+	public:
+		bool Push(Job *job);
+		Job *Pop();
+		Job *Steal();
+
+	private:
+		alignas(64) std::atomic<s64> top = 0;
+		alignas(64) std::atomic<s64> bottom = 0;
+		alignas(64) std::atomic<Job*> slots[JOB_QUEUE_CAPACITY] = {};
+	};
+
+	// Work-stealing scheduler. The thread calling Init owns queue 0 and is the only
+	// non-worker thread allowed to Submit or Wait.
+	// Jobs are owned by the caller and must stay alive until their counter is done.
+	class JobSystem
+	{
+	public:
+		JobSystem() = default;
+		~JobSystem();
+
+		// threadCount includes the calling thread, 0 picks one per hardware thread
+		void Init(u32 threadCount = 0);
+		void Quit();
+		bool IsRunning() const;
+		u32 GetThreadCount() const;
+
+		void Submit(Job *jobs, u32 count, JobCounter &counter);
+		// Runs pending jobs on the calling thread until the counter reaches zero
+		void Wait(JobCounter &counter);
+
+		// Splits [0, count) in ranges of at least grain elements and calls func(begin, end) on each
+		template<typename F>
+		void ParallelFor(u32 count, u32 grain, const F &func);
+
+	private:
+		std::vector<std::thread> workers;
+		std::unique_ptr<WorkStealingQueue[]> queues;
+		u32 queueCount = 0;
+		std::atomic_bool exit = false;
+		std::atomic<u32> sleeping = 0;
+		std::atomic<u32> epoch = 0;
+		std::mutex sleepLock;
+		std::condition_variable sleepCondition;
+
+		void WorkerFunc(u32 index);
+		s32 GetQueueIndex() const;
+		bool RunOne(u32 index);
+		Job *FindJob(u32 index);
+		void Execute(Job *job);
+		void WakeWorkers();
+
+		template<typename F>
+		static void InvokeRange(void *context, u32 begin, u32 end);
+	};
+}
+
+#include "JobSystem.inl"
@@ -0,0 +1,55 @@
+#include "JobSystem.hpp"
+
+namespace Core
+{
+	template<typename T, void (T::*Method)(u32, u32)>
+	inline Job Job::Create(T *object, u32 begin, u32 end)
+	{
+		Job job;
+		job.function = [](void *context, u32 b, u32 e) { (static_cast<T*>(context)->*Method)(b, e); };
+		job.context = object;
+		job.begin = begin;
+		job.end = end;
+		return job;
+	}
+
+	template<typename F>
+	inline void JobSystem::InvokeRange(void *context, u32 begin, u32 end)
+	{
+		(*static_cast<const F*>(context))(begin, end);
+	}
+
+	template<typename F>
+	inline void JobSystem::ParallelFor(u32 count, u32 grain, const F &func)
+	{
+		if (count == 0)
+			return;
+		if (grain == 0)
+			grain = 1;
+
+		u32 jobCount = (count + grain - 1) / grain;
+		if (!IsRunning() || jobCount == 1)
+		{
+			func(0, count);
+			return;
+		}
+		if (jobCount > MAX_PARALLEL_JOBS)
+		{
+			grain = (count + MAX_PARALLEL_JOBS - 1) / MAX_PARALLEL_JOBS;
+			jobCount = (count + grain - 1) / grain;
+		}
+
+		Job jobs[MAX_PARALLEL_JOBS];
+		for (u32 i = 0; i < jobCount; i++)
+		{
+			jobs[i].function = &InvokeRange<F>;
+			jobs[i].context = const_cast<F*>(&func);
+			jobs[i].begin = i * grain;
+			jobs[i].end = (i + 1) * grain < count ? (i + 1) * grain : count;
+		}
+
+		JobCounter counter;
+		Submit(jobs, jobCount, counter);
+		Wait(counter);
+	}
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	// Read only view of a whole file. Pages are loaded by the OS on first access,
+	// the view stays valid until Close or destruction.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		~MappedFile();
+		MappedFile(const MappedFile &) = delete;
+		MappedFile &operator=(const MappedFile &) = delete;
+
+		// Sequential is a hint that the content will be read once from start to end
+		bool Open(const std::string &path, bool sequential = false);
+		void Close();
+		bool IsOpen() const;
+		const u8 *GetData() const;
+		u64 GetSize() const;
+
+	private:
+		const u8 *data = nullptr;
+		u64 size = 0;
+#ifdef _WIN32
+		void *fileHandle = nullptr;
+		void *mappingHandle = nullptr;
+#else
+		s32 fileDescriptor = -1;
+#endif
+	};
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	struct TimingStats
+	{
+		u32 count = 0;
+		f64 min = 0;
+		f64 avg = 0;
+		f64 p99 = 0;
+		f64 max = 0;
+	};
+
+	// Rolling window of timings for a fixed set of named passes, in milliseconds.
+	// Once a pass holds windowSize samples the oldest one is replaced. Not thread safe.
+	class PassTimings
+	{
+	public:
+		PassTimings() = default;
+		~PassTimings() = default;
+
+		void Init(const std::vector<std::string> &names, u32 windowSize);
+		void AddSample(u32 pass, f64 milliseconds);
+		void Clear();
+
+		u32 GetPassCount() const;
+		const std::string &GetName(u32 pass) const;
+		TimingStats GetStats(u32 pass) const;
+
+		// One line per pass after a header: pass,samples,min_ms,avg_ms,p99_ms,max_ms
+		void WriteCsv(std::ostream &out) const;
+		bool WriteCsv(const std::string &path) const;
+
+	private:
+		struct Pass
+		{
+			std::string name;
+			std::vector<f64> samples;
+			u32 next = 0;
+		};
+
+		std::vector<Pass> passes;
+		u32 windowSize = 1;
+	};
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Types.hpp"
+
+namespace Core
+{
+	// Log-linear buckets: exact below SUB_BUCKET_COUNT, then SUB_BUCKET_COUNT buckets per power of two,
+	// so a reported value is at most 1 / SUB_BUCKET_COUNT above the recorded one.
+	const u32 SUB_BUCKET_BITS = 5;
+	const u32 SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	const u32 HISTOGRAM_BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+	// Durations in nanoseconds
+	struct HistogramStats
+	{
+		u64 count = 0;
+		u64 p50 = 0;
+		u64 p95 = 0;
+		u64 p99 = 0;
+		u64 max = 0;
+	};
+
+	// HDR-style histogram of durations. Record is lock free and may be called from any thread,
+	// TakeSnapshot moves the samples out so every sample lands in exactly one snapshot.
+	class TimingHistogram
+	{
+	public:
+		TimingHistogram() = default;
+		~TimingHistogram() = default;
+
+		void Record(u64 nanoseconds);
+		HistogramStats TakeSnapshot();
+
+		static u32 GetBucket(u64 value);
+		// Highest value that falls in the bucket
+		static u64 GetBucketValue(u32 bucket);
+
+	private:
+		std::atomic<u64> counts[HISTOGRAM_BUCKET_COUNT] = {};
+		std::atomic<u64> max = 0;
+	};
+
+	// Named histograms for the phases of a loop. Phases are fixed at Init, recording is lock free.
+	// Snapshots are exported as CSV rows: time_s,phase,count,p50_ms,p95_ms,p99_ms,max_ms
+	class TimingCollector
+	{
+	public:
+		TimingCollector() = default;
+		~TimingCollector() = default;
+
+		void Init(const std::vector<std::string> &phaseNames);
+		void Record(u32 phase, u64 nanoseconds);
+		void Record(u32 phase, std::chrono::steady_clock::duration duration);
+
+		u32 GetPhaseCount() const;
+		const std::string &GetName(u32 phase) const;
+		// Stats of every phase since the previous snapshot
+		void TakeSnapshot(std::vector<HistogramStats> &stats);
+
+		// Truncates the file and writes the header
+		bool OpenExport(const std::string &path);
+		void Export(f64 time, const std::vector<HistogramStats> &stats);
+		// Single line summary of the phases that have samples, in milliseconds
+		std::string FormatSummary(const std::vector<HistogramStats> &stats) const;
+
+	private:
+		std::vector<std::string> names;
+		std::vector<std::unique_ptr<TimingHistogram>> histograms;
+		std::ofstream exportFile;
+	};
+
+	// Records the lifetime of the object into a phase
+	class ScopedTiming
+	{
+	public:
+		ScopedTiming(TimingCollector &collector, u32 phase);
+		~ScopedTiming();
+
+	private:
+		TimingCollector &collector;
+		u32 phase;
+		std::chrono::steady_clock::time_point start;
+	};
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+
+#include "Types.hpp"
+
+// Trace zones, compiled out unless ENABLE_TRACE is defined.
+// Events are only kept between Core::Trace::Start and Core::Trace::Stop, names must be string literals.
+#ifdef ENABLE_TRACE
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) Core::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+#define TRACE_BEGIN(name) Core::Trace::Begin(name)
+#define TRACE_END(name) Core::Trace::End(name)
+#define TRACE_THREAD_NAME(name) Core::Trace::SetThreadName(name)
+#define TRACE_COMPLETE(track, name, start, duration) Core::Trace::RecordComplete(track, name, start, duration)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#define TRACE_BEGIN(name)
+#define TRACE_END(name)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_COMPLETE(track, name, start, duration)
+#endif
+
+namespace Core
+{
+	const u32 TRACE_BUFFER_CAPACITY = 1 << 15;
+
+	enum class TraceEventType : u8
+	{
+		BEGIN,
+		END,
+		COMPLETE,
+	};
+
+	struct TraceEvent
+	{
+		const char *name = nullptr;
+		// Nanoseconds since Trace::Start
+		u64 timestamp = 0;
+		u64 duration = 0;
+		TraceEventType type = TraceEventType::BEGIN;
+	};
+
+	// Ring of events for one thread, or one track like a GPU queue.
+	// Single producer, the consumer is Trace::Flush. A full ring drops events instead of blocking.
+	class TraceBuffer
+	{
+	public:
+		TraceBuffer(u32 id, const char *name);
+
+		bool Push(const TraceEvent &event);
+		bool Pop(TraceEvent &event);
+
+		const u32 id;
+		const char *name;
+		std::atomic<u64> dropped = 0;
+		bool named = false;
+
+	private:
+		alignas(64) std::atomic<u64> head = 0;
+		alignas(64) std::atomic<u64> tail = 0;
+		TraceEvent events[TRACE_BUFFER_CAPACITY];
+	};
+
+	// Writes Chrome trace JSON, which chrome://tracing and the Perfetto UI both open.
+	namespace Trace
+	{
+		bool Start(const std::string &path);
+		// Flushes the remaining events and closes the file
+		void Stop();
+		// Moves the buffered events of every thread to the file, thread safe
+		void Flush();
+		bool IsEnabled();
+		// Nanoseconds since Start on the steady clock
+		u64 Now();
+
+		void SetThreadName(const char *name);
+		void Begin(const char *name);
+		void End(const char *name);
+		// Event with explicit times on a track that is not a thread. A track must only be written by one thread.
+		void RecordComplete(const char *track, const char *name, u64 start, u64 duration);
+	}
+
+	class TraceScope
+	{
+	public:
+		TraceScope(const char *nameIn) : name(nameIn) { Trace::Begin(name); }
+		~TraceScope() { Trace::End(name); }
+
+	private:
+		const char *name;
+	};
+}
@@ -10,22 +10,15 @@
 #include <atomic>
 
 #include "Maths/Maths.hpp"
-
-typedef u32 uint;
-#include "../Assets/Shaders/shaderSimData.h"
+#include "Core/JobSystem.hpp"
+#include "Core/TimingHistogram.hpp"
+#include "Core/Trace.hpp"
+#include "Simulation/BoidSim.hpp"
 
 const u32 CELL_SIZE = 64;
 const u32 BOID_CHUNK = 512;
 const float BOID_CURSOR_DIST = 256.0f;
 
-struct PoolTask
-{
-	u32 taskID;
-	u32 cellX;
-	u32 cellY;
-	float deltaTime;
-};
-
 enum WindowMessage : u32
 {
 	NONE = 0,
@@ -34,13 +27,24 @@ enum WindowMessage : u32
 	EXIT_WINDOW = 3
 };
 
+// Phases of a game tick recorded into histograms, exported every second
+enum TickPhase : u32
+{
+	TICK_PHASE_TICK = 0,
+	TICK_PHASE_INPUT_LOCK,
+	TICK_PHASE_INPUT,
+	TICK_PHASE_CAMERA,
+	TICK_PHASE_UPDATE_BUFFERS,
+	TICK_PHASE_COUNT,
+};
+
 class GameThread
 {
 public:
 	GameThread() = default;
 	~GameThread() = default;
 
-	void Init(HWND hwnd, u32 customMsg, Maths::IVec2 res, bool isUnitTest);
+	void Init(HWND hwnd, u32 customMsg, Maths::IVec2 res, bool isUnitTest, const Simulation::SimParams &simParams, u32 seed);
 	void Resize(s32 x, s32 y);
 	bool HasFinished() const;
 	void Quit();
@@ -48,6 +52,9 @@ public:
 	void SetKeyState(u8 key, u8 scanCode, bool state);
 	void SendWindowMessage(WindowMessage msg, u64 payload = 0);
 	std::vector<Maths::Vec4> GetInitialSimulationData();
+	// True once per F5 press, polled by the render thread
+	bool TakeSnapshotRequest();
+	const Simulation::SimParams &GetSimParams() const;
 	const Maths::Mat4 &GetViewProjectionMatrix() const;
 
 	static void SendErrorPopup(const std::wstring &err);
@@ -83,13 +90,18 @@ private:
 	f64 appTime = 0;
 	Maths::Vec2 cursorPos;
 	std::atomic_bool mousePressed = false;
+	std::atomic_bool snapshotRequested = false;
+	Simulation::SimParams simParams;
+	u32 seed = 0;
+	Core::TimingCollector tickTimings;
 
 	std::vector<Maths::Vec2> positions;
 	std::vector<Maths::Vec2> velocities;
 	std::vector<Maths::Vec2> accels;
 	std::vector<float> rotations;
 
-	std::vector<std::vector<u32>> cells;
+	std::vector<u32> objectCells;
+	Simulation::SpatialGrid grid;
 
 	Maths::Mat4 vpA;
 	Maths::Mat4 vpB;
@@ -97,11 +109,9 @@ private:
 	std::vector<Maths::Vec4> bufferB;
 	std::atomic_bool currentBuf = false;
 
-	std::vector<std::thread> threadPool;
-	std::vector<PoolTask> tasks;
-	std::atomic_uint32_t taskCounter;
-	std::atomic_bool poolExit;
-	std::mutex taskLock;
+	Core::JobSystem jobSystem;
+	std::vector<Core::Job> jobs;
+	float jobDeltaTime = 0;
 
 	void ThreadFunc();
 	void HandleResize();
@@ -110,11 +120,9 @@ private:
 	void Update(float deltaTime);
 	void PostUpdate(float deltaTime);
 	void UpdateBuffers(const Maths::Mat4 &mat);
-	float NextFloat01();
-	Maths::Vec3 NextUnitVector();
 	s32 GetCell(Maths::IVec2 pos, Maths::IVec2 &dt);
-	void ThreadPoolFunc();
-	bool ThreadPoolUpdate();
+	void CellUpdateJob(u32 cellX, u32 cellY);
+	void PostUpdateJob(u32 start, u32 end);
 	void ProcessCellUpdate(u32 x, u32 y, float deltaTime);
 	void ProcessPostUpdate(u32 start, u32 end, float deltaTime);
 };
@@ -5,6 +5,7 @@
 #include <string>
 
 #include "Types.hpp"
+#include "MathsSimd.hpp"
 
 namespace Maths
 {
@@ -695,12 +696,20 @@ namespace Maths
 		Frustum() {}
 		~Frustum() {}
 
+		// Planes as (normal, distance), a point p is inside when normal.Dot(p) - distance >= 0.
+		// Normals point inward and have unit length.
 		Vec4 top;
 		Vec4 bottom;
 		Vec4 right;
 		Vec4 left;
 		Vec4 front;
 		Vec4 back;
+
+		// Extracts the planes of the clip volume of vp, with clip = vp * Vec4(p, 1).
+		// Depth uses the OpenGL range -w..w, which contains the Vulkan range 0..w.
+		static Frustum FromViewProjection(const Mat4& vp);
+
+		bool IsSphereOnFrustum(const Vec3& center, f32 radius) const;
 	};
 
 	class AABB
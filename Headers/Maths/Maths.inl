@@ -3,7 +3,9 @@
 #include "Maths.hpp"
 
 #include <assert.h>
+#ifdef _WIN32
 #include <corecrt_math_defines.h>
+#endif
 
 namespace Maths
 {
@@ -1105,9 +1107,13 @@ namespace Maths
 		return Quat(-v, -a);
 	}
 
+	static_assert(sizeof(Quat) == 4 * sizeof(f32), "Quat must be packed as (x, y, z, w) for the SIMD path");
+
 	inline Quat Quat::operator*(const Quat& other) const
 	{
-		return Quat(other.v * a + v * other.a + v.Cross(other.v), a*other.a - v.Dot(other.v));
+		Quat out;
+		Simd::MultiplyQuat(&v.x, &other.v.x, &out.v.x);
+		return out;
 	}
 
 	inline Vec3 Quat::operator*(const Vec3& other) const
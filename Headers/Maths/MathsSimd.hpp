@@ -0,0 +1,286 @@
+#pragma once
+
+#include "Types.hpp"
+
+// SIMD backend of the Maths classes, selected at compile time.
+// Define MATHS_NO_SIMD to force the scalar path everywhere.
+// Kernels only use separate multiplies and adds, in the same order as the scalar code,
+// so both paths give bit-identical results (only the sign of a zero result may differ).
+#if !defined(MATHS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MATHS_SIMD_SSE
+#include <emmintrin.h>
+#elif !defined(MATHS_NO_SIMD) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define MATHS_SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#if defined(MATHS_SIMD_SSE) || defined(MATHS_SIMD_NEON)
+#define MATHS_SIMD
+#endif
+
+namespace Maths
+{
+	// Philox4x32-10 constants (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3")
+	const u32 PHILOX_ROUNDS = 10;
+	const u32 PHILOX_M0 = 0xD2511F53;
+	const u32 PHILOX_M1 = 0xCD9E8D57;
+	const u32 PHILOX_W0 = 0x9E3779B9;
+	const u32 PHILOX_W1 = 0xBB67AE85;
+
+	// Reference implementations, always compiled so the SIMD path can be checked against them
+	namespace Scalar
+	{
+		// Column major 4x4 matrices, out must not alias a or b
+		inline void MultiplyMat4(const f32 *a, const f32 *b, f32 *out)
+		{
+			for (u32 j = 0; j < 4; j++)
+			{
+				for (u32 i = 0; i < 4; i++)
+				{
+					f32 res = 0;
+					for (u32 k = 0; k < 4; k++)
+						res += a[j + k * 4] * b[k + i * 4];
+
+					out[j + i * 4] = res;
+				}
+			}
+		}
+
+		inline void MultiplyMat4Vec4(const f32 *m, const f32 *v, f32 *out)
+		{
+			for (u32 i = 0; i < 4; i++)
+			{
+				f32 res = 0;
+				for (u32 k = 0; k < 4; k++)
+					res += m[i + k * 4] * v[k];
+				out[i] = res;
+			}
+		}
+
+		// Quaternions stored as (x, y, z, w)
+		inline void MultiplyQuat(const f32 *a, const f32 *b, f32 *out)
+		{
+			f32 x = (b[0] * a[3] + a[0] * b[3]) + (a[1] * b[2] - a[2] * b[1]);
+			f32 y = (b[1] * a[3] + a[1] * b[3]) + (a[2] * b[0] - a[0] * b[2]);
+			f32 z = (b[2] * a[3] + a[2] * b[3]) + (a[0] * b[1] - a[1] * b[0]);
+			f32 w = a[3] * b[3] - (b[0] * a[0] + b[1] * a[1] + b[2] * a[2]);
+			out[0] = x;
+			out[1] = y;
+			out[2] = z;
+			out[3] = w;
+		}
+
+		inline void PhiloxBlock(const u32 *key, const u32 *counter, u32 *out)
+		{
+			u32 c[4] = { counter[0], counter[1], counter[2], counter[3] };
+			u32 k0 = key[0];
+			u32 k1 = key[1];
+			for (u32 r = 0; r < PHILOX_ROUNDS; r++)
+			{
+				if (r > 0)
+				{
+					k0 += PHILOX_W0;
+					k1 += PHILOX_W1;
+				}
+				const u64 p0 = (u64)(PHILOX_M0) * c[0];
+				const u64 p1 = (u64)(PHILOX_M1) * c[2];
+				c[0] = (u32)(p1 >> 32) ^ c[1] ^ k0;
+				c[1] = (u32)(p1);
+				c[2] = (u32)(p0 >> 32) ^ c[3] ^ k1;
+				c[3] = (u32)(p0);
+			}
+			out[0] = c[0];
+			out[1] = c[1];
+			out[2] = c[2];
+			out[3] = c[3];
+		}
+
+		// 4 consecutive blocks: block b uses the counter (firstBlock + b, stream[0], stream[1]), out gets 4 words per block
+		inline void PhiloxBlocks4(const u32 *key, const u32 *stream, u64 firstBlock, u32 *out)
+		{
+			for (u32 b = 0; b < 4; b++)
+			{
+				const u64 block = firstBlock + b;
+				const u32 counter[4] = { (u32)(block), (u32)(block >> 32), stream[0], stream[1] };
+				PhiloxBlock(key, counter, out + b * 4);
+			}
+		}
+	}
+
+#ifdef MATHS_SIMD
+	namespace Simd
+	{
+#if defined(MATHS_SIMD_SSE)
+		inline void MultiplyMat4(const f32 *a, const f32 *b, f32 *out)
+		{
+			__m128 c0 = _mm_loadu_ps(a);
+			__m128 c1 = _mm_loadu_ps(a + 4);
+			__m128 c2 = _mm_loadu_ps(a + 8);
+			__m128 c3 = _mm_loadu_ps(a + 12);
+			for (u32 i = 0; i < 4; i++)
+			{
+				__m128 res = _mm_mul_ps(c0, _mm_set1_ps(b[i * 4]));
+				res = _mm_add_ps(res, _mm_mul_ps(c1, _mm_set1_ps(b[i * 4 + 1])));
+				res = _mm_add_ps(res, _mm_mul_ps(c2, _mm_set1_ps(b[i * 4 + 2])));
+				res = _mm_add_ps(res, _mm_mul_ps(c3, _mm_set1_ps(b[i * 4 + 3])));
+				_mm_storeu_ps(out + i * 4, res);
+			}
+		}
+
+		inline void MultiplyMat4Vec4(const f32 *m, const f32 *v, f32 *out)
+		{
+			__m128 res = _mm_mul_ps(_mm_loadu_ps(m), _mm_set1_ps(v[0]));
+			res = _mm_add_ps(res, _mm_mul_ps(_mm_loadu_ps(m + 4), _mm_set1_ps(v[1])));
+			res = _mm_add_ps(res, _mm_mul_ps(_mm_loadu_ps(m + 8), _mm_set1_ps(v[2])));
+			res = _mm_add_ps(res, _mm_mul_ps(_mm_loadu_ps(m + 12), _mm_set1_ps(v[3])));
+			_mm_storeu_ps(out, res);
+		}
+
+		inline void MultiplyQuat(const f32 *a, const f32 *b, f32 *out)
+		{
+			__m128 qa = _mm_loadu_ps(a);
+			__m128 qb = _mm_loadu_ps(b);
+			__m128 aw = _mm_shuffle_ps(qa, qa, _MM_SHUFFLE(3, 3, 3, 3));
+			__m128 bw = _mm_shuffle_ps(qb, qb, _MM_SHUFFLE(3, 3, 3, 3));
+			__m128 ayzx = _mm_shuffle_ps(qa, qa, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 azxy = _mm_shuffle_ps(qa, qa, _MM_SHUFFLE(3, 1, 0, 2));
+			__m128 byzx = _mm_shuffle_ps(qb, qb, _MM_SHUFFLE(3, 0, 2, 1));
+			__m128 bzxy = _mm_shuffle_ps(qb, qb, _MM_SHUFFLE(3, 1, 0, 2));
+			__m128 res = _mm_add_ps(_mm_mul_ps(qb, aw), _mm_mul_ps(qa, bw));
+			res = _mm_add_ps(res, _mm_sub_ps(_mm_mul_ps(ayzx, bzxy), _mm_mul_ps(azxy, byzx)));
+			_mm_storeu_ps(out, res);
+			// The real part needs a horizontal sum, the scalar unit does it in the right order for free
+			out[3] = a[3] * b[3] - (b[0] * a[0] + b[1] * a[1] + b[2] * a[2]);
+		}
+
+		// Low and high halves of the 32x32 bit products of each lane with m
+		inline void MultiplyHiLo(__m128i a, u32 m, __m128i &lo, __m128i &hi)
+		{
+			const __m128i mv = _mm_set1_epi32((s32)(m));
+			const __m128i even = _mm_mul_epu32(a, mv);
+			const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), mv);
+			lo = _mm_or_si128(_mm_and_si128(even, _mm_set_epi32(0, -1, 0, -1)), _mm_slli_epi64(odd, 32));
+			hi = _mm_or_si128(_mm_srli_epi64(even, 32), _mm_and_si128(odd, _mm_set_epi32(-1, 0, -1, 0)));
+		}
+
+		// One block per lane
+		inline void PhiloxBlocks4(const u32 *key, const u32 *stream, u64 firstBlock, u32 *out)
+		{
+			// The low counter word wraps inside this group, the carry is simpler on the scalar path
+			if ((u32)(firstBlock) > 0xfffffffc)
+			{
+				Scalar::PhiloxBlocks4(key, stream, firstBlock, out);
+				return;
+			}
+			__m128i c0 = _mm_add_epi32(_mm_set1_epi32((s32)(firstBlock)), _mm_set_epi32(3, 2, 1, 0));
+			__m128i c1 = _mm_set1_epi32((s32)(firstBlock >> 32));
+			__m128i c2 = _mm_set1_epi32((s32)(stream[0]));
+			__m128i c3 = _mm_set1_epi32((s32)(stream[1]));
+			u32 k0 = key[0];
+			u32 k1 = key[1];
+			for (u32 r = 0; r < PHILOX_ROUNDS; r++)
+			{
+				if (r > 0)
+				{
+					k0 += PHILOX_W0;
+					k1 += PHILOX_W1;
+				}
+				__m128i lo0, hi0, lo1, hi1;
+				MultiplyHiLo(c0, PHILOX_M0, lo0, hi0);
+				MultiplyHiLo(c2, PHILOX_M1, lo1, hi1);
+				c0 = _mm_xor_si128(_mm_xor_si128(hi1, c1), _mm_set1_epi32((s32)(k0)));
+				c1 = lo1;
+				c2 = _mm_xor_si128(_mm_xor_si128(hi0, c3), _mm_set1_epi32((s32)(k1)));
+				c3 = lo0;
+			}
+			// Lanes hold one word of each block, transpose to 4 words per block
+			__m128 w0 = _mm_castsi128_ps(c0);
+			__m128 w1 = _mm_castsi128_ps(c1);
+			__m128 w2 = _mm_castsi128_ps(c2);
+			__m128 w3 = _mm_castsi128_ps(c3);
+			_MM_TRANSPOSE4_PS(w0, w1, w2, w3);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm_castps_si128(w0));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4), _mm_castps_si128(w1));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 8), _mm_castps_si128(w2));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out + 12), _mm_castps_si128(w3));
+		}
+#elif defined(MATHS_SIMD_NEON)
+		inline void MultiplyMat4(const f32 *a, const f32 *b, f32 *out)
+		{
+			float32x4_t c0 = vld1q_f32(a);
+			float32x4_t c1 = vld1q_f32(a + 4);
+			float32x4_t c2 = vld1q_f32(a + 8);
+			float32x4_t c3 = vld1q_f32(a + 12);
+			for (u32 i = 0; i < 4; i++)
+			{
+				// vmlaq may be fused on some targets, keep multiply and add separate
+				float32x4_t res = vmulq_n_f32(c0, b[i * 4]);
+				res = vaddq_f32(res, vmulq_n_f32(c1, b[i * 4 + 1]));
+				res = vaddq_f32(res, vmulq_n_f32(c2, b[i * 4 + 2]));
+				res = vaddq_f32(res, vmulq_n_f32(c3, b[i * 4 + 3]));
+				vst1q_f32(out + i * 4, res);
+			}
+		}
+
+		inline void MultiplyMat4Vec4(const f32 *m, const f32 *v, f32 *out)
+		{
+			float32x4_t res = vmulq_n_f32(vld1q_f32(m), v[0]);
+			res = vaddq_f32(res, vmulq_n_f32(vld1q_f32(m + 4), v[1]));
+			res = vaddq_f32(res, vmulq_n_f32(vld1q_f32(m + 8), v[2]));
+			res = vaddq_f32(res, vmulq_n_f32(vld1q_f32(m + 12), v[3]));
+			vst1q_f32(out, res);
+		}
+
+		// Lane shuffles are as expensive as the maths here, NEON keeps the scalar quaternion product
+		inline void MultiplyQuat(const f32 *a, const f32 *b, f32 *out)
+		{
+			Scalar::MultiplyQuat(a, b, out);
+		}
+
+		inline void MultiplyHiLo(uint32x4_t a, u32 m, uint32x4_t &lo, uint32x4_t &hi)
+		{
+			const uint64x2_t low = vmull_u32(vget_low_u32(a), vdup_n_u32(m));
+			const uint64x2_t high = vmull_u32(vget_high_u32(a), vdup_n_u32(m));
+			lo = vcombine_u32(vmovn_u64(low), vmovn_u64(high));
+			hi = vcombine_u32(vshrn_n_u64(low, 32), vshrn_n_u64(high, 32));
+		}
+
+		inline void PhiloxBlocks4(const u32 *key, const u32 *stream, u64 firstBlock, u32 *out)
+		{
+			if ((u32)(firstBlock) > 0xfffffffc)
+			{
+				Scalar::PhiloxBlocks4(key, stream, firstBlock, out);
+				return;
+			}
+			const u32 offsets[4] = { 0, 1, 2, 3 };
+			uint32x4x4_t c;
+			c.val[0] = vaddq_u32(vdupq_n_u32((u32)(firstBlock)), vld1q_u32(offsets));
+			c.val[1] = vdupq_n_u32((u32)(firstBlock >> 32));
+			c.val[2] = vdupq_n_u32(stream[0]);
+			c.val[3] = vdupq_n_u32(stream[1]);
+			u32 k0 = key[0];
+			u32 k1 = key[1];
+			for (u32 r = 0; r < PHILOX_ROUNDS; r++)
+			{
+				if (r > 0)
+				{
+					k0 += PHILOX_W0;
+					k1 += PHILOX_W1;
+				}
+				uint32x4_t lo0, hi0, lo1, hi1;
+				MultiplyHiLo(c.val[0], PHILOX_M0, lo0, hi0);
+				MultiplyHiLo(c.val[2], PHILOX_M1, lo1, hi1);
+				c.val[0] = veorq_u32(veorq_u32(hi1, c.val[1]), vdupq_n_u32(k0));
+				c.val[1] = lo1;
+				c.val[2] = veorq_u32(veorq_u32(hi0, c.val[3]), vdupq_n_u32(k1));
+				c.val[3] = lo0;
+			}
+			// Interleaving store, 4 words per block
+			vst4q_u32(out, c);
+		}
+#endif
+	}
+#else
+	namespace Simd = Scalar;
+#endif
+}
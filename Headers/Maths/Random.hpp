@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Types.hpp"
+#include "MathsSimd.hpp"
+
+namespace Maths
+{
+	// Counter based generator (Philox4x32-10). Block n of a stream only depends on the seed, the stream and n,
+	// so ranges can be generated on any thread, in any order, and the result does not depend on how the work is split.
+	class Philox
+	{
+	public:
+		static const u32 BLOCK_WORDS = 4;
+
+		Philox() = default;
+		explicit Philox(u64 seed, u64 stream = 0);
+
+		void GenerateBlock(u64 block, u32 *out) const;
+		// blockCount blocks starting at firstBlock, BLOCK_WORDS words each, 4 blocks at a time on the SIMD path
+		void GenerateBlocks(u64 firstBlock, u32 blockCount, u32 *out) const;
+		// Same words mapped to [0, 1)
+		void GenerateFloats01(u64 firstBlock, u32 blockCount, f32 *out) const;
+
+		// Top 24 bits, every value is exact and 1 cannot be reached
+		static inline f32 ToFloat01(u32 bits) { return (f32)(bits >> 8) * (1.0f / 16777216.0f); }
+
+	private:
+		u32 key[2] = {};
+		u32 stream[2] = {};
+	};
+}
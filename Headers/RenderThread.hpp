@@ -17,10 +17,92 @@
 #include "Types.hpp"
 #include "Maths/Maths.hpp"
 #include "Resource/Mesh.hpp"
+#include "Resource/AssetPack.hpp"
+#include "Resource/PipelineCacheFile.hpp"
+#include "Core/FixedTimestep.hpp"
+#include "Core/JobSystem.hpp"
+#include "Core/PassTimings.hpp"
+#include "Core/TimingHistogram.hpp"
+#include "Core/Trace.hpp"
+#include "Simulation/Trajectory.hpp"
 
 #include "GameThread.hpp"
 
 const u32 MAX_FRAMES_IN_FLIGHT = 3;
+// The simulation writes its result to one copy while the other is drawn
+const u32 RENDER_OBJECT_BUFFER_COUNT = 2;
+// Fixed simulation rate, a frame runs between 0 and MAX_SIM_STEPS_PER_FRAME steps
+const f64 SIM_TICK_RATE = 144.0;
+const u32 MAX_SIM_STEPS_PER_FRAME = 8;
+
+// Compute passes, in dispatch order
+enum ComputePass : u32
+{
+	COMPUTE_BIN_COUNT = 0,
+	COMPUTE_BIN_SCAN,
+	COMPUTE_BIN_SCATTER,
+	COMPUTE_SIM_ACCEL,
+	COMPUTE_SIM_MOVE,
+	COMPUTE_PASS_COUNT,
+};
+
+// CPU phases of a frame recorded into histograms, exported every second
+enum FramePhase : u32
+{
+	FRAME_PHASE_FRAME = 0,
+	FRAME_PHASE_FRAME_WAIT,
+	FRAME_PHASE_ACQUIRE,
+	FRAME_PHASE_IMAGE_WAIT,
+	FRAME_PHASE_RECORD,
+	FRAME_PHASE_SUBMIT,
+	FRAME_PHASE_PRESENT,
+	FRAME_PHASE_COUNT,
+};
+
+// Runs once per submit after the steps, packs the render stream of the new state
+const u32 COMPUTE_PACK = COMPUTE_PASS_COUNT;
+const u32 COMPUTE_PIPELINE_COUNT = COMPUTE_PASS_COUNT + 1;
+
+// Passes timed by the GPU profiler, the compute passes keep their index
+const u32 PROFILE_PASS_PACK = COMPUTE_PASS_COUNT;
+const u32 PROFILE_PASS_CULL = COMPUTE_PASS_COUNT + 1;
+const u32 PROFILE_PASS_RENDER = COMPUTE_PASS_COUNT + 2;
+const u32 PROFILE_PASS_COUNT = COMPUTE_PASS_COUNT + 3;
+// Samples kept per pass for the rolling statistics
+const u32 GPU_TIMING_WINDOW = 1024;
+// Timestamp pairs of a frame: one per compute pass and step, then the pack and copy, then the culling and the render pass
+const u32 TIMESTAMP_PACK_QUERY = MAX_SIM_STEPS_PER_FRAME * COMPUTE_PASS_COUNT * 2;
+const u32 TIMESTAMP_CULL_QUERY = TIMESTAMP_PACK_QUERY + 2;
+const u32 TIMESTAMP_RENDER_QUERY = TIMESTAMP_CULL_QUERY + 2;
+const u32 TIMESTAMP_QUERY_COUNT = TIMESTAMP_RENDER_QUERY + 2;
+
+// Renders into images instead of a swapchain, for runs without a window
+struct OffscreenParams
+{
+	bool enabled = false;
+	// Frames drawn before the render thread stops, 0 runs until Quit
+	u32 frameCount = 0;
+	// Every captureInterval frames is read back and written to <capturePrefix><frame>.png, 0 disables the capture
+	u32 captureInterval = 0;
+	std::string capturePrefix;
+};
+
+// Saved simulation states, see Simulation::Snapshot
+struct SnapshotParams
+{
+	// Mapped and copied to the staging buffer instead of generating the initial state
+	std::string loadPath;
+	// Snapshots requested by the game thread are written to <savePrefix><tick>.boids
+	std::string savePrefix;
+};
+
+// Boid states read back every interval ticks and handed to a Simulation::TrajectoryRecorder
+struct TrajectoryParams
+{
+	// Empty disables the recording
+	std::string path;
+	u32 interval = 10;
+};
 
 struct UBO
 {
@@ -28,6 +110,28 @@ struct UBO
 	Maths::Vec2 scale;
 };
 
+// Matches the FrameUniforms block of cube.vert and cull.comp, one buffer per frame in flight
+struct FrameUniforms
+{
+	Maths::Mat4 vp;
+	// Left, right, bottom, top, front, back, see Maths::Frustum
+	Maths::Vec4 planes[6];
+	// Bounding sphere of the mesh around its origin
+	f32 cullRadius;
+	f32 padding[3];
+};
+
+// Matches the SimConstants push constant block of shaderSimData.h
+struct SimConstants
+{
+	f32 worldSize;
+	f32 distMax;
+	f32 distMin;
+	f32 maxSpeed;
+	f32 deltaTime;
+	u32 tick;
+};
+
 struct AppData
 {
 	HWND hWnd;
@@ -40,6 +144,14 @@ struct AppData
 	vkb::DispatchTable disp;
 	vkb::Swapchain swapchain;
 	f32 maxSamplerAnisotropy = 0;
+	u32 maxStorageBufferRange = 0;
+	VkDeviceSize maxMemoryAllocationSize = 0;
+	u32 maxComputeWorkGroupCount = 0;
+	f32 timestampPeriod = 0;
+	// BC formats can be sampled, textures are cached as BC1 instead of RGBA8
+	bool textureCompressionBC = false;
+	// Pipeline cache files from another device or driver are discarded
+	Resource::PipelineCacheDevice pipelineCacheDevice;
 };
 
 struct RenderData
@@ -47,37 +159,106 @@ struct RenderData
 	VkQueue graphicsQueue;
 	VkQueue presentQueue;
 	VkQueue transferQueue;
+	// Same as graphicsQueue when the device has no separate compute family
+	VkQueue computeQueue;
+	// Unique families of the queues above, buffers are shared between them
+	std::vector<u32> queueFamilies;
 
 	std::vector<VkImage> swapchainImages;
 	std::vector<VkImageView> swapchainImageViews;
 	std::vector<VkFramebuffer> framebuffers;
+	// Offscreen mode: the color targets are our images, one per frame in flight
+	std::vector<VkDeviceMemory> offscreenImagesMemory;
+	// Persistently mapped readback ring, one color target sized slot per frame in flight.
+	// captureFrames holds the frame copied into each slot, 0 when there is nothing to write.
+	// A slot stays busy until its writer thread has encoded the PNG, frames that would reuse it are not captured.
+	VkBuffer captureBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory captureBufferMemory = VK_NULL_HANDLE;
+	u8 *captureBufferMapped = nullptr;
+	u32 captureSlotSize = 0;
+	u64 captureFrames[MAX_FRAMES_IN_FLIGHT] = {};
+	// Persistently mapped copy of the simulation objects, created on the first snapshot request.
+	// One readback at a time: pending from the frame that records the copy until the writer thread is done.
+	VkBuffer snapshotBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory snapshotBufferMemory = VK_NULL_HANDLE;
+	u8 *snapshotBufferMapped = nullptr;
+	bool snapshotPending = false;
+	u32 snapshotFrame = 0;
+	u64 snapshotTick = 0;
+	// Tick of the loaded snapshot, saved ticks continue from it
+	u64 firstTick = 0;
+	// Trajectory readback ring, one copy of the simulation objects per frame in flight.
+	// recordTicks holds the tick copied into each slot, 0 when there is nothing to submit.
+	VkBuffer recordBuffer = VK_NULL_HANDLE;
+	VkDeviceMemory recordBufferMemory = VK_NULL_HANDLE;
+	u8 *recordBufferMapped = nullptr;
+	u64 recordTicks[MAX_FRAMES_IN_FLIGHT] = {};
 
 	VkRenderPass renderPass;
+	// Shared by every pipeline, saved to PipelineCache.bin once they are created
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	// Core::HashBytes of the blob last loaded or saved, an unchanged cache is not written again
+	u64 pipelineCacheHash = 0;
 	VkPipelineLayout pipelineLayout;
 	VkPipeline graphicsPipeline;
 	VkPipelineLayout computePipelineLayout;
-	VkPipeline computePipelines[4];
+	VkPipeline computePipelines[COMPUTE_PIPELINE_COUNT];
+	// Runs on the graphics queue with the render descriptor sets
+	VkPipeline cullPipeline;
 
 	VkCommandPool commandPool;
 	VkCommandPool transfertCommandPool;
-	std::vector<VkCommandBuffer> commandBuffers;
+	// One transient pool per frame in flight, reset and recorded again every frame
+	std::vector<VkCommandPool> frameCommandPools;
+	std::vector<VkCommandBuffer> frameCommandBuffers;
+	std::vector<VkCommandPool> computeCommandPools;
 	std::vector<VkCommandBuffer> computeCommandBuffers;
 	VkCommandBuffer transferCommandBuffer;
 
 	std::vector<VkSemaphore> availableSemaphores;
 	std::vector<VkSemaphore> finishedSemaphore;
-	std::vector<VkFence> inFlightFences;
-	std::vector<VkFence> imageInFlight;
+	// Timeline values are frame indices: a render submit signals its frame on graphicsTimeline,
+	// a simulation submit signals the frame it ran in on computeTimeline.
+	VkSemaphore graphicsTimeline;
+	VkSemaphore computeTimeline;
+	u64 frameIndex = 0;
+	u64 frameRenderValues[MAX_FRAMES_IN_FLIGHT] = {};
+	u64 frameSimValues[MAX_FRAMES_IN_FLIGHT] = {};
+	std::vector<u64> imageRenderValues;
+	// Last simulation output and the copy holding it
+	u64 lastSimValue = 0;
+	u32 renderSlot = 0;
+	// Last frame that drew from each copy
+	u64 slotReadValues[RENDER_OBJECT_BUFFER_COUNT] = {};
+
+	// Timestamps of each frame in flight, read back once the frame's timeline values are reached
+	bool timestampsEnabled = false;
+	VkQueryPool timestampPools[MAX_FRAMES_IN_FLIGHT] = {};
+	u32 timestampSteps[MAX_FRAMES_IN_FLIGHT] = {};
+	bool timestampsPending[MAX_FRAMES_IN_FLIGHT] = {};
+	// Trace clock at submit, and the offset from GPU to trace nanoseconds derived from it
+	u64 timestampSubmitTimes[MAX_FRAMES_IN_FLIGHT] = {};
+	s64 gpuClockOffset = 0;
+	bool gpuClockOffsetValid = false;
 	
 	std::vector<VkBuffer> objectBuffers;
 	std::vector<VkDeviceMemory> objectBuffersMemory;
 	std::vector<Maths::Vec4*> objectBuffersMapped;
 
+	// Simulation state, bins and the packed render stream, only touched by the compute queue after the upload
 	VkBuffer computeBuffer;
 	VkDeviceMemory computeBufferMemory;
+	// Render streams copied out of computeBuffer, RENDER_INSTANCE_SIZE bytes per boid
+	VkBuffer renderObjectBuffers[RENDER_OBJECT_BUFFER_COUNT];
+	VkDeviceMemory renderObjectBuffersMemory[RENDER_OBJECT_BUFFER_COUNT];
+	// Per frame in flight: the indirect draw arguments, then the ids of the visible boids written by cull.comp
+	VkBuffer cullBuffers[MAX_FRAMES_IN_FLIGHT];
+	VkDeviceMemory cullBuffersMemory[MAX_FRAMES_IN_FLIGHT];
 
 	VkBuffer vertexBuffer;
 	VkDeviceMemory vertexBufferMemory;
+	VkBuffer indexBuffer;
+	VkDeviceMemory indexBufferMemory;
 	VkDescriptorSetLayout descriptorSetLayoutCompute;
 	VkDescriptorSetLayout descriptorSetLayoutRender;
 	VkDescriptorPool descriptorPool;
@@ -90,20 +271,27 @@ struct RenderData
 	VkImageView depthImageView;
 
 	VkImage textureImage;
+	VkFormat textureFormat;
+	u32 textureMipLevels;
 	VkDeviceMemory textureImageMemory;
 	VkImageView textureImageView;
 	VkSampler textureSampler;
 
-	u32 mainBufSize = 0;
-	u32 sizeObjects = 0;
-	u32 sizeSortBuf = 0;
-	u32 sizeMergeBuf = 0;
+	VkDeviceSize mainBufSize = 0;
+	VkDeviceSize sizeObjects = 0;
+	VkDeviceSize sizeBinBuf = 0;
+	VkDeviceSize sizeInstances = 0;
+	VkDeviceSize sizeCullBuf = 0;
+	f32 cullRadius = 0;
 	u32 currentFrame = 0;
+	Simulation::SimParams simParams;
 };
 
 struct SceneData
 {
 	Resource::Mesh mesh;
+	// Closed when Assets.pack is missing, the loose files are read instead
+	Resource::AssetPack assets;
 };
 
 class RenderThread
@@ -112,7 +300,7 @@ public:
 	RenderThread() = default;
 	~RenderThread() = default;
 
-	void Init(HWND hwnd, HINSTANCE hInstance, GameThread *gm, Maths::IVec2 res, u32 targetDevice = 0);
+	void Init(HWND hwnd, HINSTANCE hInstance, GameThread *gm, Maths::IVec2 res, u32 targetDevice = 0, const OffscreenParams &offscreen = OffscreenParams(), const SnapshotParams &snapshot = SnapshotParams(), const TrajectoryParams &trajectory = TrajectoryParams());
 	void Resize(s32 x, s32 y);
 	bool HasFinished() const;
 	bool HasCrashed() const;
@@ -136,6 +324,19 @@ private:
 	Maths::Vec2 rotation = Maths::Vec2(static_cast<f32>(M_PI_2) - 1.059891f, 0.584459f);
 	f32 fov = 3.55f;
 	f64 appTime = 0;
+	Core::FixedTimestep simTimestep;
+	// Fans out startup work, the render thread owns queue 0
+	Core::JobSystem jobSystem;
+	Core::TimingCollector frameTimings;
+	Core::PassTimings gpuTimings;
+	OffscreenParams offscreen;
+	SnapshotParams snapshot;
+	std::thread snapshotWriter;
+	std::atomic_bool snapshotWriting = false;
+	std::thread captureWriters[MAX_FRAMES_IN_FLIGHT];
+	std::atomic_bool captureWriting[MAX_FRAMES_IN_FLIGHT] = {};
+	TrajectoryParams trajectory;
+	Simulation::TrajectoryRecorder recorder;
 
 	void ThreadFunc(u32 targetDevice);
 	void HandleResize();
@@ -144,36 +345,68 @@ private:
 	void UnloadAssets();
 
 	VkSurfaceKHR CreateSurfaceWin32(VkInstance instance, HINSTANCE hInstance, HWND window, VkAllocationCallbacks *allocator = nullptr);
-	VkShaderModule CreateShaderModule(const std::string &code);
-	bool CreateImage(Maths::IVec2 res, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory);
-	VkVertexInputBindingDescription GetBindingDescription();
-	std::array<VkVertexInputAttributeDescription, 4> GetAttributeDescriptions();
+	VkShaderModule CreateShaderModule(const u8 *code, u64 size);
+	// From the asset pack, or Assets/Shaders when the pack does not hold it
+	VkShaderModule LoadShaderModule(const std::string &name);
+	bool CreateImage(Maths::IVec2 res, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory, u32 mipLevels = 1);
+	VkVertexInputBindingDescription GetBindingDescription(const Resource::VertexLayout &layout);
+	std::vector<VkVertexInputAttributeDescription> GetAttributeDescriptions(const Resource::VertexLayout &layout);
+	VkFormat GetVertexFormat(Resource::VertexFormat format);
 	bool InitVulkan(u32 targetDevice);
 	bool InitDevice(u32 targetDevice);
 	bool CreateSwapchain();
+	bool CreateOffscreenTargets();
+	void DestroyOffscreenTargets();
 	bool GetQueues();
 	bool CreateRenderPass();
 	bool CreateDescriptorSetLayouts();
+	bool CreatePipelines();
+	void DestroyPipelines();
+	// True when the cache starts from the file of a previous run
+	bool CreatePipelineCache();
+	void SavePipelineCache();
 	bool CreateGraphicsPipeline();
 	bool CreateComputePipeline();
 	bool CreateFramebuffers();
 	bool CreateCommandPool();
 	bool CreateTextureImage();
-	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	VkImageView CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, u32 mipLevels = 1);
 	bool CreateTextureImageView();
 	bool CreateTextureSampler();
 	bool CreateDepthResources();
 	bool CreateVertexBuffer(const Resource::Mesh &m);
+	bool CreateIndexBuffer(const Resource::Mesh &m);
 	bool CreateObjectBuffers(u32 objectCount);
 	bool CreateCommandBuffers();
+	bool RecordFrame(u32 image, u32 stepCount, u32 slot);
+	bool SubmitSimulation(u32 slot);
+	bool SubmitRender(u32 image, u32 slot);
+	void RecordSimulation(VkCommandBuffer commandBuffer, u32 stepCount, u32 slot);
+	void RecordRender(VkCommandBuffer commandBuffer, u32 image, u32 slot);
+	void RecordCull(VkCommandBuffer commandBuffer, u32 slot);
+	bool CreateCullPipeline();
+	bool CreateCullBuffers();
 	bool CreateSyncObjects();
+	bool CreateTimestampPools();
+	bool CreateCaptureBuffer();
+	void RecordCapture(VkCommandBuffer commandBuffer, u32 image);
+	void WriteCapture(u32 frame);
+	VkMemoryPropertyFlags GetReadbackMemoryProperties();
+	bool CreateSnapshotBuffer();
+	void RecordObjectReadback(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset);
+	void WriteSnapshot(u32 frame);
+	bool CreateRecordBuffer();
+	void SubmitTrajectory(u32 frame);
+	void WriteTimestamp(VkCommandBuffer commandBuffer, u32 query);
+	void ReadTimestamps(u32 frame);
+	void LogGpuTimings();
     bool CreateDescriptorPool();
 	bool CreateDescriptorSets();
 	bool RecreateSwapchain();
 	VkCommandBuffer BeginSingleTimeCommands(VkCommandPool targetPool);
 	void EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkCommandPool targetPool, VkQueue targetQueue);
-	bool TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout);
-	void CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+	bool TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, u32 mipLevels = 1);
+	void CopyBufferToImage(VkBuffer buffer, VkImage image, const VkBufferImageCopy *regions, u32 regionCount);
 	bool UpdateUniformBuffer(u32 image);
 	u32 FindMemoryType(u32 typeFilter, VkMemoryPropertyFlags properties);
 	VkFormat FindDepthFormat();
@@ -181,7 +414,7 @@ private:
 	bool HasStencilComponent(VkFormat format);
 	VkFormat FindSupportedFormat(const std::vector<VkFormat>& candidates, VkImageTiling tiling, VkFormatFeatureFlags features);
 	bool CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory);
-	bool CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size);
-	bool DrawFrame();
+	bool CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0);
+	bool DrawFrame(f64 deltaTime);
 	void Cleanup();
 };
\ No newline at end of file
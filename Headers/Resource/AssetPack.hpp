@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Core/MappedFile.hpp"
+
+namespace Resource
+{
+	const u32 ASSET_PACK_MAGIC = 0x4b504442; // "BDPK"
+	// Bumped on any change to the header or the index, older packs are rejected
+	const u32 ASSET_PACK_VERSION = 1;
+	// The index and every asset start on this, texture mips keep their own alignment inside it
+	const u32 ASSET_PACK_ALIGNMENT = 64;
+	const u32 ASSET_PACK_NAME_SIZE = 104;
+
+	// Little endian, written and read as is. The index follows at indexOffset, sorted by name.
+	struct AssetPackHeader
+	{
+		u32 magic = ASSET_PACK_MAGIC;
+		u32 version = ASSET_PACK_VERSION;
+		u32 entryCount = 0;
+		u32 entrySize = 0;
+		u64 indexOffset = 0;
+		u64 dataOffset = 0;
+		u64 dataSize = 0;
+	};
+	static_assert(sizeof(AssetPackHeader) <= ASSET_PACK_ALIGNMENT, "the asset pack header must fit before the index");
+
+	struct AssetPackEntry
+	{
+		// Relative to the Assets folder with forward slashes, zero padded
+		char name[ASSET_PACK_NAME_SIZE] = {};
+		// From the start of the file
+		u64 offset = 0;
+		u64 size = 0;
+		// Core::HashBytes of the content
+		u64 hash = 0;
+	};
+	static_assert(sizeof(AssetPackEntry) == 128, "asset pack entries are two cache lines");
+
+	// Points into the pack mapping, data is null when the asset is missing
+	struct AssetSpan
+	{
+		const u8 *data = nullptr;
+		u64 size = 0;
+	};
+
+	struct AssetPackSource
+	{
+		std::string name;
+		std::vector<u8> data;
+	};
+
+	// Every shader and texture cache in one file, mapped once at startup.
+	// Find hands out spans into the mapping so assets are used without a copy or a read call.
+	class AssetPack
+	{
+	public:
+		AssetPack() = default;
+		~AssetPack() = default;
+
+		bool Open(const std::string &path, std::string &error);
+		void Close();
+		bool IsOpen() const;
+		const AssetPackHeader &GetHeader() const;
+		const AssetPackEntry *GetEntries() const;
+		AssetSpan Find(const std::string &name) const;
+		// Hashes every asset again, this touches the whole file
+		bool Verify(std::string &error) const;
+
+		// The sources are sorted by name, names must be unique and shorter than ASSET_PACK_NAME_SIZE
+		static bool Write(const std::string &path, std::vector<AssetPackSource> &sources, std::string &error);
+		static bool Validate(const AssetPackHeader &header, u64 fileSize, std::string &error);
+
+	private:
+		Core::MappedFile file;
+		AssetPackHeader header;
+	};
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Maths/Maths.hpp"
+
+namespace Resource
+{
+	// Writes frames read back from the GPU to PNG files
+	namespace ImageCapture
+	{
+		// Converts rows of BGRA8 pixels, the layout of the color targets, to tightly packed RGBA8.
+		// rowPitch is the size of a source row in bytes.
+		void ConvertBgraToRgba(const u8 *src, u32 rowPitch, Maths::IVec2 res, std::vector<u8> &dst);
+
+		// Writes BGRA8 rows as an RGBA PNG
+		bool WritePng(const std::string &path, const u8 *bgra, u32 rowPitch, Maths::IVec2 res);
+
+		// <prefix><frame>.png, the frame number is zero padded so the files sort in order
+		std::string GetFramePath(const std::string &prefix, u64 frame);
+	}
+}
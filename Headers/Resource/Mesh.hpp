@@ -1,21 +1,15 @@
 #pragma once
 
-#include "Maths/Maths.hpp"
+#include "Resource/VertexLayout.hpp"
 
 namespace Resource
 {
-	struct Vertex
-	{
-		Maths::Vec3 pos;
-		Maths::Vec2 uv;
-		Maths::Vec3 col;
-		Maths::Vec3 norm;
-
-		Vertex(Maths::Vec3 position, Maths::Vec2 texCoords, Maths::Vec3 color, Maths::Vec3 normal)
-			: pos(position), uv(texCoords), col(color), norm(normal) {}
-		Vertex() {}
-	};
+	// Post transform cache the triangle order is optimized for
+	const u32 MESH_VERTEX_CACHE_SIZE = 32;
 
+	// Indexed triangle list. Both creation paths weld identical vertices, order the triangles
+	// for the vertex cache and the vertices in the order the triangles fetch them.
+	// The vertices are kept as Vertex and encoded to the layout the GPU reads.
 	class Mesh
 	{
 	public:
@@ -23,9 +17,29 @@ namespace Resource
 		~Mesh();
 
 		void CreateDefaultCube();
+		// Three indices per triangle into vertices, counter clockwise
+		void CreateFromTriangles(const std::vector<Vertex> &vertices, const std::vector<u32> &indices);
 		const std::vector<Vertex>& GetVertices() const;
+		const std::vector<u32>& GetIndices() const;
+		// Full unless set, the vertex data is encoded again
+		void SetLayout(const VertexLayout &vertexLayout);
+		const VertexLayout& GetLayout() const;
+		// The vertices in the layout, layout.stride bytes each
+		const std::vector<u8>& GetVertexData() const;
+		// Radius of the sphere around the origin holding every vertex, valid for any rotation
+		f32 GetBoundingRadius() const;
+		// Vertex shader invocations per triangle with a FIFO cache of cacheSize entries, 3 means no reuse
+		f32 GetCacheMissRatio(u32 cacheSize) const;
 
 	private:
 		std::vector<Vertex> vertices;
+		std::vector<u32> indices;
+		VertexLayout layout = VertexLayout::Full();
+		std::vector<u8> vertexData;
+
+		void WeldVertices();
+		void OptimizeVertexCache();
+		void OptimizeVertexFetch();
+		void EncodeVertices();
 	};
 }
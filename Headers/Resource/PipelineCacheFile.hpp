@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+
+#include "Core/MappedFile.hpp"
+
+namespace Resource
+{
+	const u32 PIPELINE_CACHE_MAGIC = 0x43504442; // "BDPC"
+	// Bumped on any change to the header, older files are discarded
+	const u32 PIPELINE_CACHE_VERSION = 1;
+	const u32 PIPELINE_CACHE_ALIGNMENT = 64;
+	const u32 PIPELINE_CACHE_UUID_SIZE = 16;
+	// VkPipelineCacheHeaderVersionOne: header size, header version, vendor, device and the cache UUID
+	const u32 PIPELINE_CACHE_VULKAN_HEADER_SIZE = 32;
+
+	// The driver a cache blob was made by, from VkPhysicalDeviceProperties.
+	// The driver version is not in the Vulkan blob header, a driver update would otherwise reuse stale data.
+	struct PipelineCacheDevice
+	{
+		u32 vendorId = 0;
+		u32 deviceId = 0;
+		u32 driverVersion = 0;
+		u8 cacheUuid[PIPELINE_CACHE_UUID_SIZE] = {};
+
+		bool operator==(const PipelineCacheDevice &other) const;
+	};
+
+	// Little endian, written and read as is. The Vulkan blob follows at dataOffset.
+	struct PipelineCacheHeader
+	{
+		u32 magic = PIPELINE_CACHE_MAGIC;
+		u32 version = PIPELINE_CACHE_VERSION;
+		PipelineCacheDevice device;
+		u64 dataOffset = 0;
+		u64 dataSize = 0;
+		// Core::HashBytes of the blob, a torn write is dropped instead of handed to the driver
+		u64 dataHash = 0;
+	};
+	static_assert(sizeof(PipelineCacheHeader) <= PIPELINE_CACHE_ALIGNMENT, "the pipeline cache header must fit before the blob");
+
+	// vkGetPipelineCacheData output kept between runs. Open only accepts a blob from the same device
+	// and driver, so its data can be passed as the initial data of a VkPipelineCache.
+	class PipelineCacheFile
+	{
+	public:
+		PipelineCacheFile() = default;
+		~PipelineCacheFile() = default;
+
+		bool Open(const std::string &path, const PipelineCacheDevice &device, std::string &error);
+		void Close();
+		// Points into the mapping, GetDataSize bytes
+		const u8 *GetData() const;
+		u64 GetDataSize() const;
+
+		// Written next to the path then renamed over it, a crash leaves the previous file
+		static bool Write(const std::string &path, const PipelineCacheDevice &device, const u8 *data, u64 size, std::string &error);
+		static bool Validate(const PipelineCacheHeader &header, u64 fileSize, const PipelineCacheDevice &device, std::string &error);
+		// Checks the header the driver writes at the start of the blob
+		static bool ValidateBlob(const u8 *data, u64 size, const PipelineCacheDevice &device);
+
+	private:
+		Core::MappedFile file;
+		PipelineCacheHeader header;
+	};
+}
@@ -11,6 +11,8 @@ namespace Resource
 		~Texture();
 
 		static u8 *ReadTexture(const std::string& path, Maths::IVec2 &res);
+		// Encoded image bytes, like the content of a PNG file
+		static u8 *ReadTextureFromMemory(const u8 *data, u64 size, Maths::IVec2 &res);
 		static void FreeTextureData(u8 *data);
 	};
 }
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "Core/MappedFile.hpp"
+#include "Maths/Maths.hpp"
+
+namespace Resource
+{
+	const u32 TEXTURE_CACHE_MAGIC = 0x58544442; // "BDTX"
+	// Bumped on any change to the header, the mip filter or the encoders, older caches are rebuilt
+	const u32 TEXTURE_CACHE_VERSION = 1;
+	// Mip data starts and each level starts on this, every offset is valid for a buffer to image copy
+	const u32 TEXTURE_CACHE_ALIGNMENT = 64;
+	const u32 TEXTURE_CACHE_MAX_MIPS = 16;
+
+	enum class TextureFormat : u32
+	{
+		Rgba8Srgb = 0,
+		// Opaque 4x4 blocks of 8 bytes, alpha is dropped
+		Bc1Srgb,
+	};
+
+	struct TextureCacheMip
+	{
+		u32 width = 0;
+		u32 height = 0;
+		// From the start of the mip data
+		u64 offset = 0;
+		u64 size = 0;
+	};
+
+	// Little endian, written and read as is. The mips follow at dataOffset, largest first.
+	struct TextureCacheHeader
+	{
+		u32 magic = TEXTURE_CACHE_MAGIC;
+		u32 version = TEXTURE_CACHE_VERSION;
+		TextureFormat format = TextureFormat::Rgba8Srgb;
+		u32 mipCount = 0;
+		// Of the source file bytes, a different source rebuilds the cache
+		u64 sourceHash = 0;
+		u64 sourceSize = 0;
+		u64 dataOffset = 0;
+		u64 dataSize = 0;
+		TextureCacheMip mips[TEXTURE_CACHE_MAX_MIPS];
+	};
+
+	namespace TextureProcessing
+	{
+		// Down to 1x1, each level is half the previous one rounded down
+		u32 GetMipCount(Maths::IVec2 res);
+		u64 GetLevelSize(TextureFormat format, u32 width, u32 height);
+		// RGBA8 sRGB pixels, each level is a 2x2 box filter of the previous one in linear space
+		void BuildMipChain(const u8 *rgba, Maths::IVec2 res, std::vector<std::vector<u8>> &mips);
+		// Edge blocks of sizes that are not multiples of 4 repeat the last row and column
+		void CompressBc1(const u8 *rgba, u32 width, u32 height, std::vector<u8> &out);
+		void DecompressBc1(const u8 *blocks, u32 width, u32 height, std::vector<u8> &rgba);
+	}
+
+	// Texture with its mip chain in a GPU format, stored next to its source image or in an asset pack.
+	// Load maps the cache and rebuilds it first when it is missing, stale or from another version,
+	// the mips can then be copied to a staging buffer without decoding.
+	class TextureCache
+	{
+	public:
+		TextureCache() = default;
+		~TextureCache() = default;
+
+		bool Load(const std::string &sourcePath, TextureFormat format, std::string &error);
+		// A whole cache file already in memory, it must outlive the cache. The source is not checked.
+		bool LoadFromMemory(const u8 *data, u64 size, TextureFormat format, std::string &error);
+		void Close();
+		const TextureCacheHeader &GetHeader() const;
+		// Points into the mapping, dataSize bytes
+		const u8 *GetData() const;
+		// The last Load had to decode the source
+		bool WasRebuilt() const;
+
+		// The whole cache file of an encoded source image
+		static bool Encode(const u8 *source, u64 sourceSize, TextureFormat format, std::vector<u8> &out, std::string &error);
+		static bool Build(const std::string &sourcePath, const u8 *source, u64 sourceSize, const std::string &cachePath, TextureFormat format, std::string &error);
+		static bool Validate(const TextureCacheHeader &header, u64 size, TextureFormat format, std::string &error);
+		// <source>.rgba8.texcache or <source>.bc1.texcache
+		static std::string GetCachePath(const std::string &sourcePath, TextureFormat format);
+
+	private:
+		Core::MappedFile file;
+		const u8 *content = nullptr;
+		TextureCacheHeader header;
+		bool rebuilt = false;
+
+		bool Open(const std::string &cachePath, TextureFormat format, u64 sourceHash, u64 sourceSize);
+	};
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+
+#include "Maths/Maths.hpp"
+
+namespace Resource
+{
+	// Source vertex, meshes are built and optimized in this form and encoded to a VertexLayout for the GPU
+	struct Vertex
+	{
+		Maths::Vec3 pos;
+		Maths::Vec2 uv;
+		Maths::Vec3 col;
+		Maths::Vec3 norm;
+
+		Vertex(Maths::Vec3 position, Maths::Vec2 texCoords, Maths::Vec3 color, Maths::Vec3 normal)
+			: pos(position), uv(texCoords), col(color), norm(normal) {}
+		Vertex() {}
+
+		bool operator==(const Vertex &other) const;
+	};
+
+	// The value of each attribute is its location in cube.vert
+	enum class VertexAttribute : u8
+	{
+		Position = 0,
+		UV,
+		Color,
+		Normal,
+		Count
+	};
+
+	enum class VertexFormat : u8
+	{
+		// The attribute is left out of the vertex
+		None = 0,
+		Float32x2,
+		Float32x3,
+		// xyz as fp16, w is 1 since three component fp16 is rarely a vertex format
+		Float16x4,
+		// [0, 1], out of range UVs are clamped
+		Unorm16x2,
+		// rgb, a is 1
+		Unorm8x4,
+		// Unit vector folded onto the octahedron, two snorm16. Normal only.
+		Octahedral16x2,
+	};
+
+	// Which attributes a vertex holds and in which format, the pipeline vertex input is generated from it
+	struct VertexLayout
+	{
+		VertexFormat formats[(u32)(VertexAttribute::Count)] = {};
+		// Attributes are packed in order, each one on 4 bytes
+		u32 offsets[(u32)(VertexAttribute::Count)] = {};
+		u32 stride = 0;
+
+		static VertexLayout Create(VertexFormat position, VertexFormat uv, VertexFormat color, VertexFormat normal);
+		// 44 bytes, the Vertex struct as is
+		static VertexLayout Full();
+		// 16 bytes: fp16 position, unorm16 UV, octahedral normal and no color
+		static VertexLayout Packed();
+
+		bool Has(VertexAttribute attribute) const;
+		VertexFormat Get(VertexAttribute attribute) const;
+		// Position is required, every attribute must be in a format it can be encoded to
+		bool IsValid() const;
+	};
+
+	namespace VertexLayouts
+	{
+		u32 GetFormatSize(VertexFormat format);
+
+		// Round to nearest even, out of range values become infinities
+		u16 EncodeHalf(f32 value);
+		f32 DecodeHalf(u16 value);
+		// Unit vector to [-1, 1]^2, the lower half of the octahedron is folded over the corners
+		Maths::Vec2 EncodeOctahedral(const Maths::Vec3 &normal);
+		Maths::Vec3 DecodeOctahedral(const Maths::Vec2 &encoded);
+
+		// out receives count * layout.stride bytes
+		void Encode(const VertexLayout &layout, const Vertex *vertices, u32 count, u8 *out);
+		// Attributes missing from the layout are zero
+		Vertex Decode(const VertexLayout &layout, const u8 *vertex);
+	}
+}
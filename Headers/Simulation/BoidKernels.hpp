@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+#include "Maths/Maths.hpp"
+
+namespace Simulation
+{
+	// Widest batch of any kernel, gathered lanes are padded to a multiple of it
+	const u32 BOID_BATCH_WIDTH = 16;
+
+	// Positions and velocities of every boid around one cell, as structure of arrays.
+	// Positions already include the world wrap offset of the cell they come from.
+	class NeighbourBatch
+	{
+	public:
+		std::vector<f32> posX;
+		std::vector<f32> posY;
+		std::vector<f32> posZ;
+		std::vector<f32> velX;
+		std::vector<f32> velY;
+		std::vector<f32> velZ;
+		std::vector<u32> ids;
+
+		void Clear();
+		// Makes room for 'extra' more boids, Push does not check the capacity
+		void Reserve(u32 extra);
+		// Sets the lane count, new lanes are left uninitialized
+		void Resize(u32 size);
+		inline void Set(u32 index, const Maths::Vec3 &position, const Maths::Vec3 &velocity, u32 id);
+		inline void Push(const Maths::Vec3 &position, const Maths::Vec3 &velocity, u32 id);
+		// Copies lanes [begin, end) of another batch, moving their positions by offset
+		inline void Append(const NeighbourBatch &source, u32 begin, u32 end, const Maths::Vec3 &offset);
+		// Fills the last batch with boids far enough to fail every distance test
+		void Pad();
+		// Lane count, including padding once Pad has been called
+		u32 GetSize() const;
+
+	private:
+		u32 count = 0;
+	};
+
+	struct BoidConstants
+	{
+		f32 distMaxSqr = 0;
+		f32 distMinSqr = 0;
+		f32 distMinCube = 0;
+	};
+
+	struct BoidAccumulator
+	{
+		Maths::Vec3 globalPos;
+		Maths::Vec3 globalRot;
+		Maths::Vec3 avoidDir;
+		u32 count = 0;
+		u32 avoidCount = 0;
+	};
+
+	enum class BoidKernel : u8
+	{
+		Scalar,
+		SSE2,
+		AVX2,
+		AVX512,
+		Count,
+	};
+
+	// Accumulates cohesion, alignment and separation of boid 'self' against the whole batch
+	typedef void (*BoidKernelFunc)(const NeighbourBatch &batch, const Maths::Vec3 &position, u32 self, const BoidConstants &constants, BoidAccumulator &out);
+
+	// Returns nullptr when the kernel is not compiled in or not supported by this CPU
+	BoidKernelFunc GetBoidKernelFunc(BoidKernel kernel);
+	BoidKernel GetBestBoidKernel();
+	const char *GetBoidKernelName(BoidKernel kernel);
+}
+
+#include "BoidKernels.inl"
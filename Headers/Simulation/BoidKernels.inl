@@ -0,0 +1,37 @@
+#pragma once
+
+namespace Simulation
+{
+	inline void NeighbourBatch::Set(u32 index, const Maths::Vec3 &position, const Maths::Vec3 &velocity, u32 id)
+	{
+		posX[index] = position.x;
+		posY[index] = position.y;
+		posZ[index] = position.z;
+		velX[index] = velocity.x;
+		velY[index] = velocity.y;
+		velZ[index] = velocity.z;
+		ids[index] = id;
+	}
+
+	inline void NeighbourBatch::Push(const Maths::Vec3 &position, const Maths::Vec3 &velocity, u32 id)
+	{
+		Set(count, position, velocity, id);
+		count++;
+	}
+
+	inline void NeighbourBatch::Append(const NeighbourBatch &source, u32 begin, u32 end, const Maths::Vec3 &offset)
+	{
+		Reserve(end - begin);
+		for (u32 i = begin; i < end; i++)
+		{
+			posX[count] = source.posX[i] + offset.x;
+			posY[count] = source.posY[i] + offset.y;
+			posZ[count] = source.posZ[i] + offset.z;
+			velX[count] = source.velX[i];
+			velY[count] = source.velY[i];
+			velZ[count] = source.velZ[i];
+			ids[count] = source.ids[i];
+			count++;
+		}
+	}
+}
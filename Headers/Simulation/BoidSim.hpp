@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+
+#include "Maths/Maths.hpp"
+#include "Core/JobSystem.hpp"
+#include "Simulation/BoidKernels.hpp"
+#include "Simulation/SpatialGrid.hpp"
+
+typedef u32 uint;
+#include "../../Assets/Shaders/shaderSimData.h"
+
+namespace Simulation
+{
+	const u32 SIM_CELL_GRAIN = 64;
+	const u32 SIM_OBJECT_GRAIN = 512;
+	// Initial state: 3 Philox blocks (12 floats) per boid, generated in chunks that fit on the stack
+	const u32 GENERATE_BLOCKS_PER_OBJECT = 3;
+	const u32 GENERATE_CHUNK_OBJECTS = 256;
+	const u32 GENERATE_OBJECT_GRAIN = 4096;
+	// side^3 cells must stay well inside s32 and the u32 element offsets of BinningLayout.
+	// 256^3 cells take 128MB of counts and offsets, the most a binning buffer can hold on common devices.
+	const u32 MIN_CHUNK_COUNT_SIDE = 3;
+	const u32 MAX_CHUNK_COUNT_SIDE = 256;
+
+	struct SimParams
+	{
+		u32 objectCount = OBJECT_COUNT;
+		u32 chunkCountSide = CHUNK_COUNT_SIDE;
+		f32 worldSize = static_cast<f32>(WORLD_SIZE);
+		f32 distMax = BOID_DIST_MAX;
+		f32 distMin = BOID_DIST_MIN;
+		f32 maxSpeed = BOID_MAX_SPEED;
+		// Copies boid data in cell order every tick so neighbour scans read contiguous memory
+		bool reorderByCell = true;
+	};
+
+	// CPU implementation of the sort0 -> sort1 -> sim0 -> sim1 compute chain.
+	// Must stay free of any Win32 or Vulkan include so it can be built headless.
+	class BoidSim
+	{
+	public:
+		BoidSim() = default;
+		~BoidSim() = default;
+
+		// Generates the objects on the job system when one is set
+		void Init(const SimParams &params, u32 seed);
+		// Takes the same layout as the GPU object buffer: position, velocity, accel, rotation
+		void LoadObjects(const SimParams &params, const std::vector<Maths::Vec4> &objects);
+		void LoadObjects(const SimParams &params, const Maths::Vec4 *objects, u32 objectCount);
+		void WriteObjects(std::vector<Maths::Vec4> &objects) const;
+		// Step runs single threaded when no job system is set
+		void SetJobSystem(Core::JobSystem *system);
+		// Defaults to the widest kernel supported by the CPU, returns false if the kernel is unavailable
+		bool SetKernel(BoidKernel kernel);
+		BoidKernel GetKernel() const;
+		void Step(f32 deltaTime);
+
+		const SimParams &GetParams() const;
+		u32 GetObjectCount() const;
+		const std::vector<Maths::Vec3> &GetPositions() const;
+		const std::vector<Maths::Vec3> &GetVelocities() const;
+		const std::vector<Maths::Quat> &GetRotations() const;
+
+		// Fills 4 Vec4 per object, matching the Object struct of the compute shaders.
+		// The result only depends on the seed, not on the job system or its thread count.
+		static std::vector<Maths::Vec4> GenerateObjects(const SimParams &params, u32 seed, Core::JobSystem *jobSystem = nullptr);
+		// Keeps sizes in the range the grid supports: at least one boid and at least 3 cells per side
+		static SimParams ClampParams(const SimParams &params);
+
+	private:
+		SimParams params;
+		Core::JobSystem *jobSystem = nullptr;
+		BoidKernel kernel = GetBestBoidKernel();
+		BoidKernelFunc kernelFunc = GetBoidKernelFunc(GetBestBoidKernel());
+		std::vector<Maths::Vec3> positions;
+		std::vector<Maths::Vec3> velocities;
+		std::vector<Maths::Vec3> accels;
+		std::vector<Maths::Quat> rotations;
+
+		std::vector<u32> objectCells;
+		SpatialGrid grid;
+		// Positions and velocities in grid order, only filled when reorderByCell is set
+		NeighbourBatch sortedBoids;
+
+		void PreUpdate();
+		void Update(f32 deltaTime);
+		void PostUpdate(f32 deltaTime);
+		s32 GetCell(Maths::IVec3 pos, Maths::Vec3 &dt) const;
+		// Appends the boids of cells [firstCell, lastCell], which must be contiguous in the grid
+		void GatherCells(NeighbourBatch &batch, u32 firstCell, u32 lastCell, const Maths::Vec3 &dt) const;
+		void ProcessCellUpdate(s32 cx, s32 cy, s32 cz, f32 deltaTime);
+		void ProcessPostUpdate(u32 start, u32 end, f32 deltaTime);
+	};
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <string>
+
+#include "Simulation/BoidSim.hpp"
+
+namespace Simulation
+{
+	// Element offsets of the binning buffer written by sort0/sort1/sort2, see shaderSimData.h
+	struct BinningLayout
+	{
+		u32 countsOffset = 0;
+		u32 cellOffsetsOffset = 0;
+		u32 objectCellsOffset = 0;
+		u32 ranksOffset = 0;
+		u32 sortedOffset = 0;
+		u32 size = 0;
+
+		static BinningLayout Create(u32 objectCount, u32 cellCount);
+	};
+
+	// CPU reference of the GPU binning passes, used to check a buffer read back from the device.
+	namespace GpuBinning
+	{
+		// Same cell mapping as sort0.comp, objects uses the GPU object layout (4 Vec4 per boid)
+		u32 GetObjectCell(const Maths::Vec4 &position, const SimParams &params);
+
+		// Runs count, scan and scatter on the CPU. The result has the buffer layout of the GPU,
+		// counts are left cleared like sort1 does. Boids keep their index order inside a cell.
+		void Run(const std::vector<Maths::Vec4> &objects, const SimParams &params, std::vector<u32> &buffer);
+
+		// Checks a buffer produced by the GPU passes: cell ranges must match exactly,
+		// and each cell must hold the same boids as the reference, in any order.
+		bool Validate(const std::vector<Maths::Vec4> &objects, const SimParams &params, const std::vector<u32> &buffer, std::string &error);
+
+		// Emulates the fixed capacity lists of the previous sort0/sort1 and returns how many boids they kept
+		u32 CountLegacyBinned(const std::vector<Maths::Vec4> &objects, const SimParams &params);
+	}
+}
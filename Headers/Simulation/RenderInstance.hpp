@@ -0,0 +1,31 @@
+#pragma once
+
+#include "Simulation/BoidSim.hpp"
+
+namespace Simulation
+{
+	// What cube.vert reads per boid, the RenderInstance struct of shaderSimData.h.
+	// The velocity and acceleration of the 64 byte object stay in the simulation buffer.
+	struct RenderInstance
+	{
+		f32 position[3];
+		// Rotation quaternion as snorm16, x and z in the low halves
+		u32 rotationXY;
+		u32 rotationZW;
+	};
+	static_assert(sizeof(RenderInstance) == RENDER_INSTANCE_SIZE, "RenderInstance must match the render stream of the shaders");
+
+	// CPU reference of pack.comp, used for the initial upload and to check the precision
+	namespace RenderInstances
+	{
+		// Same rounding as GLSL packSnorm2x16
+		u32 PackSnorm2x16(f32 low, f32 high);
+		void UnpackSnorm2x16(u32 value, f32 &low, f32 &high);
+
+		// object points to the GPU object layout, 4 Vec4 per boid
+		RenderInstance Pack(const Maths::Vec4 *object);
+		void Pack(const Maths::Vec4 *objects, u32 count, RenderInstance *instances);
+		// Rotation as the vertex shader sees it, renormalized
+		Maths::Quat GetRotation(const RenderInstance &instance);
+	}
+}
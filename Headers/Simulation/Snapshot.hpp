@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+
+#include "Core/MappedFile.hpp"
+#include "Simulation/BoidSim.hpp"
+
+namespace Simulation
+{
+	const u32 SNAPSHOT_MAGIC = 0x50534442; // "BDSP"
+	// Bumped on any change to the header or the object layout, older files are rejected
+	const u32 SNAPSHOT_VERSION = 1;
+	// The object array starts on a cache line so it can be copied with aligned loads
+	const u32 SNAPSHOT_ALIGNMENT = 64;
+	// Position, velocity, accel and rotation, the Object struct of the compute shaders
+	const u32 SNAPSHOT_OBJECT_STRIDE = sizeof(Maths::Vec4) * 4;
+
+	// Little endian, written and read as is
+	struct SnapshotHeader
+	{
+		u32 magic = SNAPSHOT_MAGIC;
+		u32 version = SNAPSHOT_VERSION;
+		u32 headerSize = 0;
+		u32 objectStride = SNAPSHOT_OBJECT_STRIDE;
+		u32 objectCount = 0;
+		u32 chunkCountSide = 0;
+		f32 worldSize = 0;
+		f32 distMax = 0;
+		f32 distMin = 0;
+		f32 maxSpeed = 0;
+		// Simulation tick the state was taken at
+		u64 tick = 0;
+		u64 objectsOffset = 0;
+		u64 objectsSize = 0;
+	};
+	static_assert(sizeof(SnapshotHeader) <= SNAPSHOT_ALIGNMENT, "the snapshot header must fit before the object array");
+
+	// Saved simulation state: a header, then the objects in the layout of the GPU object buffer.
+	// Open maps the file, the objects can be copied straight to a staging buffer without parsing.
+	class Snapshot
+	{
+	public:
+		Snapshot() = default;
+		~Snapshot() = default;
+
+		bool Open(const std::string &path, std::string &error);
+		void Close();
+		const SnapshotHeader &GetHeader() const;
+		SimParams GetParams() const;
+		// Points into the mapping, 4 Vec4 per object
+		const u8 *GetObjects() const;
+
+		// objects holds params.objectCount * SNAPSHOT_OBJECT_STRIDE bytes
+		static bool Write(const std::string &path, const SimParams &params, u64 tick, const void *objects, std::string &error);
+		static SnapshotHeader CreateHeader(const SimParams &params, u64 tick);
+		static bool Validate(const SnapshotHeader &header, u64 fileSize, std::string &error);
+		// <prefix><tick>.boids, the tick is zero padded so the files sort in order
+		static std::string GetPath(const std::string &prefix, u64 tick);
+
+	private:
+		Core::MappedFile file;
+		SnapshotHeader header;
+	};
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.hpp"
+#include "Core/JobSystem.hpp"
+
+namespace Simulation
+{
+	// Upper bound of per-block histograms used by a parallel build
+	const u32 MAX_GRID_BLOCKS = 16;
+	const u32 GRID_BLOCK_MIN_OBJECTS = 4096;
+
+	// Flat uniform grid built with a counting sort: objects are grouped by cell into one index array,
+	// and a cell-offset table gives the [begin, end) range of every cell in it.
+	// Objects keep their index order inside a cell, so the result does not depend on the thread count.
+	// The grid only deals with cell ids, callers map positions to cells in whatever dimension they need.
+	class SpatialGrid
+	{
+	public:
+		SpatialGrid() = default;
+		~SpatialGrid() = default;
+
+		void Init(u32 cellCount);
+		// Every value of objectCells must be lower than the cell count
+		void Build(const std::vector<u32> &objectCells, Core::JobSystem *jobSystem = nullptr);
+
+		u32 GetCellCount() const;
+		u32 GetObjectCount() const;
+		// Range of the cell in GetSortedObjects()
+		u32 GetCellBegin(u32 cell) const { return cellOffsets[cell]; }
+		u32 GetCellEnd(u32 cell) const { return cellOffsets[cell + 1]; }
+		const std::vector<u32> &GetSortedObjects() const;
+
+	private:
+		u32 cellCount = 0;
+		std::vector<u32> cellOffsets;
+		std::vector<u32> sortedObjects;
+		// One histogram per block, turned into write offsets in place
+		std::vector<u32> blockOffsets;
+	};
+}
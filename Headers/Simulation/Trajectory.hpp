@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Core/MappedFile.hpp"
+#include "Simulation/BoidSim.hpp"
+
+namespace Simulation
+{
+	const u32 TRAJECTORY_MAGIC = 0x4a524442; // "BDRJ"
+	const u32 TRAJECTORY_VERSION = 1;
+	// Per boid: position as unorm16 of the world size, then the rotation quaternion as snorm16
+	const u32 TRAJECTORY_COMPONENTS = 7;
+	// Frames waiting for the writer, a full queue drops the new frame
+	const u32 TRAJECTORY_QUEUE_CAPACITY = 4;
+	// Every Nth written frame is stored whole so a reader can start there
+	const u32 TRAJECTORY_KEYFRAME_INTERVAL = 64;
+
+	// Little endian, followed by frameCount frames
+	struct TrajectoryHeader
+	{
+		u32 magic = TRAJECTORY_MAGIC;
+		u32 version = TRAJECTORY_VERSION;
+		u32 objectCount = 0;
+		u32 interval = 0;
+		f32 worldSize = 0;
+		u32 keyframeInterval = TRAJECTORY_KEYFRAME_INTERVAL;
+		// Written when the recorder stops, 0 if it never did
+		u64 frameCount = 0;
+	};
+
+	// Followed by payloadSize bytes: one zigzag varint per component, the wrapping difference
+	// to the same component of the previous frame, or to 0 in a keyframe
+	struct TrajectoryFrameHeader
+	{
+		u64 tick = 0;
+		u32 keyframe = 0;
+		u32 payloadSize = 0;
+	};
+
+	struct TrajectoryStats
+	{
+		u64 submittedFrames = 0;
+		u64 recordedFrames = 0;
+		u64 droppedFrames = 0;
+		// Size of the quantized frames before delta coding
+		u64 rawBytes = 0;
+		u64 writtenBytes = 0;
+		// Time spent in file writes, writtenBytes over it is the disk bandwidth
+		u64 writeNanoseconds = 0;
+	};
+
+	namespace Trajectory
+	{
+		u16 QuantizePosition(f32 value, f32 worldSize);
+		f32 DequantizePosition(u16 value, f32 worldSize);
+		// Two's complement bits of the snorm16 value
+		u16 QuantizeSnorm(f32 value);
+		f32 DequantizeSnorm(u16 value);
+
+		// previous is null for a keyframe
+		void EncodeFrame(const u16 *values, const u16 *previous, u32 count, std::vector<u8> &out);
+		// Returns false if the payload does not hold exactly count values
+		bool DecodeFrame(const u8 *data, u32 size, const u16 *previous, u32 count, u16 *values);
+
+		std::string FormatStats(const TrajectoryStats &stats);
+	}
+
+	// Records every Nth tick of boid state to a file without blocking the caller.
+	// One producer submits frames, they are quantized into a bounded queue and a writer
+	// thread delta codes them to disk. When the writer falls behind, new frames are dropped and counted.
+	class TrajectoryRecorder
+	{
+	public:
+		TrajectoryRecorder() = default;
+		~TrajectoryRecorder();
+		TrajectoryRecorder(const TrajectoryRecorder &) = delete;
+		TrajectoryRecorder &operator=(const TrajectoryRecorder &) = delete;
+
+		bool Start(const std::string &path, const SimParams &params, u32 interval, u32 queueCapacity = TRAJECTORY_QUEUE_CAPACITY);
+		// Writes the frames still queued, then closes the file
+		void Stop();
+		bool IsRecording() const;
+		u32 GetInterval() const;
+		bool ShouldRecord(u64 tick) const;
+
+		// Return false when the frame was dropped. CPU engine arrays:
+		bool Submit(u64 tick, const std::vector<Maths::Vec3> &positions, const std::vector<Maths::Quat> &rotations);
+		// GPU object layout, 4 Vec4 per boid
+		bool SubmitObjects(u64 tick, const Maths::Vec4 *objects, u32 objectCount);
+		TrajectoryStats GetStats() const;
+
+	private:
+		struct Slot
+		{
+			u64 tick = 0;
+			std::vector<u16> values;
+		};
+
+		TrajectoryHeader header;
+		std::FILE *file = nullptr;
+		std::thread writer;
+		std::vector<Slot> slots;
+		// head is only written by the producer, tail by the writer
+		std::atomic<u64> head = 0;
+		std::atomic<u64> tail = 0;
+		// Bumped on every submit and on Stop, the writer sleeps on it
+		std::atomic<u64> signal = 0;
+		std::atomic_bool stopping = false;
+
+		std::atomic<u64> submittedFrames = 0;
+		std::atomic<u64> recordedFrames = 0;
+		std::atomic<u64> droppedFrames = 0;
+		std::atomic<u64> rawBytes = 0;
+		std::atomic<u64> writtenBytes = 0;
+		std::atomic<u64> writeNanoseconds = 0;
+
+		Slot *AcquireSlot(u32 objectCount);
+		void CommitSlot(Slot *slot, u64 tick);
+		void WriterFunc();
+	};
+
+	// Reads a trajectory file front to back
+	class TrajectoryReader
+	{
+	public:
+		TrajectoryReader() = default;
+		~TrajectoryReader() = default;
+
+		bool Open(const std::string &path, std::string &error);
+		const TrajectoryHeader &GetHeader() const;
+		// values receives TRAJECTORY_COMPONENTS quantized values per boid. Returns false at the end of the file or on a broken frame.
+		bool ReadFrame(u64 &tick, std::vector<u16> &values);
+
+	private:
+		Core::MappedFile file;
+		TrajectoryHeader header;
+		u64 offset = 0;
+		std::vector<u16> previous;
+		bool hasPrevious = false;
+	};
+}
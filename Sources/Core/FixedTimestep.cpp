@@ -0,0 +1,48 @@
+#include "Core/FixedTimestep.hpp"
+
+#include <cmath>
+
+using namespace Core;
+
+void FixedTimestep::Init(f64 stepDurationIn, u32 maxStepsIn)
+{
+	stepDuration = stepDurationIn > 0 ? stepDurationIn : 1 / 144.0;
+	maxSteps = maxStepsIn;
+	accumulator = 0;
+	droppedTime = 0;
+	tickCount = 0;
+}
+
+u32 FixedTimestep::Advance(f64 elapsed)
+{
+	if (elapsed > 0)
+		accumulator += elapsed;
+
+	f64 steps = std::floor(accumulator / stepDuration);
+	if (steps > maxSteps)
+	{
+		// Keep the fractional part so the step phase does not jump
+		const f64 excess = (steps - maxSteps) * stepDuration;
+		droppedTime += excess;
+		accumulator -= excess;
+		steps = maxSteps;
+	}
+	accumulator -= steps * stepDuration;
+	tickCount += (u64)(steps);
+	return (u32)(steps);
+}
+
+f64 FixedTimestep::GetStepDuration() const
+{
+	return stepDuration;
+}
+
+u64 FixedTimestep::GetTickCount() const
+{
+	return tickCount;
+}
+
+f64 FixedTimestep::GetDroppedTime() const
+{
+	return droppedTime;
+}
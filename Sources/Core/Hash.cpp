@@ -0,0 +1,9 @@
+#include "Core/Hash.hpp"
+
+u64 Core::HashBytes(const u8 *data, u64 size)
+{
+	u64 hash = 0xcbf29ce484222325ull;
+	for (u64 i = 0; i < size; i++)
+		hash = (hash ^ data[i]) * 0x100000001b3ull;
+	return hash;
+}
@@ -0,0 +1,259 @@
+#include "Core/JobSystem.hpp"
+#include "Core/Trace.hpp"
+
+#include <assert.h>
+#include <chrono>
+
+using namespace Core;
+
+namespace
+{
+	thread_local const JobSystem *currentSystem = nullptr;
+	thread_local u32 currentIndex = 0;
+
+	const u32 SPIN_COUNT_BEFORE_SLEEP = 256;
+}
+
+// -----------------------   WorkStealingQueue    -----------------------
+
+bool WorkStealingQueue::Push(Job *job)
+{
+	s64 b = bottom.load(std::memory_order_relaxed);
+	s64 t = top.load(std::memory_order_acquire);
+	if (b - t >= (s64)(JOB_QUEUE_CAPACITY))
+		return false;
+
+	slots[b & (JOB_QUEUE_CAPACITY - 1)].store(job, std::memory_order_relaxed);
+	bottom.store(b + 1, std::memory_order_release);
+	return true;
+}
+
+Job *WorkStealingQueue::Pop()
+{
+	s64 b = bottom.load(std::memory_order_relaxed) - 1;
+	bottom.store(b, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	s64 t = top.load(std::memory_order_relaxed);
+
+	if (t > b)
+	{
+		// Queue was already empty
+		bottom.store(b + 1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	Job *job = slots[b & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (t == b)
+	{
+		// Last element, race against thieves for it
+		if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			job = nullptr;
+		bottom.store(b + 1, std::memory_order_relaxed);
+	}
+	return job;
+}
+
+Job *WorkStealingQueue::Steal()
+{
+	s64 t = top.load(std::memory_order_acquire);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	s64 b = bottom.load(std::memory_order_acquire);
+	if (t >= b)
+		return nullptr;
+
+	Job *job = slots[t & (JOB_QUEUE_CAPACITY - 1)].load(std::memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+		return nullptr;
+	return job;
+}
+
+// -----------------------   JobSystem    -----------------------
+
+JobSystem::~JobSystem()
+{
+	Quit();
+}
+
+void JobSystem::Init(u32 threadCount)
+{
+	Quit();
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+
+	exit = false;
+	queueCount = threadCount;
+	queues = std::make_unique<WorkStealingQueue[]>(queueCount);
+	currentSystem = this;
+	currentIndex = 0;
+
+	workers.resize(threadCount - 1);
+	for (u32 i = 0; i < workers.size(); i++)
+	{
+		workers[i] = std::thread(&JobSystem::WorkerFunc, this, i + 1);
+	}
+}
+
+void JobSystem::Quit()
+{
+	if (!IsRunning())
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		exit = true;
+		epoch++;
+	}
+	sleepCondition.notify_all();
+	for (u32 i = 0; i < workers.size(); i++)
+	{
+		if (workers[i].joinable())
+			workers[i].join();
+	}
+	workers.clear();
+	queues.reset();
+	queueCount = 0;
+	if (currentSystem == this)
+		currentSystem = nullptr;
+}
+
+bool JobSystem::IsRunning() const
+{
+	return queueCount != 0;
+}
+
+u32 JobSystem::GetThreadCount() const
+{
+	return queueCount;
+}
+
+s32 JobSystem::GetQueueIndex() const
+{
+	return currentSystem == this ? (s32)(currentIndex) : -1;
+}
+
+void JobSystem::Submit(Job *jobs, u32 count, JobCounter &counter)
+{
+	counter.pending.fetch_add(count, std::memory_order_acq_rel);
+	s32 index = GetQueueIndex();
+	assert((!IsRunning() || index >= 0) && "Jobs must be submitted from the thread that called Init or from a job");
+	if (!IsRunning() || index < 0)
+	{
+		for (u32 i = 0; i < count; i++)
+		{
+			jobs[i].counter = &counter;
+			Execute(&jobs[i]);
+		}
+		return;
+	}
+
+	WorkStealingQueue &queue = queues[index];
+	for (u32 i = 0; i < count; i++)
+	{
+		jobs[i].counter = &counter;
+		if (!queue.Push(&jobs[i]))
+			Execute(&jobs[i]);
+	}
+	WakeWorkers();
+}
+
+void JobSystem::Wait(JobCounter &counter)
+{
+	s32 index = GetQueueIndex();
+	u32 misses = 0;
+	while (!counter.IsDone())
+	{
+		if (index >= 0 && RunOne((u32)(index)))
+		{
+			misses = 0;
+			continue;
+		}
+		// Remaining jobs are running on other threads, back off instead of hammering the queues
+		if (++misses > 64)
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::WakeWorkers()
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping.load(std::memory_order_seq_cst) == 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(sleepLock);
+		epoch++;
+	}
+	sleepCondition.notify_all();
+}
+
+Job *JobSystem::FindJob(u32 index)
+{
+	Job *job = queues[index].Pop();
+	if (job)
+		return job;
+
+	for (u32 i = 1; i < queueCount; i++)
+	{
+		job = queues[(index + i) % queueCount].Steal();
+		if (job)
+			return job;
+	}
+	return nullptr;
+}
+
+bool JobSystem::RunOne(u32 index)
+{
+	Job *job = FindJob(index);
+	if (!job)
+		return false;
+	Execute(job);
+	return true;
+}
+
+void JobSystem::Execute(Job *job)
+{
+	TRACE_SCOPE("Job");
+	JobCounter *counter = job->counter;
+	job->function(job->context, job->begin, job->end);
+	counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::WorkerFunc(u32 index)
+{
+	currentSystem = this;
+	currentIndex = index;
+	TRACE_THREAD_NAME("Job Worker");
+
+	u32 misses = 0;
+	while (!exit)
+	{
+		if (RunOne(index))
+		{
+			misses = 0;
+			continue;
+		}
+		if (++misses < SPIN_COUNT_BEFORE_SLEEP)
+		{
+			std::this_thread::yield();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepLock);
+		u32 lastEpoch = epoch;
+		sleeping.fetch_add(1, std::memory_order_seq_cst);
+		Job *job = FindJob(index);
+		if (!job)
+		{
+			// The timeout is only a safety net, submitters wake us through the epoch
+			sleepCondition.wait_for(lock, std::chrono::milliseconds(2), [&]() { return exit || epoch != lastEpoch; });
+		}
+		sleeping.fetch_sub(1, std::memory_order_seq_cst);
+		lock.unlock();
+
+		if (job)
+			Execute(job);
+		misses = 0;
+	}
+	currentSystem = nullptr;
+}
@@ -0,0 +1,136 @@
+#include "Core/MappedFile.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Core;
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+bool MappedFile::Open(const std::string &path, bool sequential)
+{
+	Close();
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	fileHandle = file;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		Close();
+		return false;
+	}
+	size = (u64)(fileSize.QuadPart);
+	// Empty files cannot be mapped, they open with no data
+	if (size == 0)
+		return true;
+
+	mappingHandle = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mappingHandle)
+	{
+		Close();
+		return false;
+	}
+	data = static_cast<const u8 *>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+	if (sequential)
+	{
+		WIN32_MEMORY_RANGE_ENTRY range = { const_cast<u8 *>(data), (SIZE_T)(size) };
+		PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+	if (mappingHandle)
+		CloseHandle(mappingHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+	data = nullptr;
+	size = 0;
+	mappingHandle = nullptr;
+	fileHandle = nullptr;
+}
+
+bool MappedFile::IsOpen() const
+{
+	return fileHandle != nullptr;
+}
+#else
+bool MappedFile::Open(const std::string &path, bool sequential)
+{
+	Close();
+	fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+		return false;
+
+	struct stat status;
+	if (fstat(fileDescriptor, &status) != 0)
+	{
+		Close();
+		return false;
+	}
+	size = (u64)(status.st_size);
+	// Empty files cannot be mapped, they open with no data
+	if (size == 0)
+		return true;
+
+	void *view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	data = static_cast<const u8 *>(view);
+	if (sequential)
+	{
+		madvise(view, size, MADV_SEQUENTIAL);
+		madvise(view, size, MADV_WILLNEED);
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap(const_cast<u8 *>(data), size);
+	if (fileDescriptor >= 0)
+		close(fileDescriptor);
+	data = nullptr;
+	size = 0;
+	fileDescriptor = -1;
+}
+
+bool MappedFile::IsOpen() const
+{
+	return fileDescriptor >= 0;
+}
+#endif
+
+const u8 *MappedFile::GetData() const
+{
+	return data;
+}
+
+u64 MappedFile::GetSize() const
+{
+	return size;
+}
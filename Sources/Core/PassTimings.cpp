@@ -0,0 +1,91 @@
+#include "Core/PassTimings.hpp"
+
+#include <algorithm>
+#include <fstream>
+
+using namespace Core;
+
+void PassTimings::Init(const std::vector<std::string> &names, u32 windowSizeIn)
+{
+	windowSize = windowSizeIn > 0 ? windowSizeIn : 1;
+	passes.clear();
+	passes.resize(names.size());
+	for (size_t i = 0; i < names.size(); i++)
+	{
+		passes[i].name = names[i];
+		passes[i].samples.reserve(windowSize);
+	}
+}
+
+void PassTimings::AddSample(u32 pass, f64 milliseconds)
+{
+	if (pass >= passes.size())
+		return;
+
+	Pass &p = passes[pass];
+	if (p.samples.size() < windowSize)
+		p.samples.push_back(milliseconds);
+	else
+		p.samples[p.next] = milliseconds;
+	p.next = (p.next + 1) % windowSize;
+}
+
+void PassTimings::Clear()
+{
+	for (Pass &p : passes)
+	{
+		p.samples.clear();
+		p.next = 0;
+	}
+}
+
+u32 PassTimings::GetPassCount() const
+{
+	return (u32)(passes.size());
+}
+
+const std::string &PassTimings::GetName(u32 pass) const
+{
+	return passes[pass].name;
+}
+
+TimingStats PassTimings::GetStats(u32 pass) const
+{
+	TimingStats stats;
+	if (pass >= passes.size() || passes[pass].samples.empty())
+		return stats;
+
+	std::vector<f64> sorted = passes[pass].samples;
+	std::sort(sorted.begin(), sorted.end());
+	f64 sum = 0;
+	for (f64 sample : sorted)
+		sum += sample;
+
+	stats.count = (u32)(sorted.size());
+	stats.min = sorted.front();
+	stats.max = sorted.back();
+	stats.avg = sum / stats.count;
+	// Nearest rank
+	const u32 rank = (stats.count * 99 + 99) / 100;
+	stats.p99 = sorted[rank - 1];
+	return stats;
+}
+
+void PassTimings::WriteCsv(std::ostream &out) const
+{
+	out << "pass,samples,min_ms,avg_ms,p99_ms,max_ms\n";
+	for (u32 i = 0; i < passes.size(); i++)
+	{
+		const TimingStats stats = GetStats(i);
+		out << passes[i].name << "," << stats.count << "," << stats.min << "," << stats.avg << "," << stats.p99 << "," << stats.max << "\n";
+	}
+}
+
+bool PassTimings::WriteCsv(const std::string &path) const
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+		return false;
+	WriteCsv(file);
+	return file.good();
+}
@@ -0,0 +1,157 @@
+#include "Core/TimingHistogram.hpp"
+
+#include <bit>
+#include <iomanip>
+#include <sstream>
+
+using namespace Core;
+
+namespace
+{
+	u64 GetPercentile(const u64 *counts, u64 total, u32 percent)
+	{
+		// Nearest rank
+		const u64 rank = (total * percent + 99) / 100;
+		u64 seen = 0;
+		for (u32 i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+		{
+			seen += counts[i];
+			if (seen >= rank)
+				return TimingHistogram::GetBucketValue(i);
+		}
+		return 0;
+	}
+}
+
+u32 TimingHistogram::GetBucket(u64 value)
+{
+	if (value < SUB_BUCKET_COUNT)
+		return (u32)(value);
+	const u32 shift = (u32)(std::bit_width(value)) - 1 - SUB_BUCKET_BITS;
+	return (shift + 1) * SUB_BUCKET_COUNT + (u32)((value >> shift) - SUB_BUCKET_COUNT);
+}
+
+u64 TimingHistogram::GetBucketValue(u32 bucket)
+{
+	if (bucket < SUB_BUCKET_COUNT)
+		return bucket;
+	const u32 shift = bucket / SUB_BUCKET_COUNT - 1;
+	const u64 top = SUB_BUCKET_COUNT + bucket % SUB_BUCKET_COUNT;
+	return ((top + 1) << shift) - 1;
+}
+
+void TimingHistogram::Record(u64 nanoseconds)
+{
+	counts[GetBucket(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+	u64 current = max.load(std::memory_order_relaxed);
+	while (nanoseconds > current && !max.compare_exchange_weak(current, nanoseconds, std::memory_order_relaxed))
+	{
+	}
+}
+
+HistogramStats TimingHistogram::TakeSnapshot()
+{
+	std::unique_ptr<u64[]> snapshot(new u64[HISTOGRAM_BUCKET_COUNT]);
+	HistogramStats stats;
+	for (u32 i = 0; i < HISTOGRAM_BUCKET_COUNT; i++)
+	{
+		snapshot[i] = counts[i].exchange(0, std::memory_order_relaxed);
+		stats.count += snapshot[i];
+	}
+	stats.max = max.exchange(0, std::memory_order_relaxed);
+	if (stats.count == 0)
+		return stats;
+
+	stats.p50 = GetPercentile(snapshot.get(), stats.count, 50);
+	stats.p95 = GetPercentile(snapshot.get(), stats.count, 95);
+	stats.p99 = GetPercentile(snapshot.get(), stats.count, 99);
+	// Buckets report their highest value, the exact max is a tighter bound.
+	// A sample recorded during the snapshot can be counted here and its max in the next one.
+	if (stats.max > 0)
+	{
+		stats.p50 = stats.p50 < stats.max ? stats.p50 : stats.max;
+		stats.p95 = stats.p95 < stats.max ? stats.p95 : stats.max;
+		stats.p99 = stats.p99 < stats.max ? stats.p99 : stats.max;
+	}
+	return stats;
+}
+
+void TimingCollector::Init(const std::vector<std::string> &phaseNames)
+{
+	names = phaseNames;
+	histograms.clear();
+	for (size_t i = 0; i < names.size(); i++)
+		histograms.push_back(std::make_unique<TimingHistogram>());
+}
+
+void TimingCollector::Record(u32 phase, u64 nanoseconds)
+{
+	if (phase < histograms.size())
+		histograms[phase]->Record(nanoseconds);
+}
+
+void TimingCollector::Record(u32 phase, std::chrono::steady_clock::duration duration)
+{
+	Record(phase, (u64)(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+}
+
+u32 TimingCollector::GetPhaseCount() const
+{
+	return (u32)(names.size());
+}
+
+const std::string &TimingCollector::GetName(u32 phase) const
+{
+	return names[phase];
+}
+
+void TimingCollector::TakeSnapshot(std::vector<HistogramStats> &stats)
+{
+	stats.resize(histograms.size());
+	for (size_t i = 0; i < histograms.size(); i++)
+		stats[i] = histograms[i]->TakeSnapshot();
+}
+
+bool TimingCollector::OpenExport(const std::string &path)
+{
+	exportFile.open(path, std::ios::out | std::ios::trunc);
+	if (!exportFile.is_open())
+		return false;
+	exportFile << "time_s,phase,count,p50_ms,p95_ms,p99_ms,max_ms\n";
+	return true;
+}
+
+void TimingCollector::Export(f64 time, const std::vector<HistogramStats> &stats)
+{
+	if (!exportFile.is_open())
+		return;
+	for (size_t i = 0; i < stats.size() && i < names.size(); i++)
+	{
+		const HistogramStats &s = stats[i];
+		exportFile << time << "," << names[i] << "," << s.count << "," << s.p50 / 1e6 << "," << s.p95 / 1e6 << "," << s.p99 / 1e6 << "," << s.max / 1e6 << "\n";
+	}
+	exportFile.flush();
+}
+
+std::string TimingCollector::FormatSummary(const std::vector<HistogramStats> &stats) const
+{
+	std::ostringstream out;
+	out << std::fixed << std::setprecision(3);
+	out << "p50/p95/p99/max (ms):";
+	for (size_t i = 0; i < stats.size() && i < names.size(); i++)
+	{
+		const HistogramStats &s = stats[i];
+		if (s.count > 0)
+			out << " " << names[i] << " " << s.p50 / 1e6 << "/" << s.p95 / 1e6 << "/" << s.p99 / 1e6 << "/" << s.max / 1e6;
+	}
+	return out.str();
+}
+
+ScopedTiming::ScopedTiming(TimingCollector &collectorIn, u32 phaseIn) : collector(collectorIn), phase(phaseIn), start(std::chrono::steady_clock::now())
+{
+}
+
+ScopedTiming::~ScopedTiming()
+{
+	collector.Record(phase, std::chrono::steady_clock::now() - start);
+}
@@ -0,0 +1,236 @@
+#include "Core/Trace.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace Core;
+
+namespace
+{
+	std::atomic_bool enabled = false;
+	std::chrono::steady_clock::time_point origin;
+
+	// Buffers live until the process exits, threads keep a pointer to theirs
+	std::mutex registryLock;
+	std::vector<std::unique_ptr<TraceBuffer>> buffers;
+	std::ofstream file;
+	bool firstEvent = true;
+
+	thread_local TraceBuffer *threadBuffer = nullptr;
+	thread_local const char *threadName = nullptr;
+	thread_local std::vector<TraceBuffer*> threadTracks;
+
+	TraceBuffer *CreateBuffer(const char *name)
+	{
+		std::lock_guard<std::mutex> lock(registryLock);
+		buffers.push_back(std::make_unique<TraceBuffer>((u32)(buffers.size() + 1), name));
+		return buffers.back().get();
+	}
+
+	TraceBuffer *GetThreadBuffer()
+	{
+		if (!threadBuffer)
+			threadBuffer = CreateBuffer(threadName ? threadName : "Thread");
+		return threadBuffer;
+	}
+
+	void WriteString(const char *text)
+	{
+		file << '"';
+		for (const char *c = text; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				file << '\\';
+			file << *c;
+		}
+		file << '"';
+	}
+
+	void WriteSeparator()
+	{
+		if (!firstEvent)
+			file << ",\n";
+		firstEvent = false;
+	}
+
+	void WriteTimestamp(u64 nanoseconds)
+	{
+		// Microseconds with nanosecond decimals
+		file << nanoseconds / 1000 << "." << (char)('0' + nanoseconds / 100 % 10) << (char)('0' + nanoseconds / 10 % 10) << (char)('0' + nanoseconds % 10);
+	}
+
+	// Expects registryLock
+	void FlushLocked()
+	{
+		if (!file.is_open())
+			return;
+
+		TraceEvent event;
+		for (const std::unique_ptr<TraceBuffer> &buffer : buffers)
+		{
+			if (!buffer->named)
+			{
+				WriteSeparator();
+				file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":";
+				WriteString(buffer->name);
+				file << "}}";
+				buffer->named = true;
+			}
+			while (buffer->Pop(event))
+			{
+				WriteSeparator();
+				file << "{\"name\":";
+				WriteString(event.name);
+				file << ",\"ph\":\"" << (event.type == TraceEventType::BEGIN ? "B" : event.type == TraceEventType::END ? "E" : "X") << "\",\"ts\":";
+				WriteTimestamp(event.timestamp);
+				if (event.type == TraceEventType::COMPLETE)
+				{
+					file << ",\"dur\":";
+					WriteTimestamp(event.duration);
+				}
+				file << ",\"pid\":1,\"tid\":" << buffer->id << "}";
+			}
+		}
+		file.flush();
+	}
+}
+
+TraceBuffer::TraceBuffer(u32 idIn, const char *nameIn) : id(idIn), name(nameIn)
+{
+}
+
+bool TraceBuffer::Push(const TraceEvent &event)
+{
+	const u64 h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) >= TRACE_BUFFER_CAPACITY)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	events[h % TRACE_BUFFER_CAPACITY] = event;
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+bool TraceBuffer::Pop(TraceEvent &event)
+{
+	const u64 t = tail.load(std::memory_order_relaxed);
+	if (t == head.load(std::memory_order_acquire))
+		return false;
+	event = events[t % TRACE_BUFFER_CAPACITY];
+	tail.store(t + 1, std::memory_order_release);
+	return true;
+}
+
+bool Trace::Start(const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(registryLock);
+	if (file.is_open())
+		return false;
+	file.open(path, std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	// Events left from a previous session are discarded, names are written again
+	TraceEvent event;
+	for (const std::unique_ptr<TraceBuffer> &buffer : buffers)
+	{
+		while (buffer->Pop(event))
+		{
+		}
+		buffer->named = false;
+		buffer->dropped = 0;
+	}
+	file << "{\"traceEvents\":[\n";
+	firstEvent = true;
+	origin = std::chrono::steady_clock::now();
+	enabled.store(true, std::memory_order_release);
+	return true;
+}
+
+void Trace::Stop()
+{
+	enabled.store(false, std::memory_order_release);
+	std::lock_guard<std::mutex> lock(registryLock);
+	if (!file.is_open())
+		return;
+	FlushLocked();
+
+	u64 dropped = 0;
+	for (const std::unique_ptr<TraceBuffer> &buffer : buffers)
+		dropped += buffer->dropped.load(std::memory_order_relaxed);
+	file << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":\"" << dropped << "\"}}\n";
+	file.close();
+}
+
+void Trace::Flush()
+{
+	std::lock_guard<std::mutex> lock(registryLock);
+	FlushLocked();
+}
+
+bool Trace::IsEnabled()
+{
+	return enabled.load(std::memory_order_acquire);
+}
+
+u64 Trace::Now()
+{
+	return (u64)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count());
+}
+
+void Trace::SetThreadName(const char *name)
+{
+	threadName = name;
+}
+
+void Trace::Begin(const char *name)
+{
+	if (!IsEnabled())
+		return;
+	TraceEvent event;
+	event.name = name;
+	event.timestamp = Now();
+	event.type = TraceEventType::BEGIN;
+	GetThreadBuffer()->Push(event);
+}
+
+void Trace::End(const char *name)
+{
+	if (!IsEnabled())
+		return;
+	TraceEvent event;
+	event.name = name;
+	event.timestamp = Now();
+	event.type = TraceEventType::END;
+	GetThreadBuffer()->Push(event);
+}
+
+void Trace::RecordComplete(const char *track, const char *name, u64 start, u64 duration)
+{
+	if (!IsEnabled())
+		return;
+
+	// Tracks are looked up by name pointer, the lock is only taken the first time
+	TraceBuffer *buffer = nullptr;
+	for (TraceBuffer *t : threadTracks)
+	{
+		if (t->name == track)
+			buffer = t;
+	}
+	if (!buffer)
+	{
+		buffer = CreateBuffer(track);
+		threadTracks.push_back(buffer);
+	}
+
+	TraceEvent event;
+	event.name = name;
+	event.timestamp = start;
+	event.duration = duration;
+	event.type = TraceEventType::COMPLETE;
+	buffer->Push(event);
+}
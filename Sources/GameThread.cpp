@@ -26,19 +26,11 @@ std::string GetFormattedTime()
 	return std::string(buffer);
 }
 
-float GameThread::NextFloat01()
-{
-	return rand() / static_cast<float>(RAND_MAX);
-}
-
-Maths::Vec3 GameThread::NextUnitVector()
-{
-	return (Vec3(NextFloat01(), NextFloat01(), NextFloat01()) * 2 - 1).Normalize();
-}
-
-void GameThread::Init(HWND hwnd, u32 customMsg, Maths::IVec2 resIn, bool isUnit)
+void GameThread::Init(HWND hwnd, u32 customMsg, Maths::IVec2 resIn, bool isUnit, const Simulation::SimParams &simParamsIn, u32 seedIn)
 {
 	isUnitTest = isUnit;
+	simParams = Simulation::BoidSim::ClampParams(simParamsIn);
+	seed = seedIn;
 	hWnd = hwnd;
 	res = resIn;
 	customMessage = customMsg;
@@ -151,8 +143,12 @@ void GameThread::Quit()
 void GameThread::InitThread()
 {
 	SetThreadDescription(GetCurrentThread(), L"Game Thread");
+	TRACE_THREAD_NAME("Game Thread");
 	std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
 	start = now.time_since_epoch();
+	tickTimings.Init({ "tick", "input_lock", "input", "camera", "update_buffers" });
+	if (!tickTimings.OpenExport("TickTimings.csv"))
+		LogMessage("Could not open TickTimings.csv\n");
 	/*
 	srand((u32)(std::chrono::duration_cast<std::chrono::milliseconds>(start).count()));
 
@@ -171,12 +167,7 @@ void GameThread::InitThread()
 	}
 
 	const u32 threadCount = Util::MaxU(std::thread::hardware_concurrency() - 4, std::thread::hardware_concurrency() / 2);
-	threadPool.resize(threadCount);
-
-	for (u32 i = 0; i < threadCount; i++)
-	{
-		threadPool[i] = std::thread(&GameThread::ThreadPoolFunc, this);
-	}
+	jobSystem.Init(threadCount);
 	*/
 }
 
@@ -207,65 +198,62 @@ s32 GameThread::GetCell(Maths::IVec2 pos, Maths::IVec2 &dt)
 
 void GameThread::PreUpdate()
 {
-	for (u32 i = 0; i < cells.size(); i++)
-		cells[i].clear();
-
 	const u32 totalCells = cellCount.x * cellCount.y;
-	if (cells.size() < totalCells)
-	{
-		cells.resize(totalCells);
-	}
+	if (grid.GetCellCount() != totalCells)
+		grid.Init(totalCells);
 
+	objectCells.resize(OBJECT_COUNT);
 	for (u32 i = 0; i < OBJECT_COUNT; i++)
 	{
 		IVec2 cell = positions[i] / CELL_SIZE;
 		cell.x = Util::MinI(cell.x, cellCount.x - 1);
 		cell.y = Util::MinI(cell.y, cellCount.y - 1);
-		cells[cell.x + cell.y * cellCount.x].push_back(i);
+		objectCells[i] = cell.x + cell.y * cellCount.x;
 	}
+	grid.Build(objectCells, &jobSystem);
 }
 
 #include <unordered_set>
 
 void GameThread::Update(float deltaTime)
 {
-	taskLock.lock();
+	jobDeltaTime = deltaTime;
+	jobs.clear();
 	for (s32 cx = 0; cx < cellCount.x; cx++)
 	{
 		for (s32 cy = 0; cy < cellCount.y; cy++)
 		{
-			PoolTask task;
-			task.taskID = 0;
-			task.deltaTime = deltaTime;
-			task.cellX = cx;
-			task.cellY = cy;
-			tasks.push_back(task);
+			jobs.push_back(Core::Job::Create<GameThread, &GameThread::CellUpdateJob>(this, cx, cy));
 		}
 	}
-	taskCounter = (u32)(tasks.size());
-	taskLock.unlock();
 
-	while (taskCounter != 0)
-		ThreadPoolUpdate();
+	Core::JobCounter counter;
+	jobSystem.Submit(jobs.data(), (u32)(jobs.size()), counter);
+	jobSystem.Wait(counter);
 }
 
 void GameThread::PostUpdate(float deltaTime)
 {
-	taskLock.lock();
+	jobDeltaTime = deltaTime;
+	jobs.clear();
 	for (u32 x = 0; x < OBJECT_COUNT; x+= BOID_CHUNK)
 	{
-		PoolTask task;
-		task.taskID = 1;
-		task.deltaTime = deltaTime;
-		task.cellX = x;
-		task.cellY = Util::MinU(x + BOID_CHUNK, OBJECT_COUNT);
-		tasks.push_back(task);
+		jobs.push_back(Core::Job::Create<GameThread, &GameThread::PostUpdateJob>(this, x, Util::MinU(x + BOID_CHUNK, OBJECT_COUNT)));
 	}
-	taskCounter = (u32)(tasks.size());
-	taskLock.unlock();
 
-	while (taskCounter != 0)
-		ThreadPoolUpdate();
+	Core::JobCounter counter;
+	jobSystem.Submit(jobs.data(), (u32)(jobs.size()), counter);
+	jobSystem.Wait(counter);
+}
+
+void GameThread::CellUpdateJob(u32 cellX, u32 cellY)
+{
+	ProcessCellUpdate(cellX, cellY, jobDeltaTime);
+}
+
+void GameThread::PostUpdateJob(u32 start, u32 end)
+{
+	ProcessPostUpdate(start, end, jobDeltaTime);
 }
 
 void GameThread::UpdateBuffers(const Mat4 &mat)
@@ -290,17 +278,23 @@ void GameThread::UpdateBuffers(const Mat4 &mat)
 
 std::vector<Maths::Vec4> GameThread::GetInitialSimulationData()
 {
-	std::vector<Vec4> initialData = std::vector<Vec4>(OBJECT_COUNT * 4);
-	srand((u32)(std::chrono::duration_cast<std::chrono::milliseconds>(start).count()));
+	LogMessage("Generating " + std::to_string(simParams.objectCount) + " boids with --seed=" + std::to_string(seed) + "\n");
+	// Called from the render thread, which may not submit to the game thread's job system
+	Core::JobSystem generator;
+	generator.Init();
+	std::vector<Maths::Vec4> objects = Simulation::BoidSim::GenerateObjects(simParams, seed, &generator);
+	generator.Quit();
+	return objects;
+}
 
-	for (u32 i = 0; i < OBJECT_COUNT; i++)
-	{
-		initialData[i*4] = Vec4(NextFloat01() * WORLD_SIZE, NextFloat01() * WORLD_SIZE, NextFloat01() * WORLD_SIZE, 0);
-		initialData[i*4+1] = Vec4(NextUnitVector(), 0) * BOID_MAX_SPEED * 0.2f * (1/144.0f);
-		initialData[i*4+2] = Vec4();
-		initialData[i*4+3] = Quat::AxisAngle(NextUnitVector(), (float)(NextFloat01() * M_PI * 2)).ToVec4();
-	}
-	return initialData;
+bool GameThread::TakeSnapshotRequest()
+{
+	return snapshotRequested.exchange(false);
+}
+
+const Simulation::SimParams &GameThread::GetSimParams() const
+{
+	return simParams;
 }
 
 const Maths::Mat4 & GameThread::GetViewProjectionMatrix() const
@@ -310,10 +304,11 @@ const Maths::Mat4 & GameThread::GetViewProjectionMatrix() const
 
 void GameThread::ProcessCellUpdate(u32 cx, u32 cy, float deltaTime)
 {
-	const auto &vec1 = cells[cx + cy * cellCount.x];
-	for (u32 index1 = 0; index1 < vec1.size(); index1++)
+	const auto &sorted = grid.GetSortedObjects();
+	const u32 cell = cx + cy * cellCount.x;
+	for (u32 index1 = grid.GetCellBegin(cell); index1 < grid.GetCellEnd(cell); index1++)
 	{
-		u32 boid1 = vec1[index1];
+		u32 boid1 = sorted[index1];
 
 		Vec2 globalPos;
 		Vec2 globalRot;
@@ -328,10 +323,9 @@ void GameThread::ProcessCellUpdate(u32 cx, u32 cy, float deltaTime)
 				IVec2 dt;
 				s32 cellId = GetCell(IVec2(cx + i, cy + j), dt);
 
-				const auto &vec2 = cells[cellId];
-				for (u32 index2 = 0; index2 < vec2.size(); index2++)
+				for (u32 index2 = grid.GetCellBegin(cellId); index2 < grid.GetCellEnd(cellId); index2++)
 				{
-					u32 boid2 = vec2[index2];
+					u32 boid2 = sorted[index2];
 					if (boid1 == boid2)
 						continue;
 
@@ -409,24 +403,31 @@ void GameThread::ThreadFunc()
 	if (isUnitTest)
 		LogMessage("Starting unit test:\n");
 
-	u32 counter = 0;
 	u32 tm0 = 0;
+	std::vector<Core::HistogramStats> tickStats;
+	auto lastTick = std::chrono::steady_clock::now();
 	while (!exit)
 	{
+		TRACE_SCOPE("Tick");
 		std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
 		auto duration = now.time_since_epoch() - start;
 		auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
 		f64 iTime = micros / 1000000.0;
 		f32 deltaTime = static_cast<f32>(iTime - appTime);
 		appTime = iTime;
+		auto tickStart = std::chrono::steady_clock::now();
+		tickTimings.Record(TICK_PHASE_TICK, tickStart - lastTick);
+		lastTick = tickStart;
 		u32 tm1 = (u32)(iTime);
 		if (tm0 != tm1)
 		{
 			tm0 = tm1;
-			LogMessage("TPS: " + std::to_string(counter) + "\n");
-			counter = 0;
+			tickTimings.TakeSnapshot(tickStats);
+			tickTimings.Export(iTime, tickStats);
+			LogMessage("Ticks: " + std::to_string(tickStats[TICK_PHASE_TICK].count) + ", " + tickTimings.FormatSummary(tickStats) + "\n");
+			// Drains the trace rings of every thread
+			Core::Trace::Flush();
 		}
-		counter++;
 		HandleResize();
 		if (res.x <= 0 || res.y <= 0)
 		{
@@ -434,7 +435,9 @@ void GameThread::ThreadFunc()
 			continue;
 		}
 
+		auto inputStart = std::chrono::steady_clock::now();
 		mouseLock.lock();
+		auto lockWait = std::chrono::steady_clock::now() - inputStart;
 		Vec2 delta = storedDelta;
 		storedDelta = Vec2();
 		mouseLock.unlock();
@@ -442,7 +445,9 @@ void GameThread::ThreadFunc()
 		rotation.x = Util::Clamp(rotation.x + delta.y, static_cast<f32>(-M_PI_2), static_cast<f32>(M_PI_2));
 		rotation.y = Util::Mod(rotation.y + delta.x, static_cast<f32>(2 * M_PI));
 		Maths::Vec3 dir;
+		auto lockStart = std::chrono::steady_clock::now();
 		keyLock.lock();
+		lockWait += std::chrono::steady_clock::now() - lockStart;
 		for (u8 i = 0; i < 6; ++i)
 		{
 			f32 key = keyCodesDown.test(MOVEMENT_KEYS[i]);
@@ -451,10 +456,14 @@ void GameThread::ThreadFunc()
 		f32 fovDir = static_cast<f32>(keyDown.test(VK_DOWN)) - static_cast<f32>(keyDown.test(VK_UP));
 		bool fullscreen = keyPress.test(VK_F11);
 		bool capture = keyPress.test(VK_ESCAPE);
+		bool snapshot = keyPress.test(VK_F5);
 		bool shift = keyDown.test(VK_SHIFT);
 		keyPress.reset();
 		keyCodesPress.reset();
 		keyLock.unlock();
+		tickTimings.Record(TICK_PHASE_INPUT_LOCK, lockWait);
+		auto cameraStart = std::chrono::steady_clock::now();
+		tickTimings.Record(TICK_PHASE_INPUT, cameraStart - inputStart);
 		fov = Util::Clamp(fov + fovDir * deltaTime * fov, 0.5f, 175.0f);
 		rotationQuat = Quat::FromEuler(Vec3(rotation.x, rotation.y, 0.0f));
 		if (dir.Dot())
@@ -467,6 +476,8 @@ void GameThread::ThreadFunc()
 			SendWindowMessage(FULLSCREEN);
 		if (capture)
 			SendWindowMessage(LOCK_MOUSE);
+		if (snapshot)
+			snapshotRequested = true;
 
 		Mat4 vp = Mat4::CreatePerspectiveProjectionMatrix(0.1f, 1000.0f, fov, (float)(res.x) / res.y);
 		vp = vp * Mat4::CreateViewMatrix(position, position + rotationQuat * Vec3(0,0,-1), rotationQuat * Vec3(0,1,0));
@@ -499,6 +510,7 @@ void GameThread::ThreadFunc()
 		}
 		cursorPos = Vec2(rayDir.x, rayDir.z) * 10;
 		mousePressed = click;
+		tickTimings.Record(TICK_PHASE_CAMERA, std::chrono::steady_clock::now() - cameraStart);
 		
 		// Hard cap movement to 30 fps so that deltatime does not gets too big
 		if (deltaTime > 0.033f)
@@ -512,62 +524,19 @@ void GameThread::ThreadFunc()
 		}
 		*/
 		//else
+		{
+			TRACE_SCOPE("Sleep");
 			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
 		
-		UpdateBuffers(vp);
+		{
+			TRACE_SCOPE("UpdateBuffers");
+			Core::ScopedTiming timing(tickTimings, TICK_PHASE_UPDATE_BUFFERS);
+			UpdateBuffers(vp);
+		}
 
 		if (isUnitTest && appTime > 10.0f)
 			SendWindowMessage(EXIT_WINDOW);
 	}
-	/*
-	poolExit = true;
-	for (u32 i = 0; i < threadPool.size(); i++)
-	{
-		threadPool[i].join();
-	}
-	*/
+	jobSystem.Quit();
 }
-
-bool GameThread::ThreadPoolUpdate()
-{
-	taskLock.lock();
-	PoolTask task;
-	task.taskID = -1;
-	if (!tasks.empty())
-	{
-		task = tasks.back();
-		tasks.pop_back();
-	}
-	taskLock.unlock();
-
-	if (task.taskID == (u32)(-1))
-	{
-		return false;
-	}
-	else
-	{
-		switch (task.taskID)
-		{
-		case 0:
-			ProcessCellUpdate(task.cellX, task.cellY, task.deltaTime);
-			break;
-		case 1:
-			ProcessPostUpdate(task.cellX, task.cellY, task.deltaTime);
-			break;
-		default:
-			break;
-		}
-		taskCounter--;
-	}
-	return true;
-}
-
-void GameThread::ThreadPoolFunc()
-{
-	while (!poolExit)
-	{
-		ThreadPoolUpdate();
-		//if (!ThreadPoolUpdate())
-		//	std::this_thread::sleep_for(std::chrono::milliseconds(5));
-	}
-}
\ No newline at end of file
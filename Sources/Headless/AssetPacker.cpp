@@ -0,0 +1,114 @@
+#include <iostream>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Core/MappedFile.hpp"
+#include "Resource/AssetPack.hpp"
+#include "Resource/TextureCache.hpp"
+
+// Builds the asset pack the renderer maps at startup: the compiled shaders of Assets/Shaders and
+// both texture caches of every image in Assets/Textures. Run it again after a shader or texture change.
+// Usage: AssetPacker [assets folder] [output pack], Assets and Assets.pack by default
+
+namespace
+{
+	bool ReadFile(const std::filesystem::path &path, std::vector<u8> &out)
+	{
+		Core::MappedFile file;
+		if (!file.Open(path.string(), true))
+			return false;
+		out.assign(file.GetData(), file.GetData() + file.GetSize());
+		return true;
+	}
+
+	std::vector<std::filesystem::path> ListFiles(const std::filesystem::path &folder, const std::string &extension)
+	{
+		std::vector<std::filesystem::path> result;
+		std::error_code error;
+		for (const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(folder, error))
+		{
+			if (entry.is_regular_file() && entry.path().extension() == extension)
+				result.push_back(entry.path());
+		}
+		return result;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	const std::filesystem::path assetsPath = argc > 1 ? argv[1] : "Assets";
+	const std::string packPath = argc > 2 ? argv[2] : "Assets.pack";
+	if (!std::filesystem::is_directory(assetsPath))
+	{
+		std::cerr << assetsPath.string() << " is not a folder" << std::endl;
+		return 1;
+	}
+
+	std::vector<Resource::AssetPackSource> sources;
+	std::string error;
+	// Every shader source needs its module, a missing or stale one would be packed in place of the source
+	const std::filesystem::path shadersPath = assetsPath / "Shaders";
+	std::error_code timeError;
+	const std::filesystem::file_time_type sharedTime = std::filesystem::last_write_time(shadersPath / "shaderSimData.h", timeError);
+	const char *shaderExtensions[] = { ".comp", ".vert", ".frag" };
+	for (const char *extension : shaderExtensions)
+	{
+		for (const std::filesystem::path &shaderPath : ListFiles(shadersPath, extension))
+		{
+			std::filesystem::path path = shaderPath;
+			path += ".spv";
+			const std::filesystem::file_time_type moduleTime = std::filesystem::last_write_time(path, timeError);
+			if (timeError || moduleTime < std::filesystem::last_write_time(shaderPath) || moduleTime < sharedTime)
+			{
+				std::cerr << path.string() << " is missing or older than its source, build the Shaders target first" << std::endl;
+				return 1;
+			}
+			Resource::AssetPackSource source;
+			source.name = "Shaders/" + path.filename().string();
+			if (!ReadFile(path, source.data))
+			{
+				std::cerr << "Could not read " << path.string() << std::endl;
+				return 1;
+			}
+			sources.push_back(std::move(source));
+		}
+	}
+
+	const Resource::TextureFormat formats[] = { Resource::TextureFormat::Rgba8Srgb, Resource::TextureFormat::Bc1Srgb };
+	for (const std::filesystem::path &path : ListFiles(assetsPath / "Textures", ".png"))
+	{
+		std::vector<u8> image;
+		if (!ReadFile(path, image))
+		{
+			std::cerr << "Could not read " << path.string() << std::endl;
+			return 1;
+		}
+		// The renderer picks one of them depending on BC support
+		for (Resource::TextureFormat format : formats)
+		{
+			Resource::AssetPackSource source;
+			source.name = Resource::TextureCache::GetCachePath("Textures/" + path.filename().string(), format);
+			if (!Resource::TextureCache::Encode(image.data(), image.size(), format, source.data, error))
+			{
+				std::cerr << path.string() << ": " << error << std::endl;
+				return 1;
+			}
+			sources.push_back(std::move(source));
+		}
+	}
+
+	if (!Resource::AssetPack::Write(packPath, sources, error))
+	{
+		std::cerr << error << std::endl;
+		return 1;
+	}
+	u64 totalSize = 0;
+	for (const Resource::AssetPackSource &source : sources)
+	{
+		std::cout << source.name << ": " << source.data.size() << " bytes" << std::endl;
+		totalSize += source.data.size();
+	}
+	std::cout << "Wrote " << packPath << ", " << sources.size() << " assets, " << totalSize << " bytes" << std::endl;
+	return 0;
+}
@@ -0,0 +1,1197 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <array>
+#include <filesystem>
+
+#include "Simulation/BoidSim.hpp"
+#include "Simulation/GpuBinning.hpp"
+#include "Simulation/Snapshot.hpp"
+#include "Simulation/Trajectory.hpp"
+#include "Simulation/RenderInstance.hpp"
+#include "Core/FixedTimestep.hpp"
+#include "Core/PassTimings.hpp"
+#include "Core/TimingHistogram.hpp"
+#include "Core/Trace.hpp"
+#include "Resource/ImageCapture.hpp"
+#include "Resource/Mesh.hpp"
+#include "Resource/TextureCache.hpp"
+#include "Resource/AssetPack.hpp"
+#include "Resource/PipelineCacheFile.hpp"
+#include "Maths/Random.hpp"
+
+struct LaunchArgs
+{
+	Simulation::SimParams params;
+	u32 ticks = 600;
+	u32 seed = 0;
+	u32 threadCount = 0;
+	f32 deltaTime = 1 / 144.0f;
+	Simulation::BoidKernel kernel = Simulation::GetBestBoidKernel();
+	std::string tracePath;
+	// Starts from a snapshot instead of generating, and writes one after the last tick
+	std::string loadPath;
+	std::string savePath;
+	// Every recordInterval-th tick goes to the trajectory file
+	std::string recordPath;
+	u32 recordInterval = 10;
+	bool isUnitTest = false;
+} launchArgs;
+
+bool RunBinningTest(const Simulation::BoidSim &sim)
+{
+	std::vector<Maths::Vec4> objects;
+	sim.WriteObjects(objects);
+	const Simulation::SimParams &params = sim.GetParams();
+
+	std::vector<u32> buffer;
+	Simulation::GpuBinning::Run(objects, params, buffer);
+	const u32 cellCount = params.chunkCountSide * params.chunkCountSide * params.chunkCountSide;
+	const auto layout = Simulation::BinningLayout::Create(sim.GetObjectCount(), cellCount);
+	if (buffer[layout.cellOffsetsOffset + cellCount] != sim.GetObjectCount())
+	{
+		std::cout << "GPU binning reference lost boids\n";
+		return false;
+	}
+
+	// The GPU is free to order boids inside a cell, the validation must accept any order
+	for (u32 c = 0; c < cellCount; c++)
+	{
+		const u32 begin = layout.sortedOffset + buffer[layout.cellOffsetsOffset + c];
+		const u32 end = layout.sortedOffset + buffer[layout.cellOffsetsOffset + c + 1];
+		std::reverse(buffer.begin() + begin, buffer.begin() + end);
+	}
+	std::string error;
+	if (!Simulation::GpuBinning::Validate(objects, params, buffer, error))
+	{
+		std::cout << "GPU binning validation failed: " << error << "\n";
+		return false;
+	}
+	// Breaking a cell must be caught
+	std::swap(buffer[layout.sortedOffset], buffer[layout.sortedOffset + sim.GetObjectCount() - 1]);
+	if (Simulation::GpuBinning::Validate(objects, params, buffer, error))
+	{
+		std::cout << "GPU binning validation accepted a broken buffer\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunTimestepTest()
+{
+	// Quarter second steps keep every value exact
+	Core::FixedTimestep timestep;
+	timestep.Init(0.25, 4);
+	const f64 frames[] = { 0.125, 0.25, 0.0, 2.0, 0.125 };
+	const u32 expected[] = { 0, 1, 0, 4, 1 };
+	for (u32 i = 0; i < 5; i++)
+	{
+		u32 steps = timestep.Advance(frames[i]);
+		if (steps != expected[i])
+		{
+			std::cout << "Fixed timestep ran " << steps << " steps on frame " << i << ", expected " << expected[i] << "\n";
+			return false;
+		}
+	}
+	if (timestep.GetTickCount() != 6 || timestep.GetDroppedTime() != 1.0)
+	{
+		std::cout << "Fixed timestep counted " << timestep.GetTickCount() << " ticks and dropped " << timestep.GetDroppedTime() << " s\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunPassTimingsTest()
+{
+	// 200 samples in a window of 100 keep 101..200
+	Core::PassTimings timings;
+	timings.Init({ "full", "empty" }, 100);
+	for (u32 i = 1; i <= 200; i++)
+		timings.AddSample(0, (f64)(i));
+	const Core::TimingStats stats = timings.GetStats(0);
+	if (stats.count != 100 || stats.min != 101.0 || stats.max != 200.0 || stats.avg != 150.5 || stats.p99 != 199.0)
+	{
+		std::cout << "Pass timings: " << stats.count << " samples, min " << stats.min << ", avg " << stats.avg << ", p99 " << stats.p99 << ", max " << stats.max << "\n";
+		return false;
+	}
+	if (timings.GetStats(1).count != 0)
+	{
+		std::cout << "Pass timings reported samples for an empty pass\n";
+		return false;
+	}
+
+	std::ostringstream csv;
+	timings.WriteCsv(csv);
+	if (csv.str() != "pass,samples,min_ms,avg_ms,p99_ms,max_ms\nfull,100,101,150.5,199,200\nempty,0,0,0,0,0\n")
+	{
+		std::cout << "Unexpected pass timings CSV:\n" << csv.str();
+		return false;
+	}
+	return true;
+}
+
+bool RunHistogramTest()
+{
+	const u64 values[] = { 0, 1, 31, 32, 33, 1000, 123456789, 1ull << 62, ~0ull };
+	for (u64 value : values)
+	{
+		const u64 reported = Core::TimingHistogram::GetBucketValue(Core::TimingHistogram::GetBucket(value));
+		if (reported < value || reported - value > value / Core::SUB_BUCKET_COUNT)
+		{
+			std::cout << "Histogram reports " << reported << " for " << value << "\n";
+			return false;
+		}
+	}
+
+	// Every thread records 1..1000 us
+	Core::TimingCollector collector;
+	collector.Init({ "phase" });
+	std::vector<std::thread> threads;
+	for (u32 t = 0; t < 4; t++)
+	{
+		threads.emplace_back([&collector]()
+		{
+			for (u64 i = 1; i <= 1000; i++)
+				collector.Record(0, i * 1000);
+		});
+	}
+	for (std::thread &thread : threads)
+		thread.join();
+
+	std::vector<Core::HistogramStats> stats;
+	collector.TakeSnapshot(stats);
+	auto isClose = [](u64 value, u64 expected) { return value >= expected && value - expected <= expected / Core::SUB_BUCKET_COUNT; };
+	if (stats[0].count != 4000 || !isClose(stats[0].p50, 500000) || !isClose(stats[0].p95, 950000) || !isClose(stats[0].p99, 990000) || stats[0].max != 1000000)
+	{
+		std::cout << "Histogram: " << stats[0].count << " samples, p50 " << stats[0].p50 << ", p95 " << stats[0].p95 << ", p99 " << stats[0].p99 << ", max " << stats[0].max << "\n";
+		return false;
+	}
+	collector.TakeSnapshot(stats);
+	if (stats[0].count != 0 || stats[0].max != 0)
+	{
+		std::cout << "Histogram snapshot did not start a new interval\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunTraceTest()
+{
+	// Calls the functions directly, the macros may be compiled out
+	const std::string path = "TraceTest.json";
+	if (!Core::Trace::Start(path))
+	{
+		std::cout << "Could not start a trace in " << path << "\n";
+		return false;
+	}
+	Core::Trace::Begin("Outer");
+	std::thread worker([]()
+	{
+		Core::Trace::SetThreadName("Trace Worker");
+		Core::Trace::Begin("Work");
+		Core::Trace::End("Work");
+	});
+	worker.join();
+	Core::Trace::RecordComplete("GPU", "Pass", 1000, 2500);
+	Core::Trace::End("Outer");
+	Core::Trace::Stop();
+	Core::Trace::Begin("Ignored");
+
+	std::ifstream file(path);
+	std::stringstream content;
+	content << file.rdbuf();
+	file.close();
+	std::remove(path.c_str());
+	const std::string json = content.str();
+	auto count = [&json](const std::string &text)
+	{
+		u32 found = 0;
+		for (size_t pos = json.find(text); pos != std::string::npos; pos = json.find(text, pos + 1))
+			found++;
+		return found;
+	};
+	if (json.rfind("{\"traceEvents\":[", 0) != 0 || count("\"ph\":\"B\"") != 2 || count("\"ph\":\"E\"") != 2 ||
+		count("\"name\":\"Trace Worker\"") != 1 || count("\"ts\":1.000,\"dur\":2.500") != 1 || count("Ignored") != 0 ||
+		count("\"droppedEvents\":\"0\"") != 1)
+	{
+		std::cout << "Unexpected trace:\n" << json;
+		return false;
+	}
+	return true;
+}
+
+bool RunImageCaptureTest()
+{
+	// 3x2 BGRA rows with a padded pitch, like a readback buffer
+	const Maths::IVec2 res(3, 2);
+	const u32 rowPitch = 16;
+	std::vector<u8> bgra(rowPitch * res.y, 0xee);
+	for (s32 y = 0; y < res.y; y++)
+	{
+		for (s32 x = 0; x < res.x; x++)
+		{
+			u8 *pixel = &bgra[y * rowPitch + x * 4];
+			pixel[0] = (u8)(x);
+			pixel[1] = (u8)(y);
+			pixel[2] = 200;
+			pixel[3] = 255;
+		}
+	}
+	std::vector<u8> rgba;
+	Resource::ImageCapture::ConvertBgraToRgba(bgra.data(), rowPitch, res, rgba);
+	if (rgba.size() != 24 || rgba[0] != 200 || rgba[1] != 0 || rgba[2] != 0 || rgba[3] != 255 ||
+		rgba[20] != 200 || rgba[21] != 1 || rgba[22] != 2)
+	{
+		std::cout << "BGRA to RGBA conversion is wrong\n";
+		return false;
+	}
+
+	const std::string path = Resource::ImageCapture::GetFramePath("CaptureTest_", 42);
+	if (path != "CaptureTest_000042.png")
+	{
+		std::cout << "Unexpected capture path " << path << "\n";
+		return false;
+	}
+	if (!Resource::ImageCapture::WritePng(path, bgra.data(), rowPitch, res))
+	{
+		std::cout << "Could not write " << path << "\n";
+		return false;
+	}
+	std::ifstream file(path, std::ios_base::binary);
+	std::string header(24, '\0');
+	file.read(header.data(), header.size());
+	const bool complete = file.gcount() == (std::streamsize)(header.size());
+	file.close();
+	std::remove(path.c_str());
+	// Signature, then the IHDR chunk with the big endian size
+	if (!complete || header.compare(0, 8, "\x89PNG\r\n\x1a\n") != 0 || header.compare(12, 4, "IHDR") != 0 ||
+		header[19] != res.x || header[23] != res.y)
+	{
+		std::cout << "Unexpected PNG header\n";
+		return false;
+	}
+	return true;
+}
+
+// Every triangle as its three vertices, starting from the smallest so the winding is kept, sorted
+std::vector<std::array<f32, 33>> GetTriangleKeys(const std::vector<Resource::Vertex> &vertices, const std::vector<u32> &indices)
+{
+	std::vector<std::array<f32, 33>> result;
+	for (u32 t = 0; t + 2 < indices.size(); t += 3)
+	{
+		std::array<std::array<f32, 11>, 3> corners;
+		for (u32 j = 0; j < 3; j++)
+		{
+			const Resource::Vertex &v = vertices[indices[t + j]];
+			corners[j] = { v.pos.x, v.pos.y, v.pos.z, v.uv.x, v.uv.y, v.col.x, v.col.y, v.col.z, v.norm.x, v.norm.y, v.norm.z };
+		}
+		const u32 first = (u32)(std::min_element(corners.begin(), corners.end()) - corners.begin());
+		std::array<f32, 33> key;
+		for (u32 j = 0; j < 3; j++)
+			std::copy(corners[(first + j) % 3].begin(), corners[(first + j) % 3].end(), key.begin() + j * 11);
+		result.push_back(key);
+	}
+	std::sort(result.begin(), result.end());
+	return result;
+}
+
+bool RunMeshTest()
+{
+	Resource::Mesh cube;
+	cube.CreateDefaultCube();
+	if (cube.GetVertices().size() != 24 || cube.GetIndices().size() != 36 || cube.GetCacheMissRatio(Resource::MESH_VERTEX_CACHE_SIZE) > 2.0f)
+	{
+		std::cout << "Default cube has " << cube.GetVertices().size() << " vertices for " << cube.GetIndices().size() << " indices, cache miss ratio " << cube.GetCacheMissRatio(Resource::MESH_VERTEX_CACHE_SIZE) << "\n";
+		return false;
+	}
+
+	// Grid of quads with shuffled triangles and duplicated vertices, the worst case for the cache
+	const u32 side = 32;
+	std::vector<Resource::Vertex> gridVertices;
+	std::vector<u32> gridIndices;
+	std::vector<u32> quads(side * side);
+	for (u32 i = 0; i < quads.size(); i++)
+		quads[i] = (i * 7919) % (u32)(quads.size());
+	for (u32 quad : quads)
+	{
+		const u32 x = quad % side;
+		const u32 y = quad / side;
+		const u32 corners[] = { 0, 1, 3, 0, 3, 2 };
+		for (u32 corner : corners)
+		{
+			const Maths::Vec3 pos((f32)(x + (corner & 1)), (f32)(y + (corner >> 1)), 0.0f);
+			gridIndices.push_back((u32)(gridVertices.size()));
+			gridVertices.push_back(Resource::Vertex(pos, Maths::Vec2(pos.x, pos.y) / (f32)(side), Maths::Vec3(1.0f), Maths::Vec3(0, 0, 1)));
+		}
+	}
+	Resource::Mesh grid;
+	grid.CreateFromTriangles(gridVertices, gridIndices);
+	const f32 missRatio = grid.GetCacheMissRatio(Resource::MESH_VERTEX_CACHE_SIZE);
+	if (grid.GetVertices().size() != (side + 1) * (side + 1) || GetTriangleKeys(grid.GetVertices(), grid.GetIndices()) != GetTriangleKeys(gridVertices, gridIndices))
+	{
+		std::cout << "Optimized grid does not hold the same triangles\n";
+		return false;
+	}
+	// 0.53 would load every vertex once
+	if (!(missRatio < 0.8f))
+	{
+		std::cout << "Optimized grid misses the vertex cache " << missRatio << " times per triangle\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunVertexLayoutTest()
+{
+	using namespace Resource::VertexLayouts;
+	// Rounding to even, the largest half, overflow and the smallest subnormal
+	if (EncodeHalf(1.0f) != 0x3c00 || EncodeHalf(-2.0f) != 0xc000 || EncodeHalf(1.0f + 1.0f / 2048) != 0x3c00 || EncodeHalf(1.0f + 3.0f / 2048) != 0x3c02 ||
+		EncodeHalf(65504.0f) != 0x7bff || EncodeHalf(65520.0f) != 0x7c00 || EncodeHalf(1.0f / 16777216) != 0x0001 || DecodeHalf(0x3555) != 0.333251953125f)
+	{
+		std::cout << "Half conversion does not round like the GPU formats\n";
+		return false;
+	}
+
+	const Resource::VertexLayout packed = Resource::VertexLayout::Packed();
+	if (packed.stride != 16 || Resource::VertexLayout::Full().stride != sizeof(Resource::Vertex) || !packed.IsValid() ||
+		Resource::VertexLayout::Create(Resource::VertexFormat::Float16x4, Resource::VertexFormat::Octahedral16x2, Resource::VertexFormat::None, Resource::VertexFormat::None).IsValid())
+	{
+		std::cout << "Unexpected vertex layouts, packed stride " << packed.stride << "\n";
+		return false;
+	}
+
+	Resource::Mesh cube;
+	cube.CreateDefaultCube();
+	cube.SetLayout(packed);
+	const auto &vertices = cube.GetVertices();
+	if (cube.GetVertexData().size() != vertices.size() * packed.stride)
+	{
+		std::cout << "Packed cube holds " << cube.GetVertexData().size() << " bytes\n";
+		return false;
+	}
+	f32 positionError = 0;
+	f32 uvError = 0;
+	f32 normalError = 0;
+	for (u32 i = 0; i < vertices.size(); i++)
+	{
+		const Resource::Vertex decoded = Decode(packed, &cube.GetVertexData()[i * packed.stride]);
+		positionError = std::max(positionError, (decoded.pos - vertices[i].pos).Length());
+		uvError = std::max(uvError, std::max(std::abs(decoded.uv.x - vertices[i].uv.x), std::abs(decoded.uv.y - vertices[i].uv.y)));
+		normalError = std::max(normalError, (decoded.norm - vertices[i].norm).Length());
+	}
+
+	// Every direction, the folded lower half included, must come back close
+	std::vector<f32> randoms(1000 * Maths::Philox::BLOCK_WORDS);
+	Maths::Philox(1234).GenerateFloats01(0, 1000, randoms.data());
+	for (u32 i = 0; i < 1000; i++)
+	{
+		const f32 *r = &randoms[i * Maths::Philox::BLOCK_WORDS];
+		const Maths::Vec3 direction = Maths::Vec3(r[0] * 2 - 1, r[1] * 2 - 1, r[2] * 2 - 1).Normalize();
+		const Maths::Vec2 folded = EncodeOctahedral(direction);
+		const Maths::Vec2 quantized = Maths::Vec2(std::round(folded.x * 32767.0f), std::round(folded.y * 32767.0f)) / 32767.0f;
+		normalError = std::max(normalError, (DecodeOctahedral(quantized) - direction).Length());
+	}
+	// Half of an fp16 step at 1, of a unorm16 step, and the snorm16 octahedron
+	if (!(positionError <= 1.0f / 2048) || !(uvError <= 0.5f / 65535) || !(normalError < 1e-4f))
+	{
+		std::cout << "Packed vertices are off by " << positionError << " in position, " << uvError << " in UV and " << normalError << " in normal\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunTextureCacheTest()
+{
+	using namespace Resource::TextureProcessing;
+	if (GetMipCount(Maths::IVec2(32, 32)) != 6 || GetMipCount(Maths::IVec2(5, 3)) != 3)
+	{
+		std::cout << "Unexpected mip counts\n";
+		return false;
+	}
+
+	// Black and white average to half the light, not to half the sRGB value
+	std::vector<u8> checker(8 * 8 * 4, 255);
+	for (u32 i = 0; i < 64; i++)
+		memset(&checker[i * 4], ((i & 1) ^ ((i >> 3) & 1)) ? 255 : 0, 3);
+	std::vector<std::vector<u8>> mips;
+	BuildMipChain(checker.data(), Maths::IVec2(8, 8), mips);
+	if (mips.size() != 4 || mips[1].size() != 4 * 4 * 4 || mips[1][0] != 188 || mips[3].size() != 4 || mips[3][0] != 188 || mips[3][3] != 255)
+	{
+		std::cout << "Mip chain is not filtered in linear space\n";
+		return false;
+	}
+
+	// Smooth gradient, the usual content of a block. 565 endpoints alone cost about 2.4 on red.
+	const u32 size = 16;
+	std::vector<u8> gradient(size * size * 4);
+	for (u32 y = 0; y < size; y++)
+	{
+		for (u32 x = 0; x < size; x++)
+		{
+			u8 *pixel = &gradient[(y * size + x) * 4];
+			pixel[0] = (u8)(x * 16);
+			pixel[1] = (u8)(128 + y * 4);
+			pixel[2] = (u8)(255 - x * 8);
+			pixel[3] = 255;
+		}
+	}
+	std::vector<u8> blocks;
+	std::vector<u8> decoded;
+	CompressBc1(gradient.data(), size, size, blocks);
+	DecompressBc1(blocks.data(), size, size, decoded);
+	f64 squaredError = 0;
+	for (u32 i = 0; i < gradient.size(); i++)
+		squaredError += (f64)((s32)(decoded[i]) - gradient[i]) * ((s32)(decoded[i]) - gradient[i]);
+	const f64 rmse = sqrt(squaredError / (size * size * 3));
+	if (blocks.size() != 16 * 8 || !(rmse < 4.0))
+	{
+		std::cout << "BC1 gradient error is " << rmse << "\n";
+		return false;
+	}
+
+	// The first load builds the cache, the next one maps it, a changed source rebuilds it
+	const std::string sourcePath = "TextureCacheTest.png";
+	const std::string cachePath = Resource::TextureCache::GetCachePath(sourcePath, Resource::TextureFormat::Bc1Srgb);
+	std::vector<u8> bgra(gradient);
+	for (u32 i = 0; i < size * size; i++)
+		std::swap(bgra[i * 4], bgra[i * 4 + 2]);
+	std::string error;
+	Resource::TextureCache cache;
+	bool success = Resource::ImageCapture::WritePng(sourcePath, bgra.data(), size * 4, Maths::IVec2(size, size)) &&
+		cache.Load(sourcePath, Resource::TextureFormat::Bc1Srgb, error) && cache.WasRebuilt();
+	if (success)
+	{
+		const Resource::TextureCacheHeader &header = cache.GetHeader();
+		success = header.mipCount == 5 && header.mips[4].width == 1 && header.mips[0].size == blocks.size() &&
+			memcmp(cache.GetData() + header.mips[0].offset, blocks.data(), blocks.size()) == 0;
+
+		// Aligned offsets near 2^64 wrap their sums back into the file
+		const u64 fileSize = header.dataOffset + header.dataSize;
+		const u64 wrapOffset = ~(u64)(Resource::TEXTURE_CACHE_ALIGNMENT - 1);
+		Resource::TextureCacheHeader broken = header;
+		broken.mips[1].offset = wrapOffset;
+		Resource::TextureCacheHeader brokenData = header;
+		brokenData.dataOffset = wrapOffset;
+		std::string validateError;
+		if (success && (Resource::TextureCache::Validate(broken, fileSize, Resource::TextureFormat::Bc1Srgb, validateError) ||
+			Resource::TextureCache::Validate(brokenData, fileSize, Resource::TextureFormat::Bc1Srgb, validateError)))
+		{
+			std::cout << "Texture cache validation accepted a mip outside the file\n";
+			success = false;
+		}
+	}
+	success = success && cache.Load(sourcePath, Resource::TextureFormat::Bc1Srgb, error) && !cache.WasRebuilt();
+	cache.Close();
+	bgra[0] ^= 0xff;
+	success = success && Resource::ImageCapture::WritePng(sourcePath, bgra.data(), size * 4, Maths::IVec2(size, size)) &&
+		cache.Load(sourcePath, Resource::TextureFormat::Bc1Srgb, error) && cache.WasRebuilt();
+	cache.Close();
+	std::remove(sourcePath.c_str());
+	std::remove(cachePath.c_str());
+	if (!success)
+	{
+		std::cout << "Texture cache was not built, reused and rebuilt as expected " << error << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunAssetPackTest()
+{
+	// A texture cache encoded in memory comes back through a span of the mapped pack
+	const u32 size = 8;
+	std::vector<u8> bgra(size * size * 4, 255);
+	for (u32 i = 0; i < size * size; i++)
+		bgra[i * 4 + 1] = (u8)(i * 4);
+	const std::string imagePath = "AssetPackTest.png";
+	const std::string packPath = "AssetPackTest.pack";
+	std::vector<Resource::AssetPackSource> sources(3);
+	sources[0].name = "Shaders/b.spv";
+	sources[0].data.assign(12, 0x23);
+	sources[1].name = "Shaders/a.spv";
+	sources[1].data.assign(100, 0x07);
+	sources[2].name = "Textures/c.png.rgba8.texcache";
+	std::string error;
+	bool success = Resource::ImageCapture::WritePng(imagePath, bgra.data(), size * 4, Maths::IVec2(size, size));
+	if (success)
+	{
+		Core::MappedFile image;
+		success = image.Open(imagePath) &&
+			Resource::TextureCache::Encode(image.GetData(), image.GetSize(), Resource::TextureFormat::Rgba8Srgb, sources[2].data, error);
+	}
+	std::remove(imagePath.c_str());
+	success = success && Resource::AssetPack::Write(packPath, sources, error);
+
+	Resource::AssetPack pack;
+	success = success && pack.Open(packPath, error) && pack.Verify(error);
+	if (success)
+	{
+		const Resource::AssetSpan first = pack.Find("Shaders/a.spv");
+		const Resource::AssetSpan second = pack.Find("Shaders/b.spv");
+		const Resource::AssetSpan texture = pack.Find("Textures/c.png.rgba8.texcache");
+		Resource::TextureCache cache;
+		success = pack.GetHeader().entryCount == 3 && !pack.Find("Shaders/c.spv").data && !pack.Find("").data &&
+			std::string(pack.GetEntries()[0].name) == "Shaders/a.spv" && first.size == 100 && first.data[99] == 0x07 &&
+			second.size == 12 && second.data[0] == 0x23 && ((uintptr_t)(second.data) % Resource::ASSET_PACK_ALIGNMENT) == 0 &&
+			cache.LoadFromMemory(texture.data, texture.size, Resource::TextureFormat::Rgba8Srgb, error) &&
+			cache.GetHeader().mipCount == 4 && cache.GetData()[1] == 0 && cache.GetData()[4 * 4 + 1] == 16 &&
+			!cache.LoadFromMemory(texture.data, texture.size, Resource::TextureFormat::Bc1Srgb, error);
+	}
+	pack.Close();
+	if (!success)
+	{
+		std::remove(packPath.c_str());
+		std::cout << "Asset pack did not hand back its assets " << error << "\n";
+		return false;
+	}
+
+	// An entry past the data and an index offset that wraps are rejected by Open
+	{
+		std::fstream file(packPath, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		Resource::AssetPackEntry entry;
+		file.seekg((std::streamoff)(Resource::ASSET_PACK_ALIGNMENT));
+		file.read((char *)(&entry), sizeof(entry));
+		entry.offset = ~(u64)(Resource::ASSET_PACK_ALIGNMENT - 1);
+		file.seekp((std::streamoff)(Resource::ASSET_PACK_ALIGNMENT));
+		file.write((const char *)(&entry), sizeof(entry));
+	}
+	success = !pack.Open(packPath, error);
+	{
+		std::fstream file(packPath, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		Resource::AssetPackHeader packHeader;
+		file.read((char *)(&packHeader), sizeof(packHeader));
+		packHeader.indexOffset = ~(u64)(Resource::ASSET_PACK_ALIGNMENT - 1);
+		file.seekp(0);
+		file.write((const char *)(&packHeader), sizeof(packHeader));
+	}
+	success = success && !pack.Open(packPath, error);
+	success = success && Resource::AssetPack::Write(packPath, sources, error);
+	if (!success)
+	{
+		std::remove(packPath.c_str());
+		std::cout << "Asset pack with a corrupt index was opened\n";
+		return false;
+	}
+
+	// A flipped byte is caught by Verify, a cut file by Open
+	const u64 corruptOffset = Resource::ASSET_PACK_ALIGNMENT + 3 * sizeof(Resource::AssetPackEntry) + Resource::ASSET_PACK_ALIGNMENT;
+	{
+		std::fstream file(packPath, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		file.seekp((std::streamoff)(corruptOffset));
+		file.put((char)(0x42));
+	}
+	success = pack.Open(packPath, error) && !pack.Verify(error);
+	pack.Close();
+	std::filesystem::resize_file(packPath, corruptOffset);
+	success = success && !pack.Open(packPath, error);
+	std::remove(packPath.c_str());
+	if (!success)
+	{
+		std::cout << "Corrupt asset pack was not rejected\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunPipelineCacheTest()
+{
+	// Blob shaped like a driver's, VkPipelineCacheHeaderVersionOne then opaque data
+	Resource::PipelineCacheDevice device;
+	device.vendorId = 0x10de;
+	device.deviceId = 0x2684;
+	device.driverVersion = 0x88a30000;
+	for (u32 i = 0; i < Resource::PIPELINE_CACHE_UUID_SIZE; i++)
+		device.cacheUuid[i] = (u8)(i * 17 + 3);
+	std::vector<u8> blob(200, 0x5a);
+	const u32 fields[4] = { Resource::PIPELINE_CACHE_VULKAN_HEADER_SIZE, 1, device.vendorId, device.deviceId };
+	memcpy(blob.data(), fields, sizeof(fields));
+	memcpy(blob.data() + 16, device.cacheUuid, Resource::PIPELINE_CACHE_UUID_SIZE);
+
+	const std::string path = "PipelineCacheTest.bin";
+	std::string error;
+	Resource::PipelineCacheFile file;
+	bool success = Resource::PipelineCacheFile::Write(path, device, blob.data(), blob.size(), error) &&
+		file.Open(path, device, error) && file.GetDataSize() == blob.size() && memcmp(file.GetData(), blob.data(), blob.size()) == 0;
+	file.Close();
+	if (!success)
+	{
+		std::remove(path.c_str());
+		std::cout << "Pipeline cache did not round trip " << error << "\n";
+		return false;
+	}
+
+	// A driver update, a blob from another GPU and a flipped byte all start cold
+	Resource::PipelineCacheDevice updated = device;
+	updated.driverVersion++;
+	success = !file.Open(path, updated, error);
+	blob[20] ^= 1;
+	success = success && Resource::PipelineCacheFile::Write(path, device, blob.data(), blob.size(), error) && !file.Open(path, device, error);
+	blob[20] ^= 1;
+	success = success && Resource::PipelineCacheFile::Write(path, device, blob.data(), blob.size(), error);
+	{
+		std::fstream stream(path, std::ios_base::binary | std::ios_base::in | std::ios_base::out);
+		stream.seekp((std::streamoff)(Resource::PIPELINE_CACHE_ALIGNMENT + 100));
+		stream.put((char)(0x00));
+	}
+	success = success && !file.Open(path, device, error);
+	std::remove(path.c_str());
+	success = success && !file.Open(path, device, error);
+	if (!success)
+	{
+		std::cout << "Pipeline cache from another device or with corrupt data was accepted\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunSnapshotTest(const Simulation::BoidSim &sim)
+{
+	std::vector<Maths::Vec4> objects;
+	sim.WriteObjects(objects);
+	const std::string path = Simulation::Snapshot::GetPath("SnapshotTest_", 60);
+	if (path != "SnapshotTest_00000060.boids")
+	{
+		std::cout << "Unexpected snapshot path " << path << "\n";
+		return false;
+	}
+	std::string error;
+	if (!Simulation::Snapshot::Write(path, sim.GetParams(), 60, objects.data(), error))
+	{
+		std::cout << "Snapshot write failed: " << error << "\n";
+		return false;
+	}
+
+	Simulation::Snapshot snapshot;
+	if (!snapshot.Open(path, error))
+	{
+		std::cout << "Snapshot open failed: " << error << "\n";
+		std::remove(path.c_str());
+		return false;
+	}
+	const Simulation::SnapshotHeader header = snapshot.GetHeader();
+	const Simulation::SimParams params = snapshot.GetParams();
+	bool success = header.tick == 60 && header.objectsOffset % Simulation::SNAPSHOT_ALIGNMENT == 0 &&
+		params.objectCount == sim.GetObjectCount() && params.chunkCountSide == sim.GetParams().chunkCountSide && params.worldSize == sim.GetParams().worldSize &&
+		memcmp(snapshot.GetObjects(), objects.data(), (size_t)(header.objectsSize)) == 0;
+	if (!success)
+		std::cout << "Snapshot does not hold the saved state\n";
+
+	// A restored state must carry on exactly like the one it was saved from
+	Simulation::BoidSim restored;
+	Simulation::BoidSim original;
+	restored.LoadObjects(params, reinterpret_cast<const Maths::Vec4 *>(snapshot.GetObjects()), header.objectCount);
+	original.LoadObjects(sim.GetParams(), objects);
+	snapshot.Close();
+	std::remove(path.c_str());
+	for (u32 i = 0; success && i < 10; i++)
+	{
+		restored.Step(launchArgs.deltaTime);
+		original.Step(launchArgs.deltaTime);
+	}
+	if (success && restored.GetPositions() != original.GetPositions())
+	{
+		std::cout << "Restored snapshot diverged from the saved state\n";
+		success = false;
+	}
+
+	// Truncated files and other versions must be rejected before anything is copied
+	Simulation::SnapshotHeader broken = header;
+	if (success && Simulation::Snapshot::Validate(broken, header.objectsOffset + header.objectsSize - 1, error))
+	{
+		std::cout << "Snapshot validation accepted a truncated file\n";
+		success = false;
+	}
+	broken.version = Simulation::SNAPSHOT_VERSION + 1;
+	if (success && Simulation::Snapshot::Validate(broken, header.objectsOffset + header.objectsSize, error))
+	{
+		std::cout << "Snapshot validation accepted version " << broken.version << "\n";
+		success = false;
+	}
+	// An aligned offset near 2^64 wraps the end of the objects back into the file
+	broken = header;
+	broken.objectsOffset = ~(u64)(Simulation::SNAPSHOT_ALIGNMENT - 1);
+	if (success && Simulation::Snapshot::Validate(broken, header.objectsOffset + header.objectsSize, error))
+	{
+		std::cout << "Snapshot validation accepted an object array past the end of the file\n";
+		success = false;
+	}
+	broken = header;
+	broken.distMin = broken.distMax * 2.0f;
+	Simulation::SnapshotHeader noSpeed = header;
+	noSpeed.maxSpeed = 0.0f;
+	Simulation::SnapshotHeader nanWorld = header;
+	nanWorld.worldSize = NAN;
+	// 1626^3 cells wraps u32 back to a small grid
+	Simulation::SnapshotHeader hugeGrid = header;
+	hugeGrid.chunkCountSide = 1626;
+	if (success && (Simulation::Snapshot::Validate(broken, header.objectsOffset + header.objectsSize, error) ||
+		Simulation::Snapshot::Validate(noSpeed, header.objectsOffset + header.objectsSize, error) ||
+		Simulation::Snapshot::Validate(nanWorld, header.objectsOffset + header.objectsSize, error) ||
+		Simulation::Snapshot::Validate(hugeGrid, header.objectsOffset + header.objectsSize, error)))
+	{
+		std::cout << "Snapshot validation accepted out of range parameters\n";
+		success = false;
+	}
+	return success;
+}
+
+bool RunRenderInstanceTest(const Simulation::BoidSim &sim)
+{
+	// Same bits as GLSL packSnorm2x16, low half first
+	if (Simulation::RenderInstances::PackSnorm2x16(-1.0f, 1.0f) != 0x7fff8001u || Simulation::RenderInstances::PackSnorm2x16(0.0f, -2.0f) != 0x80010000u)
+	{
+		std::cout << "PackSnorm2x16 does not match the GLSL rounding\n";
+		return false;
+	}
+
+	std::vector<Maths::Vec4> objects;
+	sim.WriteObjects(objects);
+	std::vector<Simulation::RenderInstance> instances(sim.GetObjectCount());
+	Simulation::RenderInstances::Pack(objects.data(), sim.GetObjectCount(), instances.data());
+	f32 maxError = 0;
+	for (u32 i = 0; i < sim.GetObjectCount(); i++)
+	{
+		const Maths::Vec4 &position = objects[i * 4];
+		const Simulation::RenderInstance &instance = instances[i];
+		if (instance.position[0] != position.x || instance.position[1] != position.y || instance.position[2] != position.z)
+		{
+			std::cout << "Render instance " << i << " moved from " << position.toString() << "\n";
+			return false;
+		}
+		const Maths::Quat rotation = sim.GetRotations()[i].Normalize();
+		const Maths::Quat packed = Simulation::RenderInstances::GetRotation(instance);
+		for (u32 j = 0; j < 3; j++)
+			maxError = std::max(maxError, std::abs(packed.v[j] - rotation.v[j]));
+		maxError = std::max(maxError, std::abs(packed.a - rotation.a));
+	}
+	// Half a snorm16 step from the rounding, plus the renormalization
+	if (!(maxError <= 1.5f / 32767.0f))
+	{
+		std::cout << "Render instance rotations are off by " << maxError << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool RunTrajectoryTest()
+{
+	// Wrapping differences must survive the varint coding, in keyframes and in deltas
+	const u16 previous[] = { 0, 65535, 100, 32768, 7 };
+	const u16 values[] = { 65535, 0, 100, 0, 40000 };
+	std::vector<u8> payload;
+	u16 decoded[5] = {};
+	Simulation::Trajectory::EncodeFrame(values, previous, 5, payload);
+	if (payload.size() != 1 + 1 + 1 + 3 + 3 || !Simulation::Trajectory::DecodeFrame(payload.data(), (u32)(payload.size()), previous, 5, decoded) || memcmp(decoded, values, sizeof(values)) != 0)
+	{
+		std::cout << "Trajectory delta coding is wrong\n";
+		return false;
+	}
+	Simulation::Trajectory::EncodeFrame(values, nullptr, 5, payload);
+	if (!Simulation::Trajectory::DecodeFrame(payload.data(), (u32)(payload.size()), nullptr, 5, decoded) || memcmp(decoded, values, sizeof(values)) != 0 ||
+		Simulation::Trajectory::DecodeFrame(payload.data(), (u32)(payload.size()) - 1, nullptr, 5, decoded))
+	{
+		std::cout << "Trajectory keyframe coding is wrong\n";
+		return false;
+	}
+
+	Simulation::SimParams params;
+	params.objectCount = 1000;
+	Simulation::BoidSim sim;
+	sim.Init(params, 1234);
+	const std::string path = "TrajectoryTest.boidtraj";
+	Simulation::TrajectoryRecorder recorder;
+	// Large enough for every frame, nothing may be dropped
+	if (!recorder.Start(path, sim.GetParams(), 3, 16))
+	{
+		std::cout << "Could not create " << path << "\n";
+		return false;
+	}
+	std::vector<std::vector<Maths::Vec3>> expectedPositions;
+	std::vector<std::vector<Maths::Quat>> expectedRotations;
+	for (u64 tick = 1; tick <= 30; tick++)
+	{
+		sim.Step(launchArgs.deltaTime);
+		if (!recorder.ShouldRecord(tick))
+			continue;
+		recorder.Submit(tick, sim.GetPositions(), sim.GetRotations());
+		expectedPositions.push_back(sim.GetPositions());
+		expectedRotations.push_back(sim.GetRotations());
+	}
+	recorder.Stop();
+	const Simulation::TrajectoryStats stats = recorder.GetStats();
+	if (stats.recordedFrames != 10 || stats.droppedFrames != 0 || stats.writtenBytes >= stats.rawBytes)
+	{
+		std::cout << "Unexpected trajectory stats: " << Simulation::Trajectory::FormatStats(stats) << "\n";
+		std::remove(path.c_str());
+		return false;
+	}
+
+	Simulation::TrajectoryReader reader;
+	std::string error;
+	bool success = reader.Open(path, error) && reader.GetHeader().frameCount == 10;
+	u64 tick = 0;
+	std::vector<u16> frame;
+	const f32 worldSize = sim.GetParams().worldSize;
+	for (u32 f = 0; success && f < 10; f++)
+	{
+		success = reader.ReadFrame(tick, frame) && tick == (f + 1) * 3;
+		for (u32 i = 0; success && i < sim.GetObjectCount(); i++)
+		{
+			const u16 *v = &frame[i * Simulation::TRAJECTORY_COMPONENTS];
+			const Maths::Vec3 position(Simulation::Trajectory::DequantizePosition(v[0], worldSize), Simulation::Trajectory::DequantizePosition(v[1], worldSize), Simulation::Trajectory::DequantizePosition(v[2], worldSize));
+			const Maths::Quat &rotation = expectedRotations[f][i];
+			success = (position - expectedPositions[f][i]).Length() <= worldSize / 65535.0f &&
+				Maths::Util::Abs(Simulation::Trajectory::DequantizeSnorm(v[6]) - rotation.a) <= 1.0f / 32767.0f;
+		}
+	}
+	success = success && !reader.ReadFrame(tick, frame);
+	if (!success)
+		std::cout << "Trajectory does not hold the recorded frames " << error << "\n";
+
+	// A queue of one frame drops, but every submitted frame must be accounted for
+	if (success && recorder.Start(path, sim.GetParams(), 1, 1))
+	{
+		for (u64 t = 1; t <= 50; t++)
+			recorder.Submit(t, sim.GetPositions(), sim.GetRotations());
+		recorder.Stop();
+		const Simulation::TrajectoryStats dropStats = recorder.GetStats();
+		if (dropStats.submittedFrames != 50 || dropStats.recordedFrames + dropStats.droppedFrames != 50)
+		{
+			std::cout << "Trajectory frames went missing: " << Simulation::Trajectory::FormatStats(dropStats) << "\n";
+			success = false;
+		}
+	}
+	std::remove(path.c_str());
+	return success;
+}
+
+bool RunGenerateTest(Core::JobSystem &jobSystem, const Simulation::SimParams &params, const std::vector<Maths::Vec4> &singleThreaded)
+{
+	// The initial state must be bit-identical whatever the thread count
+	std::vector<Maths::Vec4> parallel = Simulation::BoidSim::GenerateObjects(params, 1234, &jobSystem);
+	if (parallel.size() != singleThreaded.size() || memcmp(parallel.data(), singleThreaded.data(), parallel.size() * sizeof(Maths::Vec4)) != 0)
+	{
+		std::cout << "Initial state depends on the thread count\n";
+		return false;
+	}
+	std::vector<Maths::Vec4> other = Simulation::BoidSim::GenerateObjects(params, 1235, &jobSystem);
+	if (memcmp(parallel.data(), other.data(), parallel.size() * sizeof(Maths::Vec4)) == 0)
+	{
+		std::cout << "Two seeds gave the same initial state\n";
+		return false;
+	}
+	for (u32 i = 0; i < params.objectCount; i++)
+	{
+		for (u32 j = 0; j < 3; j++)
+		{
+			if (!(parallel[i * 4][j] >= 0 && parallel[i * 4][j] < params.worldSize))
+			{
+				std::cout << "Boid " << i << " starts outside the world\n";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool RunUnitTest(Core::JobSystem &jobSystem)
+{
+	if (!RunTimestepTest() || !RunPassTimingsTest() || !RunHistogramTest() || !RunTraceTest() || !RunImageCaptureTest() || !RunMeshTest() || !RunVertexLayoutTest() || !RunTextureCacheTest() || !RunAssetPackTest() || !RunPipelineCacheTest() || !RunTrajectoryTest())
+		return false;
+
+	Simulation::SimParams params;
+	params.objectCount = 4096;
+	const u32 ticks = 60;
+
+	// simA runs on the job system and simB single threaded, results must not depend on scheduling
+	Simulation::BoidSim simA;
+	Simulation::BoidSim simB;
+	simA.SetJobSystem(&jobSystem);
+	simA.Init(params, 1234);
+	simB.Init(params, 1234);
+	for (u32 i = 0; i < ticks; i++)
+	{
+		simA.Step(launchArgs.deltaTime);
+		simB.Step(launchArgs.deltaTime);
+	}
+
+	const auto &posA = simA.GetPositions();
+	const auto &posB = simB.GetPositions();
+	const auto &vel = simA.GetVelocities();
+	const f32 size = simA.GetParams().worldSize;
+	for (u32 i = 0; i < simA.GetObjectCount(); i++)
+	{
+		if (posA[i] != posB[i])
+		{
+			std::cout << "Boid " << i << " diverged between two runs with the same seed\n";
+			return false;
+		}
+		for (u32 j = 0; j < 3; j++)
+		{
+			if (!(posA[i][j] >= 0 && posA[i][j] <= size))
+			{
+				std::cout << "Boid " << i << " left the world: " << posA[i].ToString() << "\n";
+				return false;
+			}
+		}
+		if (!(vel[i].Length() <= params.maxSpeed * 1.001f))
+		{
+			std::cout << "Boid " << i << " exceeds max speed: " << vel[i].ToString() << "\n";
+			return false;
+		}
+	}
+
+	if (!RunBinningTest(simA) || !RunSnapshotTest(simA) || !RunRenderInstanceTest(simA))
+		return false;
+
+	// Default sized world, straight from the initial distribution
+	Simulation::SimParams defaultParams;
+	std::vector<Maths::Vec4> defaultObjects = Simulation::BoidSim::GenerateObjects(defaultParams, 1234);
+	if (!RunGenerateTest(jobSystem, defaultParams, defaultObjects))
+		return false;
+	std::cout << "Fixed capacity sort0/sort1 would have kept " << Simulation::GpuBinning::CountLegacyBinned(defaultObjects, defaultParams) << " of " << defaultParams.objectCount << " boids\n";
+
+	// Sizes are runtime parameters, uneven ones must bin and stay in the world as well
+	Simulation::SimParams oddParams;
+	oddParams.objectCount = 1000;
+	oddParams.chunkCountSide = 7;
+	oddParams.worldSize = 200.0f;
+	Simulation::BoidSim oddSim;
+	oddSim.Init(oddParams, 1234);
+	for (u32 i = 0; i < ticks; i++)
+		oddSim.Step(launchArgs.deltaTime);
+	for (const Maths::Vec3 &pos : oddSim.GetPositions())
+	{
+		for (u32 j = 0; j < 3; j++)
+		{
+			if (!(pos[j] >= 0 && pos[j] <= oddParams.worldSize))
+			{
+				std::cout << "Boid left a world of size " << oddParams.worldSize << ": " << pos.ToString() << "\n";
+				return false;
+			}
+		}
+	}
+	if (!RunBinningTest(oddSim))
+		return false;
+
+	// The grid side is capped so side^3 and the binning offsets cannot wrap
+	Simulation::SimParams hugeParams;
+	hugeParams.chunkCountSide = 1626;
+	if (Simulation::BoidSim::ClampParams(hugeParams).chunkCountSide != Simulation::MAX_CHUNK_COUNT_SIDE)
+	{
+		std::cout << "Grid side " << hugeParams.chunkCountSide << " was not clamped\n";
+		return false;
+	}
+
+	// Reading neighbours from the cell ordered copy must not change a single bit
+	Simulation::BoidSim simC;
+	params.reorderByCell = false;
+	simC.Init(params, 1234);
+	params.reorderByCell = true;
+	for (u32 i = 0; i < ticks; i++)
+		simC.Step(launchArgs.deltaTime);
+	if (simC.GetPositions() != posB)
+	{
+		std::cout << "Reordering boids by cell changed the result\n";
+		return false;
+	}
+
+	// Every kernel only changes the summation order, so it must stay close to the scalar one
+	Simulation::BoidSim reference;
+	reference.Init(params, 1234);
+	reference.SetKernel(Simulation::BoidKernel::Scalar);
+	reference.Step(launchArgs.deltaTime);
+	for (u32 k = 0; k < (u32)(Simulation::BoidKernel::Count); k++)
+	{
+		Simulation::BoidSim sim;
+		sim.Init(params, 1234);
+		if (!sim.SetKernel((Simulation::BoidKernel)(k)))
+			continue;
+		sim.Step(launchArgs.deltaTime);
+		const auto &velRef = reference.GetVelocities();
+		const auto &velSim = sim.GetVelocities();
+		for (u32 i = 0; i < sim.GetObjectCount(); i++)
+		{
+			if ((velRef[i] - velSim[i]).Length() > params.maxSpeed * 1e-4f)
+			{
+				std::cout << "Kernel " << Simulation::GetBoidKernelName(sim.GetKernel()) << " differs from scalar on boid " << i << ": " << velSim[i].ToString() << " != " << velRef[i].ToString() << "\n";
+				return false;
+			}
+		}
+		std::cout << "Kernel " << Simulation::GetBoidKernelName(sim.GetKernel()) << " matches scalar\n";
+	}
+	std::cout << "Unit test passed\n";
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	const std::string testText = "--test";
+	const std::string countText = "--count=";
+	const std::string chunksText = "--chunks=";
+	const std::string worldText = "--world=";
+	const std::string ticksText = "--ticks=";
+	const std::string seedText = "--seed=";
+	const std::string dtText = "--dt=";
+	const std::string threadsText = "--threads=";
+	const std::string kernelText = "--kernel=";
+	const std::string traceText = "--trace=";
+	const std::string loadText = "--load=";
+	const std::string saveText = "--save=";
+	const std::string recordText = "--record=";
+	const std::string recordIntervalText = "--record-interval=";
+	for (s32 i = 1; i < argc; i++)
+	{
+		if (testText.compare(argv[i]) == 0)
+		{
+			launchArgs.isUnitTest = true;
+		}
+		else if (countText.compare(0, countText.size(), argv[i], countText.size()) == 0)
+		{
+			launchArgs.params.objectCount = (u32)Maths::Util::MaxI(1, std::stoi(argv[i] + countText.size()));
+		}
+		else if (chunksText.compare(0, chunksText.size(), argv[i], chunksText.size()) == 0)
+		{
+			launchArgs.params.chunkCountSide = (u32)Maths::Util::IClamp(std::stoi(argv[i] + chunksText.size()), Simulation::MIN_CHUNK_COUNT_SIDE, Simulation::MAX_CHUNK_COUNT_SIDE);
+		}
+		else if (worldText.compare(0, worldText.size(), argv[i], worldText.size()) == 0)
+		{
+			launchArgs.params.worldSize = Maths::Util::MaxF(1.0f, std::stof(argv[i] + worldText.size()));
+		}
+		else if (ticksText.compare(0, ticksText.size(), argv[i], ticksText.size()) == 0)
+		{
+			launchArgs.ticks = (u32)Maths::Util::MaxI(1, std::stoi(argv[i] + ticksText.size()));
+		}
+		else if (seedText.compare(0, seedText.size(), argv[i], seedText.size()) == 0)
+		{
+			launchArgs.seed = (u32)std::stoul(argv[i] + seedText.size());
+		}
+		else if (dtText.compare(0, dtText.size(), argv[i], dtText.size()) == 0)
+		{
+			launchArgs.deltaTime = std::stof(argv[i] + dtText.size());
+		}
+		else if (threadsText.compare(0, threadsText.size(), argv[i], threadsText.size()) == 0)
+		{
+			launchArgs.threadCount = (u32)Maths::Util::MaxI(0, std::stoi(argv[i] + threadsText.size()));
+		}
+		else if (kernelText.compare(0, kernelText.size(), argv[i], kernelText.size()) == 0)
+		{
+			for (u32 k = 0; k < (u32)(Simulation::BoidKernel::Count); k++)
+			{
+				if (strcmp(argv[i] + kernelText.size(), Simulation::GetBoidKernelName((Simulation::BoidKernel)(k))) == 0)
+					launchArgs.kernel = (Simulation::BoidKernel)(k);
+			}
+		}
+		else if (traceText.compare(0, traceText.size(), argv[i], traceText.size()) == 0)
+		{
+			launchArgs.tracePath = argv[i] + traceText.size();
+		}
+		else if (loadText.compare(0, loadText.size(), argv[i], loadText.size()) == 0)
+		{
+			launchArgs.loadPath = argv[i] + loadText.size();
+		}
+		else if (saveText.compare(0, saveText.size(), argv[i], saveText.size()) == 0)
+		{
+			launchArgs.savePath = argv[i] + saveText.size();
+		}
+		else if (recordText.compare(0, recordText.size(), argv[i], recordText.size()) == 0)
+		{
+			launchArgs.recordPath = argv[i] + recordText.size();
+		}
+		else if (recordIntervalText.compare(0, recordIntervalText.size(), argv[i], recordIntervalText.size()) == 0)
+		{
+			launchArgs.recordInterval = (u32)Maths::Util::MaxI(1, std::stoi(argv[i] + recordIntervalText.size()));
+		}
+	}
+
+	Core::JobSystem jobSystem;
+	jobSystem.Init(launchArgs.isUnitTest ? Maths::Util::MaxU(launchArgs.threadCount, 4) : launchArgs.threadCount);
+
+	if (launchArgs.isUnitTest)
+		return RunUnitTest(jobSystem) ? 0 : 1;
+
+	Simulation::BoidSim sim;
+	sim.SetJobSystem(&jobSystem);
+	u64 firstTick = 0;
+	auto generateStart = std::chrono::steady_clock::now();
+	if (!launchArgs.loadPath.empty())
+	{
+		Simulation::Snapshot snapshot;
+		std::string error;
+		if (!snapshot.Open(launchArgs.loadPath, error))
+		{
+			std::cout << "Could not load the snapshot: " << error << "\n";
+			return 1;
+		}
+		firstTick = snapshot.GetHeader().tick;
+		sim.LoadObjects(snapshot.GetParams(), reinterpret_cast<const Maths::Vec4 *>(snapshot.GetObjects()), snapshot.GetHeader().objectCount);
+		std::cout << "Loaded " << sim.GetObjectCount() << " boids at tick " << firstTick << " from " << launchArgs.loadPath << " in " << std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - generateStart).count() << " ms\n";
+	}
+	else
+	{
+		sim.Init(launchArgs.params, launchArgs.seed);
+		std::cout << "Generated " << sim.GetObjectCount() << " boids with --seed=" << launchArgs.seed << " in " << std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - generateStart).count() << " ms\n";
+	}
+	if (!sim.SetKernel(launchArgs.kernel))
+		std::cout << "Kernel " << Simulation::GetBoidKernelName(launchArgs.kernel) << " is not supported, using " << Simulation::GetBoidKernelName(sim.GetKernel()) << "\n";
+
+#ifdef ENABLE_TRACE
+	TRACE_THREAD_NAME("Main");
+	if (!launchArgs.tracePath.empty() && !Core::Trace::Start(launchArgs.tracePath))
+		std::cout << "Could not write a trace to " << launchArgs.tracePath << "\n";
+#else
+	if (!launchArgs.tracePath.empty())
+		std::cout << "--trace needs a build with ENABLE_TRACE\n";
+#endif
+
+	Simulation::TrajectoryRecorder recorder;
+	if (!launchArgs.recordPath.empty() && !recorder.Start(launchArgs.recordPath, sim.GetParams(), launchArgs.recordInterval))
+		std::cout << "Could not record to " << launchArgs.recordPath << "\n";
+
+	std::cout << "Simulating " << sim.GetObjectCount() << " boids for " << launchArgs.ticks << " ticks on " << jobSystem.GetThreadCount() << " thread(s) with the " << Simulation::GetBoidKernelName(sim.GetKernel()) << " kernel\n";
+	auto start = std::chrono::steady_clock::now();
+	for (u32 i = 0; i < launchArgs.ticks; i++)
+	{
+		sim.Step(launchArgs.deltaTime);
+		const u64 tick = firstTick + i + 1;
+		if (recorder.ShouldRecord(tick))
+			recorder.Submit(tick, sim.GetPositions(), sim.GetRotations());
+		// Keeps the trace rings from filling up on long runs
+		if (i % 8 == 7)
+			Core::Trace::Flush();
+	}
+	auto end = std::chrono::steady_clock::now();
+	Core::Trace::Stop();
+	if (recorder.IsRecording())
+	{
+		recorder.Stop();
+		std::cout << "Trajectory: " << Simulation::Trajectory::FormatStats(recorder.GetStats()) << "\n";
+	}
+
+	f64 seconds = std::chrono::duration<f64>(end - start).count();
+	std::cout << "Total: " << seconds << " s\n";
+	std::cout << "TPS: " << launchArgs.ticks / seconds << "\n";
+	std::cout << "Boid updates/s: " << (f64)(launchArgs.ticks) * sim.GetObjectCount() / seconds << "\n";
+
+	if (!launchArgs.savePath.empty())
+	{
+		std::vector<Maths::Vec4> objects;
+		sim.WriteObjects(objects);
+		std::string error;
+		auto saveStart = std::chrono::steady_clock::now();
+		if (!Simulation::Snapshot::Write(launchArgs.savePath, sim.GetParams(), firstTick + launchArgs.ticks, objects.data(), error))
+		{
+			std::cout << "Could not save the snapshot: " << error << "\n";
+			return 1;
+		}
+		std::cout << "Saved " << sim.GetObjectCount() << " boids to " << launchArgs.savePath << " in " << std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - saveStart).count() << " ms\n";
+	}
+	return 0;
+}
@@ -0,0 +1,278 @@
+#include <iostream>
+#include <fstream>
+#include <random>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstring>
+#include <cstdio>
+
+#include "Maths/Maths.hpp"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define BENCH_HAS_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC
+#endif
+
+#ifdef _MSC_VER
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+using namespace Maths;
+
+// Times the hot Maths primitives over batches of inputs, once called in place (inlined when the compiler can)
+// and once through a noinline wrapper. Each result is the best of several samples, in ns and TSC cycles per op.
+// TSC cycles tick at a fixed reference rate, they match core cycles only without turbo or frequency scaling.
+
+namespace
+{
+	const u32 BATCH_SIZES[] = { 16, 256, 4096, 65536 };
+	const u32 SAMPLE_COUNT = 5;
+
+	struct BenchArgs
+	{
+		bool quick = false;
+		std::string filter;
+		std::string csvPath;
+	};
+
+	struct BenchResult
+	{
+		std::string primitive;
+		std::string variant;
+		u32 batch = 0;
+		u64 ops = 0;
+		f64 nsPerOp = 0;
+		f64 cyclesPerOp = -1;
+	};
+
+	// Inputs are shared by all primitives, sized for the largest batch
+	struct BenchData
+	{
+		std::vector<Mat4> matA;
+		std::vector<Mat4> matB;
+		std::vector<Mat4> matOut;
+		std::vector<Quat> quatA;
+		std::vector<Quat> quatB;
+		std::vector<Quat> quatOut;
+		std::vector<Vec3> vecA;
+		std::vector<Vec3> vecB;
+		std::vector<f32> alphas;
+	};
+
+	// Outputs are folded in here so no loop can be removed
+	volatile f32 sink = 0;
+
+	u64 ReadCycles()
+	{
+#ifdef BENCH_HAS_TSC
+		return __rdtsc();
+#else
+		return 0;
+#endif
+	}
+
+	namespace NoInline
+	{
+		BENCH_NOINLINE Mat4 MultiplyMat4(const Mat4 &a, const Mat4 &b) { return a * b; }
+		BENCH_NOINLINE Mat4 InverseMat4(const Mat4 &a) { return a.CreateInverseMatrix(); }
+		BENCH_NOINLINE Quat MultiplyQuat(const Quat &a, const Quat &b) { return a * b; }
+		BENCH_NOINLINE Quat FromEuler(const Vec3 &euler) { return Quat::FromEuler(euler); }
+		BENCH_NOINLINE Quat Slerp(const Quat &a, const Quat &b, f32 alpha) { return Quat::Slerp(a, b, alpha); }
+		BENCH_NOINLINE Mat4 ViewMatrix(const Vec3 &position, const Vec3 &focus) { return Mat4::CreateViewMatrix(position, focus, Vec3(0, 1, 0)); }
+	}
+
+	void FillData(BenchData &data, u32 count)
+	{
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<f32> dist(-1.0f, 1.0f);
+		data.matA.resize(count);
+		data.matB.resize(count);
+		data.matOut.resize(count);
+		data.quatA.resize(count);
+		data.quatB.resize(count);
+		data.quatOut.resize(count);
+		data.vecA.resize(count);
+		data.vecB.resize(count);
+		data.alphas.resize(count);
+		for (u32 i = 0; i < count; i++)
+		{
+			// Diagonal dominant so every matrix has an inverse
+			for (u32 j = 0; j < 16; j++)
+			{
+				data.matA[i].content[j] = dist(rng) + (j % 5 == 0 ? 4.0f : 0.0f);
+				data.matB[i].content[j] = dist(rng);
+			}
+			data.quatA[i] = Quat(Vec3(dist(rng), dist(rng), dist(rng)), dist(rng)).Normalize();
+			data.quatB[i] = Quat(Vec3(dist(rng), dist(rng), dist(rng)), dist(rng)).Normalize();
+			data.vecA[i] = Vec3(dist(rng), dist(rng), dist(rng)) * 100.0f;
+			data.vecB[i] = Vec3(dist(rng), dist(rng), dist(rng)) * 100.0f;
+			data.alphas[i] = dist(rng) * 0.5f + 0.5f;
+		}
+	}
+
+	// Repeats the batch until a sample is long enough to time, then keeps the fastest sample
+	BenchResult Measure(const std::string &primitive, const std::string &variant, u32 batch, const BenchArgs &args, const std::function<void(u32)> &body)
+	{
+		using Clock = std::chrono::steady_clock;
+		const f64 minSampleSeconds = args.quick ? 0.0005 : 0.02;
+
+		u32 repeats = 1;
+		while (true)
+		{
+			auto start = Clock::now();
+			for (u32 r = 0; r < repeats; r++)
+				body(batch);
+			const f64 elapsed = std::chrono::duration<f64>(Clock::now() - start).count();
+			if (elapsed >= minSampleSeconds || repeats >= (1u << 30))
+				break;
+			repeats *= 2;
+		}
+
+		BenchResult result;
+		result.primitive = primitive;
+		result.variant = variant;
+		result.batch = batch;
+		result.ops = (u64)(repeats) * batch;
+		result.nsPerOp = 1e300;
+		for (u32 s = 0; s < (args.quick ? 1 : SAMPLE_COUNT); s++)
+		{
+			auto start = Clock::now();
+			const u64 cycleStart = ReadCycles();
+			for (u32 r = 0; r < repeats; r++)
+				body(batch);
+			const u64 cycleEnd = ReadCycles();
+			const f64 ns = std::chrono::duration<f64, std::nano>(Clock::now() - start).count() / result.ops;
+			if (ns < result.nsPerOp)
+			{
+				result.nsPerOp = ns;
+#ifdef BENCH_HAS_TSC
+				result.cyclesPerOp = (f64)(cycleEnd - cycleStart) / result.ops;
+#else
+				(void)(cycleEnd - cycleStart);
+#endif
+			}
+		}
+		return result;
+	}
+
+	// Registers the in place and the noinline version of a primitive
+	struct Primitive
+	{
+		std::string name;
+		std::function<void(u32)> inlined;
+		std::function<void(u32)> called;
+	};
+
+	std::vector<Primitive> CreatePrimitives(BenchData &d)
+	{
+		std::vector<Primitive> list;
+		list.push_back({ "mat4_mul",
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.matOut[i] = d.matA[i] * d.matB[i]; sink = sink + d.matOut[n - 1].content[0]; },
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.matOut[i] = NoInline::MultiplyMat4(d.matA[i], d.matB[i]); sink = sink + d.matOut[n - 1].content[0]; } });
+		list.push_back({ "mat4_inverse",
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.matOut[i] = d.matA[i].CreateInverseMatrix(); sink = sink + d.matOut[n - 1].content[0]; },
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.matOut[i] = NoInline::InverseMat4(d.matA[i]); sink = sink + d.matOut[n - 1].content[0]; } });
+		list.push_back({ "quat_mul",
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.quatOut[i] = d.quatA[i] * d.quatB[i]; sink = sink + d.quatOut[n - 1].a; },
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.quatOut[i] = NoInline::MultiplyQuat(d.quatA[i], d.quatB[i]); sink = sink + d.quatOut[n - 1].a; } });
+		list.push_back({ "quat_from_euler",
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.quatOut[i] = Quat::FromEuler(d.vecA[i]); sink = sink + d.quatOut[n - 1].a; },
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.quatOut[i] = NoInline::FromEuler(d.vecA[i]); sink = sink + d.quatOut[n - 1].a; } });
+		list.push_back({ "quat_slerp",
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.quatOut[i] = Quat::Slerp(d.quatA[i], d.quatB[i], d.alphas[i]); sink = sink + d.quatOut[n - 1].a; },
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.quatOut[i] = NoInline::Slerp(d.quatA[i], d.quatB[i], d.alphas[i]); sink = sink + d.quatOut[n - 1].a; } });
+		list.push_back({ "view_matrix",
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.matOut[i] = Mat4::CreateViewMatrix(d.vecA[i], d.vecB[i], Vec3(0, 1, 0)); sink = sink + d.matOut[n - 1].content[0]; },
+			[&d](u32 n) { for (u32 i = 0; i < n; i++) d.matOut[i] = NoInline::ViewMatrix(d.vecA[i], d.vecB[i]); sink = sink + d.matOut[n - 1].content[0]; } });
+		return list;
+	}
+
+	void PrintResult(const BenchResult &r)
+	{
+		char line[160];
+		snprintf(line, sizeof(line), "%-16s %-9s %6u %10.2f ns/op %10.2f cycles/op %10.2f Mop/s\n",
+			r.primitive.c_str(), r.variant.c_str(), r.batch, r.nsPerOp, r.cyclesPerOp, 1000.0 / r.nsPerOp);
+		std::cout << line;
+	}
+
+	bool WriteCsv(const std::string &path, const std::vector<BenchResult> &results)
+	{
+		std::ofstream file(path);
+		if (!file.is_open())
+			return false;
+		file << "primitive,variant,batch,ops,ns_per_op,cycles_per_op,mops_per_s\n";
+		for (const BenchResult &r : results)
+			file << r.primitive << "," << r.variant << "," << r.batch << "," << r.ops << "," << r.nsPerOp << "," << r.cyclesPerOp << "," << 1000.0 / r.nsPerOp << "\n";
+		return file.good();
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	BenchArgs args;
+	const std::string quickText = "--quick";
+	const std::string filterText = "--filter=";
+	const std::string csvText = "--csv=";
+	for (s32 i = 1; i < argc; i++)
+	{
+		if (quickText.compare(argv[i]) == 0)
+			args.quick = true;
+		else if (filterText.compare(0, filterText.size(), argv[i], filterText.size()) == 0)
+			args.filter = argv[i] + filterText.size();
+		else if (csvText.compare(0, csvText.size(), argv[i], csvText.size()) == 0)
+			args.csvPath = argv[i] + csvText.size();
+		else
+		{
+			std::cout << "Usage: MathsBench [--quick] [--filter=<primitive>] [--csv=<file>]\n";
+			return 1;
+		}
+	}
+
+#ifdef MATHS_SIMD_SSE
+	std::cout << "Maths backend: SSE\n";
+#elif defined(MATHS_SIMD_NEON)
+	std::cout << "Maths backend: NEON\n";
+#else
+	std::cout << "Maths backend: scalar\n";
+#endif
+#ifndef BENCH_HAS_TSC
+	std::cout << "No cycle counter on this target, cycles/op is -1\n";
+#endif
+
+	BenchData data;
+	FillData(data, BATCH_SIZES[sizeof(BATCH_SIZES) / sizeof(BATCH_SIZES[0]) - 1]);
+	const std::vector<Primitive> primitives = CreatePrimitives(data);
+
+	std::vector<BenchResult> results;
+	for (const Primitive &primitive : primitives)
+	{
+		if (!args.filter.empty() && primitive.name.find(args.filter) == std::string::npos)
+			continue;
+		for (u32 batch : BATCH_SIZES)
+		{
+			results.push_back(Measure(primitive.name, "inline", batch, args, primitive.inlined));
+			PrintResult(results.back());
+			results.push_back(Measure(primitive.name, "noinline", batch, args, primitive.called));
+			PrintResult(results.back());
+		}
+	}
+	if (results.empty())
+	{
+		std::cout << "No primitive matches " << args.filter << "\n";
+		return 1;
+	}
+
+	if (!args.csvPath.empty() && !WriteCsv(args.csvPath, results))
+	{
+		std::cout << "Could not write " << args.csvPath << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,219 @@
+#include <iostream>
+#include <random>
+
+#include "Maths/Maths.hpp"
+#include "Maths/Random.hpp"
+
+using namespace Maths;
+
+// Checks the SIMD backend against the scalar reference, results must match bit for bit.
+// Zeros are compared by value since their sign is allowed to differ.
+
+namespace
+{
+	const u32 CASE_COUNT = 100000;
+
+	std::mt19937 rng(1234);
+
+	f32 NextValue()
+	{
+		// Mix of magnitudes so rounding differences would show up
+		std::uniform_real_distribution<f32> dist(-1.0f, 1.0f);
+		std::uniform_int_distribution<s32> exponent(-8, 8);
+		return ldexpf(dist(rng), exponent(rng));
+	}
+
+	bool Compare(const char *name, u32 testCase, const f32 *expected, const f32 *result, u32 count)
+	{
+		for (u32 i = 0; i < count; i++)
+		{
+			if (expected[i] != result[i])
+			{
+				std::cout << name << " mismatch on case " << testCase << " element " << i << ": " << expected[i] << " != " << result[i] << "\n";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool RunPhiloxTest()
+	{
+		// Known answers of the Random123 reference implementation
+		const u32 keys[3][2] = { { 0, 0 }, { 0xffffffff, 0xffffffff }, { 0xa4093822, 0x299f31d0 } };
+		const u32 counters[3][4] = { { 0, 0, 0, 0 }, { 0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff }, { 0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344 } };
+		const u32 answers[3][4] = { { 0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8 }, { 0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd }, { 0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1 } };
+		for (u32 t = 0; t < 3; t++)
+		{
+			u32 result[4];
+			Scalar::PhiloxBlock(keys[t], counters[t], result);
+			for (u32 i = 0; i < 4; i++)
+			{
+				if (result[i] != answers[t][i])
+				{
+					std::cout << "Philox known answer " << t << " mismatch on word " << i << ": " << std::hex << result[i] << " != " << answers[t][i] << std::dec << "\n";
+					return false;
+				}
+			}
+		}
+
+		// SIMD blocks against the reference, including groups where the low counter word wraps
+		std::uniform_int_distribution<u32> words;
+		for (u32 t = 0; t < CASE_COUNT / 10; t++)
+		{
+			const u32 key[2] = { words(rng), words(rng) };
+			const u32 stream[2] = { words(rng), words(rng) };
+			u64 firstBlock = ((u64)(words(rng)) << 32) | words(rng);
+			if (t % 16 == 0)
+				firstBlock |= 0xfffffffc + t % 4;
+			u32 expected[16];
+			u32 result[16];
+			Scalar::PhiloxBlocks4(key, stream, firstBlock, expected);
+			Simd::PhiloxBlocks4(key, stream, firstBlock, result);
+			for (u32 i = 0; i < 16; i++)
+			{
+				if (expected[i] != result[i])
+				{
+					std::cout << "PhiloxBlocks4 mismatch on case " << t << " word " << i << "\n";
+					return false;
+				}
+			}
+		}
+
+		// Any split of a range gives the same words
+		const Philox philox(1234, 5);
+		std::vector<u32> whole(103 * Philox::BLOCK_WORDS);
+		std::vector<u32> split(whole.size());
+		philox.GenerateBlocks(17, 103, whole.data());
+		philox.GenerateBlocks(17, 6, split.data());
+		philox.GenerateBlocks(23, 97, split.data() + 6 * Philox::BLOCK_WORDS);
+		if (whole != split)
+		{
+			std::cout << "Philox blocks depend on how the range is split\n";
+			return false;
+		}
+		std::vector<f32> floats(whole.size());
+		philox.GenerateFloats01(17, 103, floats.data());
+		for (u32 i = 0; i < floats.size(); i++)
+		{
+			if (floats[i] != Philox::ToFloat01(whole[i]) || !(floats[i] >= 0.0f && floats[i] < 1.0f))
+			{
+				std::cout << "Philox float " << i << " is wrong: " << floats[i] << "\n";
+				return false;
+			}
+		}
+		if (Philox::ToFloat01(0xffffffff) >= 1.0f)
+		{
+			std::cout << "Philox floats can reach 1\n";
+			return false;
+		}
+		return true;
+	}
+
+	bool RunFrustumTest()
+	{
+		// Camera of GameThread, the planes must agree with the clip space test of the same matrix
+		std::uniform_real_distribution<f32> coord(-600.0f, 1100.0f);
+		std::uniform_real_distribution<f32> angle(-180.0f, 180.0f);
+		u32 insideCount = 0;
+		for (u32 t = 0; t < 100; t++)
+		{
+			const Vec3 position = Vec3(coord(rng), coord(rng), coord(rng));
+			const Quat rotation = Quat::FromEuler(Vec3(Util::ToRadians(angle(rng)), Util::ToRadians(angle(rng)), 0));
+			Mat4 vp = Mat4::CreatePerspectiveProjectionMatrix(0.1f, 1000.0f, 70.0f, 16.0f / 9.0f);
+			vp = vp * Mat4::CreateViewMatrix(position, position + rotation * Vec3(0, 0, -1), rotation * Vec3(0, 1, 0));
+			const Frustum frustum = Frustum::FromViewProjection(vp);
+			for (u32 i = 0; i < 1000; i++)
+			{
+				const Vec3 point = Vec3(coord(rng), coord(rng), coord(rng));
+				const Vec4 clip = vp * Vec4(point, 1);
+				const f32 margin = 1e-3f * clip.w;
+				const bool inside = clip.w > 0 && std::abs(clip.x) <= clip.w - margin && std::abs(clip.y) <= clip.w - margin && std::abs(clip.z) <= clip.w - margin;
+				const bool outside = clip.w <= 0 || std::abs(clip.x) > clip.w + margin || std::abs(clip.y) > clip.w + margin || std::abs(clip.z) > clip.w + margin;
+				if (!inside && !outside)
+					continue;
+				if (frustum.IsSphereOnFrustum(point, 0) != inside)
+				{
+					std::cout << "Frustum disagrees with clip space on case " << t << " point " << point.ToString() << "\n";
+					return false;
+				}
+				insideCount += inside;
+			}
+
+			// A sphere reaching back through the near plane is kept
+			const Vec3 behind = position - rotation * Vec3(0, 0, -1) * 5.0f;
+			if (frustum.IsSphereOnFrustum(behind, 1.0f) || !frustum.IsSphereOnFrustum(behind, 6.0f))
+			{
+				std::cout << "Frustum sphere test is off on case " << t << "\n";
+				return false;
+			}
+		}
+		if (insideCount == 0)
+		{
+			std::cout << "Frustum test never saw a visible point\n";
+			return false;
+		}
+		return true;
+	}
+}
+
+int main()
+{
+#ifdef MATHS_SIMD_SSE
+	std::cout << "Testing SSE backend\n";
+#elif defined(MATHS_SIMD_NEON)
+	std::cout << "Testing NEON backend\n";
+#else
+	std::cout << "No SIMD backend, testing scalar path against itself\n";
+#endif
+
+	for (u32 t = 0; t < CASE_COUNT; t++)
+	{
+		f32 a[16];
+		f32 b[16];
+		f32 expected[16];
+		f32 result[16];
+		for (u32 i = 0; i < 16; i++)
+		{
+			a[i] = NextValue();
+			b[i] = NextValue();
+		}
+
+		Scalar::MultiplyMat4(a, b, expected);
+		Simd::MultiplyMat4(a, b, result);
+		if (!Compare("Mat4 * Mat4", t, expected, result, 16))
+			return 1;
+
+		Scalar::MultiplyMat4Vec4(a, b, expected);
+		Simd::MultiplyMat4Vec4(a, b, result);
+		if (!Compare("Mat4 * Vec4", t, expected, result, 4))
+			return 1;
+
+		Scalar::MultiplyQuat(a, b, expected);
+		Simd::MultiplyQuat(a, b, result);
+		if (!Compare("Quat * Quat", t, expected, result, 4))
+			return 1;
+
+		// Public API must still agree with the reference
+		Quat qa = Quat(Vec3(a[0], a[1], a[2]), a[3]);
+		Quat qb = Quat(Vec3(b[0], b[1], b[2]), b[3]);
+		Quat q = qa * qb;
+		if (!Compare("Quat::operator*", t, expected, &q.v.x, 4))
+			return 1;
+
+		Mat4 ma = Mat4();
+		Mat4 mb = Mat4();
+		for (u32 i = 0; i < 16; i++)
+		{
+			ma.content[i] = a[i];
+			mb.content[i] = b[i];
+		}
+		Mat4 m = ma * mb;
+		Scalar::MultiplyMat4(a, b, expected);
+		if (!Compare("Mat4::operator*", t, expected, m.content, 16))
+			return 1;
+	}
+	if (!RunPhiloxTest() || !RunFrustumTest())
+		return 1;
+	std::cout << "Unit test passed\n";
+	return 0;
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <filesystem>
 #include <Windows.h>
 #include <dwmapi.h>
 #pragma comment(lib, "dwmapi")
@@ -6,6 +7,7 @@
 #include "Maths/Maths.hpp"
 #include "RenderThread.hpp"
 #include "GameThread.hpp"
+#include "Simulation/Snapshot.hpp"
 
 #ifdef _DEBUG
 #include <crtdbg.h>
@@ -25,6 +27,21 @@ struct LaunchArgs
 {
 	Maths::IVec2 defaultRes = Maths::IVec2(800, 600);
 	u32 targetDevice = 0;
+	Simulation::SimParams simParams;
+	// Picked from the clock when --seed is not given, the game thread logs it
+	u32 seed = 0;
+	bool hasSeed = false;
+	std::wstring tracePath;
+	// Offscreen runs draw frameCount frames without a window
+	bool offscreen = false;
+	u32 frameCount = 600;
+	u32 captureInterval = 60;
+	std::wstring capturePrefix;
+	// The snapshot's parameters replace --count, --chunks and --world
+	std::wstring loadPath;
+	std::wstring snapshotPrefix = L"Snapshot_";
+	std::wstring recordPath;
+	u32 recordInterval = 10;
 	bool isUnitTest = false;
 } launchArgs;
 
@@ -41,6 +58,7 @@ LRESULT CALLBACK WndProc(_In_ HWND hWnd, _In_ UINT message, _In_ WPARAM wParam,
 void OnMoveMouse(HWND hwnd, bool reset = false);
 void ToggleFullscreen(HWND hwnd, bool full);
 void HandleCustomMessage(HWND hWnd, WindowMessage msg, u64 payload);
+bool CreateMainWindow(HINSTANCE hInstance, int nCmdShow, HWND &hWnd);
 
 std::wstring GetLastErrorAsString()
 {
@@ -84,6 +102,19 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 		const std::wstring deviceText = L"--device=";
 		const std::wstring widthText = L"--width=";
 		const std::wstring heightText = L"--height=";
+		const std::wstring countText = L"--count=";
+		const std::wstring chunksText = L"--chunks=";
+		const std::wstring worldText = L"--world=";
+		const std::wstring seedText = L"--seed=";
+		const std::wstring traceText = L"--trace=";
+		const std::wstring offscreenText = L"--offscreen";
+		const std::wstring framesText = L"--frames=";
+		const std::wstring captureText = L"--capture=";
+		const std::wstring captureIntervalText = L"--capture-interval=";
+		const std::wstring loadText = L"--load=";
+		const std::wstring snapshotText = L"--snapshot=";
+		const std::wstring recordText = L"--record=";
+		const std::wstring recordIntervalText = L"--record-interval=";
 		for (s32 i = 0; i < argCount; i++)
 		{
 			if (testText.compare(arglist[i]) == 0)
@@ -102,88 +133,202 @@ int WINAPI wWinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance,
 			{
 				launchArgs.defaultRes.y = Maths::Util::MaxI(64, std::stoi(arglist[i] + heightText.size()));
 			}
+			else if (countText.compare(0, countText.size(), arglist[i], countText.size()) == 0)
+			{
+				launchArgs.simParams.objectCount = (u32)Maths::Util::MaxI(1, std::stoi(arglist[i] + countText.size()));
+			}
+			else if (chunksText.compare(0, chunksText.size(), arglist[i], chunksText.size()) == 0)
+			{
+				launchArgs.simParams.chunkCountSide = (u32)Maths::Util::IClamp(std::stoi(arglist[i] + chunksText.size()), Simulation::MIN_CHUNK_COUNT_SIDE, Simulation::MAX_CHUNK_COUNT_SIDE);
+			}
+			else if (worldText.compare(0, worldText.size(), arglist[i], worldText.size()) == 0)
+			{
+				launchArgs.simParams.worldSize = Maths::Util::MaxF(1.0f, std::stof(arglist[i] + worldText.size()));
+			}
+			else if (seedText.compare(0, seedText.size(), arglist[i], seedText.size()) == 0)
+			{
+				launchArgs.seed = (u32)std::stoul(arglist[i] + seedText.size());
+				launchArgs.hasSeed = true;
+			}
+			else if (traceText.compare(0, traceText.size(), arglist[i], traceText.size()) == 0)
+			{
+				launchArgs.tracePath = arglist[i] + traceText.size();
+			}
+			else if (offscreenText.compare(arglist[i]) == 0)
+			{
+				launchArgs.offscreen = true;
+			}
+			else if (framesText.compare(0, framesText.size(), arglist[i], framesText.size()) == 0)
+			{
+				launchArgs.frameCount = (u32)Maths::Util::MaxI(0, std::stoi(arglist[i] + framesText.size()));
+			}
+			else if (captureText.compare(0, captureText.size(), arglist[i], captureText.size()) == 0)
+			{
+				launchArgs.capturePrefix = arglist[i] + captureText.size();
+			}
+			else if (captureIntervalText.compare(0, captureIntervalText.size(), arglist[i], captureIntervalText.size()) == 0)
+			{
+				launchArgs.captureInterval = (u32)Maths::Util::MaxI(1, std::stoi(arglist[i] + captureIntervalText.size()));
+			}
+			else if (loadText.compare(0, loadText.size(), arglist[i], loadText.size()) == 0)
+			{
+				launchArgs.loadPath = arglist[i] + loadText.size();
+			}
+			else if (snapshotText.compare(0, snapshotText.size(), arglist[i], snapshotText.size()) == 0)
+			{
+				launchArgs.snapshotPrefix = arglist[i] + snapshotText.size();
+			}
+			else if (recordText.compare(0, recordText.size(), arglist[i], recordText.size()) == 0)
+			{
+				launchArgs.recordPath = arglist[i] + recordText.size();
+			}
+			else if (recordIntervalText.compare(0, recordIntervalText.size(), arglist[i], recordIntervalText.size()) == 0)
+			{
+				launchArgs.recordInterval = (u32)Maths::Util::MaxI(1, std::stoi(arglist[i] + recordIntervalText.size()));
+			}
 		}
 		LocalFree(arglist);
 
 		cursorHide = nullptr;
 
-		WNDCLASSEXW wcex = {};
-		wcex.cbSize = sizeof(WNDCLASSEX);
-		wcex.style = CS_HREDRAW | CS_VREDRAW;
-		wcex.lpfnWndProc = WndProc;
-		wcex.cbClsExtra = 0;
-		wcex.cbWndExtra = 0;
-		wcex.hInstance = hInstance;
-		wcex.hIcon = LoadIcon(wcex.hInstance, IDI_APPLICATION);
-		wcex.hCursor = LoadCursor(NULL, IDC_ARROW);
-		wcex.hbrBackground = NULL;
-		wcex.lpszMenuName = NULL;
-		wcex.lpszClassName = szClassName;
-		wcex.hIconSm = LoadIcon(wcex.hInstance, IDI_APPLICATION);
-
-		if (!RegisterClassExW(&wcex))
-		{
-			MessageBoxW(NULL, L"Call to RegisterClassExW failed!", szTitle, NULL);
+		HWND hWnd = NULL;
+		if (!launchArgs.offscreen && !CreateMainWindow(hInstance, nCmdShow, hWnd))
 			return 1;
-		}
 
-		if (!SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_SYSTEM_AWARE))
+		customMessage = RegisterWindowMessageA("VulkanWin32 Custom Message");
+
+#ifdef ENABLE_TRACE
+		TRACE_THREAD_NAME("Main Thread");
+		if (!launchArgs.tracePath.empty() && !Core::Trace::Start(std::filesystem::path(launchArgs.tracePath).string()))
+			GameThread::LogMessage(L"Could not write a trace to " + launchArgs.tracePath + L"\n");
+#else
+		if (!launchArgs.tracePath.empty())
+			GameThread::LogMessage("--trace needs a build with ENABLE_TRACE\n");
+#endif
+
+		OffscreenParams offscreen;
+		offscreen.enabled = launchArgs.offscreen;
+		offscreen.frameCount = launchArgs.offscreen ? launchArgs.frameCount : 0;
+		if (launchArgs.offscreen && !launchArgs.capturePrefix.empty())
 		{
-			MessageBoxW(NULL, L"Could not set window dpi awareness !", szTitle, NULL);
+			offscreen.captureInterval = launchArgs.captureInterval;
+			offscreen.capturePrefix = std::filesystem::path(launchArgs.capturePrefix).string();
 		}
-		HWND hWnd = CreateWindowExW(WS_EX_OVERLAPPEDWINDOW, szClassName, szTitle, WS_OVERLAPPEDWINDOW,
-									CW_USEDEFAULT, CW_USEDEFAULT, launchArgs.defaultRes.x,
-									launchArgs.defaultRes.y, NULL, NULL, hInstance, NULL);
-
-		area = CreateRectRgn(0, 0, -1, -1);
-		DWM_BLURBEHIND bb = { 0 };
-		bb.dwFlags = DWM_BB_ENABLE | DWM_BB_BLURREGION;
-		bb.hRgnBlur = area;
-		bb.fEnable = TRUE;
-		HRESULT r = DwmEnableBlurBehindWindow(hWnd, &bb);
-		if (r != S_OK)
-			MessageBoxW(hWnd, L"Call to DwmEnableBlurBehindWindow failed!", szTitle, NULL);
-		DeleteObject(area);
-
-		ShowWindow(hWnd, nCmdShow);
-		UpdateWindow(hWnd);
-
-		LONG_PTR lExStyle = GetWindowLongPtrW(hWnd, GWL_EXSTYLE);
-		lExStyle &= ~(WS_EX_DLGMODALFRAME | WS_EX_CLIENTEDGE | WS_EX_STATICEDGE | WS_EX_TRANSPARENT | WS_EX_LAYERED);
-		SetWindowLongPtrW(hWnd, GWL_EXSTYLE, lExStyle);
-
-		RECT windowRect = {};
-		GetWindowRect(hWnd, &windowRect);
-		windowRect.right = windowRect.left + launchArgs.defaultRes.x;
-		windowRect.bottom = windowRect.top + launchArgs.defaultRes.y;
-		AdjustWindowRectEx(&windowRect, (DWORD)GetWindowLongPtrW(hWnd, GWL_STYLE), false, (DWORD)lExStyle);
-		
-		SetWindowPos(hWnd, NULL, 0, 0, windowRect.right - windowRect.left, windowRect.bottom - windowRect.top, SWP_FRAMECHANGED | SWP_NOMOVE | SWP_NOZORDER | SWP_NOOWNERZORDER);
-		SetLayeredWindowAttributes(hWnd, RGB(255,0,0), 255, LWA_ALPHA);
-		if (!hWnd)
+
+		SnapshotParams snapshot;
+		snapshot.savePrefix = std::filesystem::path(launchArgs.snapshotPrefix).string();
+		if (!launchArgs.loadPath.empty())
 		{
-			MessageBoxW(hWnd, L"Call to CreateWindow failed!", szTitle, NULL);
-			return 1;
+			// Only the header is read here, the render thread copies the objects
+			snapshot.loadPath = std::filesystem::path(launchArgs.loadPath).string();
+			Simulation::Snapshot file;
+			std::string error;
+			if (!file.Open(snapshot.loadPath, error))
+			{
+				GameThread::SendErrorPopup(error);
+				return 1;
+			}
+			launchArgs.simParams = file.GetParams();
 		}
 
-		customMessage = RegisterWindowMessageA("VulkanWin32 Custom Message");
+		TrajectoryParams trajectory;
+		trajectory.path = std::filesystem::path(launchArgs.recordPath).string();
+		trajectory.interval = launchArgs.recordInterval;
 
-		gh.Init(hWnd, customMessage, launchArgs.defaultRes,  launchArgs.isUnitTest);
-		rh.Init(hWnd, hInstance, &gh, launchArgs.defaultRes, launchArgs.targetDevice);
+		if (!launchArgs.hasSeed)
+			launchArgs.seed = (u32)(GetTickCount64());
+		gh.Init(hWnd, customMessage, launchArgs.defaultRes,  launchArgs.isUnitTest, launchArgs.simParams, launchArgs.seed);
+		rh.Init(hWnd, hInstance, &gh, launchArgs.defaultRes, launchArgs.targetDevice, offscreen, snapshot, trajectory);
 
-		// Main message loop:
-		MSG msg;
-		while (GetMessageW(&msg, NULL, 0, 0) && !rh.HasCrashed() && !gh.HasCrashed())
+		int exitCode = 0;
+		if (launchArgs.offscreen)
 		{
-			TranslateMessage(&msg);
-			DispatchMessageW(&msg);
+			// No window sends the resolution, and the render thread stops on its own after frameCount frames
+			gh.Resize(launchArgs.defaultRes.x, launchArgs.defaultRes.y);
+			while (!rh.HasFinished() && !rh.HasCrashed() && !gh.HasCrashed())
+				Sleep(10);
+		}
+		else
+		{
+			// Main message loop:
+			MSG msg;
+			while (GetMessageW(&msg, NULL, 0, 0) && !rh.HasCrashed() && !gh.HasCrashed())
+			{
+				TranslateMessage(&msg);
+				DispatchMessageW(&msg);
+			}
+			exitCode = (int)msg.wParam;
 		}
 		rh.Quit();
 		gh.Quit();
+		Core::Trace::Stop();
 		if (gh.HasCrashed() || rh.HasCrashed())
 			return 1;
-		return (int)msg.wParam;
+		return exitCode;
+	}
+}
+
+bool CreateMainWindow(HINSTANCE hInstance, int nCmdShow, HWND &hWnd)
+{
+	WNDCLASSEXW wcex = {};
+	wcex.cbSize = sizeof(WNDCLASSEX);
+	wcex.style = CS_HREDRAW | CS_VREDRAW;
+	wcex.lpfnWndProc = WndProc;
+	wcex.cbClsExtra = 0;
+	wcex.cbWndExtra = 0;
+	wcex.hInstance = hInstance;
+	wcex.hIcon = LoadIcon(wcex.hInstance, IDI_APPLICATION);
+	wcex.hCursor = LoadCursor(NULL, IDC_ARROW);
+	wcex.hbrBackground = NULL;
+	wcex.lpszMenuName = NULL;
+	wcex.lpszClassName = szClassName;
+	wcex.hIconSm = LoadIcon(wcex.hInstance, IDI_APPLICATION);
+
+	if (!RegisterClassExW(&wcex))
+	{
+		MessageBoxW(NULL, L"Call to RegisterClassExW failed!", szTitle, NULL);
+		return false;
+	}
+
+	if (!SetProcessDpiAwarenessContext(DPI_AWARENESS_CONTEXT_SYSTEM_AWARE))
+	{
+		MessageBoxW(NULL, L"Could not set window dpi awareness !", szTitle, NULL);
+	}
+	hWnd = CreateWindowExW(WS_EX_OVERLAPPEDWINDOW, szClassName, szTitle, WS_OVERLAPPEDWINDOW,
+								CW_USEDEFAULT, CW_USEDEFAULT, launchArgs.defaultRes.x,
+								launchArgs.defaultRes.y, NULL, NULL, hInstance, NULL);
+
+	area = CreateRectRgn(0, 0, -1, -1);
+	DWM_BLURBEHIND bb = { 0 };
+	bb.dwFlags = DWM_BB_ENABLE | DWM_BB_BLURREGION;
+	bb.hRgnBlur = area;
+	bb.fEnable = TRUE;
+	HRESULT r = DwmEnableBlurBehindWindow(hWnd, &bb);
+	if (r != S_OK)
+		MessageBoxW(hWnd, L"Call to DwmEnableBlurBehindWindow failed!", szTitle, NULL);
+	DeleteObject(area);
+
+	ShowWindow(hWnd, nCmdShow);
+	UpdateWindow(hWnd);
+
+	LONG_PTR lExStyle = GetWindowLongPtrW(hWnd, GWL_EXSTYLE);
+	lExStyle &= ~(WS_EX_DLGMODALFRAME | WS_EX_CLIENTEDGE | WS_EX_STATICEDGE | WS_EX_TRANSPARENT | WS_EX_LAYERED);
+	SetWindowLongPtrW(hWnd, GWL_EXSTYLE, lExStyle);
+
+	RECT windowRect = {};
+	GetWindowRect(hWnd, &windowRect);
+	windowRect.right = windowRect.left + launchArgs.defaultRes.x;
+	windowRect.bottom = windowRect.top + launchArgs.defaultRes.y;
+	AdjustWindowRectEx(&windowRect, (DWORD)GetWindowLongPtrW(hWnd, GWL_STYLE), false, (DWORD)lExStyle);
+	
+	SetWindowPos(hWnd, NULL, 0, 0, windowRect.right - windowRect.left, windowRect.bottom - windowRect.top, SWP_FRAMECHANGED | SWP_NOMOVE | SWP_NOZORDER | SWP_NOOWNERZORDER);
+	SetLayeredWindowAttributes(hWnd, RGB(255,0,0), 255, LWA_ALPHA);
+	if (!hWnd)
+	{
+		MessageBoxW(hWnd, L"Call to CreateWindow failed!", szTitle, NULL);
+		return false;
 	}
+	return true;
 }
 
 LRESULT CALLBACK WndProc(_In_ HWND hWnd, _In_ UINT message, _In_ WPARAM wParam, _In_ LPARAM lParam)
@@ -102,29 +102,14 @@ namespace Maths
 	Mat4 Mat4::operator*(const Mat4& in) const
 	{
 		Mat4 out;
-		for (size_t j = 0; j < 4; j++)
-		{
-			for (size_t i = 0; i < 4; i++)
-			{
-				f32 res = 0;
-				for (size_t k = 0; k < 4; k++)
-					res += content[j + k * 4] * in.content[k + i * 4];
-
-				out.content[j + i * 4] = res;
-			}
-		}
+		Simd::MultiplyMat4(content, in.content, out.content);
 		return out;
 	}
 
 	Vec4 Mat4::operator*(const Vec4& in) const
 	{
 		Vec4 out;
-		for (size_t i = 0; i < 4; i++)
-		{
-			f32 res = 0;
-			for (size_t k = 0; k < 4; k++) res += content[i + k * 4] * in[k];
-			out[i] = res;
-		}
+		Simd::MultiplyMat4Vec4(content, &in.x, &out.x);
 		return out;
 	}
 
@@ -1072,6 +1057,39 @@ namespace Maths
 		return Vec3(cosf(longitude) * cosf(latitude), sinf(latitude), sinf(longitude) * cosf(latitude));
 	}
 
+	Frustum Frustum::FromViewProjection(const Mat4& vp)
+	{
+		// Row i of vp gives clip[i], a plane is row 3 plus or minus another row
+		Vec4 rows[4];
+		for (u8 i = 0; i < 4; i++)
+			rows[i] = Vec4(vp.at(0, i), vp.at(1, i), vp.at(2, i), vp.at(3, i));
+		auto makePlane = [&](u8 row, f32 sign)
+		{
+			const Vec3 normal = Vec3(rows[3].x + sign * rows[row].x, rows[3].y + sign * rows[row].y, rows[3].z + sign * rows[row].z);
+			const f32 offset = rows[3].w + sign * rows[row].w;
+			const f32 length = normal.Length();
+			return Vec4(normal / length, -offset / length);
+		};
+		Frustum result;
+		result.left = makePlane(0, 1);
+		result.right = makePlane(0, -1);
+		result.bottom = makePlane(1, 1);
+		result.top = makePlane(1, -1);
+		result.front = makePlane(2, 1);
+		result.back = makePlane(2, -1);
+		return result;
+	}
+
+	bool Frustum::IsSphereOnFrustum(const Vec3& center, f32 radius) const
+	{
+		return left.GetSignedDistanceToPlane(center) >= -radius &&
+			right.GetSignedDistanceToPlane(center) >= -radius &&
+			bottom.GetSignedDistanceToPlane(center) >= -radius &&
+			top.GetSignedDistanceToPlane(center) >= -radius &&
+			front.GetSignedDistanceToPlane(center) >= -radius &&
+			back.GetSignedDistanceToPlane(center) >= -radius;
+	}
+
 	bool AABB::IsOnFrustum(const Frustum& camFrustum, const Maths::Mat4& transform) const
 	{
 		Vec3 globalCenter = (transform * Vec4(center)).GetVector();
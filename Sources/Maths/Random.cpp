@@ -0,0 +1,39 @@
+#include "Maths/Random.hpp"
+
+using namespace Maths;
+
+Philox::Philox(u64 seed, u64 streamIn)
+{
+	key[0] = (u32)(seed);
+	key[1] = (u32)(seed >> 32);
+	stream[0] = (u32)(streamIn);
+	stream[1] = (u32)(streamIn >> 32);
+}
+
+void Philox::GenerateBlock(u64 block, u32 *out) const
+{
+	const u32 counter[4] = { (u32)(block), (u32)(block >> 32), stream[0], stream[1] };
+	Scalar::PhiloxBlock(key, counter, out);
+}
+
+void Philox::GenerateBlocks(u64 firstBlock, u32 blockCount, u32 *out) const
+{
+	u32 b = 0;
+	for (; b + 4 <= blockCount; b += 4)
+		Simd::PhiloxBlocks4(key, stream, firstBlock + b, out + b * BLOCK_WORDS);
+	for (; b < blockCount; b++)
+		GenerateBlock(firstBlock + b, out + b * BLOCK_WORDS);
+}
+
+void Philox::GenerateFloats01(u64 firstBlock, u32 blockCount, f32 *out) const
+{
+	const u32 CHUNK_BLOCKS = 256;
+	u32 words[CHUNK_BLOCKS * BLOCK_WORDS];
+	for (u32 done = 0; done < blockCount; done += CHUNK_BLOCKS)
+	{
+		const u32 count = blockCount - done < CHUNK_BLOCKS ? blockCount - done : CHUNK_BLOCKS;
+		GenerateBlocks(firstBlock + done, count, words);
+		for (u32 i = 0; i < count * BLOCK_WORDS; i++)
+			out[done * BLOCK_WORDS + i] = ToFloat01(words[i]);
+	}
+}
@@ -1,10 +1,16 @@
 #include "RenderThread.hpp"
 
-#include "Resource/Texture.hpp"
-
+#include "Resource/TextureCache.hpp"
+#include "Resource/ImageCapture.hpp"
+#include "Simulation/GpuBinning.hpp"
+#include "Simulation/Snapshot.hpp"
+#include "Simulation/RenderInstance.hpp"
+#include "Core/MappedFile.hpp"
+#include "Core/Hash.hpp"
+
+#include <algorithm>
 #include <filesystem>
 #include <time.h>
-#include <fstream>
 
 using namespace Maths;
 
@@ -16,27 +22,28 @@ const char *alphaBitStrings[] =
 	"VK_COMPOSITE_ALPHA_INHERIT_BIT_KHR"
 };
 
-std::string LoadFile(const std::string &path)
+// Names of the GPU profiler passes, also used as trace event names
+const char *profilePassNames[PROFILE_PASS_COUNT] =
 {
-	std::ifstream file = std::ifstream(path, std::ios_base::binary | std::ios_base::ate);
-	if (!file.is_open())
-		return "";
-
-	u64 size = file.tellg();
-	file.seekg(std::ios_base::beg);
-
-	std::string result(size, '0');
-	file.read(result.data(), size);
-	file.close();
-
-	return result;
-}
+	"bin_count",
+	"bin_scan",
+	"bin_scatter",
+	"sim_accel",
+	"sim_move",
+	"pack",
+	"cull",
+	"render"
+};
 
-void RenderThread::Init(HWND hwnd, HINSTANCE hinstance, GameThread *gm, Maths::IVec2 resIn, u32 targetDevice)
+void RenderThread::Init(HWND hwnd, HINSTANCE hinstance, GameThread *gm, Maths::IVec2 resIn, u32 targetDevice, const OffscreenParams &offscreenIn, const SnapshotParams &snapshotIn, const TrajectoryParams &trajectoryIn)
 {
+	offscreen = offscreenIn;
+	snapshot = snapshotIn;
+	trajectory = trajectoryIn;
 	appData.hWnd = hwnd;
 	appData.hInstance = hinstance;
 	appData.gm = gm;
+	renderData.simParams = gm->GetSimParams();
 	res = resIn;
 	thread = std::thread(&RenderThread::ThreadFunc, this, targetDevice);
 }
@@ -69,6 +76,9 @@ void RenderThread::Quit()
 
 void RenderThread::HandleResize()
 {
+	// Offscreen targets keep the launch resolution
+	if (offscreen.enabled)
+		return;
 	res.x = (s32)(storedRes & 0xffffffff);
 	res.y = (s32)(storedRes >> 32);
 	if (res.x != swapRes.x || res.y != swapRes.y)
@@ -78,6 +88,12 @@ void RenderThread::HandleResize()
 void RenderThread::InitThread()
 {
 	SetThreadDescription(GetCurrentThread(), L"Render Thread");
+	TRACE_THREAD_NAME("Render Thread");
+	simTimestep.Init(1.0 / SIM_TICK_RATE, MAX_SIM_STEPS_PER_FRAME);
+	jobSystem.Init();
+	frameTimings.Init({ "frame", "frame_wait", "acquire", "image_wait", "record", "submit", "present" });
+	if (!frameTimings.OpenExport("FrameTimings.csv"))
+		GameThread::LogMessage("Could not open FrameTimings.csv\n");
 	std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
 	start = now.time_since_epoch();
 }
@@ -89,39 +105,83 @@ void RenderThread::ThreadFunc(u32 targetDevice)
 
 	if (!InitVulkan(targetDevice))
 	{
+		jobSystem.Quit();
 		crashed = true;
 		return;
 	}
 
-	u32 counter = 0;
 	u32 tm0 = 0;
+	std::vector<Core::HistogramStats> frameStats;
+	auto lastFrame = std::chrono::steady_clock::now();
 	while (!exit)
 	{
 		std::chrono::time_point<std::chrono::system_clock> now = std::chrono::system_clock::now();
 		auto duration = now.time_since_epoch() - start;
 		auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
 		f64 iTime = micros / 1000000.0;
-		f32 deltaTime = static_cast<f32>(iTime - appTime);
+		f64 deltaTime = iTime - appTime;
 		appTime = iTime;
+		auto frameStart = std::chrono::steady_clock::now();
+		frameTimings.Record(FRAME_PHASE_FRAME, frameStart - lastFrame);
+		lastFrame = frameStart;
 		u32 tm1 = (u32)(iTime);
 		if (tm0 != tm1)
 		{
 			tm0 = tm1;
-			GameThread::LogMessage("FPS: " + std::to_string(counter) + "\n");
-			counter = 0;
+			frameTimings.TakeSnapshot(frameStats);
+			frameTimings.Export(iTime, frameStats);
+			GameThread::LogMessage("Frames: " + std::to_string(frameStats[FRAME_PHASE_FRAME].count) + ", " + frameTimings.FormatSummary(frameStats) + "\n");
+			LogGpuTimings();
+			if (recorder.IsRecording())
+				GameThread::LogMessage("Trajectory: " + Simulation::Trajectory::FormatStats(recorder.GetStats()) + "\n");
 		}
-		counter++;
 		
 		HandleResize();
 
-		if (!DrawFrame())
+		if (!DrawFrame(deltaTime))
 			break;
-		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		if (offscreen.frameCount > 0 && renderData.frameIndex >= offscreen.frameCount)
+			exit = true;
+		// Offscreen runs are not paced by a display
+		if (!offscreen.enabled)
+		{
+			TRACE_SCOPE("Sleep");
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		}
 	}
 
 	appData.disp.deviceWaitIdle();
+	if (renderData.timestampsEnabled)
+	{
+		for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+			ReadTimestamps(i);
+		if (!gpuTimings.WriteCsv("GpuTimings.csv"))
+			GameThread::LogMessage("Could not write GpuTimings.csv\n");
+	}
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		WriteCapture(i);
+		WriteSnapshot(i);
+	}
+	// The writers read straight from the mapped readback buffers
+	if (snapshotWriter.joinable())
+		snapshotWriter.join();
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (captureWriters[i].joinable())
+			captureWriters[i].join();
+	}
+	if (recorder.IsRecording())
+	{
+		// Oldest frame first so the ticks stay in order
+		for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+			SubmitTrajectory((renderData.currentFrame + i) % MAX_FRAMES_IN_FLIGHT);
+		recorder.Stop();
+		GameThread::LogMessage("Trajectory: " + Simulation::Trajectory::FormatStats(recorder.GetStats()) + "\n");
+	}
 	UnloadAssets();
 	Cleanup();
+	jobSystem.Quit();
 
 	if (!exit)
 		crashed = true;
@@ -129,13 +189,13 @@ void RenderThread::ThreadFunc(u32 targetDevice)
 
 bool RenderThread::InitVulkan(u32 targetDevice)
 {
+	TRACE_FUNCTION();
 	return	InitDevice(targetDevice) &&
 			CreateSwapchain() &&
 			GetQueues() &&
 			CreateRenderPass() &&
 			CreateDescriptorSetLayouts() &&
-			CreateGraphicsPipeline() &&
-			CreateComputePipeline() &&
+			CreatePipelines() &&
 			CreateDepthResources() &&
 			CreateFramebuffers() &&
 			CreateCommandPool() &&
@@ -143,16 +203,29 @@ bool RenderThread::InitVulkan(u32 targetDevice)
 			CreateTextureImageView() &&
 			CreateTextureSampler() &&
 			CreateVertexBuffer(sceneData.mesh) &&
-			CreateObjectBuffers(OBJECT_COUNT) &&
+			CreateIndexBuffer(sceneData.mesh) &&
+			CreateObjectBuffers(renderData.simParams.objectCount) &&
+			CreateCullBuffers() &&
 			CreateDescriptorPool() &&
 			CreateDescriptorSets() &&
 			CreateCommandBuffers() &&
-			CreateSyncObjects();
+			CreateSyncObjects() &&
+			CreateTimestampPools() &&
+			CreateCaptureBuffer() &&
+			CreateRecordBuffer();
 }
 
 void RenderThread::LoadAssets()
 {
 	sceneData.mesh.CreateDefaultCube();
+	sceneData.mesh.SetLayout(Resource::VertexLayout::Packed());
+
+	// One mapping for every shader and texture, AssetPacker builds it from the Assets folder
+	std::string error;
+	if (sceneData.assets.Open("Assets.pack", error))
+		GameThread::LogMessage("Assets.pack: " + std::to_string(sceneData.assets.GetHeader().entryCount) + " assets\n");
+	else
+		GameThread::LogMessage("Loading loose assets, " + error + "\n");
 }
 
 void RenderThread::UnloadAssets()
@@ -164,6 +237,7 @@ void RenderThread::UnloadAssets()
 	kernels.UnloadMeshes(meshes);
 	kernels.ClearKernels();
 	*/
+	sceneData.assets.Close();
 }
 
 VkSurfaceKHR RenderThread::CreateSurfaceWin32(VkInstance instance, HINSTANCE hInstance, HWND window, VkAllocationCallbacks* allocator)
@@ -198,6 +272,7 @@ VkSurfaceKHR RenderThread::CreateSurfaceWin32(VkInstance instance, HINSTANCE hIn
 
 bool RenderThread::InitDevice(u32 targetDevice)
 {
+	TRACE_FUNCTION();
 	GameThread::LogMessage("Initializing Vulkan...\n");
 	auto systemInfoRes = vkb::SystemInfo::get_system_info();
 	if (!systemInfoRes)
@@ -211,10 +286,20 @@ bool RenderThread::InitDevice(u32 targetDevice)
 		GameThread::LogMessage(std::string("- ") + systemInfo.available_extensions[i].extensionName + "\n");
 
 	vkb::InstanceBuilder instanceBuilder;
-	instanceBuilder.enable_extension(VK_KHR_SURFACE_EXTENSION_NAME);
-	instanceBuilder.enable_extension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+	if (offscreen.enabled)
+	{
+		// No surface, devices are not required to present
+		instanceBuilder.set_headless();
+	}
+	else
+	{
+		instanceBuilder.enable_extension(VK_KHR_SURFACE_EXTENSION_NAME);
+		instanceBuilder.enable_extension(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
+	}
 	instanceBuilder.set_app_name("Vulkan Demo").set_app_version(VK_MAKE_VERSION(1, 4, 0));
 	instanceBuilder.set_engine_name("Ligma Engine").request_validation_layers();
+	// Device selection checks the extension features through vkGetPhysicalDeviceFeatures2
+	instanceBuilder.require_api_version(1, 1, 0);
 
 	instanceBuilder.set_debug_callback([](VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
 		VkDebugUtilsMessageTypeFlagsEXT messageType,
@@ -240,10 +325,24 @@ bool RenderThread::InitDevice(u32 targetDevice)
 	}
 	appData.instance = instanceRet.value();
 	appData.instDisp = appData.instance.make_table();
-	appData.surface = CreateSurfaceWin32(appData.instance, appData.hInstance, appData.hWnd);
-
 	vkb::PhysicalDeviceSelector physDeviceSelector(appData.instance);
-	auto devices = physDeviceSelector.set_surface(appData.surface).select_devices();
+	// The frame loop waits on timeline semaphores and submits with synchronization2, GPUs without them are not listed
+	physDeviceSelector.add_required_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+	physDeviceSelector.add_required_extension(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+	VkPhysicalDeviceSynchronization2Features syncFeatures = {};
+	syncFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
+	syncFeatures.synchronization2 = VK_TRUE;
+	physDeviceSelector.add_required_extension_features(syncFeatures);
+	VkPhysicalDeviceTimelineSemaphoreFeatures timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES;
+	timelineFeatures.timelineSemaphore = VK_TRUE;
+	physDeviceSelector.add_required_extension_features(timelineFeatures);
+	if (!offscreen.enabled)
+	{
+		appData.surface = CreateSurfaceWin32(appData.instance, appData.hInstance, appData.hWnd);
+		physDeviceSelector.set_surface(appData.surface);
+	}
+	auto devices = physDeviceSelector.select_devices();
 	if (!devices)
 	{
 		std::string err = "No suitable GPU found: " + devices.error().message() + '\n';
@@ -276,13 +375,10 @@ bool RenderThread::InitDevice(u32 targetDevice)
 	VkPhysicalDeviceFeatures features = {};
 	features.logicOp = VK_TRUE;
 	features.samplerAnisotropy = VK_TRUE;
+	features.textureCompressionBC = VK_TRUE;
 	physicalDevice.enable_features_if_present(features);
-	physicalDevice.enable_extension_if_present(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+	// The required extensions and their features are enabled by the builder
 	vkb::DeviceBuilder deviceBuilder{ physicalDevice };
-	VkPhysicalDeviceSynchronization2Features syncFeatures = {};
-	syncFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES;
-	syncFeatures.synchronization2 = VK_TRUE;
-	deviceBuilder.add_pNext<VkPhysicalDeviceSynchronization2Features>(&syncFeatures);
 
 	auto deviceRet = deviceBuilder.build();
 	if (!deviceRet)
@@ -292,9 +388,26 @@ bool RenderThread::InitDevice(u32 targetDevice)
 	}
 	appData.device = deviceRet.value();
 	appData.disp = appData.device.make_table();
-	VkPhysicalDeviceProperties properties{};
-	vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+	// maxMemoryAllocationSize is core in Vulkan 1.1, which the instance requires
+	VkPhysicalDeviceMaintenance3Properties maintenance3{};
+	maintenance3.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MAINTENANCE_3_PROPERTIES;
+	VkPhysicalDeviceProperties2 properties2{};
+	properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties2.pNext = &maintenance3;
+	vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+	const VkPhysicalDeviceProperties &properties = properties2.properties;
 	appData.maxSamplerAnisotropy = properties.limits.maxSamplerAnisotropy;
+	appData.maxStorageBufferRange = properties.limits.maxStorageBufferRange;
+	appData.maxMemoryAllocationSize = maintenance3.maxMemoryAllocationSize;
+	appData.maxComputeWorkGroupCount = properties.limits.maxComputeWorkGroupCount[0];
+	appData.timestampPeriod = properties.limits.timestampPeriod;
+	VkPhysicalDeviceFeatures supportedFeatures{};
+	vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+	appData.textureCompressionBC = supportedFeatures.textureCompressionBC == VK_TRUE;
+	appData.pipelineCacheDevice.vendorId = properties.vendorID;
+	appData.pipelineCacheDevice.deviceId = properties.deviceID;
+	appData.pipelineCacheDevice.driverVersion = properties.driverVersion;
+	memcpy(appData.pipelineCacheDevice.cacheUuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
 
 	return true;
 }
@@ -302,6 +415,9 @@ bool RenderThread::InitDevice(u32 targetDevice)
 bool init = false;
 bool RenderThread::CreateSwapchain()
 {
+	TRACE_FUNCTION();
+	if (offscreen.enabled)
+		return CreateOffscreenTargets();
 	vkb::SwapchainBuilder swapchainBuilder = vkb::SwapchainBuilder(appData.device.physical_device, appData.device, appData.surface);
 	u32 x, y;
 	VkSurfaceFormatKHR format = {};
@@ -340,8 +456,45 @@ bool RenderThread::CreateSwapchain()
 	return true;
 }
 
+bool RenderThread::CreateOffscreenTargets()
+{
+	// The rest of the renderer reads the target description from the swapchain, which stays empty otherwise
+	const VkFormat format = VK_FORMAT_B8G8R8A8_UNORM;
+	appData.swapchain.image_format = format;
+	appData.swapchain.extent = { (u32)(res.x), (u32)(res.y) };
+	appData.swapchain.image_count = MAX_FRAMES_IN_FLIGHT;
+	swapRes = res;
+
+	renderData.swapchainImages.resize(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+	renderData.swapchainImageViews.resize(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+	renderData.offscreenImagesMemory.resize(MAX_FRAMES_IN_FLIGHT, VK_NULL_HANDLE);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (!CreateImage(res, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.swapchainImages[i], renderData.offscreenImagesMemory[i]))
+			return false;
+		renderData.swapchainImageViews[i] = CreateImageView(renderData.swapchainImages[i], format, VK_IMAGE_ASPECT_COLOR_BIT);
+	}
+	GameThread::LogMessage("Rendering offscreen at " + std::to_string(res.x) + "x" + std::to_string(res.y) + "\n");
+	return true;
+}
+
+void RenderThread::DestroyOffscreenTargets()
+{
+	for (u32 i = 0; i < renderData.swapchainImages.size(); i++)
+	{
+		appData.disp.destroyImageView(renderData.swapchainImageViews[i], nullptr);
+		appData.disp.destroyImage(renderData.swapchainImages[i], nullptr);
+		appData.disp.freeMemory(renderData.offscreenImagesMemory[i], nullptr);
+	}
+	renderData.swapchainImages.clear();
+	renderData.swapchainImageViews.clear();
+	renderData.offscreenImagesMemory.clear();
+}
+
 bool RenderThread::GetQueues()
 {
+	TRACE_FUNCTION();
 	auto gq = appData.device.get_queue(vkb::QueueType::graphics);
 	if (!gq.has_value())
 	{
@@ -350,24 +503,49 @@ bool RenderThread::GetQueues()
 	}
 	renderData.graphicsQueue = gq.value();
 
-	auto pq = appData.device.get_queue(vkb::QueueType::present);
-	if (!pq.has_value())
+	if (offscreen.enabled)
+		renderData.presentQueue = renderData.graphicsQueue;
+	else
 	{
-		GameThread::SendErrorPopup("failed to get present queue: " + pq.error().message());
-		return false;
+		auto pq = appData.device.get_queue(vkb::QueueType::present);
+		if (!pq.has_value())
+		{
+			GameThread::SendErrorPopup("failed to get present queue: " + pq.error().message());
+			return false;
+		}
+		renderData.presentQueue = pq.value();
 	}
-	renderData.presentQueue = pq.value();
 
 	auto tq = appData.device.get_queue(vkb::QueueType::transfer);
 	if (!tq.has_value())
 		renderData.transferQueue = renderData.graphicsQueue;
 	else
 		renderData.transferQueue = tq.value();
+
+	// A family without graphics lets the simulation overlap with rasterization
+	auto cq = appData.device.get_queue(vkb::QueueType::compute);
+	if (!cq.has_value())
+	{
+		renderData.computeQueue = renderData.graphicsQueue;
+		GameThread::LogMessage("No async compute queue, the simulation shares the graphics queue\n");
+	}
+	else
+		renderData.computeQueue = cq.value();
+
+	renderData.queueFamilies.clear();
+	const vkb::QueueType types[3] = { vkb::QueueType::graphics, vkb::QueueType::transfer, vkb::QueueType::compute };
+	for (u32 i = 0; i < 3; i++)
+	{
+		auto index = appData.device.get_queue_index(types[i]);
+		if (index.has_value() && std::find(renderData.queueFamilies.begin(), renderData.queueFamilies.end(), index.value()) == renderData.queueFamilies.end())
+			renderData.queueFamilies.push_back(index.value());
+	}
 	return true;
 }
 
 bool RenderThread::CreateRenderPass()
 {
+	TRACE_FUNCTION();
 	VkAttachmentDescription colorAttachment = {};
 	colorAttachment.format = appData.swapchain.image_format;
 	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
@@ -376,7 +554,8 @@ bool RenderThread::CreateRenderPass()
 	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	// Offscreen targets are copied to the capture ring after the pass
+	colorAttachment.finalLayout = offscreen.enabled ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
 	VkAttachmentDescription depthAttachment = {};
 	depthAttachment.format = FindDepthFormat();
@@ -410,6 +589,16 @@ bool RenderThread::CreateRenderPass()
 	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
 	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
+	// Orders the capture copy after the color writes and the final layout transition
+	VkSubpassDependency captureDependency = {};
+	captureDependency.srcSubpass = 0;
+	captureDependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+	captureDependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	captureDependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	captureDependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+	captureDependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+	VkSubpassDependency dependencies[2] = {dependency, captureDependency};
 	VkAttachmentDescription descriptions[2] = {colorAttachment, depthAttachment};
 	VkRenderPassCreateInfo renderPassInfo = {};
 	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -417,8 +606,8 @@ bool RenderThread::CreateRenderPass()
 	renderPassInfo.pAttachments = descriptions;
 	renderPassInfo.subpassCount = 1;
 	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
+	renderPassInfo.dependencyCount = offscreen.enabled ? 2 : 1;
+	renderPassInfo.pDependencies = dependencies;
 
 	if (appData.disp.createRenderPass(&renderPassInfo, nullptr, &renderData.renderPass) != VK_SUCCESS)
 	{
@@ -428,12 +617,16 @@ bool RenderThread::CreateRenderPass()
 	return true;
 }
 
-VkShaderModule RenderThread::CreateShaderModule(const std::string &code)
+VkShaderModule RenderThread::CreateShaderModule(const u8 *code, u64 size)
 {
+	// Pack entries and mappings are aligned, the code can be passed in place
+	if (!code || size == 0 || size % sizeof(u32) != 0)
+		return VK_NULL_HANDLE;
+
 	VkShaderModuleCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-	createInfo.codeSize = code.size();
-	createInfo.pCode = reinterpret_cast<const u32*>(code.data());
+	createInfo.codeSize = static_cast<size_t>(size);
+	createInfo.pCode = reinterpret_cast<const u32*>(code);
 
 	VkShaderModule shaderModule;
 	if (appData.disp.createShaderModule(&createInfo, nullptr, &shaderModule) != VK_SUCCESS)
@@ -442,8 +635,24 @@ VkShaderModule RenderThread::CreateShaderModule(const std::string &code)
 	return shaderModule;
 }
 
+VkShaderModule RenderThread::LoadShaderModule(const std::string &name)
+{
+	const Resource::AssetSpan span = sceneData.assets.Find("Shaders/" + name);
+	if (span.data)
+		return CreateShaderModule(span.data, span.size);
+
+	// Modules are build outputs, a tree that never built the Shaders target has none
+	Core::MappedFile file;
+	if (!file.Open(std::filesystem::current_path().append("Assets/Shaders").append(name).string(), true))
+	{
+		GameThread::LogMessage("Shader module " + name + " is missing, build the Shaders target\n");
+		return VK_NULL_HANDLE;
+	}
+	return CreateShaderModule(file.GetData(), file.GetSize());
+}
+
 bool RenderThread::CreateImage(	IVec2 res, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-								VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory)
+								VkMemoryPropertyFlags properties, VkImage &image, VkDeviceMemory &memory, u32 mipLevels)
 {
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -451,7 +660,7 @@ bool RenderThread::CreateImage(	IVec2 res, VkFormat format, VkImageTiling tiling
 	imageInfo.extent.width = (u32)(res.x);
 	imageInfo.extent.height = (u32)(res.y);
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -485,57 +694,72 @@ bool RenderThread::CreateImage(	IVec2 res, VkFormat format, VkImageTiling tiling
 	return true;
 }
 
-VkVertexInputBindingDescription RenderThread::GetBindingDescription()
+VkVertexInputBindingDescription RenderThread::GetBindingDescription(const Resource::VertexLayout &layout)
 {
 	VkVertexInputBindingDescription bindingDescription = {};
 	bindingDescription.binding = 0;
-	bindingDescription.stride = sizeof(Resource::Vertex);
+	bindingDescription.stride = layout.stride;
 	bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
 	return bindingDescription;
 }
 
-std::array<VkVertexInputAttributeDescription, 4> RenderThread::GetAttributeDescriptions()
+std::vector<VkVertexInputAttributeDescription> RenderThread::GetAttributeDescriptions(const Resource::VertexLayout &layout)
 {
-	std::array<VkVertexInputAttributeDescription, 4> attributeDescriptions = {};
-
-	attributeDescriptions[0].binding = 0;
-	attributeDescriptions[0].location = 0;
-	attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[0].offset = offsetof(Resource::Vertex, pos);
-
-	attributeDescriptions[1].binding = 0;
-	attributeDescriptions[1].location = 1;
-	attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
-	attributeDescriptions[1].offset = offsetof(Resource::Vertex, uv);
+	std::vector<VkVertexInputAttributeDescription> attributeDescriptions;
 
-	attributeDescriptions[2].binding = 0;
-	attributeDescriptions[2].location = 2;
-	attributeDescriptions[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[2].offset = offsetof(Resource::Vertex, col);
-
-	attributeDescriptions[3].binding = 0;
-	attributeDescriptions[3].location = 3;
-	attributeDescriptions[3].format = VK_FORMAT_R32G32B32_SFLOAT;
-	attributeDescriptions[3].offset = offsetof(Resource::Vertex, norm);
+	// Attributes left out of the layout get no location, the shaders must not read them
+	for (u32 i = 0; i < (u32)(Resource::VertexAttribute::Count); i++)
+	{
+		if (layout.formats[i] == Resource::VertexFormat::None)
+			continue;
+		VkVertexInputAttributeDescription attributeDescription = {};
+		attributeDescription.binding = 0;
+		attributeDescription.location = i;
+		attributeDescription.format = GetVertexFormat(layout.formats[i]);
+		attributeDescription.offset = layout.offsets[i];
+		attributeDescriptions.push_back(attributeDescription);
+	}
 
 	return attributeDescriptions;
 }
 
+VkFormat RenderThread::GetVertexFormat(Resource::VertexFormat format)
+{
+	switch (format)
+	{
+	case Resource::VertexFormat::Float32x2:
+		return VK_FORMAT_R32G32_SFLOAT;
+	case Resource::VertexFormat::Float32x3:
+		return VK_FORMAT_R32G32B32_SFLOAT;
+	case Resource::VertexFormat::Float16x4:
+		return VK_FORMAT_R16G16B16A16_SFLOAT;
+	case Resource::VertexFormat::Unorm16x2:
+		return VK_FORMAT_R16G16_UNORM;
+	case Resource::VertexFormat::Unorm8x4:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	case Resource::VertexFormat::Octahedral16x2:
+		return VK_FORMAT_R16G16_SNORM;
+	default:
+		return VK_FORMAT_UNDEFINED;
+	}
+}
+
 bool RenderThread::CreateDescriptorSetLayouts()
 {
+	TRACE_FUNCTION();
 	VkDescriptorSetLayoutBinding uboLayoutBinding = {};
 	uboLayoutBinding.binding = 0;
 	uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	uboLayoutBinding.descriptorCount = 1;
-	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 	uboLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding objectLayoutBinding = {};
 	objectLayoutBinding.binding = 1;
 	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	objectLayoutBinding.descriptorCount = 1;
-	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
 	objectLayoutBinding.pImmutableSamplers = nullptr;
 
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
@@ -544,6 +768,14 @@ bool RenderThread::CreateDescriptorSetLayouts()
 	samplerLayoutBinding.descriptorCount = 1;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
+
+	// The culling pass runs with the render sets, it reads the uniforms and instances and writes the visible list
+	VkDescriptorSetLayoutBinding visibleLayoutBinding = {};
+	visibleLayoutBinding.binding = 3;
+	visibleLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	visibleLayoutBinding.descriptorCount = 1;
+	visibleLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT;
+	visibleLayoutBinding.pImmutableSamplers = nullptr;
 	
 	VkDescriptorSetLayoutBinding computeLayoutBinding0 = {};
 	computeLayoutBinding0.binding = 0;
@@ -567,8 +799,8 @@ bool RenderThread::CreateDescriptorSetLayouts()
 
 	VkDescriptorSetLayoutCreateInfo layoutInfoRender = {};
 	layoutInfoRender.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfoRender.bindingCount = 3;
-	VkDescriptorSetLayoutBinding bindings1[3] = { uboLayoutBinding, objectLayoutBinding, samplerLayoutBinding };
+	layoutInfoRender.bindingCount = 4;
+	VkDescriptorSetLayoutBinding bindings1[4] = { uboLayoutBinding, objectLayoutBinding, samplerLayoutBinding, visibleLayoutBinding };
 	layoutInfoRender.pBindings = bindings1;
 	
 	if (appData.disp.createDescriptorSetLayout(&layoutInfoCompute, nullptr, &renderData.descriptorSetLayoutCompute) != VK_SUCCESS ||
@@ -581,25 +813,136 @@ bool RenderThread::CreateDescriptorSetLayouts()
 	return true;
 }
 
-bool RenderThread::CreateGraphicsPipeline()
+bool RenderThread::CreatePipelines()
 {
-	const std::filesystem::path defaultPath = std::filesystem::current_path();
-	std::string vertCode = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/cube.vert.spv").string());
-	std::string fragCode = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/cube.frag.spv").string());
+	TRACE_FUNCTION();
+	const bool warm = CreatePipelineCache();
+	auto compileStart = std::chrono::steady_clock::now();
+
+	// One job builds the render then the culling pipeline, which uses the render layout,
+	// the other fans the compute passes out to the remaining workers
+	bool created[2] = {};
+	jobSystem.ParallelFor(2, 1, [this, &created](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; i++)
+			created[i] = i == 0 ? CreateGraphicsPipeline() && CreateCullPipeline() : CreateComputePipeline();
+	});
+	if (!created[0] || !created[1])
+	{
+		DestroyPipelines();
+		return false;
+	}
 
-	VkShaderModule vertModule = CreateShaderModule(vertCode);
-	VkShaderModule fragModule = CreateShaderModule(fragCode);
-	if (vertModule == VK_NULL_HANDLE || fragModule == VK_NULL_HANDLE)
+	const f64 compileTime = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - compileStart).count();
+	GameThread::LogMessage("Pipelines created in " + std::to_string(compileTime) + " ms from a " + (warm ? "warm" : "cold") + " cache\n");
+	SavePipelineCache();
+	return true;
+}
+
+void RenderThread::DestroyPipelines()
+{
+	appData.disp.destroyPipeline(renderData.graphicsPipeline, nullptr);
+	appData.disp.destroyPipeline(renderData.cullPipeline, nullptr);
+	for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
 	{
-		GameThread::SendErrorPopup("failed to create shader module");
+		appData.disp.destroyPipeline(renderData.computePipelines[i], nullptr);
+		renderData.computePipelines[i] = VK_NULL_HANDLE;
+	}
+	appData.disp.destroyPipelineLayout(renderData.pipelineLayout, nullptr);
+	appData.disp.destroyPipelineLayout(renderData.computePipelineLayout, nullptr);
+	appData.disp.destroyPipelineCache(renderData.pipelineCache, nullptr);
+	renderData.graphicsPipeline = VK_NULL_HANDLE;
+	renderData.cullPipeline = VK_NULL_HANDLE;
+	renderData.pipelineLayout = VK_NULL_HANDLE;
+	renderData.computePipelineLayout = VK_NULL_HANDLE;
+	renderData.pipelineCache = VK_NULL_HANDLE;
+}
+
+bool RenderThread::CreatePipelineCache()
+{
+	TRACE_FUNCTION();
+	Resource::PipelineCacheFile file;
+	std::string error;
+	const bool loaded = file.Open("PipelineCache.bin", appData.pipelineCacheDevice, error);
+	if (!loaded)
+		GameThread::LogMessage("Cold pipeline cache, " + error + "\n");
+
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = loaded ? static_cast<size_t>(file.GetDataSize()) : 0;
+	cacheInfo.pInitialData = loaded ? file.GetData() : nullptr;
+	if (appData.disp.createPipelineCache(&cacheInfo, nullptr, &renderData.pipelineCache) == VK_SUCCESS)
+	{
+		renderData.pipelineCacheHash = loaded ? Core::HashBytes(file.GetData(), file.GetDataSize()) : 0;
+		return loaded;
+	}
+
+	// The pipelines can still be built without one
+	cacheInfo.initialDataSize = 0;
+	cacheInfo.pInitialData = nullptr;
+	if (!loaded || appData.disp.createPipelineCache(&cacheInfo, nullptr, &renderData.pipelineCache) != VK_SUCCESS)
+	{
+		renderData.pipelineCache = VK_NULL_HANDLE;
+		GameThread::LogMessage("Could not create a pipeline cache\n");
+	}
+	return false;
+}
+
+void RenderThread::SavePipelineCache()
+{
+	TRACE_FUNCTION();
+	if (renderData.pipelineCache == VK_NULL_HANDLE)
+		return;
+	size_t size = 0;
+	if (appData.disp.getPipelineCacheData(renderData.pipelineCache, &size, nullptr) != VK_SUCCESS)
+		return;
+	std::vector<u8> data(size);
+	if (appData.disp.getPipelineCacheData(renderData.pipelineCache, &size, data.data()) != VK_SUCCESS)
+		return;
+	// A warm start that hit every pipeline has nothing to add
+	const u64 hash = Core::HashBytes(data.data(), size);
+	if (hash == renderData.pipelineCacheHash)
+		return;
+
+	std::string error;
+	if (!Resource::PipelineCacheFile::Write("PipelineCache.bin", appData.pipelineCacheDevice, data.data(), size, error))
+		GameThread::LogMessage("Could not save the pipeline cache, " + error + "\n");
+	else
+		renderData.pipelineCacheHash = hash;
+}
+
+bool RenderThread::CreateGraphicsPipeline()
+{
+	TRACE_FUNCTION();
+	VkShaderModule vertModule = LoadShaderModule("cube.vert.spv");
+	VkShaderModule fragModule = LoadShaderModule("cube.frag.spv");
+	const Resource::VertexLayout &layout = sceneData.mesh.GetLayout();
+	if (vertModule == VK_NULL_HANDLE || fragModule == VK_NULL_HANDLE || !layout.IsValid())
+	{
+		appData.disp.destroyShaderModule(fragModule, nullptr);
+		appData.disp.destroyShaderModule(vertModule, nullptr);
+		GameThread::SendErrorPopup(layout.IsValid() ? "failed to create shader module" : "mesh vertex layout has no position or an attribute in a format it cannot use");
 		return false;
 	}
 
+	// cube.vert unfolds octahedral normals when this is set
+	const VkBool32 octahedralNormals = layout.Get(Resource::VertexAttribute::Normal) == Resource::VertexFormat::Octahedral16x2;
+	VkSpecializationMapEntry vertSpecEntry = {};
+	vertSpecEntry.constantID = 2;
+	vertSpecEntry.offset = 0;
+	vertSpecEntry.size = sizeof(VkBool32);
+	VkSpecializationInfo vertSpecInfo = {};
+	vertSpecInfo.mapEntryCount = 1;
+	vertSpecInfo.pMapEntries = &vertSpecEntry;
+	vertSpecInfo.dataSize = sizeof(octahedralNormals);
+	vertSpecInfo.pData = &octahedralNormals;
+
 	VkPipelineShaderStageCreateInfo vertStageInfo = {};
 	vertStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
 	vertStageInfo.module = vertModule;
 	vertStageInfo.pName = "main";
+	vertStageInfo.pSpecializationInfo = &vertSpecInfo;
 
 	VkPipelineShaderStageCreateInfo fragStageInfo = {};
 	fragStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -609,8 +952,8 @@ bool RenderThread::CreateGraphicsPipeline()
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertStageInfo, fragStageInfo };
 
-	auto bindingDescription = GetBindingDescription();
-	auto attributeDescriptions = GetAttributeDescriptions();
+	auto bindingDescription = GetBindingDescription(layout);
+	auto attributeDescriptions = GetAttributeDescriptions(layout);
 
 	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
 	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
@@ -700,6 +1043,8 @@ bool RenderThread::CreateGraphicsPipeline()
 
 	if (appData.disp.createPipelineLayout(&pipelineLayoutInfo, nullptr, &renderData.pipelineLayout) != VK_SUCCESS)
 	{
+		appData.disp.destroyShaderModule(fragModule, nullptr);
+		appData.disp.destroyShaderModule(vertModule, nullptr);
 		GameThread::SendErrorPopup("failed to create pipeline layout");
 		return false;
 	}
@@ -728,31 +1073,43 @@ bool RenderThread::CreateGraphicsPipeline()
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-	if (appData.disp.createGraphicsPipelines(VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &renderData.graphicsPipeline) != VK_SUCCESS)
+	// The layout is left to DestroyPipelines on failure
+	const bool success = appData.disp.createGraphicsPipelines(renderData.pipelineCache, 1, &pipelineInfo, nullptr, &renderData.graphicsPipeline) == VK_SUCCESS;
+	appData.disp.destroyShaderModule(fragModule, nullptr);
+	appData.disp.destroyShaderModule(vertModule, nullptr);
+	if (!success)
 	{
 		GameThread::SendErrorPopup("failed to create pipline");
 		return false;
 	}
-
-	appData.disp.destroyShaderModule(fragModule, nullptr);
-	appData.disp.destroyShaderModule(vertModule, nullptr);
 	return true;
 }
 
 bool RenderThread::CreateComputePipeline()
 {
-	const std::filesystem::path defaultPath = std::filesystem::current_path();
-	std::string compCodeSort0 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sort0.comp.spv").string());
-	std::string compCodeSort1 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sort1.comp.spv").string());
-	std::string compCodeSim0 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sim0.comp.spv").string());
-	std::string compCodeSim1 = LoadFile(std::filesystem::path(defaultPath).append("Assets/Shaders/sim1.comp.spv").string());
+	TRACE_FUNCTION();
+	const Simulation::SimParams &params = renderData.simParams;
+	const u32 cellCount = params.chunkCountSide * params.chunkCountSide * params.chunkCountSide;
+	const u32 maxGroups = Util::MaxU((params.objectCount + SIM_GROUP_SIZE - 1) / SIM_GROUP_SIZE, (cellCount + SIM_GROUP_SIZE - 1) / SIM_GROUP_SIZE);
+	if (maxGroups > appData.maxComputeWorkGroupCount)
+	{
+		GameThread::SendErrorPopup("simulation size exceeds the device work group count of " + std::to_string(appData.maxComputeWorkGroupCount));
+		return false;
+	}
+
+	const char *shaderFiles[COMPUTE_PIPELINE_COUNT] = {"sort0.comp.spv", "sort1.comp.spv", "sort2.comp.spv", "sim0.comp.spv", "sim1.comp.spv", "pack.comp.spv"};
 
-	VkShaderModule compModuleSort0 = CreateShaderModule(compCodeSort0);
-	VkShaderModule compModuleSort1 = CreateShaderModule(compCodeSort1);
-	VkShaderModule compModuleSim0 = CreateShaderModule(compCodeSim0);
-	VkShaderModule compModuleSim1 = CreateShaderModule(compCodeSim1);
-	if (compModuleSort0 == VK_NULL_HANDLE || compModuleSort1 == VK_NULL_HANDLE || compModuleSim0 == VK_NULL_HANDLE || compModuleSim1 == VK_NULL_HANDLE)
+	VkShaderModule modules[COMPUTE_PIPELINE_COUNT] = {};
+	bool success = true;
+	for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+	{
+		modules[i] = LoadShaderModule(shaderFiles[i]);
+		success &= modules[i] != VK_NULL_HANDLE;
+	}
+	if (!success)
 	{
+		for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+			appData.disp.destroyShaderModule(modules[i], nullptr);
 		GameThread::SendErrorPopup("failed to create compute shader module");
 		return false;
 	}
@@ -763,72 +1120,193 @@ bool RenderThread::CreateComputePipeline()
 	pipelineLayoutInfo.setLayoutCount = 1;
 	pipelineLayoutInfo.pSetLayouts = &renderData.descriptorSetLayoutCompute;
 
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(SimConstants);
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
 	if (appData.disp.createPipelineLayout(&pipelineLayoutInfo, nullptr, &renderData.computePipelineLayout) != VK_SUCCESS)
 	{
+		for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+			appData.disp.destroyShaderModule(modules[i], nullptr);
 		GameThread::SendErrorPopup("failed to create compute pipeline layout!");
 		return false;
 	}
 
-	VkShaderModule modules[4] = {compModuleSort0, compModuleSort1, compModuleSim0, compModuleSim1};
-	VkPipelineShaderStageCreateInfo compStageInfo[4] = {};
-	VkComputePipelineCreateInfo pipelineInfo[4] = {};
+	// Sizes of shaderSimData.h, passes ignore the ones they do not use
+	const u32 specData[2] = { params.objectCount, params.chunkCountSide };
+	VkSpecializationMapEntry specEntries[2] = {};
+	for (u32 i = 0; i < 2; i++)
+	{
+		specEntries[i].constantID = i;
+		specEntries[i].offset = i * sizeof(u32);
+		specEntries[i].size = sizeof(u32);
+	}
+	VkSpecializationInfo specInfo = {};
+	specInfo.mapEntryCount = 2;
+	specInfo.pMapEntries = specEntries;
+	specInfo.dataSize = sizeof(specData);
+	specInfo.pData = specData;
+
+	VkPipelineShaderStageCreateInfo compStageInfo[COMPUTE_PIPELINE_COUNT] = {};
+	VkComputePipelineCreateInfo pipelineInfo[COMPUTE_PIPELINE_COUNT] = {};
 
-	for (u32 i = 0; i < 4; i++)
+	for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
 	{
 		compStageInfo[i].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 		compStageInfo[i].stage = VK_SHADER_STAGE_COMPUTE_BIT;
 		compStageInfo[i].module = modules[i];
 		compStageInfo[i].pName = "main";
+		compStageInfo[i].pSpecializationInfo = &specInfo;
 
 		pipelineInfo[i].sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
 		pipelineInfo[i].layout = renderData.computePipelineLayout;
 		pipelineInfo[i].stage = compStageInfo[i];
 	}
 
-	if (appData.disp.createComputePipelines(VK_NULL_HANDLE, 4, pipelineInfo, nullptr, renderData.computePipelines) != VK_SUCCESS)
+	// One call per pipeline so the job system compiles them in parallel, the cache is internally synchronized.
+	// Pipelines that were created are left to DestroyPipelines on failure.
+	VkResult results[COMPUTE_PIPELINE_COUNT] = {};
+	jobSystem.ParallelFor(COMPUTE_PIPELINE_COUNT, 1, [this, &pipelineInfo, &results](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; i++)
+			results[i] = appData.disp.createComputePipelines(renderData.pipelineCache, 1, &pipelineInfo[i], nullptr, &renderData.computePipelines[i]);
+	});
+	for (u32 i = 0; i < COMPUTE_PIPELINE_COUNT; i++)
+	{
+		success &= results[i] == VK_SUCCESS;
+		appData.disp.destroyShaderModule(modules[i], nullptr);
+	}
+	if (!success)
 	{
 		GameThread::SendErrorPopup("failed to create compute pipelines!");
 		return false;
 	}
 
-	appData.disp.destroyShaderModule(compModuleSort0, nullptr);
-	appData.disp.destroyShaderModule(compModuleSort1, nullptr);
-	appData.disp.destroyShaderModule(compModuleSim0, nullptr);
-	appData.disp.destroyShaderModule(compModuleSim1, nullptr);
+	return true;
+}
+
+bool RenderThread::CreateCullPipeline()
+{
+	TRACE_FUNCTION();
+	VkShaderModule module = LoadShaderModule("cull.comp.spv");
+	if (module == VK_NULL_HANDLE)
+	{
+		GameThread::SendErrorPopup("failed to create culling shader module");
+		return false;
+	}
 
+	const u32 specData[2] = { renderData.simParams.objectCount, renderData.simParams.chunkCountSide };
+	VkSpecializationMapEntry specEntries[2] = {};
+	for (u32 i = 0; i < 2; i++)
+	{
+		specEntries[i].constantID = i;
+		specEntries[i].offset = i * sizeof(u32);
+		specEntries[i].size = sizeof(u32);
+	}
+	VkSpecializationInfo specInfo = {};
+	specInfo.mapEntryCount = 2;
+	specInfo.pMapEntries = specEntries;
+	specInfo.dataSize = sizeof(specData);
+	specInfo.pData = specData;
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.layout = renderData.pipelineLayout;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = module;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.stage.pSpecializationInfo = &specInfo;
+
+	const bool success = appData.disp.createComputePipelines(renderData.pipelineCache, 1, &pipelineInfo, nullptr, &renderData.cullPipeline) == VK_SUCCESS;
+	appData.disp.destroyShaderModule(module, nullptr);
+	if (!success)
+	{
+		GameThread::SendErrorPopup("failed to create culling pipeline");
+		return false;
+	}
 	return true;
 }
 
-u32 align(unsigned int x, unsigned int a)
+VkDeviceSize align(VkDeviceSize x, VkDeviceSize a)
 {
-	unsigned int r = x % a;
+	VkDeviceSize r = x % a;
 	return r ? x + (a - r) : x;
 }
 
 bool RenderThread::CreateObjectBuffers(u32 objectCount)
 {
-	VkDeviceSize bufferSizeA = sizeof(Mat4);
-	renderData.sizeObjects = align(sizeof(Vec4) * 4 * objectCount, 0x40);
-	renderData.sizeSortBuf = align(SORT_THREAD_COUNT * CHUNK_COUNT * SORT_THREAD_OBJECT_PER_CHUNK * sizeof(u32), 0x40);
-	renderData.sizeMergeBuf = align(MAX_OBJECTS_PER_CHUNK * CHUNK_COUNT * sizeof(u32), 0x40);
-	renderData.mainBufSize = renderData.sizeObjects + renderData.sizeSortBuf + renderData.sizeMergeBuf;
+	TRACE_FUNCTION();
+	const u32 side = renderData.simParams.chunkCountSide;
+	const Simulation::BinningLayout binLayout = Simulation::BinningLayout::Create(objectCount, side * side * side);
+	const u64 sizeObjects = sizeof(Vec4) * 4 * (u64)(objectCount);
+	const u64 sizeBins = sizeof(u32) * (u64)(binLayout.size);
+	const u64 sizeInstances = RENDER_INSTANCE_SIZE * (u64)(objectCount);
+	if (sizeObjects > appData.maxStorageBufferRange || sizeBins > appData.maxStorageBufferRange || sizeInstances > appData.maxStorageBufferRange)
+	{
+		GameThread::SendErrorPopup("simulation buffers exceed the device storage buffer range of " + std::to_string(appData.maxStorageBufferRange) + " bytes");
+		return false;
+	}
+
+	VkDeviceSize bufferSizeA = sizeof(FrameUniforms);
+	renderData.sizeObjects = align(sizeObjects, 0x40);
+	renderData.sizeBinBuf = align(sizeBins, 0x40);
+	renderData.sizeInstances = align(sizeInstances, 0x40);
+	renderData.mainBufSize = renderData.sizeObjects + renderData.sizeBinBuf + renderData.sizeInstances;
+	if (renderData.mainBufSize > appData.maxMemoryAllocationSize)
+	{
+		GameThread::SendErrorPopup("simulation buffers exceed the device allocation limit of " + std::to_string(appData.maxMemoryAllocationSize) + " bytes");
+		return false;
+	}
 	VkDeviceSize bufferSizeB = renderData.mainBufSize;
-	renderData.objectBuffers.resize(renderData.swapchainImageViews.size());
-	renderData.objectBuffersMemory.resize(renderData.swapchainImageViews.size());
-	renderData.objectBuffersMapped.resize(renderData.swapchainImageViews.size());
+	renderData.objectBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.objectBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.objectBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
 	CreateBuffer(bufferSizeB, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
-	auto sourceData = appData.gm->GetInitialSimulationData();
 	void* data;
-	appData.disp.mapMemory(stagingBufferMemory, 0, renderData.sizeObjects, 0, &data);
-	memcpy(data, sourceData.data(), renderData.sizeObjects);
+	appData.disp.mapMemory(stagingBufferMemory, 0, bufferSizeB, 0, &data);
+	if (!snapshot.loadPath.empty())
+	{
+		// The file holds the GPU layout, it is copied from the mapping as is
+		TRACE_SCOPE("LoadSnapshot");
+		auto loadStart = std::chrono::steady_clock::now();
+		Simulation::Snapshot file;
+		std::string error;
+		if (!file.Open(snapshot.loadPath, error) || file.GetHeader().objectCount != objectCount)
+		{
+			appData.disp.unmapMemory(stagingBufferMemory);
+			appData.disp.destroyBuffer(stagingBuffer, nullptr);
+			appData.disp.freeMemory(stagingBufferMemory, nullptr);
+			GameThread::SendErrorPopup(error.empty() ? snapshot.loadPath + " does not hold " + std::to_string(objectCount) + " boids" : error);
+			return false;
+		}
+		memcpy(data, file.GetObjects(), (size_t)(file.GetHeader().objectsSize));
+		renderData.firstTick = file.GetHeader().tick;
+		GameThread::LogMessage("Loaded " + std::to_string(objectCount) + " boids at tick " + std::to_string(renderData.firstTick) + " from " + snapshot.loadPath + " in " +
+			std::to_string(std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - loadStart).count()) + " ms\n");
+	}
+	else
+	{
+		auto sourceData = appData.gm->GetInitialSimulationData();
+		sourceData.resize((size_t)(objectCount) * 4);
+		memcpy(data, sourceData.data(), renderData.sizeObjects);
+	}
+	// The binning passes expect cleared cell counts on the first frame
+	memset(static_cast<u8*>(data) + renderData.sizeObjects, 0, renderData.sizeBinBuf);
+	// Frames before the first step draw the initial state, packed like pack.comp does
+	Simulation::RenderInstances::Pack(static_cast<const Vec4*>(data), objectCount,
+		reinterpret_cast<Simulation::RenderInstance*>(static_cast<u8*>(data) + renderData.sizeObjects + renderData.sizeBinBuf));
 	appData.disp.unmapMemory(stagingBufferMemory);
 
 	bool success = true;
-	for (u32 i = 0; i < renderData.swapchainImageViews.size(); i++)
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
 		success &= CreateBuffer(bufferSizeA,
 								VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
@@ -844,23 +1322,58 @@ bool RenderThread::CreateObjectBuffers(u32 objectCount)
 	}
 
 	success &= CreateBuffer(bufferSizeB,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		renderData.computeBuffer,
 		renderData.computeBufferMemory);
 
 	CopyBuffer(stagingBuffer, renderData.computeBuffer, bufferSizeB);
 
+	// Both copies start with the initial state, frames that run no step draw whichever is current
+	for (u32 i = 0; i < RENDER_OBJECT_BUFFER_COUNT; i++)
+	{
+		success &= CreateBuffer(renderData.sizeInstances,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			renderData.renderObjectBuffers[i],
+			renderData.renderObjectBuffersMemory[i]);
+
+		CopyBuffer(stagingBuffer, renderData.renderObjectBuffers[i], renderData.sizeInstances, renderData.sizeObjects + renderData.sizeBinBuf);
+	}
+
 	appData.disp.destroyBuffer(stagingBuffer, nullptr);
 	appData.disp.freeMemory(stagingBufferMemory, nullptr);
 
 	return success;
 }
 
+bool RenderThread::CreateCullBuffers()
+{
+	TRACE_FUNCTION();
+	renderData.cullRadius = sceneData.mesh.GetBoundingRadius();
+	renderData.sizeCullBuf = align(sizeof(VkDrawIndexedIndirectCommand) + sizeof(u32) * (u64)(renderData.simParams.objectCount), 0x40);
+
+	// Written on the GPU every frame before they are read, nothing to upload
+	bool success = true;
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		success &= CreateBuffer(renderData.sizeCullBuf,
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			renderData.cullBuffers[i],
+			renderData.cullBuffersMemory[i]);
+	}
+	return success;
+}
+
 bool RenderThread::CreateFramebuffers()
 {
-	renderData.swapchainImages = appData.swapchain.get_images().value();
-	renderData.swapchainImageViews = appData.swapchain.get_image_views().value();
+	TRACE_FUNCTION();
+	if (!offscreen.enabled)
+	{
+		renderData.swapchainImages = appData.swapchain.get_images().value();
+		renderData.swapchainImageViews = appData.swapchain.get_image_views().value();
+	}
 
 	renderData.framebuffers.resize(renderData.swapchainImageViews.size());
 
@@ -885,6 +1398,7 @@ bool RenderThread::CreateFramebuffers()
 
 bool RenderThread::CreateCommandPool()
 {
+	TRACE_FUNCTION();
 	VkCommandPoolCreateInfo poolInfo0 = {};
 	poolInfo0.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
 	poolInfo0.queueFamilyIndex = appData.device.get_queue_index(vkb::QueueType::graphics).value();
@@ -905,19 +1419,54 @@ bool RenderThread::CreateCommandPool()
 		GameThread::SendErrorPopup("failed to create command pool");
 		return false;
 	}
+
+	VkCommandPoolCreateInfo poolInfoFrame = poolInfo0;
+	poolInfoFrame.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	VkCommandPoolCreateInfo poolInfoCompute = poolInfoFrame;
+	auto compute = appData.device.get_queue_index(vkb::QueueType::compute);
+	poolInfoCompute.queueFamilyIndex = compute.has_value() ? compute.value() : poolInfo0.queueFamilyIndex;
+	renderData.frameCommandPools.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.computeCommandPools.resize(MAX_FRAMES_IN_FLIGHT);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (appData.disp.createCommandPool(&poolInfoFrame, nullptr, &renderData.frameCommandPools[i]) != VK_SUCCESS ||
+			appData.disp.createCommandPool(&poolInfoCompute, nullptr, &renderData.computeCommandPools[i]) != VK_SUCCESS)
+		{
+			GameThread::SendErrorPopup("failed to create command pool");
+			return false;
+		}
+	}
 	return true;
 }
 
 bool RenderThread::CreateTextureImage()
 {
-	IVec2 res;
-	u8 *pixels = Resource::Texture::ReadTexture("Assets/Textures/blocks.png", res);
-	if (!pixels)
+	TRACE_FUNCTION();
+	const std::string textureName = "Textures/blocks.png";
+	const std::string texturePath = "Assets/" + textureName;
+	const Resource::TextureFormat cacheFormat = appData.textureCompressionBC ? Resource::TextureFormat::Bc1Srgb : Resource::TextureFormat::Rgba8Srgb;
+	Resource::TextureCache cache;
+	std::string error;
+	auto loadStart = std::chrono::steady_clock::now();
+	// The packed cache is used as is, it is only as fresh as the last AssetPacker run
+	const Resource::AssetSpan span = sceneData.assets.Find(Resource::TextureCache::GetCachePath(textureName, cacheFormat));
+	const bool loaded = span.data ? cache.LoadFromMemory(span.data, span.size, cacheFormat, error) : cache.Load(texturePath, cacheFormat, error);
+	if (!loaded)
 	{
-		GameThread::SendErrorPopup("failed to load texture");
+		GameThread::SendErrorPopup("failed to load texture: " + error);
 		return false;
 	}
-	u64 imageSize = sizeof(u32) * res.x * res.y;
+	if (cache.WasRebuilt())
+	{
+		const f64 buildTime = std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - loadStart).count();
+		GameThread::LogMessage("Built " + Resource::TextureCache::GetCachePath(texturePath, cacheFormat) + " in " + std::to_string(buildTime) + " ms\n");
+	}
+
+	// The cache holds every mip in the upload layout, one copy to staging and one region per level
+	const Resource::TextureCacheHeader &header = cache.GetHeader();
+	renderData.textureFormat = cacheFormat == Resource::TextureFormat::Bc1Srgb ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+	renderData.textureMipLevels = header.mipCount;
+	u64 imageSize = header.dataSize;
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
@@ -925,17 +1474,28 @@ bool RenderThread::CreateTextureImage()
 
 	void *data;
 	appData.disp.mapMemory(stagingBufferMemory, 0, imageSize, 0, &data);
-	memcpy(data, pixels, static_cast<size_t>(imageSize));
+	memcpy(data, cache.GetData(), static_cast<size_t>(imageSize));
 	appData.disp.unmapMemory(stagingBufferMemory);
 
-	Resource::Texture::FreeTextureData(pixels);
+	std::vector<VkBufferImageCopy> regions(header.mipCount);
+	for (u32 i = 0; i < header.mipCount; i++)
+	{
+		regions[i] = {};
+		regions[i].bufferOffset = header.mips[i].offset;
+		regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		regions[i].imageSubresource.mipLevel = i;
+		regions[i].imageSubresource.baseArrayLayer = 0;
+		regions[i].imageSubresource.layerCount = 1;
+		regions[i].imageExtent = { header.mips[i].width, header.mips[i].height, 1 };
+	}
 
-	CreateImage(res, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.textureImage, renderData.textureImageMemory);
+	const IVec2 res((s32)(header.mips[0].width), (s32)(header.mips[0].height));
+	CreateImage(res, renderData.textureFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.textureImage, renderData.textureImageMemory, renderData.textureMipLevels);
 
-	TransitionImageLayout(renderData.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	CopyBufferToImage(stagingBuffer, renderData.textureImage, (u32)(res.x), (u32)(res.y));
-	TransitionImageLayout(renderData.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	TransitionImageLayout(renderData.textureImage, renderData.textureFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, renderData.textureMipLevels);
+	CopyBufferToImage(stagingBuffer, renderData.textureImage, regions.data(), (u32)(regions.size()));
+	TransitionImageLayout(renderData.textureImage, renderData.textureFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, renderData.textureMipLevels);
 
 	appData.disp.destroyBuffer(stagingBuffer, nullptr);
 	appData.disp.freeMemory(stagingBufferMemory, nullptr);
@@ -945,16 +1505,19 @@ bool RenderThread::CreateTextureImage()
 
 bool RenderThread::CreateTextureImageView()
 {
-	renderData.textureImageView = CreateImageView(renderData.textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+	TRACE_FUNCTION();
+	renderData.textureImageView = CreateImageView(renderData.textureImage, renderData.textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, renderData.textureMipLevels);
 	return renderData.textureImageView != nullptr;
 }
 
 bool RenderThread::CreateTextureSampler()
 {
+	TRACE_FUNCTION();
 	VkSamplerCreateInfo samplerInfo = {};
 	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	// Texels stay sharp up close, distant boids blend the mips
 	samplerInfo.magFilter = VK_FILTER_NEAREST;
-	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
 	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
 	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
@@ -967,7 +1530,7 @@ bool RenderThread::CreateTextureSampler()
 	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
 	samplerInfo.mipLodBias = 0.0f;
 	samplerInfo.minLod = 0.0f;
-	samplerInfo.maxLod = 0.0f;
+	samplerInfo.maxLod = (f32)(renderData.textureMipLevels);
 
 	if (appData.disp.createSampler(&samplerInfo, nullptr, &renderData.textureSampler) != VK_SUCCESS)
 	{
@@ -978,7 +1541,7 @@ bool RenderThread::CreateTextureSampler()
 	return true;
 }
 
-VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, u32 mipLevels)
 {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -987,7 +1550,7 @@ VkImageView RenderThread::CreateImageView(VkImage image, VkFormat format, VkImag
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
 	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.levelCount = mipLevels;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -1033,6 +1596,7 @@ void RenderThread::EndSingleTimeCommands(VkCommandBuffer commandBuffer, VkComman
 
 bool RenderThread::CreateDepthResources()
 {
+	TRACE_FUNCTION();
 	VkFormat depthFormat = FindDepthFormat();
 	CreateImage(swapRes, depthFormat, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, renderData.depthImage, renderData.depthImageMemory);
 	renderData.depthImageView = CreateImageView(renderData.depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
@@ -1042,9 +1606,10 @@ bool RenderThread::CreateDepthResources()
 
 bool RenderThread::CreateVertexBuffer(const Resource::Mesh &m)
 {
-	const auto &vertices = m.GetVertices();
+	TRACE_FUNCTION();
+	const auto &vertexData = m.GetVertexData();
 
-	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+	VkDeviceSize bufferSize = vertexData.size();
 
 	VkBuffer stagingBuffer;
 	VkDeviceMemory stagingBufferMemory;
@@ -1056,7 +1621,7 @@ bool RenderThread::CreateVertexBuffer(const Resource::Mesh &m)
 
 	void *data;
 	appData.disp.mapMemory(stagingBufferMemory, 0, bufferSize, 0, &data);
-	std::memcpy(data, vertices.data(), bufferSize);
+	std::memcpy(data, vertexData.data(), bufferSize);
 	appData.disp.unmapMemory(stagingBufferMemory);
 
 	CreateBuffer(	bufferSize,
@@ -1073,12 +1638,46 @@ bool RenderThread::CreateVertexBuffer(const Resource::Mesh &m)
 	return true;
 }
 
-bool RenderThread::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size)
+bool RenderThread::CreateIndexBuffer(const Resource::Mesh &m)
+{
+	TRACE_FUNCTION();
+	const auto &indices = m.GetIndices();
+
+	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	CreateBuffer(	bufferSize,
+					VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+					stagingBuffer,
+					stagingBufferMemory);
+
+	void *data;
+	appData.disp.mapMemory(stagingBufferMemory, 0, bufferSize, 0, &data);
+	std::memcpy(data, indices.data(), bufferSize);
+	appData.disp.unmapMemory(stagingBufferMemory);
+
+	CreateBuffer(	bufferSize,
+					VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+					VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+					renderData.indexBuffer,
+					renderData.indexBufferMemory);
+
+	CopyBuffer(stagingBuffer, renderData.indexBuffer, bufferSize);
+
+	appData.disp.destroyBuffer(stagingBuffer, nullptr);
+	appData.disp.freeMemory(stagingBufferMemory, nullptr);
+
+	return true;
+}
+
+bool RenderThread::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size, VkDeviceSize srcOffset)
 {
 	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(renderData.transfertCommandPool);
 	
 	VkBufferCopy copyRegion = {};
-	copyRegion.srcOffset = 0; // Optional
+	copyRegion.srcOffset = srcOffset;
 	copyRegion.dstOffset = 0; // Optional
 	copyRegion.size = size;
 	appData.disp.cmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
@@ -1088,7 +1687,7 @@ bool RenderThread::CopyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSi
 	return true;
 }
 
-bool RenderThread::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout)
+bool RenderThread::TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, u32 mipLevels)
 {
 	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(renderData.commandPool);
 
@@ -1101,7 +1700,7 @@ bool RenderThread::TransitionImageLayout(VkImage image, VkFormat format, VkImage
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 	barrier.srcAccessMask = 0; // TODO
@@ -1142,34 +1741,17 @@ bool RenderThread::TransitionImageLayout(VkImage image, VkFormat format, VkImage
 	return true;
 }
 
-void RenderThread::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height)
+void RenderThread::CopyBufferToImage(VkBuffer buffer, VkImage image, const VkBufferImageCopy *regions, u32 regionCount)
 {
 	VkCommandBuffer commandBuffer = BeginSingleTimeCommands(renderData.transfertCommandPool);
 
-	VkBufferImageCopy region = {};
-	region.bufferOffset = 0;
-	region.bufferRowLength = 0;
-	region.bufferImageHeight = 0;
-
-	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-	region.imageSubresource.mipLevel = 0;
-	region.imageSubresource.baseArrayLayer = 0;
-	region.imageSubresource.layerCount = 1;
-
-	region.imageOffset = {0, 0, 0};
-	region.imageExtent = {
-		width,
-		height,
-		1
-	};
-
 	appData.disp.cmdCopyBufferToImage(
 		commandBuffer,
 		buffer,
 		image,
 		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
+		regionCount,
+		regions
 	);
 
 	EndSingleTimeCommands(commandBuffer, renderData.transfertCommandPool, renderData.transferQueue);
@@ -1177,20 +1759,7 @@ void RenderThread::CopyBufferToImage(VkBuffer buffer, VkImage image, uint32_t wi
 
 bool RenderThread::CreateCommandBuffers()
 {
-	renderData.commandBuffers.resize(renderData.framebuffers.size());
-
-	VkCommandBufferAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	allocInfo.commandPool = renderData.commandPool;
-	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandBufferCount = (u32)renderData.commandBuffers.size();
-
-	if (appData.disp.allocateCommandBuffers(&allocInfo, renderData.commandBuffers.data()) != VK_SUCCESS)
-	{
-		GameThread::SendErrorPopup("failed to allocate command buffers");
-		return false;
-	}
-
+	TRACE_FUNCTION();
 	VkCommandBufferAllocateInfo allocInfoTr = {};
 	allocInfoTr.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfoTr.commandPool = renderData.commandPool;
@@ -1203,108 +1772,470 @@ bool RenderThread::CreateCommandBuffers()
 		return false;
 	}
 
-	for (u32 i = 0; i < renderData.commandBuffers.size(); i++)
+	renderData.frameCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.computeCommandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		VkCommandBufferBeginInfo beginInfo = {};
-		beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		VkCommandBufferAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+		allocInfo.commandPool = renderData.frameCommandPools[i];
+		allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+		allocInfo.commandBufferCount = 1;
 
-		if (appData.disp.beginCommandBuffer(renderData.commandBuffers[i], &beginInfo) != VK_SUCCESS)
+		VkCommandBufferAllocateInfo allocInfoCompute = allocInfo;
+		allocInfoCompute.commandPool = renderData.computeCommandPools[i];
+
+		if (appData.disp.allocateCommandBuffers(&allocInfo, &renderData.frameCommandBuffers[i]) != VK_SUCCESS ||
+			appData.disp.allocateCommandBuffers(&allocInfoCompute, &renderData.computeCommandBuffers[i]) != VK_SUCCESS)
+		{
+			GameThread::SendErrorPopup("failed to allocate command buffers");
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RenderThread::RecordFrame(u32 image, u32 stepCount, u32 slot)
+{
+	// The timeline values of the frame have been waited on, nothing recorded from these pools is still in use
+	VkCommandBuffer commandBuffer = renderData.frameCommandBuffers[renderData.currentFrame];
+	VkCommandBuffer computeCommandBuffer = renderData.computeCommandBuffers[renderData.currentFrame];
+	appData.disp.resetCommandPool(renderData.frameCommandPools[renderData.currentFrame], 0);
+	appData.disp.resetCommandPool(renderData.computeCommandPools[renderData.currentFrame], 0);
+
+	VkCommandBufferBeginInfo beginInfo = {};
+	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+	if (stepCount > 0)
+	{
+		if (appData.disp.beginCommandBuffer(computeCommandBuffer, &beginInfo) != VK_SUCCESS)
 		{
 			GameThread::SendErrorPopup("failed to begin recording command buffer");
 			return false;
 		}
+		if (renderData.timestampsEnabled)
+			appData.disp.cmdResetQueryPool(computeCommandBuffer, renderData.timestampPools[renderData.currentFrame], 0, TIMESTAMP_CULL_QUERY);
+		RecordSimulation(computeCommandBuffer, stepCount, slot);
+		if (appData.disp.endCommandBuffer(computeCommandBuffer) != VK_SUCCESS)
+		{
+			GameThread::SendErrorPopup("failed to record command buffer");
+			return false;
+		}
+	}
 
-		VkRenderPassBeginInfo renderPassInfo = {};
-		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-		renderPassInfo.renderPass = renderData.renderPass;
-		renderPassInfo.framebuffer = renderData.framebuffers[i];
-		renderPassInfo.renderArea.offset = { 0, 0 };
-		renderPassInfo.renderArea.extent = appData.swapchain.extent;
-		VkClearValue clearColors[2];
-		clearColors[0].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
-		clearColors[1].depthStencil = { 1.0f, 0 };
-		renderPassInfo.clearValueCount = 2;
-		renderPassInfo.pClearValues = clearColors;
-
-		VkViewport viewport = {};
-		viewport.x = 0.0f;
-		viewport.y = 0.0f;
-		viewport.width = (float)appData.swapchain.extent.width;
-		viewport.height = (float)appData.swapchain.extent.height;
-		viewport.minDepth = 0.0f;
-		viewport.maxDepth = 1.0f;
-
-		VkRect2D scissor = {};
-		scissor.offset = { 0, 0 };
-		scissor.extent = appData.swapchain.extent;
-
-		// Sort 0
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[0]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i], 0, 0);
-
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], SORT_THREAD_COUNT, 1, 1);
-
-		VkMemoryBarrier2KHR memoryBarrier0 = {};
-		memoryBarrier0.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
-		memoryBarrier0.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
-		memoryBarrier0.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR,
-		memoryBarrier0.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR,
-		memoryBarrier0.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR;
-
-		VkDependencyInfoKHR dependencyInfo0 = {};
-		dependencyInfo0.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
-		dependencyInfo0.memoryBarrierCount = 1;
-		dependencyInfo0.pMemoryBarriers = &memoryBarrier0;
-		//dependencyInfo0.dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
-		
-		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
+	if (appData.disp.beginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to begin recording command buffer");
+		return false;
+	}
 
-		// Sort 1
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[1]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, 0);
+	if (renderData.timestampsEnabled)
+		appData.disp.cmdResetQueryPool(commandBuffer, renderData.timestampPools[renderData.currentFrame], TIMESTAMP_CULL_QUERY, TIMESTAMP_QUERY_COUNT - TIMESTAMP_CULL_QUERY);
+	RecordRender(commandBuffer, image, slot);
 
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, BLOCK_SIZE_Z);
-		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
+	if (appData.disp.endCommandBuffer(commandBuffer) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to record command buffer");
+		return false;
+	}
+	renderData.timestampSteps[renderData.currentFrame] = stepCount;
+	renderData.timestampsPending[renderData.currentFrame] = true;
+	return true;
+}
 
-		// Sim 0
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[2]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, 0);
+bool RenderThread::SubmitSimulation(u32 slot)
+{
+	// The final copy overwrites the slot, the last frame drawing from it must be done
+	VkSemaphoreSubmitInfoKHR waitInfo = {};
+	waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+	waitInfo.semaphore = renderData.graphicsTimeline;
+	waitInfo.value = renderData.slotReadValues[slot];
+	waitInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+
+	VkSemaphoreSubmitInfoKHR signalInfo = {};
+	signalInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+	signalInfo.semaphore = renderData.computeTimeline;
+	signalInfo.value = renderData.frameIndex;
+	signalInfo.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+
+	VkCommandBufferSubmitInfoKHR commandBufferInfo = {};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+	commandBufferInfo.commandBuffer = renderData.computeCommandBuffers[renderData.currentFrame];
+
+	VkSubmitInfo2KHR submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+	submitInfo.waitSemaphoreInfoCount = 1;
+	submitInfo.pWaitSemaphoreInfos = &waitInfo;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount = 1;
+	submitInfo.pSignalSemaphoreInfos = &signalInfo;
+
+	if (appData.disp.queueSubmit2KHR(renderData.computeQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to submit compute command buffer");
+		return false;
+	}
 
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, BLOCK_SIZE_Z);
-		appData.disp.cmdPipelineBarrier2KHR(renderData.commandBuffers[i], &dependencyInfo0);
+	renderData.lastSimValue = renderData.frameIndex;
+	renderData.frameSimValues[renderData.currentFrame] = renderData.frameIndex;
+	renderData.renderSlot = slot;
+	return true;
+}
 
-		// Sim 1
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[3]);
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3], 0, 0);
+bool RenderThread::SubmitRender(u32 image, u32 slot)
+{
+	VkSemaphoreSubmitInfoKHR waitInfos[2] = {};
+	waitInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+	waitInfos[0].semaphore = renderData.availableSemaphores[renderData.currentFrame];
+	waitInfos[0].stageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT_KHR;
+	// Only the culling pass and the vertex shader read the simulation output, earlier stages can overlap with the compute queue
+	waitInfos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+	waitInfos[1].semaphore = renderData.computeTimeline;
+	waitInfos[1].value = renderData.lastSimValue;
+	waitInfos[1].stageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR;
+
+	VkSemaphoreSubmitInfoKHR signalInfos[2] = {};
+	signalInfos[0].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+	signalInfos[0].semaphore = renderData.finishedSemaphore[image];
+	signalInfos[0].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+	signalInfos[1].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+	signalInfos[1].semaphore = renderData.graphicsTimeline;
+	signalInfos[1].value = renderData.frameIndex;
+	signalInfos[1].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+
+	VkCommandBufferSubmitInfoKHR commandBufferInfo = {};
+	commandBufferInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+	commandBufferInfo.commandBuffer = renderData.frameCommandBuffers[renderData.currentFrame];
+
+	// Offscreen targets are never acquired or presented, only the timelines are used
+	const u32 binaryCount = offscreen.enabled ? 0 : 1;
+	VkSubmitInfo2KHR submitInfo = {};
+	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+	submitInfo.waitSemaphoreInfoCount = 1 + binaryCount;
+	submitInfo.pWaitSemaphoreInfos = waitInfos + 1 - binaryCount;
+	submitInfo.commandBufferInfoCount = 1;
+	submitInfo.pCommandBufferInfos = &commandBufferInfo;
+	submitInfo.signalSemaphoreInfoCount = 1 + binaryCount;
+	submitInfo.pSignalSemaphoreInfos = signalInfos + 1 - binaryCount;
+
+	if (appData.disp.queueSubmit2KHR(renderData.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to submit draw command buffer");
+		return false;
+	}
+
+	renderData.slotReadValues[slot] = renderData.frameIndex;
+	renderData.frameRenderValues[renderData.currentFrame] = renderData.frameIndex;
+	renderData.imageRenderValues[image] = renderData.frameIndex;
+	return true;
+}
+
+void RenderThread::RecordRender(VkCommandBuffer commandBuffer, u32 image, u32 slot)
+{
+	VkRenderPassBeginInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+	renderPassInfo.renderPass = renderData.renderPass;
+	renderPassInfo.framebuffer = renderData.framebuffers[image];
+	renderPassInfo.renderArea.offset = { 0, 0 };
+	renderPassInfo.renderArea.extent = appData.swapchain.extent;
+	VkClearValue clearColors[2];
+	clearColors[0].color = {{0.0f, 0.0f, 0.0f, 0.0f}};
+	clearColors[1].depthStencil = { 1.0f, 0 };
+	renderPassInfo.clearValueCount = 2;
+	renderPassInfo.pClearValues = clearColors;
+
+	VkViewport viewport = {};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float)appData.swapchain.extent.width;
+	viewport.height = (float)appData.swapchain.extent.height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+
+	VkRect2D scissor = {};
+	scissor.offset = { 0, 0 };
+	scissor.extent = appData.swapchain.extent;
+
+	RecordCull(commandBuffer, slot);
+
+	// Render
+	appData.disp.cmdSetViewport(commandBuffer, 0, 1, &viewport);
+	appData.disp.cmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+	WriteTimestamp(commandBuffer, TIMESTAMP_RENDER_QUERY);
+	appData.disp.cmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+	appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.graphicsPipeline);
+
+	VkBuffer vertexBuffers[] = { renderData.vertexBuffer };
+	VkDeviceSize offsets[] = { 0 };
+	appData.disp.cmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	appData.disp.cmdBindIndexBuffer(commandBuffer, renderData.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	appData.disp.cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.pipelineLayout, 0, 1, &renderData.descriptorSets[renderData.currentFrame + slot * MAX_FRAMES_IN_FLIGHT], 0, nullptr);
+
+	// The instance count was written by the culling pass
+	appData.disp.cmdDrawIndexedIndirect(commandBuffer, renderData.cullBuffers[renderData.currentFrame], 0, 1, sizeof(VkDrawIndexedIndirectCommand));
+
+	appData.disp.cmdEndRenderPass(commandBuffer);
+	WriteTimestamp(commandBuffer, TIMESTAMP_RENDER_QUERY + 1);
+
+	if (renderData.captureFrames[renderData.currentFrame] != 0)
+		RecordCapture(commandBuffer, image);
+}
 
-		appData.disp.cmdDispatch(renderData.commandBuffers[i], 1, 1, BLOCK_SIZE_Z);
+void RenderThread::RecordCull(VkCommandBuffer commandBuffer, u32 slot)
+{
+	// The frame that last used this buffer has completed, the draw restarts from no instance
+	const VkBuffer cullBuffer = renderData.cullBuffers[renderData.currentFrame];
+	VkDrawIndexedIndirectCommand drawCommand = {};
+	drawCommand.indexCount = (u32)(sceneData.mesh.GetIndices().size());
+
+	VkMemoryBarrier2KHR resetBarrier = {};
+	resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	resetBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+	resetBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	resetBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	resetBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+
+	// The count is read as draw arguments, the list by the vertex shader
+	VkMemoryBarrier2KHR drawBarrier = {};
+	drawBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	drawBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	drawBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	drawBarrier.dstStageMask = VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT_KHR | VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT_KHR;
+	drawBarrier.dstAccessMask = VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT_KHR | VK_ACCESS_2_SHADER_READ_BIT_KHR;
+
+	VkDependencyInfoKHR resetDependency = {};
+	resetDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	resetDependency.memoryBarrierCount = 1;
+	resetDependency.pMemoryBarriers = &resetBarrier;
+	VkDependencyInfoKHR drawDependency = resetDependency;
+	drawDependency.pMemoryBarriers = &drawBarrier;
+
+	WriteTimestamp(commandBuffer, TIMESTAMP_CULL_QUERY);
+	appData.disp.cmdUpdateBuffer(commandBuffer, cullBuffer, 0, sizeof(drawCommand), &drawCommand);
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &resetDependency);
+
+	appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.cullPipeline);
+	appData.disp.cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.pipelineLayout, 0, 1, &renderData.descriptorSets[renderData.currentFrame + slot * MAX_FRAMES_IN_FLIGHT], 0, nullptr);
+	appData.disp.cmdDispatch(commandBuffer, (renderData.simParams.objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &drawDependency);
+	WriteTimestamp(commandBuffer, TIMESTAMP_CULL_QUERY + 1);
+}
 
+void RenderThread::RecordSimulation(VkCommandBuffer commandBuffer, u32 stepCount, u32 slot)
+{
+	const Simulation::SimParams &params = renderData.simParams;
+	const u32 cellCount = params.chunkCountSide * params.chunkCountSide * params.chunkCountSide;
+	const u32 objectGroups = (params.objectCount + BIN_GROUP_SIZE - 1) / BIN_GROUP_SIZE;
+	const u32 cellGroups = (cellCount + SIM_GROUP_SIZE - 1) / SIM_GROUP_SIZE;
+	const u32 moveGroups = (params.objectCount + SIM_GROUP_SIZE - 1) / SIM_GROUP_SIZE;
+
+	SimConstants simConstants = {};
+	simConstants.worldSize = params.worldSize;
+	simConstants.distMax = params.distMax;
+	simConstants.distMin = params.distMin;
+	simConstants.maxSpeed = params.maxSpeed;
+	simConstants.deltaTime = static_cast<f32>(simTimestep.GetStepDuration());
+
+	// The previous submit may still be stepping, packing or copying out the objects
+	VkMemoryBarrier2KHR startBarrier = {};
+	startBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	startBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+	startBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	startBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	startBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+
+	VkMemoryBarrier2KHR computeBarrier = {};
+	computeBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	computeBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	computeBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	computeBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	computeBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+
+	// The final state is packed and read back, the packed stream is then copied to the render slot.
+	// The timeline semaphore makes the copy visible to the graphics queue.
+	VkMemoryBarrier2KHR packBarrier = {};
+	packBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	packBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	packBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	packBarrier.dstStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR | VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+	packBarrier.dstAccessMask = VK_ACCESS_2_SHADER_READ_BIT_KHR | VK_ACCESS_2_TRANSFER_READ_BIT_KHR;
+
+	VkMemoryBarrier2KHR copyBarrier = {};
+	copyBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	copyBarrier.srcStageMask = VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT_KHR;
+	copyBarrier.srcAccessMask = VK_ACCESS_2_SHADER_WRITE_BIT_KHR;
+	copyBarrier.dstStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+	copyBarrier.dstAccessMask = VK_ACCESS_2_TRANSFER_READ_BIT_KHR;
+
+	VkDependencyInfoKHR startDependency = {};
+	startDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	startDependency.memoryBarrierCount = 1;
+	startDependency.pMemoryBarriers = &startBarrier;
+	VkDependencyInfoKHR computeDependency = startDependency;
+	computeDependency.pMemoryBarriers = &computeBarrier;
+	VkDependencyInfoKHR packDependency = startDependency;
+	packDependency.pMemoryBarriers = &packBarrier;
+	VkDependencyInfoKHR copyDependency = startDependency;
+	copyDependency.pMemoryBarriers = &copyBarrier;
+
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &startDependency);
+
+	const VkDescriptorSet binSet = renderData.computeDescriptorSets[renderData.currentFrame];
+	const VkDescriptorSet moveSet = renderData.computeDescriptorSets[renderData.currentFrame + MAX_FRAMES_IN_FLIGHT];
+	const VkDescriptorSet packSet = renderData.computeDescriptorSets[renderData.currentFrame + MAX_FRAMES_IN_FLIGHT * 2];
+	// The timestep has already advanced past the steps recorded here, a loaded snapshot starts at firstTick
+	const u64 firstStepTick = renderData.firstTick + simTimestep.GetTickCount() - stepCount;
+	for (u32 step = 0; step < stepCount; step++)
+	{
+		if (step > 0)
+			appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &computeDependency);
+
+		simConstants.tick = (u32)(firstStepTick + step);
+		appData.disp.cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &binSet, 0, 0);
+		appData.disp.cmdPushConstants(commandBuffer, renderData.computePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(SimConstants), &simConstants);
+
+		// Binning: count, scan and scatter
+		const u32 query = step * COMPUTE_PASS_COUNT * 2;
+		appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[COMPUTE_BIN_COUNT]);
+		WriteTimestamp(commandBuffer, query + COMPUTE_BIN_COUNT * 2);
+		appData.disp.cmdDispatch(commandBuffer, objectGroups, 1, 1);
+		WriteTimestamp(commandBuffer, query + COMPUTE_BIN_COUNT * 2 + 1);
+		appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &computeDependency);
+
+		appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[COMPUTE_BIN_SCAN]);
+		WriteTimestamp(commandBuffer, query + COMPUTE_BIN_SCAN * 2);
+		appData.disp.cmdDispatch(commandBuffer, 1, 1, 1);
+		WriteTimestamp(commandBuffer, query + COMPUTE_BIN_SCAN * 2 + 1);
+		appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &computeDependency);
+
+		appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[COMPUTE_BIN_SCATTER]);
+		WriteTimestamp(commandBuffer, query + COMPUTE_BIN_SCATTER * 2);
+		appData.disp.cmdDispatch(commandBuffer, objectGroups, 1, 1);
+		WriteTimestamp(commandBuffer, query + COMPUTE_BIN_SCATTER * 2 + 1);
+		appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &computeDependency);
 
-		// Render
-		appData.disp.cmdSetViewport(renderData.commandBuffers[i], 0, 1, &viewport);
-		appData.disp.cmdSetScissor(renderData.commandBuffers[i], 0, 1, &scissor);
+		// Sim 0
+		appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[COMPUTE_SIM_ACCEL]);
+		WriteTimestamp(commandBuffer, query + COMPUTE_SIM_ACCEL * 2);
+		appData.disp.cmdDispatch(commandBuffer, cellGroups, 1, 1);
+		WriteTimestamp(commandBuffer, query + COMPUTE_SIM_ACCEL * 2 + 1);
+		appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &computeDependency);
 
-		appData.disp.cmdBeginRenderPass(renderData.commandBuffers[i], &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+		// Sim 1
+		appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[COMPUTE_SIM_MOVE]);
+		appData.disp.cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &moveSet, 0, 0);
+		WriteTimestamp(commandBuffer, query + COMPUTE_SIM_MOVE * 2);
+		appData.disp.cmdDispatch(commandBuffer, moveGroups, 1, 1);
+		WriteTimestamp(commandBuffer, query + COMPUTE_SIM_MOVE * 2 + 1);
+	}
 
-		appData.disp.cmdBindPipeline(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.graphicsPipeline);
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &packDependency);
 
-		VkBuffer vertexBuffers[] = { renderData.vertexBuffer };
-		VkDeviceSize offsets[] = { 0 };
-		appData.disp.cmdBindVertexBuffers(renderData.commandBuffers[i], 0, 1, vertexBuffers, offsets);
+	// Only the packed stream crosses to the graphics queue, RENDER_INSTANCE_SIZE bytes per boid instead of the whole object
+	WriteTimestamp(commandBuffer, TIMESTAMP_PACK_QUERY);
+	appData.disp.cmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelines[COMPUTE_PACK]);
+	appData.disp.cmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, renderData.computePipelineLayout, 0, 1, &packSet, 0, 0);
+	appData.disp.cmdDispatch(commandBuffer, moveGroups, 1, 1);
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &copyDependency);
 
-		appData.disp.cmdBindDescriptorSets(renderData.commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, renderData.pipelineLayout, 0, 1, &renderData.descriptorSets[i], 0, nullptr);
+	VkBufferCopy copyRegion = {};
+	copyRegion.srcOffset = renderData.sizeObjects + renderData.sizeBinBuf;
+	copyRegion.size = renderData.sizeInstances;
+	appData.disp.cmdCopyBuffer(commandBuffer, renderData.computeBuffer, renderData.renderObjectBuffers[slot], 1, &copyRegion);
+	WriteTimestamp(commandBuffer, TIMESTAMP_PACK_QUERY + 1);
+
+	// Snapshots and trajectories need the whole objects, they are copied from the simulation state
+	if (renderData.snapshotPending && renderData.snapshotFrame == renderData.currentFrame)
+		RecordObjectReadback(commandBuffer, renderData.snapshotBuffer, 0);
+	if (renderData.recordTicks[renderData.currentFrame] != 0)
+		RecordObjectReadback(commandBuffer, renderData.recordBuffer, (VkDeviceSize)(renderData.currentFrame) * renderData.sizeObjects);
+}
 
-		appData.disp.cmdDraw(renderData.commandBuffers[i], (u32)(sceneData.mesh.GetVertices().size()), OBJECT_COUNT, 0, 0);
+void RenderThread::WriteTimestamp(VkCommandBuffer commandBuffer, u32 query)
+{
+	// All commands: the timestamp is written once the work recorded before it has completed
+	if (renderData.timestampsEnabled)
+		appData.disp.cmdWriteTimestamp2KHR(commandBuffer, VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR, renderData.timestampPools[renderData.currentFrame], query);
+}
 
-		appData.disp.cmdEndRenderPass(renderData.commandBuffers[i]);
+void RenderThread::ReadTimestamps(u32 frame)
+{
+	if (!renderData.timestampsEnabled || !renderData.timestampsPending[frame])
+		return;
+	renderData.timestampsPending[frame] = false;
+
+	// Value and availability per query. The frame's timeline values have been waited on,
+	// so the results are there and this never blocks, an unavailable pair is skipped.
+	u64 results[TIMESTAMP_QUERY_COUNT * 2] = {};
+	const VkQueryResultFlags flags = VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT;
+	const VkQueryPool pool = renderData.timestampPools[frame];
+	const u32 steps = renderData.timestampSteps[frame];
+	if (steps > 0)
+	{
+		appData.disp.getQueryPoolResults(pool, 0, steps * COMPUTE_PASS_COUNT * 2, steps * COMPUTE_PASS_COUNT * 2 * 2 * sizeof(u64), results, 2 * sizeof(u64), flags);
+		appData.disp.getQueryPoolResults(pool, TIMESTAMP_PACK_QUERY, 2, 2 * 2 * sizeof(u64), &results[TIMESTAMP_PACK_QUERY * 2], 2 * sizeof(u64), flags);
+	}
+	appData.disp.getQueryPoolResults(pool, TIMESTAMP_CULL_QUERY, 4, 4 * 2 * sizeof(u64), &results[TIMESTAMP_CULL_QUERY * 2], 2 * sizeof(u64), flags);
 
-		if (appData.disp.endCommandBuffer(renderData.commandBuffers[i]) != VK_SUCCESS)
+#ifdef ENABLE_TRACE
+	// GPU ticks move to the trace clock with the largest (submit time - first timestamp) seen so far.
+	// Work cannot start before its submit, so the offset converges on frames where the GPU starts right away.
+	u64 first = UINT64_MAX;
+	for (u32 i = 0; i < TIMESTAMP_QUERY_COUNT; i++)
+	{
+		if (results[i * 2 + 1] != 0 && results[i * 2] < first)
+			first = results[i * 2];
+	}
+	if (first != UINT64_MAX)
+	{
+		const s64 offset = (s64)(renderData.timestampSubmitTimes[frame]) - (s64)(first * appData.timestampPeriod);
+		if (!renderData.gpuClockOffsetValid || offset > renderData.gpuClockOffset)
+			renderData.gpuClockOffset = offset;
+		renderData.gpuClockOffsetValid = true;
+	}
+#endif
+
+	const f64 toMilliseconds = appData.timestampPeriod / 1000000.0;
+	auto addSample = [&](u32 pass, u32 query, const char *track)
+	{
+		const u64 *begin = &results[query * 2];
+		const u64 *end = &results[(query + 1) * 2];
+		if (begin[1] != 0 && end[1] != 0 && end[0] >= begin[0])
 		{
-			GameThread::SendErrorPopup("failed to record command buffer");
-			return false;
+			gpuTimings.AddSample(pass, (end[0] - begin[0]) * toMilliseconds);
+			TRACE_COMPLETE(track, profilePassNames[pass], (u64)((s64)(begin[0] * appData.timestampPeriod) + renderData.gpuClockOffset), (u64)((end[0] - begin[0]) * appData.timestampPeriod));
 		}
+	};
+	for (u32 step = 0; step < steps; step++)
+	{
+		for (u32 pass = 0; pass < COMPUTE_PASS_COUNT; pass++)
+			addSample(pass, (step * COMPUTE_PASS_COUNT + pass) * 2, "GPU Compute");
 	}
-	return true;
+	if (steps > 0)
+		addSample(PROFILE_PASS_PACK, TIMESTAMP_PACK_QUERY, "GPU Compute");
+	addSample(PROFILE_PASS_CULL, TIMESTAMP_CULL_QUERY, "GPU Graphics");
+	addSample(PROFILE_PASS_RENDER, TIMESTAMP_RENDER_QUERY, "GPU Graphics");
+}
+
+void RenderThread::LogGpuTimings()
+{
+	if (!renderData.timestampsEnabled)
+		return;
+
+	std::string line = "GPU avg/p99 (ms):";
+	for (u32 i = 0; i < gpuTimings.GetPassCount(); i++)
+	{
+		const Core::TimingStats stats = gpuTimings.GetStats(i);
+		if (stats.count > 0)
+			line += " " + gpuTimings.GetName(i) + " " + std::to_string(stats.avg) + "/" + std::to_string(stats.p99);
+	}
+	GameThread::LogMessage(line + "\n");
 }
 
 bool RenderThread::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory)
@@ -1313,12 +2244,10 @@ bool RenderThread::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
 	bufferInfo.usage = usage;
-	bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
-	bufferInfo.queueFamilyIndexCount = 2;
-	auto transfer = appData.device.get_queue_index(vkb::QueueType::transfer);
-	auto graph = appData.device.get_queue_index(vkb::QueueType::graphics);
-	u32 queueFamilies[2] = {appData.device.get_queue_index(vkb::QueueType::graphics).value(), transfer.has_value() ? transfer.value() : graph.has_value()};
-	bufferInfo.pQueueFamilyIndices = queueFamilies;
+	// Buffers move between the graphics, transfer and compute queues without ownership transfers
+	bufferInfo.sharingMode = renderData.queueFamilies.size() > 1 ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE;
+	bufferInfo.queueFamilyIndexCount = (u32)(renderData.queueFamilies.size());
+	bufferInfo.pQueueFamilyIndices = renderData.queueFamilies.data();
 
 	if (appData.disp.createBuffer(&bufferInfo, nullptr, &buffer) != VK_SUCCESS)
 	{
@@ -1346,17 +2275,27 @@ bool RenderThread::CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkM
 
 bool RenderThread::CreateSyncObjects()
 {
+	TRACE_FUNCTION();
 	renderData.availableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderData.finishedSemaphore.resize(appData.swapchain.image_count);
-	renderData.inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
-	renderData.imageInFlight.resize(appData.swapchain.image_count, VK_NULL_HANDLE);
+	renderData.imageRenderValues.resize(appData.swapchain.image_count, 0);
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+	VkSemaphoreTypeCreateInfo timelineTypeInfo = {};
+	timelineTypeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+	timelineTypeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+	timelineTypeInfo.initialValue = 0;
+	VkSemaphoreCreateInfo timelineInfo = semaphoreInfo;
+	timelineInfo.pNext = &timelineTypeInfo;
+
+	if (appData.disp.createSemaphore(&timelineInfo, nullptr, &renderData.graphicsTimeline) != VK_SUCCESS ||
+		appData.disp.createSemaphore(&timelineInfo, nullptr, &renderData.computeTimeline) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to create sync objects");
+		return false;
+	}
 
 	for (u32 i = 0; i < appData.swapchain.image_count; i++)
 	{
@@ -1369,8 +2308,7 @@ bool RenderThread::CreateSyncObjects()
 
 	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		if (appData.disp.createSemaphore(&semaphoreInfo, nullptr, &renderData.availableSemaphores[i]) != VK_SUCCESS ||
-			appData.disp.createFence(&fenceInfo, nullptr, &renderData.inFlightFences[i]) != VK_SUCCESS)
+		if (appData.disp.createSemaphore(&semaphoreInfo, nullptr, &renderData.availableSemaphores[i]) != VK_SUCCESS)
 		{
 			GameThread::SendErrorPopup("failed to create sync objects");
 			return false;
@@ -1379,8 +2317,123 @@ bool RenderThread::CreateSyncObjects()
 	return true;
 }
 
+bool RenderThread::CreateTimestampPools()
+{
+	TRACE_FUNCTION();
+	gpuTimings.Init(std::vector<std::string>(profilePassNames, profilePassNames + PROFILE_PASS_COUNT), GPU_TIMING_WINDOW);
+
+	// Both queues write timestamps, the profiler stays off if either cannot
+	auto graphics = appData.device.get_queue_index(vkb::QueueType::graphics);
+	auto compute = appData.device.get_queue_index(vkb::QueueType::compute);
+	const u32 families[2] = { graphics.value(), compute.has_value() ? compute.value() : graphics.value() };
+	for (u32 i = 0; i < 2; i++)
+	{
+		if (appData.device.queue_families[families[i]].timestampValidBits == 0 || appData.timestampPeriod <= 0)
+		{
+			GameThread::LogMessage("Timestamps are not supported, GPU timings are disabled\n");
+			return true;
+		}
+	}
+
+	VkQueryPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	poolInfo.queryCount = TIMESTAMP_QUERY_COUNT;
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (appData.disp.createQueryPool(&poolInfo, nullptr, &renderData.timestampPools[i]) != VK_SUCCESS)
+		{
+			GameThread::SendErrorPopup("failed to create timestamp query pools");
+			return false;
+		}
+	}
+	renderData.timestampsEnabled = true;
+	return true;
+}
+
+VkMemoryPropertyFlags RenderThread::GetReadbackMemoryProperties()
+{
+	// Readbacks are read by the CPU byte by byte, cached memory keeps that fast. Coherent so they never need invalidating.
+	VkMemoryPropertyFlags properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+	VkPhysicalDeviceMemoryProperties memProperties;
+	appData.instDisp.getPhysicalDeviceMemoryProperties(appData.device.physical_device, &memProperties);
+	for (u32 i = 0; i < memProperties.memoryTypeCount; i++)
+	{
+		if ((memProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return properties;
+	}
+	return properties & ~VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+}
+
+bool RenderThread::CreateCaptureBuffer()
+{
+	TRACE_FUNCTION();
+	if (!offscreen.enabled || offscreen.captureInterval == 0)
+		return true;
+
+	renderData.captureSlotSize = appData.swapchain.extent.width * appData.swapchain.extent.height * 4;
+	if (!CreateBuffer((VkDeviceSize)(renderData.captureSlotSize) * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, GetReadbackMemoryProperties(), renderData.captureBuffer, renderData.captureBufferMemory))
+		return false;
+	if (appData.disp.mapMemory(renderData.captureBufferMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&renderData.captureBufferMapped)) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to map capture buffer");
+		return false;
+	}
+	return true;
+}
+
+void RenderThread::RecordCapture(VkCommandBuffer commandBuffer, u32 image)
+{
+	// The render pass left the target in TRANSFER_SRC_OPTIMAL, each frame in flight copies to its own slot
+	VkBufferImageCopy region = {};
+	region.bufferOffset = (VkDeviceSize)(renderData.currentFrame) * renderData.captureSlotSize;
+	region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	region.imageSubresource.layerCount = 1;
+	region.imageExtent = { appData.swapchain.extent.width, appData.swapchain.extent.height, 1 };
+	appData.disp.cmdCopyImageToBuffer(commandBuffer, renderData.swapchainImages[image], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, renderData.captureBuffer, 1, &region);
+
+	// Read on the CPU once the frame's timeline value is reached
+	VkMemoryBarrier2KHR hostBarrier = {};
+	hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+	hostBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT_KHR;
+	hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT_KHR;
+
+	VkDependencyInfoKHR hostDependency = {};
+	hostDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	hostDependency.memoryBarrierCount = 1;
+	hostDependency.pMemoryBarriers = &hostBarrier;
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &hostDependency);
+}
+
+void RenderThread::WriteCapture(u32 frame)
+{
+	const u64 captured = renderData.captureFrames[frame];
+	if (captured == 0)
+		return;
+	renderData.captureFrames[frame] = 0;
+
+	if (captureWriters[frame].joinable())
+		captureWriters[frame].join();
+	const IVec2 size((s32)(appData.swapchain.extent.width), (s32)(appData.swapchain.extent.height));
+	const std::string path = Resource::ImageCapture::GetFramePath(offscreen.capturePrefix, captured);
+	const u8 *pixels = renderData.captureBufferMapped + (size_t)(frame) * renderData.captureSlotSize;
+	// PNG encoding takes longer than a frame, the slot is not captured into again until the writer is done
+	captureWriting[frame] = true;
+	captureWriters[frame] = std::thread([this, frame, path, pixels, size]()
+	{
+		TRACE_THREAD_NAME("Capture Writer");
+		TRACE_SCOPE("WriteCapture");
+		if (!Resource::ImageCapture::WritePng(path, pixels, size.x * 4, size))
+			GameThread::LogMessage("Could not write " + path + "\n");
+		captureWriting[frame] = false;
+	});
+}
+
 bool RenderThread::CreateDescriptorPool()
 {
+	TRACE_FUNCTION();
 	VkDescriptorPoolSize poolSize0 = {};
 	poolSize0.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
 	poolSize0.descriptorCount = 256;
@@ -1418,28 +2471,32 @@ bool RenderThread::CreateDescriptorPool()
 
 bool RenderThread::CreateDescriptorSets()
 {
-	std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, renderData.descriptorSetLayoutRender);
+	TRACE_FUNCTION();
+	// One render set per frame in flight and object copy, indexed by frame + slot * MAX_FRAMES_IN_FLIGHT
+	const u32 renderSetCount = MAX_FRAMES_IN_FLIGHT * RENDER_OBJECT_BUFFER_COUNT;
+	std::vector<VkDescriptorSetLayout> layouts(renderSetCount, renderData.descriptorSetLayoutRender);
 	VkDescriptorSetAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfo.descriptorPool = renderData.descriptorPool;
-	allocInfo.descriptorSetCount = MAX_FRAMES_IN_FLIGHT;
+	allocInfo.descriptorSetCount = renderSetCount;
 	allocInfo.pSetLayouts = layouts.data();
 
-	std::vector<VkDescriptorSetLayout> layoutsCompute(MAX_FRAMES_IN_FLIGHT * 4, renderData.descriptorSetLayoutCompute);
+	// Compute sets per frame in flight: binning and sim0, then sim1, then pack
+	std::vector<VkDescriptorSetLayout> layoutsCompute(MAX_FRAMES_IN_FLIGHT * 3, renderData.descriptorSetLayoutCompute);
 	VkDescriptorSetAllocateInfo allocInfoCompute = {};
 	allocInfoCompute.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	allocInfoCompute.descriptorPool = renderData.descriptorPoolCompute;
-	allocInfoCompute.descriptorSetCount = MAX_FRAMES_IN_FLIGHT * 4;
+	allocInfoCompute.descriptorSetCount = MAX_FRAMES_IN_FLIGHT * 3;
 	allocInfoCompute.pSetLayouts = layoutsCompute.data();
 
-	renderData.descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
+	renderData.descriptorSets.resize(renderSetCount);
 	if (appData.disp.allocateDescriptorSets(&allocInfo, renderData.descriptorSets.data()) != VK_SUCCESS)
 	{
 		GameThread::SendErrorPopup("failed to allocate descriptor sets");
 		return false;
 	}
 
-	renderData.computeDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT*4);
+	renderData.computeDescriptorSets.resize(MAX_FRAMES_IN_FLIGHT*3);
 	if (appData.disp.allocateDescriptorSets(&allocInfoCompute, renderData.computeDescriptorSets.data()) != VK_SUCCESS)
 	{
 		GameThread::SendErrorPopup("failed to allocate descriptor sets");
@@ -1451,7 +2508,7 @@ bool RenderThread::CreateDescriptorSets()
 		VkDescriptorBufferInfo bufferInfoUBO = {};
 		bufferInfoUBO.buffer = renderData.objectBuffers[i];
 		bufferInfoUBO.offset = 0;
-		bufferInfoUBO.range = sizeof(Mat4);
+		bufferInfoUBO.range = sizeof(FrameUniforms);
 
 		VkDescriptorBufferInfo bufferInfoLast = {};
 		bufferInfoLast.buffer = renderData.computeBuffer;
@@ -1463,44 +2520,57 @@ bool RenderThread::CreateDescriptorSets()
 		bufferInfoObjects.offset = 0;
 		bufferInfoObjects.range = renderData.sizeObjects;
 
-		VkDescriptorBufferInfo bufferInfoMerge = {};
-		bufferInfoMerge.buffer = renderData.computeBuffer;
-		bufferInfoMerge.offset = renderData.sizeObjects;
-		bufferInfoMerge.range = renderData.sizeMergeBuf;
+		VkDescriptorBufferInfo bufferInfoBins = {};
+		bufferInfoBins.buffer = renderData.computeBuffer;
+		bufferInfoBins.offset = renderData.sizeObjects;
+		bufferInfoBins.range = renderData.sizeBinBuf;
 
-		VkDescriptorBufferInfo bufferInfoSort = {};
-		bufferInfoSort.buffer = renderData.computeBuffer;
-		bufferInfoSort.offset = renderData.sizeObjects + renderData.sizeMergeBuf;
-		bufferInfoSort.range = renderData.sizeSortBuf;
+		VkDescriptorBufferInfo bufferInfoInstances = {};
+		bufferInfoInstances.buffer = renderData.computeBuffer;
+		bufferInfoInstances.offset = renderData.sizeObjects + renderData.sizeBinBuf;
+		bufferInfoInstances.range = renderData.sizeInstances;
 
 		VkDescriptorImageInfo imageInfo = {};
 		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 		imageInfo.imageView = renderData.textureImageView;
 		imageInfo.sampler = renderData.textureSampler;
 
+		VkDescriptorBufferInfo bufferInfoVisible = {};
+		bufferInfoVisible.buffer = renderData.cullBuffers[i];
+		bufferInfoVisible.offset = 0;
+		bufferInfoVisible.range = renderData.sizeCullBuf;
 
-		VkWriteDescriptorSet descriptorWriteUBO = CreateWriteDescriptorSet(renderData.descriptorSets[i], 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &bufferInfoUBO);
-		VkWriteDescriptorSet descriptorWriteObjects = CreateWriteDescriptorSet(renderData.descriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteImage = CreateWriteDescriptorSet(renderData.descriptorSets[i], 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, &imageInfo);
-
-		VkWriteDescriptorSet descriptorWriteSort0A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteSort0B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoSort);
+		for (u32 slot = 0; slot < RENDER_OBJECT_BUFFER_COUNT; slot++)
+		{
+			VkDescriptorBufferInfo bufferInfoRender = {};
+			bufferInfoRender.buffer = renderData.renderObjectBuffers[slot];
+			bufferInfoRender.offset = 0;
+			bufferInfoRender.range = renderData.sizeInstances;
+
+			const VkDescriptorSet renderSet = renderData.descriptorSets[i + slot * MAX_FRAMES_IN_FLIGHT];
+			VkWriteDescriptorSet descriptorWriteUBO = CreateWriteDescriptorSet(renderSet, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, &bufferInfoUBO);
+			VkWriteDescriptorSet descriptorWriteObjects = CreateWriteDescriptorSet(renderSet, 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoRender);
+			VkWriteDescriptorSet descriptorWriteImage = CreateWriteDescriptorSet(renderSet, 2, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, nullptr, &imageInfo);
+			VkWriteDescriptorSet descriptorWriteVisible = CreateWriteDescriptorSet(renderSet, 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoVisible);
+
+			VkWriteDescriptorSet renderArray[4] = {descriptorWriteUBO, descriptorWriteObjects, descriptorWriteImage, descriptorWriteVisible};
+			appData.disp.updateDescriptorSets(4, renderArray, 0, nullptr);
+		}
 
-		VkWriteDescriptorSet descriptorWriteSort1A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoSort);
-		VkWriteDescriptorSet descriptorWriteSort1B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoMerge);
+		// Binning passes and sim0 share a set, sim1 reads the objects through both bindings
+		VkWriteDescriptorSet descriptorWriteBinA = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
+		VkWriteDescriptorSet descriptorWriteBinB = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoBins);
 
-		VkWriteDescriptorSet descriptorWriteSim0A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteSim0B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoMerge);
+		VkWriteDescriptorSet descriptorWriteSim1A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
+		VkWriteDescriptorSet descriptorWriteSim1B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoLast);
 
-		VkWriteDescriptorSet descriptorWriteSim1A = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
-		VkWriteDescriptorSet descriptorWriteSim1B = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 3], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoLast);
+		VkWriteDescriptorSet descriptorWritePackA = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoObjects);
+		VkWriteDescriptorSet descriptorWritePackB = CreateWriteDescriptorSet(renderData.computeDescriptorSets[i + MAX_FRAMES_IN_FLIGHT * 2], 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, &bufferInfoInstances);
 
-		VkWriteDescriptorSet descriptorArray[11] = {descriptorWriteUBO, descriptorWriteObjects, descriptorWriteImage,
-													descriptorWriteSort0A, descriptorWriteSort0B,
-													descriptorWriteSort1A, descriptorWriteSort1B,
-													descriptorWriteSim0A, descriptorWriteSim0B,
-													descriptorWriteSim1A, descriptorWriteSim1B};
-		appData.disp.updateDescriptorSets(11, descriptorArray, 0, nullptr);
+		VkWriteDescriptorSet descriptorArray[6] = {descriptorWriteBinA, descriptorWriteBinB,
+													descriptorWriteSim1A, descriptorWriteSim1B,
+													descriptorWritePackA, descriptorWritePackB};
+		appData.disp.updateDescriptorSets(6, descriptorArray, 0, nullptr);
 	}
 
 	return true;
@@ -1514,15 +2584,12 @@ bool RenderThread::RecreateSwapchain()
 		return true;
 	}
 	appData.disp.deviceWaitIdle();
-	if (renderData.commandPool != VK_NULL_HANDLE)
+	if (renderData.depthImageView != VK_NULL_HANDLE)
 	{
 		appData.disp.destroyImageView(renderData.depthImageView, nullptr);
 		appData.disp.destroyImage(renderData.depthImage, nullptr);
 		appData.disp.freeMemory(renderData.depthImageMemory, nullptr);
-
-		appData.disp.destroyCommandPool(renderData.commandPool, nullptr);
-		appData.disp.destroyCommandPool(renderData.transfertCommandPool, nullptr);
-		renderData.commandPool = VK_NULL_HANDLE;
+		renderData.depthImageView = VK_NULL_HANDLE;
 
 		for (u32 i = 0; i < renderData.framebuffers.size(); i++)
 			appData.disp.destroyFramebuffer(renderData.framebuffers[i], nullptr);
@@ -1536,25 +2603,30 @@ bool RenderThread::RecreateSwapchain()
 			return true;
 		return false;
 	}
+	// Command buffers are recorded every frame, only the images depend on the swapchain
 	if (!CreateDepthResources() ||
-		!CreateFramebuffers() ||
-		!CreateCommandPool() ||
-		!CreateCommandBuffers())
+		!CreateFramebuffers())
 		return false;
+	renderData.imageRenderValues.resize(appData.swapchain.image_count, 0);
 	resized = false;
 	return true;
 }
 
 bool RenderThread::UpdateUniformBuffer(u32 image)
 {
-	Vec4 *dataPtr = renderData.objectBuffersMapped[image];
-	const auto &mat = appData.gm->GetViewProjectionMatrix();
-	const Vec4 *matPtr = reinterpret_cast<const Vec4*>(mat.content);
-	for (u32 i = 0; i < 4; i++)
-	{
-		dataPtr[i] = matPtr[i];
-	}
-
+	FrameUniforms *uniforms = reinterpret_cast<FrameUniforms*>(renderData.objectBuffersMapped[image]);
+	// The game thread hands the matrix over transposed for the shaders
+	const Mat4 &mat = appData.gm->GetViewProjectionMatrix();
+	uniforms->vp = mat;
+
+	const Frustum frustum = Frustum::FromViewProjection(mat.TransposeMatrix());
+	uniforms->planes[0] = frustum.left;
+	uniforms->planes[1] = frustum.right;
+	uniforms->planes[2] = frustum.bottom;
+	uniforms->planes[3] = frustum.top;
+	uniforms->planes[4] = frustum.front;
+	uniforms->planes[5] = frustum.back;
+	uniforms->cullRadius = renderData.cullRadius;
 	return true;
 }
 
@@ -1618,8 +2690,109 @@ bool RenderThread::HasStencilComponent(VkFormat format)
 	return format == VK_FORMAT_D32_SFLOAT_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT;
 }
 
-bool RenderThread::DrawFrame()
+bool RenderThread::CreateSnapshotBuffer()
+{
+	TRACE_FUNCTION();
+	if (renderData.snapshotBuffer != VK_NULL_HANDLE)
+		return true;
+	if (!CreateBuffer(renderData.sizeObjects, VK_BUFFER_USAGE_TRANSFER_DST_BIT, GetReadbackMemoryProperties(), renderData.snapshotBuffer, renderData.snapshotBufferMemory))
+		return false;
+	if (appData.disp.mapMemory(renderData.snapshotBufferMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&renderData.snapshotBufferMapped)) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to map snapshot buffer");
+		return false;
+	}
+	return true;
+}
+
+void RenderThread::RecordObjectReadback(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize offset)
+{
+	// Recorded after the pack barrier, the last step's writes are visible to transfers
+	VkBufferCopy region = {};
+	region.dstOffset = offset;
+	region.size = renderData.sizeObjects;
+	appData.disp.cmdCopyBuffer(commandBuffer, renderData.computeBuffer, buffer, 1, &region);
+
+	VkMemoryBarrier2KHR hostBarrier = {};
+	hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2_KHR;
+	hostBarrier.srcStageMask = VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT_KHR;
+	hostBarrier.srcAccessMask = VK_ACCESS_2_TRANSFER_WRITE_BIT_KHR;
+	hostBarrier.dstStageMask = VK_PIPELINE_STAGE_2_HOST_BIT_KHR;
+	hostBarrier.dstAccessMask = VK_ACCESS_2_HOST_READ_BIT_KHR;
+
+	VkDependencyInfoKHR hostDependency = {};
+	hostDependency.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO_KHR;
+	hostDependency.memoryBarrierCount = 1;
+	hostDependency.pMemoryBarriers = &hostBarrier;
+	appData.disp.cmdPipelineBarrier2KHR(commandBuffer, &hostDependency);
+}
+
+void RenderThread::WriteSnapshot(u32 frame)
+{
+	// Called once the frame's timeline value is reached, the readback is complete
+	if (!renderData.snapshotPending || renderData.snapshotFrame != frame)
+		return;
+	renderData.snapshotPending = false;
+
+	if (snapshotWriter.joinable())
+		snapshotWriter.join();
+	const std::string path = Simulation::Snapshot::GetPath(snapshot.savePrefix, renderData.snapshotTick);
+	const Simulation::SimParams params = renderData.simParams;
+	const u64 tick = renderData.snapshotTick;
+	const u8 *objects = renderData.snapshotBufferMapped;
+	// Disk writes of a few hundred MB would stall the frame, the buffer stays untouched until the writer is done
+	snapshotWriter = std::thread([this, path, params, tick, objects]()
+	{
+		TRACE_THREAD_NAME("Snapshot Writer");
+		TRACE_SCOPE("WriteSnapshot");
+		auto writeStart = std::chrono::steady_clock::now();
+		std::string error;
+		if (Simulation::Snapshot::Write(path, params, tick, objects, error))
+			GameThread::LogMessage("Saved " + std::to_string(params.objectCount) + " boids to " + path + " in " +
+				std::to_string(std::chrono::duration<f64, std::milli>(std::chrono::steady_clock::now() - writeStart).count()) + " ms\n");
+		else
+			GameThread::LogMessage("Could not save the snapshot: " + error + "\n");
+		snapshotWriting = false;
+	});
+}
+
+bool RenderThread::CreateRecordBuffer()
+{
+	TRACE_FUNCTION();
+	if (trajectory.path.empty())
+		return true;
+
+	if (!CreateBuffer(renderData.sizeObjects * MAX_FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_TRANSFER_DST_BIT, GetReadbackMemoryProperties(), renderData.recordBuffer, renderData.recordBufferMemory))
+		return false;
+	if (appData.disp.mapMemory(renderData.recordBufferMemory, 0, VK_WHOLE_SIZE, 0, reinterpret_cast<void **>(&renderData.recordBufferMapped)) != VK_SUCCESS)
+	{
+		GameThread::SendErrorPopup("failed to map trajectory buffer");
+		return false;
+	}
+	if (!recorder.Start(trajectory.path, renderData.simParams, trajectory.interval))
+	{
+		GameThread::SendErrorPopup("could not record a trajectory to " + trajectory.path);
+		return false;
+	}
+	return true;
+}
+
+void RenderThread::SubmitTrajectory(u32 frame)
 {
+	const u64 tick = renderData.recordTicks[frame];
+	if (tick == 0)
+		return;
+	renderData.recordTicks[frame] = 0;
+
+	// Only quantizes into the recorder's queue, a full queue drops the frame instead of waiting
+	TRACE_SCOPE("SubmitTrajectory");
+	const Vec4 *objects = reinterpret_cast<const Vec4 *>(renderData.recordBufferMapped + (size_t)(frame) * renderData.sizeObjects);
+	recorder.SubmitObjects(tick, objects, renderData.simParams.objectCount);
+}
+
+bool RenderThread::DrawFrame(f64 deltaTime)
+{
+	TRACE_FUNCTION();
 	if (resized)
 	{
 		HandleResize();
@@ -1632,54 +2805,122 @@ bool RenderThread::DrawFrame()
 			return RecreateSwapchain();
 	}
 
-	appData.disp.waitForFences(1, &renderData.inFlightFences[renderData.currentFrame], VK_TRUE, UINT64_MAX);
+	// Wait for the last submits of this frame slot, their command pools and uniform buffer are reused
+	VkSemaphore frameSemaphores[2] = { renderData.graphicsTimeline, renderData.computeTimeline };
+	u64 frameValues[2] = { renderData.frameRenderValues[renderData.currentFrame], renderData.frameSimValues[renderData.currentFrame] };
+	VkSemaphoreWaitInfoKHR frameWaitInfo = {};
+	frameWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	frameWaitInfo.semaphoreCount = 2;
+	frameWaitInfo.pSemaphores = frameSemaphores;
+	frameWaitInfo.pValues = frameValues;
+	TRACE_BEGIN("FrameWait");
+	auto phaseStart = std::chrono::steady_clock::now();
+	appData.disp.waitSemaphoresKHR(&frameWaitInfo, UINT64_MAX);
+	auto phaseEnd = std::chrono::steady_clock::now();
+	TRACE_END("FrameWait");
+	frameTimings.Record(FRAME_PHASE_FRAME_WAIT, phaseEnd - phaseStart);
+	ReadTimestamps(renderData.currentFrame);
+	WriteCapture(renderData.currentFrame);
+	WriteSnapshot(renderData.currentFrame);
+	SubmitTrajectory(renderData.currentFrame);
+
+	// Offscreen targets belong to a frame slot, there is nothing to acquire
+	u32 imgIndex = renderData.currentFrame;
+	VkResult result = VK_SUCCESS;
+	if (!offscreen.enabled)
+	{
+		TRACE_BEGIN("Acquire");
+		phaseStart = std::chrono::steady_clock::now();
+		result = appData.disp.acquireNextImageKHR(
+			appData.swapchain, UINT64_MAX, renderData.availableSemaphores[renderData.currentFrame], VK_NULL_HANDLE, &imgIndex);
+		phaseEnd = std::chrono::steady_clock::now();
+		TRACE_END("Acquire");
+		frameTimings.Record(FRAME_PHASE_ACQUIRE, phaseEnd - phaseStart);
+
+		if (result == VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			return RecreateSwapchain();
+		}
+		else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+		{
+			GameThread::SendErrorPopup("failed to acquire swapchain image. Error " + result);
+			return false;
+		}
+	}
 
-	u32 imgIndex = 0;
-	VkResult result = appData.disp.acquireNextImageKHR(
-		appData.swapchain, UINT64_MAX, renderData.availableSemaphores[renderData.currentFrame], VK_NULL_HANDLE, &imgIndex);
+	VkSemaphoreWaitInfoKHR imageWaitInfo = {};
+	imageWaitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+	imageWaitInfo.semaphoreCount = 1;
+	imageWaitInfo.pSemaphores = &renderData.graphicsTimeline;
+	imageWaitInfo.pValues = &renderData.imageRenderValues[imgIndex];
+	TRACE_BEGIN("ImageWait");
+	phaseStart = std::chrono::steady_clock::now();
+	appData.disp.waitSemaphoresKHR(&imageWaitInfo, UINT64_MAX);
+	phaseEnd = std::chrono::steady_clock::now();
+	TRACE_END("ImageWait");
+	frameTimings.Record(FRAME_PHASE_IMAGE_WAIT, phaseEnd - phaseStart);
+
+	renderData.frameIndex++;
+	UpdateUniformBuffer(renderData.currentFrame);
+	if (renderData.captureBuffer != VK_NULL_HANDLE && renderData.frameIndex % offscreen.captureInterval == 0)
+	{
+		if (captureWriting[renderData.currentFrame])
+			GameThread::LogMessage("Frame " + std::to_string(renderData.frameIndex) + " is not captured, the previous capture is still being written\n");
+		else
+			renderData.captureFrames[renderData.currentFrame] = renderData.frameIndex;
+	}
 
-	if (result == VK_ERROR_OUT_OF_DATE_KHR)
+	// New steps go to the copy the previous frames are not drawing from
+	const u32 stepCount = simTimestep.Advance(deltaTime);
+	const u32 slot = stepCount > 0 ? (renderData.renderSlot + 1) % RENDER_OBJECT_BUFFER_COUNT : renderData.renderSlot;
+	// Readbacks are recorded after the steps, a request waits for a frame that runs some
+	if (stepCount > 0 && appData.gm->TakeSnapshotRequest())
 	{
-		return RecreateSwapchain();
+		if (snapshotWriting)
+			GameThread::LogMessage("A snapshot is still being saved, request ignored\n");
+		else if (CreateSnapshotBuffer())
+		{
+			snapshotWriting = true;
+			renderData.snapshotPending = true;
+			renderData.snapshotFrame = renderData.currentFrame;
+			renderData.snapshotTick = renderData.firstTick + simTimestep.GetTickCount();
+		}
 	}
-	else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+	// The GPU steps several ticks per submit, the state after the step that crossed the interval is recorded
+	const u64 tick = renderData.firstTick + simTimestep.GetTickCount();
+	if (renderData.recordBuffer != VK_NULL_HANDLE && stepCount > 0 && tick / recorder.GetInterval() != (tick - stepCount) / recorder.GetInterval())
+		renderData.recordTicks[renderData.currentFrame] = tick;
+	phaseStart = std::chrono::steady_clock::now();
 	{
-		GameThread::SendErrorPopup("failed to acquire swapchain image. Error " + result);
-		return false;
+		TRACE_SCOPE("Record");
+		if (!RecordFrame(imgIndex, stepCount, slot))
+			return false;
 	}
+	phaseEnd = std::chrono::steady_clock::now();
+	frameTimings.Record(FRAME_PHASE_RECORD, phaseEnd - phaseStart);
 
-	if (renderData.imageInFlight[imgIndex] != VK_NULL_HANDLE)
+#ifdef ENABLE_TRACE
+	renderData.timestampSubmitTimes[renderData.currentFrame] = Core::Trace::Now();
+#endif
+	phaseStart = phaseEnd;
 	{
-		appData.disp.waitForFences(1, &renderData.imageInFlight[imgIndex], VK_TRUE, UINT64_MAX);
+		TRACE_SCOPE("Submit");
+		if (stepCount > 0 && !SubmitSimulation(slot))
+			return false;
+		if (!SubmitRender(imgIndex, slot))
+			return false;
 	}
-	renderData.imageInFlight[imgIndex] = renderData.inFlightFences[renderData.currentFrame];
+	phaseEnd = std::chrono::steady_clock::now();
+	frameTimings.Record(FRAME_PHASE_SUBMIT, phaseEnd - phaseStart);
 
-	UpdateUniformBuffer(renderData.currentFrame);
-
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-	VkSemaphore waitSemaphores[] = { renderData.availableSemaphores[renderData.currentFrame] };
-	VkPipelineStageFlags waitStages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-	submitInfo.waitSemaphoreCount = 1;
-	submitInfo.pWaitSemaphores = waitSemaphores;
-	submitInfo.pWaitDstStageMask = waitStages;
-
-	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &renderData.commandBuffers[imgIndex];
-
-	VkSemaphore signalSemaphores[] = { renderData.finishedSemaphore[imgIndex] };
-	submitInfo.signalSemaphoreCount = 1;
-	submitInfo.pSignalSemaphores = signalSemaphores;
-
-	appData.disp.resetFences(1, &renderData.inFlightFences[renderData.currentFrame]);
-
-	if (appData.disp.queueSubmit(renderData.graphicsQueue, 1, &submitInfo, renderData.inFlightFences[renderData.currentFrame]) != VK_SUCCESS)
+	if (offscreen.enabled)
 	{
-		GameThread::SendErrorPopup("failed to submit draw command buffer");
-		return false;
+		renderData.currentFrame = (renderData.currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+		return true;
 	}
 
+	VkSemaphore signalSemaphores[] = { renderData.finishedSemaphore[imgIndex] };
+
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
@@ -1692,7 +2933,11 @@ bool RenderThread::DrawFrame()
 
 	presentInfo.pImageIndices = &imgIndex;
 
+	phaseStart = std::chrono::steady_clock::now();
+	TRACE_BEGIN("Present");
 	result = appData.disp.queuePresentKHR(renderData.presentQueue, &presentInfo);
+	TRACE_END("Present");
+	frameTimings.Record(FRAME_PHASE_PRESENT, std::chrono::steady_clock::now() - phaseStart);
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || resized)
 	{
 		return RecreateSwapchain();
@@ -1716,11 +2961,22 @@ void RenderThread::Cleanup()
 	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
 		appData.disp.destroySemaphore(renderData.availableSemaphores[i], nullptr);
-		appData.disp.destroyFence(renderData.inFlightFences[i], nullptr);
+	}
+	appData.disp.destroySemaphore(renderData.graphicsTimeline, nullptr);
+	appData.disp.destroySemaphore(renderData.computeTimeline, nullptr);
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (renderData.timestampPools[i] != VK_NULL_HANDLE)
+			appData.disp.destroyQueryPool(renderData.timestampPools[i], nullptr);
 	}
 
 	appData.disp.destroyCommandPool(renderData.commandPool, nullptr);
 	appData.disp.destroyCommandPool(renderData.transfertCommandPool, nullptr);
+	for (u32 i = 0; i < renderData.frameCommandPools.size(); i++)
+	{
+		appData.disp.destroyCommandPool(renderData.frameCommandPools[i], nullptr);
+		appData.disp.destroyCommandPool(renderData.computeCommandPools[i], nullptr);
+	}
 
 	for (u32 i = 0; i < renderData.framebuffers.size(); i++)
 	{
@@ -1734,14 +2990,19 @@ void RenderThread::Cleanup()
 	}
 	appData.disp.destroyBuffer(renderData.computeBuffer, nullptr);
 	appData.disp.freeMemory(renderData.computeBufferMemory, nullptr);
+	for (u32 i = 0; i < RENDER_OBJECT_BUFFER_COUNT; i++)
+	{
+		appData.disp.destroyBuffer(renderData.renderObjectBuffers[i], nullptr);
+		appData.disp.freeMemory(renderData.renderObjectBuffersMemory[i], nullptr);
+	}
 
-	appData.disp.destroyPipeline(renderData.graphicsPipeline, nullptr);
-	for (u32 i = 0; i < 4; i++)
+	for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
 	{
-		appData.disp.destroyPipeline(renderData.computePipelines[i], nullptr);
+		appData.disp.destroyBuffer(renderData.cullBuffers[i], nullptr);
+		appData.disp.freeMemory(renderData.cullBuffersMemory[i], nullptr);
 	}
-	appData.disp.destroyPipelineLayout(renderData.pipelineLayout, nullptr);
-	appData.disp.destroyPipelineLayout(renderData.computePipelineLayout, nullptr);
+
+	DestroyPipelines();
 	appData.disp.destroyRenderPass(renderData.renderPass, nullptr);
 	appData.disp.destroyBuffer(renderData.vertexBuffer, nullptr);
 	appData.disp.destroyDescriptorPool(renderData.descriptorPool, nullptr);
@@ -1749,6 +3010,8 @@ void RenderThread::Cleanup()
 	appData.disp.destroyDescriptorSetLayout(renderData.descriptorSetLayoutRender, nullptr);
 	appData.disp.destroyDescriptorSetLayout(renderData.descriptorSetLayoutCompute, nullptr);
 	appData.disp.freeMemory(renderData.vertexBufferMemory, nullptr);
+	appData.disp.destroyBuffer(renderData.indexBuffer, nullptr);
+	appData.disp.freeMemory(renderData.indexBufferMemory, nullptr);
 	appData.disp.destroySampler(renderData.textureSampler, nullptr);
 	appData.disp.destroyImageView(renderData.textureImageView, nullptr);
 	appData.disp.destroyImage(renderData.textureImage, nullptr);
@@ -1758,7 +3021,28 @@ void RenderThread::Cleanup()
 	appData.disp.destroyImage(renderData.depthImage, nullptr);
 	appData.disp.freeMemory(renderData.depthImageMemory, nullptr);
 
-	appData.swapchain.destroy_image_views(renderData.swapchainImageViews);
+	if (offscreen.enabled)
+		DestroyOffscreenTargets();
+	else
+		appData.swapchain.destroy_image_views(renderData.swapchainImageViews);
+	if (renderData.captureBuffer != VK_NULL_HANDLE)
+	{
+		appData.disp.unmapMemory(renderData.captureBufferMemory);
+		appData.disp.destroyBuffer(renderData.captureBuffer, nullptr);
+		appData.disp.freeMemory(renderData.captureBufferMemory, nullptr);
+	}
+	if (renderData.recordBuffer != VK_NULL_HANDLE)
+	{
+		appData.disp.unmapMemory(renderData.recordBufferMemory);
+		appData.disp.destroyBuffer(renderData.recordBuffer, nullptr);
+		appData.disp.freeMemory(renderData.recordBufferMemory, nullptr);
+	}
+	if (renderData.snapshotBuffer != VK_NULL_HANDLE)
+	{
+		appData.disp.unmapMemory(renderData.snapshotBufferMemory);
+		appData.disp.destroyBuffer(renderData.snapshotBuffer, nullptr);
+		appData.disp.freeMemory(renderData.snapshotBufferMemory, nullptr);
+	}
 
 	vkb::destroy_swapchain(appData.swapchain);
 	vkb::destroy_device(appData.device);
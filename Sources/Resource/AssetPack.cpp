@@ -0,0 +1,224 @@
+#include "Resource/AssetPack.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "Core/Hash.hpp"
+
+using namespace Resource;
+
+namespace
+{
+	u64 AlignUp(u64 value, u64 alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	s32 CompareName(const AssetPackEntry &entry, const std::string &name)
+	{
+		return strncmp(entry.name, name.c_str(), ASSET_PACK_NAME_SIZE);
+	}
+}
+
+bool AssetPack::Open(const std::string &path, std::string &error)
+{
+	Close();
+	// Random access, only the assets in use are paged in
+	if (!file.Open(path, false))
+	{
+		error = "could not open " + path;
+		return false;
+	}
+	if (file.GetSize() < sizeof(AssetPackHeader))
+	{
+		error = path + " is too small for an asset pack header";
+		Close();
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(AssetPackHeader));
+	if (!Validate(header, file.GetSize(), error))
+	{
+		error = path + ": " + error;
+		Close();
+		return false;
+	}
+
+	const AssetPackEntry *entries = GetEntries();
+	for (u32 i = 0; i < header.entryCount; i++)
+	{
+		const AssetPackEntry &entry = entries[i];
+		const bool terminated = memchr(entry.name, 0, ASSET_PACK_NAME_SIZE) != nullptr;
+		const bool sorted = i == 0 || strncmp(entries[i - 1].name, entry.name, ASSET_PACK_NAME_SIZE) < 0;
+		// Relative to the data so no sum can wrap, Validate keeps the data inside the file
+		const bool inData = entry.offset % ASSET_PACK_ALIGNMENT == 0 && entry.offset >= header.dataOffset &&
+			entry.offset - header.dataOffset <= header.dataSize && entry.size <= header.dataSize - (entry.offset - header.dataOffset);
+		if (!terminated || !sorted || !inData)
+		{
+			error = path + ": asset pack entry " + std::to_string(i) + " is corrupt";
+			Close();
+			return false;
+		}
+	}
+	return true;
+}
+
+void AssetPack::Close()
+{
+	file.Close();
+	header = AssetPackHeader();
+}
+
+bool AssetPack::IsOpen() const
+{
+	return file.IsOpen();
+}
+
+const AssetPackHeader &AssetPack::GetHeader() const
+{
+	return header;
+}
+
+const AssetPackEntry *AssetPack::GetEntries() const
+{
+	// The index offset is aligned, the entries can be read in place
+	return file.IsOpen() ? (const AssetPackEntry *)(file.GetData() + header.indexOffset) : nullptr;
+}
+
+AssetSpan AssetPack::Find(const std::string &name) const
+{
+	AssetSpan result;
+	if (!file.IsOpen() || name.size() >= ASSET_PACK_NAME_SIZE)
+		return result;
+	const AssetPackEntry *entries = GetEntries();
+	u32 low = 0;
+	u32 high = header.entryCount;
+	while (low < high)
+	{
+		const u32 middle = low + (high - low) / 2;
+		const s32 order = CompareName(entries[middle], name);
+		if (order == 0)
+		{
+			result.data = file.GetData() + entries[middle].offset;
+			result.size = entries[middle].size;
+			return result;
+		}
+		if (order < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return result;
+}
+
+bool AssetPack::Verify(std::string &error) const
+{
+	const AssetPackEntry *entries = GetEntries();
+	for (u32 i = 0; i < header.entryCount; i++)
+	{
+		if (Core::HashBytes(file.GetData() + entries[i].offset, entries[i].size) != entries[i].hash)
+		{
+			error = std::string(entries[i].name) + " does not match its hash";
+			return false;
+		}
+	}
+	return true;
+}
+
+bool AssetPack::Write(const std::string &path, std::vector<AssetPackSource> &sources, std::string &error)
+{
+	std::sort(sources.begin(), sources.end(), [](const AssetPackSource &a, const AssetPackSource &b) { return a.name < b.name; });
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		if (sources[i].name.empty() || sources[i].name.size() >= ASSET_PACK_NAME_SIZE)
+		{
+			error = "asset name '" + sources[i].name + "' does not fit in the index";
+			return false;
+		}
+		if (i > 0 && sources[i].name == sources[i - 1].name)
+		{
+			error = "asset " + sources[i].name + " is packed twice";
+			return false;
+		}
+	}
+
+	AssetPackHeader fileHeader;
+	fileHeader.entryCount = (u32)(sources.size());
+	fileHeader.entrySize = sizeof(AssetPackEntry);
+	fileHeader.indexOffset = ASSET_PACK_ALIGNMENT;
+	fileHeader.dataOffset = AlignUp(fileHeader.indexOffset + sources.size() * sizeof(AssetPackEntry), ASSET_PACK_ALIGNMENT);
+	std::vector<AssetPackEntry> entries(sources.size());
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		AssetPackEntry &entry = entries[i];
+		memcpy(entry.name, sources[i].name.c_str(), sources[i].name.size());
+		entry.offset = fileHeader.dataOffset + fileHeader.dataSize;
+		entry.size = sources[i].data.size();
+		entry.hash = Core::HashBytes(sources[i].data.data(), entry.size);
+		fileHeader.dataSize = AlignUp(fileHeader.dataSize + entry.size, ASSET_PACK_ALIGNMENT);
+	}
+
+	// Padding stays zero
+	std::vector<u8> block((size_t)(fileHeader.dataOffset), 0);
+	memcpy(block.data(), &fileHeader, sizeof(fileHeader));
+	if (!entries.empty())
+		memcpy(block.data() + fileHeader.indexOffset, entries.data(), entries.size() * sizeof(AssetPackEntry));
+
+	std::FILE *output = std::fopen(path.c_str(), "wb");
+	if (!output)
+	{
+		error = "could not create " + path;
+		return false;
+	}
+	bool success = std::fwrite(block.data(), block.size(), 1, output) == 1;
+	const u8 padding[ASSET_PACK_ALIGNMENT] = {};
+	for (size_t i = 0; success && i < sources.size(); i++)
+	{
+		const u64 size = sources[i].data.size();
+		if (size > 0)
+			success = std::fwrite(sources[i].data.data(), (size_t)(size), 1, output) == 1;
+		const u64 pad = AlignUp(size, ASSET_PACK_ALIGNMENT) - size;
+		if (success && pad > 0)
+			success = std::fwrite(padding, (size_t)(pad), 1, output) == 1;
+	}
+	success &= std::fclose(output) == 0;
+	if (!success)
+	{
+		error = "could not write " + path;
+		std::remove(path.c_str());
+	}
+	return success;
+}
+
+bool AssetPack::Validate(const AssetPackHeader &header, u64 fileSize, std::string &error)
+{
+	if (header.magic != ASSET_PACK_MAGIC)
+	{
+		error = "not an asset pack";
+		return false;
+	}
+	if (header.version != ASSET_PACK_VERSION || header.entrySize != sizeof(AssetPackEntry))
+	{
+		error = "asset pack version " + std::to_string(header.version) + " is not supported, expected " + std::to_string(ASSET_PACK_VERSION);
+		return false;
+	}
+	// Both bounded by the file size first, the index end cannot wrap
+	if (header.indexOffset > fileSize || header.entryCount > (fileSize - header.indexOffset) / sizeof(AssetPackEntry))
+	{
+		error = "asset pack index is truncated";
+		return false;
+	}
+	const u64 indexEnd = header.indexOffset + (u64)(header.entryCount) * sizeof(AssetPackEntry);
+	if (header.indexOffset % ASSET_PACK_ALIGNMENT != 0 || header.indexOffset < sizeof(AssetPackHeader) ||
+		header.dataOffset % ASSET_PACK_ALIGNMENT != 0 || header.dataOffset < indexEnd)
+	{
+		error = "asset pack index is misplaced";
+		return false;
+	}
+	if (header.dataOffset > fileSize || header.dataSize > fileSize - header.dataOffset)
+	{
+		error = "asset pack is truncated, " + std::to_string(fileSize) + " bytes for " + std::to_string(header.entryCount) + " assets";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,42 @@
+#include "Resource/ImageCapture.hpp"
+
+#include <cstdio>
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+using namespace Resource;
+using namespace Maths;
+
+void ImageCapture::ConvertBgraToRgba(const u8 *src, u32 rowPitch, IVec2 res, std::vector<u8> &dst)
+{
+	dst.resize((size_t)(res.x) * res.y * 4);
+	for (s32 y = 0; y < res.y; y++)
+	{
+		const u8 *row = src + (size_t)(y) * rowPitch;
+		u8 *out = &dst[(size_t)(y) * res.x * 4];
+		for (s32 x = 0; x < res.x; x++)
+		{
+			out[x * 4 + 0] = row[x * 4 + 2];
+			out[x * 4 + 1] = row[x * 4 + 1];
+			out[x * 4 + 2] = row[x * 4 + 0];
+			out[x * 4 + 3] = row[x * 4 + 3];
+		}
+	}
+}
+
+bool ImageCapture::WritePng(const std::string &path, const u8 *bgra, u32 rowPitch, IVec2 res)
+{
+	if (res.x <= 0 || res.y <= 0)
+		return false;
+	std::vector<u8> rgba;
+	ConvertBgraToRgba(bgra, rowPitch, res, rgba);
+	return stbi_write_png(path.c_str(), res.x, res.y, 4, rgba.data(), res.x * 4) != 0;
+}
+
+std::string ImageCapture::GetFramePath(const std::string &prefix, u64 frame)
+{
+	char number[32];
+	snprintf(number, sizeof(number), "%06llu", (unsigned long long)(frame));
+	return prefix + number + ".png";
+}
@@ -1,8 +1,49 @@
 #include "Resource/Mesh.hpp"
 
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
 using namespace Resource;
 using namespace Maths;
 
+namespace
+{
+	struct VertexHash
+	{
+		size_t operator()(const Vertex &vertex) const
+		{
+			const f32 values[] = { vertex.pos.x, vertex.pos.y, vertex.pos.z, vertex.uv.x, vertex.uv.y,
+				vertex.col.x, vertex.col.y, vertex.col.z, vertex.norm.x, vertex.norm.y, vertex.norm.z };
+			u64 hash = 0xcbf29ce484222325ull;
+			for (f32 value : values)
+			{
+				// -0 and 0 compare equal, they must hash the same
+				const f32 normalized = value + 0.0f;
+				u32 bits;
+				memcpy(&bits, &normalized, sizeof(bits));
+				hash = (hash ^ bits) * 0x100000001b3ull;
+			}
+			return (size_t)(hash);
+		}
+	};
+
+	// Forsyth's linear speed vertex cache optimization scores
+	f32 GetVertexScore(s32 cachePosition, u32 remainingTriangles)
+	{
+		if (remainingTriangles == 0)
+			return -1.0f;
+		f32 score = 0;
+		// The vertices of the last triangle score the same whatever their order in it
+		if (cachePosition >= 0 && cachePosition < 3)
+			score = 0.75f;
+		else if (cachePosition >= 3)
+			score = powf(1.0f - (cachePosition - 3) / (f32)(MESH_VERTEX_CACHE_SIZE - 3), 1.5f);
+		// Vertices with few triangles left are finished first so they leave the cache for good
+		return score + 2.0f / sqrtf((f32)(remainingTriangles));
+	}
+}
+
 Mesh::Mesh()
 {
 }
@@ -13,7 +54,7 @@ Mesh::~Mesh()
 
 void Mesh::CreateDefaultCube()
 {
-	vertices.clear();
+	std::vector<Vertex> cubeVertices;
 
 	const u32 faceIndices[] = { 0, 1, 3, 0, 3, 2};
 	const u32 remapIndices[] = { 2, 1, 0, 0, 2, 1, 1, 0, 2 };
@@ -34,7 +75,8 @@ void Mesh::CreateDefaultCube()
 			Vec3 normal = Vec3();
 			normal[remapIndices[globalIndex + 2]] = point.z;
 			Vec2 uv = Vec2(-point.x, point.y) * 0.5f + 0.5f;
-			u32 counter = i*6+j;
+			// Per face corner, so the two copies of a corner weld
+			u32 counter = i*4+id;
 			Vec3 color = Vec3(counter & 0x1 ? 1.0f : 0.0f, counter & 0x2 ? 1.0f : 0.0f, counter & 0x4 ? 1.0f : 0.0f);
 			if (i == 2 || i == 5)
 				uv = Vec2(1) - uv;
@@ -46,14 +88,219 @@ void Mesh::CreateDefaultCube()
 				uv = uv / 2;
 			else
 				uv = uv / 2 + Vec2(0.5f, 0.5f);
-			vertices.push_back(Vertex(vert, uv, color, normal));
+			cubeVertices.push_back(Vertex(vert, uv, color, normal));
 			if (flip && (j == 2 || j == 5))
-				std::swap(vertices[vertices.size()-1],vertices[vertices.size()-2]);
+				std::swap(cubeVertices[cubeVertices.size()-1],cubeVertices[cubeVertices.size()-2]);
 		}
 	}
+
+	// Each face repeats two of its corners, welding leaves 24 vertices for the 36 indices
+	std::vector<u32> cubeIndices(cubeVertices.size());
+	for (u32 i = 0; i < cubeIndices.size(); i++)
+		cubeIndices[i] = i;
+	CreateFromTriangles(cubeVertices, cubeIndices);
+}
+
+void Mesh::CreateFromTriangles(const std::vector<Vertex> &triangleVertices, const std::vector<u32> &triangleIndices)
+{
+	vertices = triangleVertices;
+	indices = triangleIndices;
+	WeldVertices();
+	OptimizeVertexCache();
+	OptimizeVertexFetch();
+	EncodeVertices();
 }
 
 const std::vector<Vertex>& Resource::Mesh::GetVertices() const
 {
 	return vertices;
 }
+
+const std::vector<u32>& Resource::Mesh::GetIndices() const
+{
+	return indices;
+}
+
+void Resource::Mesh::SetLayout(const VertexLayout &vertexLayout)
+{
+	layout = vertexLayout;
+	EncodeVertices();
+}
+
+const VertexLayout& Resource::Mesh::GetLayout() const
+{
+	return layout;
+}
+
+const std::vector<u8>& Resource::Mesh::GetVertexData() const
+{
+	return vertexData;
+}
+
+f32 Resource::Mesh::GetBoundingRadius() const
+{
+	// Of the encoded positions, the ones the GPU transforms
+	f32 result = 0;
+	for (u32 i = 0; i < vertices.size(); i++)
+		result = Util::MaxF(result, VertexLayouts::Decode(layout, &vertexData[i * layout.stride]).pos.Length());
+	return result;
+}
+
+f32 Resource::Mesh::GetCacheMissRatio(u32 cacheSize) const
+{
+	if (indices.size() < 3)
+		return 0;
+	// A vertex is still cached while fewer than cacheSize misses happened since it was loaded
+	std::vector<u32> loadedAt(vertices.size(), 0);
+	std::vector<bool> loaded(vertices.size(), false);
+	u32 misses = 0;
+	for (u32 index : indices)
+	{
+		if (loaded[index] && misses - loadedAt[index] < cacheSize)
+			continue;
+		loaded[index] = true;
+		loadedAt[index] = misses++;
+	}
+	return misses / (f32)(indices.size() / 3);
+}
+
+void Resource::Mesh::WeldVertices()
+{
+	std::unordered_map<Vertex, u32, VertexHash> unique;
+	unique.reserve(vertices.size());
+	std::vector<Vertex> welded;
+	welded.reserve(vertices.size());
+	std::vector<u32> remap(vertices.size());
+	for (u32 i = 0; i < vertices.size(); i++)
+	{
+		auto inserted = unique.emplace(vertices[i], (u32)(welded.size()));
+		if (inserted.second)
+			welded.push_back(vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+	for (u32 &index : indices)
+		index = remap[index];
+	vertices.swap(welded);
+}
+
+void Resource::Mesh::OptimizeVertexCache()
+{
+	const u32 triangleCount = (u32)(indices.size() / 3);
+	const u32 vertexCount = (u32)(vertices.size());
+	if (triangleCount == 0)
+		return;
+
+	// Triangles not emitted yet around each vertex, packed per vertex
+	std::vector<u32> remaining(vertexCount, 0);
+	for (u32 i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+	std::vector<u32> offsets(vertexCount + 1, 0);
+	for (u32 i = 0; i < vertexCount; i++)
+		offsets[i + 1] = offsets[i] + remaining[i];
+	std::vector<u32> adjacency(triangleCount * 3);
+	std::vector<u32> cursors(offsets.begin(), offsets.end() - 1);
+	for (u32 t = 0; t < triangleCount; t++)
+	{
+		for (u32 j = 0; j < 3; j++)
+			adjacency[cursors[indices[t * 3 + j]]++] = t;
+	}
+
+	std::vector<s32> cachePositions(vertexCount, -1);
+	std::vector<f32> vertexScores(vertexCount);
+	for (u32 i = 0; i < vertexCount; i++)
+		vertexScores[i] = GetVertexScore(-1, remaining[i]);
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<u32> result;
+	result.reserve(triangleCount * 3);
+	std::vector<u32> cache;
+	std::vector<u32> nextCache;
+	u32 scanCursor = 0;
+	s64 best = -1;
+	for (u32 emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		// Nothing left around the cached vertices, start again from the first triangle not emitted
+		if (best < 0)
+		{
+			while (emitted[scanCursor])
+				scanCursor++;
+			best = scanCursor;
+		}
+		const u32 triangle = (u32)(best);
+		const u32 *corners = &indices[triangle * 3];
+		emitted[triangle] = true;
+		nextCache.clear();
+		for (u32 j = 0; j < 3; j++)
+		{
+			const u32 vertex = corners[j];
+			result.push_back(vertex);
+			nextCache.push_back(vertex);
+			u32 *begin = &adjacency[offsets[vertex]];
+			u32 *last = begin + --remaining[vertex];
+			for (u32 *it = begin; it < last; it++)
+			{
+				if (*it == triangle)
+				{
+					std::swap(*it, *last);
+					break;
+				}
+			}
+		}
+		for (u32 vertex : cache)
+		{
+			if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+				nextCache.push_back(vertex);
+		}
+
+		// Entries past the cache size were pushed out, their triangles are rescored as well
+		for (u32 i = 0; i < nextCache.size(); i++)
+		{
+			const u32 vertex = nextCache[i];
+			cachePositions[vertex] = i < MESH_VERTEX_CACHE_SIZE ? (s32)(i) : -1;
+			vertexScores[vertex] = GetVertexScore(cachePositions[vertex], remaining[vertex]);
+		}
+		best = -1;
+		f32 bestScore = -1.0f;
+		for (u32 vertex : nextCache)
+		{
+			for (u32 k = offsets[vertex]; k < offsets[vertex] + remaining[vertex]; k++)
+			{
+				const u32 t = adjacency[k];
+				const f32 score = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = t;
+				}
+			}
+		}
+		if (nextCache.size() > MESH_VERTEX_CACHE_SIZE)
+			nextCache.resize(MESH_VERTEX_CACHE_SIZE);
+		cache.swap(nextCache);
+	}
+	indices.swap(result);
+}
+
+void Resource::Mesh::OptimizeVertexFetch()
+{
+	// Vertices in the order the triangles first use them, unused ones are dropped
+	std::vector<u32> remap(vertices.size(), ~0u);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (u32 &index : indices)
+	{
+		if (remap[index] == ~0u)
+		{
+			remap[index] = (u32)(ordered.size());
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(ordered);
+}
+
+void Resource::Mesh::EncodeVertices()
+{
+	vertexData.resize(vertices.size() * layout.stride);
+	VertexLayouts::Encode(layout, vertices.data(), (u32)(vertices.size()), vertexData.data());
+}
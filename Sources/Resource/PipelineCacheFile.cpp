@@ -0,0 +1,127 @@
+#include "Resource/PipelineCacheFile.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+
+#include "Core/Hash.hpp"
+
+using namespace Resource;
+
+bool PipelineCacheDevice::operator==(const PipelineCacheDevice &other) const
+{
+	return vendorId == other.vendorId && deviceId == other.deviceId && driverVersion == other.driverVersion &&
+		memcmp(cacheUuid, other.cacheUuid, PIPELINE_CACHE_UUID_SIZE) == 0;
+}
+
+bool PipelineCacheFile::Open(const std::string &path, const PipelineCacheDevice &device, std::string &error)
+{
+	Close();
+	if (!file.Open(path, true))
+	{
+		error = "no " + path;
+		return false;
+	}
+	if (file.GetSize() < sizeof(PipelineCacheHeader))
+	{
+		error = path + " is too small for a pipeline cache header";
+		Close();
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(PipelineCacheHeader));
+	if (!Validate(header, file.GetSize(), device, error))
+	{
+		error = path + ": " + error;
+		Close();
+		return false;
+	}
+	const u8 *data = file.GetData() + header.dataOffset;
+	if (Core::HashBytes(data, header.dataSize) != header.dataHash || !ValidateBlob(data, header.dataSize, device))
+	{
+		error = path + " is corrupt";
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void PipelineCacheFile::Close()
+{
+	file.Close();
+	header = PipelineCacheHeader();
+}
+
+const u8 *PipelineCacheFile::GetData() const
+{
+	return file.IsOpen() ? file.GetData() + header.dataOffset : nullptr;
+}
+
+u64 PipelineCacheFile::GetDataSize() const
+{
+	return header.dataSize;
+}
+
+bool PipelineCacheFile::Write(const std::string &path, const PipelineCacheDevice &device, const u8 *data, u64 size, std::string &error)
+{
+	const std::string tempPath = path + ".tmp";
+	std::FILE *output = std::fopen(tempPath.c_str(), "wb");
+	if (!output)
+	{
+		error = "could not create " + tempPath;
+		return false;
+	}
+
+	u8 headerBlock[PIPELINE_CACHE_ALIGNMENT] = {};
+	PipelineCacheHeader fileHeader;
+	fileHeader.device = device;
+	fileHeader.dataOffset = PIPELINE_CACHE_ALIGNMENT;
+	fileHeader.dataSize = size;
+	fileHeader.dataHash = Core::HashBytes(data, size);
+	memcpy(headerBlock, &fileHeader, sizeof(PipelineCacheHeader));
+	bool success = std::fwrite(headerBlock, sizeof(headerBlock), 1, output) == 1;
+	if (success && size > 0)
+		success = std::fwrite(data, (size_t)(size), 1, output) == 1;
+	success &= std::fclose(output) == 0;
+	std::error_code renameError;
+	if (success)
+		std::filesystem::rename(tempPath, path, renameError);
+	if (!success || renameError)
+	{
+		error = "could not write " + path;
+		std::remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool PipelineCacheFile::Validate(const PipelineCacheHeader &header, u64 fileSize, const PipelineCacheDevice &device, std::string &error)
+{
+	if (header.magic != PIPELINE_CACHE_MAGIC || header.version != PIPELINE_CACHE_VERSION)
+	{
+		error = "not a pipeline cache of version " + std::to_string(PIPELINE_CACHE_VERSION);
+		return false;
+	}
+	if (!(header.device == device))
+	{
+		error = "made by another device or driver version";
+		return false;
+	}
+	if (header.dataOffset < sizeof(PipelineCacheHeader) || header.dataOffset > fileSize || header.dataSize > fileSize - header.dataOffset)
+	{
+		error = "pipeline cache is truncated";
+		return false;
+	}
+	return true;
+}
+
+bool PipelineCacheFile::ValidateBlob(const u8 *data, u64 size, const PipelineCacheDevice &device)
+{
+	if (!data || size < PIPELINE_CACHE_VULKAN_HEADER_SIZE)
+		return false;
+	u32 fields[4];
+	memcpy(fields, data, sizeof(fields));
+	// Header version one is the only one defined by the core spec
+	return fields[0] >= PIPELINE_CACHE_VULKAN_HEADER_SIZE && fields[0] <= size && fields[1] == 1 &&
+		fields[2] == device.vendorId && fields[3] == device.deviceId &&
+		memcmp(data + 16, device.cacheUuid, PIPELINE_CACHE_UUID_SIZE) == 0;
+}
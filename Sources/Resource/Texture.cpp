@@ -21,6 +21,14 @@ u8 *Texture::ReadTexture(const std::string &path, IVec2 &res)
 	return data;
 }
 
+u8 *Texture::ReadTextureFromMemory(const u8 *data, u64 size, IVec2 &res)
+{
+	s32 comp;
+	if (!data || size > 0x7fffffff)
+		return nullptr;
+	return stbi_load_from_memory(data, (s32)(size), &res.x, &res.y, &comp, 4);
+}
+
 void Resource::Texture::FreeTextureData(u8 *data)
 {
 	stbi_image_free(data);
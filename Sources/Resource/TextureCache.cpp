@@ -0,0 +1,506 @@
+#include "Resource/TextureCache.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "Core/Hash.hpp"
+#include "Resource/Texture.hpp"
+
+using namespace Resource;
+using namespace Maths;
+
+namespace
+{
+	u64 AlignUp(u64 value, u64 alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	f32 SrgbToLinear(f32 value)
+	{
+		return value <= 0.04045f ? value / 12.92f : powf((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	u8 LinearToSrgb(f32 value)
+	{
+		value = Util::Clamp(value);
+		const f32 encoded = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+		return (u8)(lroundf(encoded * 255.0f));
+	}
+
+	void Decode565(u16 value, s32 *rgb)
+	{
+		const s32 r = (value >> 11) & 0x1f;
+		const s32 g = (value >> 5) & 0x3f;
+		const s32 b = value & 0x1f;
+		rgb[0] = (r << 3) | (r >> 2);
+		rgb[1] = (g << 2) | (g >> 4);
+		rgb[2] = (b << 3) | (b >> 2);
+	}
+
+	u16 Encode565(const f32 *rgb)
+	{
+		const u32 r = (u32)(lroundf(Util::Clamp(rgb[0] / 255.0f) * 31.0f));
+		const u32 g = (u32)(lroundf(Util::Clamp(rgb[1] / 255.0f) * 63.0f));
+		const u32 b = (u32)(lroundf(Util::Clamp(rgb[2] / 255.0f) * 31.0f));
+		return (u16)((r << 11) | (g << 5) | b);
+	}
+
+	// The four colors of a block in 4 color mode, or 3 colors and black when color0 <= color1
+	void GetBc1Palette(u16 color0, u16 color1, s32 palette[4][3])
+	{
+		Decode565(color0, palette[0]);
+		Decode565(color1, palette[1]);
+		for (u32 c = 0; c < 3; c++)
+		{
+			if (color0 > color1)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			else
+			{
+				palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+				palette[3][c] = 0;
+			}
+		}
+	}
+
+	// Picks the closest palette entry per pixel, returns the squared error
+	u32 FitBc1Indices(const u8 pixels[16][4], u16 color0, u16 color1, u32 &indices)
+	{
+		s32 palette[4][3];
+		GetBc1Palette(color0, color1, palette);
+		// Equal endpoints fall in 3 color mode, where the last entry is transparent
+		const u32 paletteSize = color0 > color1 ? 4 : 3;
+		u32 error = 0;
+		indices = 0;
+		for (u32 i = 0; i < 16; i++)
+		{
+			u32 best = 0;
+			u32 bestError = ~0u;
+			for (u32 p = 0; p < paletteSize; p++)
+			{
+				u32 distance = 0;
+				for (u32 c = 0; c < 3; c++)
+				{
+					const s32 delta = (s32)(pixels[i][c]) - palette[p][c];
+					distance += (u32)(delta * delta);
+				}
+				if (distance < bestError)
+				{
+					bestError = distance;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+			error += bestError;
+		}
+		return error;
+	}
+
+	// Keeps the 4 color mode, swapping the endpoints mirrors the indices
+	void OrderBc1Endpoints(u16 &color0, u16 &color1)
+	{
+		if (color0 < color1)
+			std::swap(color0, color1);
+	}
+
+	void EncodeBc1Block(const u8 pixels[16][4], u8 *out)
+	{
+		// Endpoints at the extremes of the principal axis of the colors
+		f32 mean[3] = {};
+		for (u32 i = 0; i < 16; i++)
+		{
+			for (u32 c = 0; c < 3; c++)
+				mean[c] += pixels[i][c] / 16.0f;
+		}
+		f32 covariance[3][3] = {};
+		for (u32 i = 0; i < 16; i++)
+		{
+			for (u32 a = 0; a < 3; a++)
+			{
+				for (u32 b = 0; b < 3; b++)
+					covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+			}
+		}
+		f32 axis[3] = { 1.0f, 1.0f, 1.0f };
+		for (u32 iteration = 0; iteration < 8; iteration++)
+		{
+			f32 next[3] = {};
+			for (u32 a = 0; a < 3; a++)
+				next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+			const f32 length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+			if (length < 1e-6f)
+				break;
+			for (u32 a = 0; a < 3; a++)
+				axis[a] = next[a] / length;
+		}
+		f32 minT = 0;
+		f32 maxT = 0;
+		for (u32 i = 0; i < 16; i++)
+		{
+			const f32 t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+			minT = Util::MinF(minT, t);
+			maxT = Util::MaxF(maxT, t);
+		}
+		f32 high[3];
+		f32 low[3];
+		for (u32 c = 0; c < 3; c++)
+		{
+			high[c] = mean[c] + axis[c] * maxT;
+			low[c] = mean[c] + axis[c] * minT;
+		}
+		u16 color0 = Encode565(high);
+		u16 color1 = Encode565(low);
+		OrderBc1Endpoints(color0, color1);
+		u32 indices;
+		u32 error = FitBc1Indices(pixels, color0, color1, indices);
+
+		// One least squares refit of the endpoints to the chosen indices
+		if (color0 != color1)
+		{
+			const f32 weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			f32 aa = 0, bb = 0, ab = 0;
+			f32 ax[3] = {};
+			f32 bx[3] = {};
+			for (u32 i = 0; i < 16; i++)
+			{
+				const f32 w = weights[(indices >> (i * 2)) & 3];
+				aa += w * w;
+				bb += (1.0f - w) * (1.0f - w);
+				ab += w * (1.0f - w);
+				for (u32 c = 0; c < 3; c++)
+				{
+					ax[c] += w * pixels[i][c];
+					bx[c] += (1.0f - w) * pixels[i][c];
+				}
+			}
+			const f32 determinant = aa * bb - ab * ab;
+			if (fabsf(determinant) > 1e-6f)
+			{
+				for (u32 c = 0; c < 3; c++)
+				{
+					high[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+					low[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+				}
+				u16 refined0 = Encode565(high);
+				u16 refined1 = Encode565(low);
+				OrderBc1Endpoints(refined0, refined1);
+				u32 refinedIndices;
+				const u32 refinedError = FitBc1Indices(pixels, refined0, refined1, refinedIndices);
+				if (refinedError < error)
+				{
+					color0 = refined0;
+					color1 = refined1;
+					indices = refinedIndices;
+					error = refinedError;
+				}
+			}
+		}
+
+		memcpy(out, &color0, 2);
+		memcpy(out + 2, &color1, 2);
+		memcpy(out + 4, &indices, 4);
+	}
+}
+
+u32 TextureProcessing::GetMipCount(IVec2 res)
+{
+	u32 count = 1;
+	for (u32 size = (u32)(Util::MaxI(res.x, res.y)); size > 1; size >>= 1)
+		count++;
+	return count;
+}
+
+u64 TextureProcessing::GetLevelSize(TextureFormat format, u32 width, u32 height)
+{
+	if (format == TextureFormat::Bc1Srgb)
+		return (u64)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	return (u64)(width) * height * 4;
+}
+
+void TextureProcessing::BuildMipChain(const u8 *rgba, IVec2 res, std::vector<std::vector<u8>> &mips)
+{
+	f32 toLinear[256];
+	for (u32 i = 0; i < 256; i++)
+		toLinear[i] = SrgbToLinear(i / 255.0f);
+
+	const u32 count = GetMipCount(res);
+	mips.resize(count);
+	mips[0].assign(rgba, rgba + (size_t)(res.x) * res.y * 4);
+	u32 width = (u32)(res.x);
+	u32 height = (u32)(res.y);
+	for (u32 level = 1; level < count; level++)
+	{
+		const std::vector<u8> &src = mips[level - 1];
+		const u32 nextWidth = Util::MaxU(width / 2, 1);
+		const u32 nextHeight = Util::MaxU(height / 2, 1);
+		std::vector<u8> &dst = mips[level];
+		dst.resize((size_t)(nextWidth) * nextHeight * 4);
+		for (u32 y = 0; y < nextHeight; y++)
+		{
+			for (u32 x = 0; x < nextWidth; x++)
+			{
+				f32 sum[4] = {};
+				for (u32 sy = 0; sy < 2; sy++)
+				{
+					for (u32 sx = 0; sx < 2; sx++)
+					{
+						const u8 *pixel = &src[((size_t)(Util::MinU(y * 2 + sy, height - 1)) * width + Util::MinU(x * 2 + sx, width - 1)) * 4];
+						for (u32 c = 0; c < 3; c++)
+							sum[c] += toLinear[pixel[c]];
+						sum[3] += pixel[3];
+					}
+				}
+				u8 *out = &dst[((size_t)(y) * nextWidth + x) * 4];
+				for (u32 c = 0; c < 3; c++)
+					out[c] = LinearToSrgb(sum[c] / 4.0f);
+				out[3] = (u8)(lroundf(sum[3] / 4.0f));
+			}
+		}
+		width = nextWidth;
+		height = nextHeight;
+	}
+}
+
+void TextureProcessing::CompressBc1(const u8 *rgba, u32 width, u32 height, std::vector<u8> &out)
+{
+	const u32 blocksX = (width + 3) / 4;
+	const u32 blocksY = (height + 3) / 4;
+	out.resize((size_t)(blocksX) * blocksY * 8);
+	for (u32 by = 0; by < blocksY; by++)
+	{
+		for (u32 bx = 0; bx < blocksX; bx++)
+		{
+			u8 pixels[16][4];
+			for (u32 i = 0; i < 16; i++)
+			{
+				const u32 x = Util::MinU(bx * 4 + (i & 3), width - 1);
+				const u32 y = Util::MinU(by * 4 + (i >> 2), height - 1);
+				memcpy(pixels[i], &rgba[((size_t)(y) * width + x) * 4], 4);
+			}
+			EncodeBc1Block(pixels, &out[((size_t)(by) * blocksX + bx) * 8]);
+		}
+	}
+}
+
+void TextureProcessing::DecompressBc1(const u8 *blocks, u32 width, u32 height, std::vector<u8> &rgba)
+{
+	const u32 blocksX = (width + 3) / 4;
+	rgba.resize((size_t)(width) * height * 4);
+	for (u32 y = 0; y < height; y++)
+	{
+		for (u32 x = 0; x < width; x++)
+		{
+			const u8 *block = &blocks[((size_t)(y / 4) * blocksX + x / 4) * 8];
+			u16 color0, color1;
+			u32 indices;
+			memcpy(&color0, block, 2);
+			memcpy(&color1, block + 2, 2);
+			memcpy(&indices, block + 4, 4);
+			s32 palette[4][3];
+			GetBc1Palette(color0, color1, palette);
+			const u32 index = (indices >> (((y & 3) * 4 + (x & 3)) * 2)) & 3;
+			u8 *out = &rgba[((size_t)(y) * width + x) * 4];
+			for (u32 c = 0; c < 3; c++)
+				out[c] = (u8)(palette[index][c]);
+			out[3] = color0 <= color1 && index == 3 ? 0 : 255;
+		}
+	}
+}
+
+bool TextureCache::Load(const std::string &sourcePath, TextureFormat format, std::string &error)
+{
+	Close();
+	Core::MappedFile source;
+	if (!source.Open(sourcePath, true))
+	{
+		error = "could not open " + sourcePath;
+		return false;
+	}
+	const u64 sourceHash = Core::HashBytes(source.GetData(), source.GetSize());
+	const std::string cachePath = GetCachePath(sourcePath, format);
+	if (Open(cachePath, format, sourceHash, source.GetSize()))
+		return true;
+
+	// Missing, made from other bytes or by another version
+	if (!Build(sourcePath, source.GetData(), source.GetSize(), cachePath, format, error))
+		return false;
+	if (!Open(cachePath, format, sourceHash, source.GetSize()))
+	{
+		error = "could not read back " + cachePath;
+		return false;
+	}
+	rebuilt = true;
+	return true;
+}
+
+bool TextureCache::LoadFromMemory(const u8 *data, u64 size, TextureFormat format, std::string &error)
+{
+	Close();
+	if (!data || size < sizeof(TextureCacheHeader))
+	{
+		error = "too small for a texture cache header";
+		return false;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (!Validate(header, size, format, error))
+	{
+		Close();
+		return false;
+	}
+	content = data;
+	return true;
+}
+
+void TextureCache::Close()
+{
+	file.Close();
+	content = nullptr;
+	header = TextureCacheHeader();
+	rebuilt = false;
+}
+
+const TextureCacheHeader &TextureCache::GetHeader() const
+{
+	return header;
+}
+
+const u8 *TextureCache::GetData() const
+{
+	return content ? content + header.dataOffset : nullptr;
+}
+
+bool TextureCache::WasRebuilt() const
+{
+	return rebuilt;
+}
+
+bool TextureCache::Encode(const u8 *source, u64 sourceSize, TextureFormat format, std::vector<u8> &out, std::string &error)
+{
+	IVec2 res;
+	u8 *pixels = Texture::ReadTextureFromMemory(source, sourceSize, res);
+	if (!pixels)
+	{
+		error = "could not decode the image";
+		return false;
+	}
+	std::vector<std::vector<u8>> mips;
+	TextureProcessing::BuildMipChain(pixels, res, mips);
+	Texture::FreeTextureData(pixels);
+	if (mips.size() > TEXTURE_CACHE_MAX_MIPS)
+	{
+		error = "image is too large for a texture cache";
+		return false;
+	}
+
+	TextureCacheHeader fileHeader;
+	fileHeader.format = format;
+	fileHeader.mipCount = (u32)(mips.size());
+	fileHeader.sourceHash = Core::HashBytes(source, sourceSize);
+	fileHeader.sourceSize = sourceSize;
+	fileHeader.dataOffset = AlignUp(sizeof(TextureCacheHeader), TEXTURE_CACHE_ALIGNMENT);
+	u32 width = (u32)(res.x);
+	u32 height = (u32)(res.y);
+	for (u32 level = 0; level < mips.size(); level++)
+	{
+		if (format == TextureFormat::Bc1Srgb)
+		{
+			std::vector<u8> blocks;
+			TextureProcessing::CompressBc1(mips[level].data(), width, height, blocks);
+			mips[level].swap(blocks);
+		}
+		TextureCacheMip &mip = fileHeader.mips[level];
+		mip.width = width;
+		mip.height = height;
+		mip.offset = fileHeader.dataSize;
+		mip.size = mips[level].size();
+		fileHeader.dataSize = AlignUp(mip.offset + mip.size, TEXTURE_CACHE_ALIGNMENT);
+		width = Util::MaxU(width / 2, 1);
+		height = Util::MaxU(height / 2, 1);
+	}
+
+	// Padding stays zero
+	out.assign((size_t)(fileHeader.dataOffset + fileHeader.dataSize), 0);
+	memcpy(out.data(), &fileHeader, sizeof(fileHeader));
+	for (u32 level = 0; level < mips.size(); level++)
+		memcpy(out.data() + fileHeader.dataOffset + fileHeader.mips[level].offset, mips[level].data(), mips[level].size());
+	return true;
+}
+
+bool TextureCache::Build(const std::string &sourcePath, const u8 *source, u64 sourceSize, const std::string &cachePath, TextureFormat format, std::string &error)
+{
+	std::vector<u8> encoded;
+	if (!Encode(source, sourceSize, format, encoded, error))
+	{
+		error = sourcePath + ": " + error;
+		return false;
+	}
+
+	std::FILE *output = std::fopen(cachePath.c_str(), "wb");
+	if (!output)
+	{
+		error = "could not create " + cachePath;
+		return false;
+	}
+	bool success = std::fwrite(encoded.data(), encoded.size(), 1, output) == 1;
+	success &= std::fclose(output) == 0;
+	if (!success)
+	{
+		error = "could not write " + cachePath;
+		std::remove(cachePath.c_str());
+	}
+	return success;
+}
+
+bool TextureCache::Validate(const TextureCacheHeader &header, u64 size, TextureFormat format, std::string &error)
+{
+	if (header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION)
+	{
+		error = "not a texture cache of version " + std::to_string(TEXTURE_CACHE_VERSION);
+		return false;
+	}
+	if (header.format != format || header.mipCount == 0 || header.mipCount > TEXTURE_CACHE_MAX_MIPS)
+	{
+		error = "texture cache holds another format";
+		return false;
+	}
+	// Subtractions after each bound so a crafted offset cannot wrap a sum back into the file
+	bool valid = header.dataOffset >= sizeof(TextureCacheHeader) && header.dataOffset <= size && header.dataSize <= size - header.dataOffset;
+	for (u32 level = 0; valid && level < header.mipCount; level++)
+	{
+		const TextureCacheMip &mip = header.mips[level];
+		valid = mip.offset % TEXTURE_CACHE_ALIGNMENT == 0 && mip.offset <= header.dataSize && mip.size <= header.dataSize - mip.offset &&
+			mip.size == TextureProcessing::GetLevelSize(format, mip.width, mip.height);
+	}
+	if (!valid)
+		error = "texture cache is truncated or its mips are misplaced";
+	return valid;
+}
+
+std::string TextureCache::GetCachePath(const std::string &sourcePath, TextureFormat format)
+{
+	return sourcePath + (format == TextureFormat::Bc1Srgb ? ".bc1.texcache" : ".rgba8.texcache");
+}
+
+bool TextureCache::Open(const std::string &cachePath, TextureFormat format, u64 sourceHash, u64 sourceSize)
+{
+	Close();
+	std::string error;
+	if (!file.Open(cachePath, true) || file.GetSize() < sizeof(TextureCacheHeader))
+	{
+		Close();
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (header.sourceHash != sourceHash || header.sourceSize != sourceSize || !Validate(header, file.GetSize(), format, error))
+	{
+		Close();
+		return false;
+	}
+	content = file.GetData();
+	return true;
+}
@@ -0,0 +1,293 @@
+#include "Resource/VertexLayout.hpp"
+
+#include <cmath>
+#include <cstring>
+
+using namespace Resource;
+using namespace Maths;
+
+namespace
+{
+	u16 EncodeUnorm16(f32 value)
+	{
+		return (u16)(lroundf(Util::Clamp(value) * 65535.0f));
+	}
+
+	u16 EncodeSnorm16(f32 value)
+	{
+		return (u16)(s16)(lroundf(Util::Clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	f32 DecodeSnorm16(u16 value)
+	{
+		return Util::Clamp((s16)(value) / 32767.0f, -1.0f, 1.0f);
+	}
+
+	// Components of an attribute, the unused ones are 0
+	void GetComponents(const Vertex &vertex, VertexAttribute attribute, f32 *out)
+	{
+		const Vec3 source = attribute == VertexAttribute::Position ? vertex.pos :
+			attribute == VertexAttribute::Color ? vertex.col :
+			attribute == VertexAttribute::Normal ? vertex.norm : Vec3(vertex.uv.x, vertex.uv.y, 0.0f);
+		out[0] = source.x;
+		out[1] = source.y;
+		out[2] = source.z;
+	}
+
+	void SetComponents(Vertex &vertex, VertexAttribute attribute, const f32 *values)
+	{
+		const Vec3 value(values[0], values[1], values[2]);
+		if (attribute == VertexAttribute::Position)
+			vertex.pos = value;
+		else if (attribute == VertexAttribute::UV)
+			vertex.uv = Vec2(value.x, value.y);
+		else if (attribute == VertexAttribute::Color)
+			vertex.col = value;
+		else
+			vertex.norm = value;
+	}
+}
+
+bool Vertex::operator==(const Vertex &other) const
+{
+	return pos == other.pos && uv == other.uv && col == other.col && norm == other.norm;
+}
+
+VertexLayout VertexLayout::Create(VertexFormat position, VertexFormat uv, VertexFormat color, VertexFormat normal)
+{
+	VertexLayout result;
+	result.formats[(u32)(VertexAttribute::Position)] = position;
+	result.formats[(u32)(VertexAttribute::UV)] = uv;
+	result.formats[(u32)(VertexAttribute::Color)] = color;
+	result.formats[(u32)(VertexAttribute::Normal)] = normal;
+	for (u32 i = 0; i < (u32)(VertexAttribute::Count); i++)
+	{
+		result.offsets[i] = result.stride;
+		result.stride += VertexLayouts::GetFormatSize(result.formats[i]);
+	}
+	return result;
+}
+
+VertexLayout VertexLayout::Full()
+{
+	return Create(VertexFormat::Float32x3, VertexFormat::Float32x2, VertexFormat::Float32x3, VertexFormat::Float32x3);
+}
+
+VertexLayout VertexLayout::Packed()
+{
+	return Create(VertexFormat::Float16x4, VertexFormat::Unorm16x2, VertexFormat::None, VertexFormat::Octahedral16x2);
+}
+
+bool VertexLayout::Has(VertexAttribute attribute) const
+{
+	return Get(attribute) != VertexFormat::None;
+}
+
+VertexFormat VertexLayout::Get(VertexAttribute attribute) const
+{
+	return formats[(u32)(attribute)];
+}
+
+bool VertexLayout::IsValid() const
+{
+	const VertexFormat position = Get(VertexAttribute::Position);
+	if (position != VertexFormat::Float32x3 && position != VertexFormat::Float16x4)
+		return false;
+	for (u32 i = 0; i < (u32)(VertexAttribute::Count); i++)
+	{
+		if (formats[i] == VertexFormat::Octahedral16x2 && (VertexAttribute)(i) != VertexAttribute::Normal)
+			return false;
+	}
+	return true;
+}
+
+u32 VertexLayouts::GetFormatSize(VertexFormat format)
+{
+	switch (format)
+	{
+	case VertexFormat::Float32x2:
+		return 8;
+	case VertexFormat::Float32x3:
+		return 12;
+	case VertexFormat::Float16x4:
+		return 8;
+	case VertexFormat::Unorm16x2:
+	case VertexFormat::Unorm8x4:
+	case VertexFormat::Octahedral16x2:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+u16 VertexLayouts::EncodeHalf(f32 value)
+{
+	u32 bits;
+	memcpy(&bits, &value, sizeof(bits));
+	const u16 sign = (u16)((bits >> 16) & 0x8000);
+	const u32 magnitude = bits & 0x7fffffff;
+	// NaN stays a NaN
+	if (magnitude > 0x7f800000)
+		return sign | 0x7e00;
+	// From halfway past 65504, the largest half
+	if (magnitude >= 0x477ff000)
+		return sign | 0x7c00;
+	// Below 2^-14 the result is subnormal, the float addition rounds to its step
+	if (magnitude < 0x38800000)
+	{
+		f32 scaled;
+		memcpy(&scaled, &magnitude, sizeof(scaled));
+		scaled += 0.5f;
+		u32 scaledBits;
+		memcpy(&scaledBits, &scaled, sizeof(scaledBits));
+		return sign | (u16)(scaledBits - 0x3f000000);
+	}
+	// Rebias the exponent from 127 to 15, round the 13 dropped mantissa bits to even
+	const u32 odd = (magnitude >> 13) & 1;
+	return sign | (u16)((magnitude - 0x38000000 + 0xfff + odd) >> 13);
+}
+
+f32 VertexLayouts::DecodeHalf(u16 value)
+{
+	const u32 sign = (u32)(value & 0x8000) << 16;
+	const u32 exponent = (value >> 10) & 0x1f;
+	const u32 mantissa = value & 0x3ff;
+	if (exponent == 0)
+	{
+		const f32 result = mantissa / 16777216.0f;
+		return sign ? -result : result;
+	}
+	const u32 bits = sign | (exponent == 31 ? 0x7f800000 | (mantissa << 13) : ((exponent + 112) << 23) | (mantissa << 13));
+	f32 result;
+	memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+Vec2 VertexLayouts::EncodeOctahedral(const Vec3 &normal)
+{
+	const f32 sum = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (sum == 0)
+		return Vec2();
+	Vec2 result(normal.x / sum, normal.y / sum);
+	if (normal.z < 0)
+	{
+		result = Vec2((1.0f - fabsf(result.y)) * (result.x >= 0 ? 1.0f : -1.0f),
+			(1.0f - fabsf(result.x)) * (result.y >= 0 ? 1.0f : -1.0f));
+	}
+	return result;
+}
+
+Vec3 VertexLayouts::DecodeOctahedral(const Vec2 &encoded)
+{
+	Vec3 result(encoded.x, encoded.y, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+	const f32 fold = Util::MaxF(-result.z, 0.0f);
+	result.x += result.x >= 0 ? -fold : fold;
+	result.y += result.y >= 0 ? -fold : fold;
+	return result.Normalize();
+}
+
+void VertexLayouts::Encode(const VertexLayout &layout, const Vertex *vertices, u32 count, u8 *out)
+{
+	memset(out, 0, (size_t)(count) * layout.stride);
+	for (u32 v = 0; v < count; v++, out += layout.stride)
+	{
+		for (u32 i = 0; i < (u32)(VertexAttribute::Count); i++)
+		{
+			f32 values[3];
+			GetComponents(vertices[v], (VertexAttribute)(i), values);
+			u8 *dst = out + layout.offsets[i];
+			switch (layout.formats[i])
+			{
+			case VertexFormat::Float32x2:
+				memcpy(dst, values, 8);
+				break;
+			case VertexFormat::Float32x3:
+				memcpy(dst, values, 12);
+				break;
+			case VertexFormat::Float16x4:
+			{
+				const u16 halves[4] = { EncodeHalf(values[0]), EncodeHalf(values[1]), EncodeHalf(values[2]), EncodeHalf(1.0f) };
+				memcpy(dst, halves, 8);
+				break;
+			}
+			case VertexFormat::Unorm16x2:
+			{
+				const u16 units[2] = { EncodeUnorm16(values[0]), EncodeUnorm16(values[1]) };
+				memcpy(dst, units, 4);
+				break;
+			}
+			case VertexFormat::Unorm8x4:
+			{
+				for (u32 j = 0; j < 3; j++)
+					dst[j] = (u8)(lroundf(Util::Clamp(values[j]) * 255.0f));
+				dst[3] = 255;
+				break;
+			}
+			case VertexFormat::Octahedral16x2:
+			{
+				const Vec2 folded = EncodeOctahedral(Vec3(values[0], values[1], values[2]));
+				const u16 units[2] = { EncodeSnorm16(folded.x), EncodeSnorm16(folded.y) };
+				memcpy(dst, units, 4);
+				break;
+			}
+			default:
+				break;
+			}
+		}
+	}
+}
+
+Vertex VertexLayouts::Decode(const VertexLayout &layout, const u8 *vertex)
+{
+	Vertex result;
+	for (u32 i = 0; i < (u32)(VertexAttribute::Count); i++)
+	{
+		f32 values[3] = {};
+		const u8 *src = vertex + layout.offsets[i];
+		switch (layout.formats[i])
+		{
+		case VertexFormat::Float32x2:
+			memcpy(values, src, 8);
+			break;
+		case VertexFormat::Float32x3:
+			memcpy(values, src, 12);
+			break;
+		case VertexFormat::Float16x4:
+		{
+			u16 halves[3];
+			memcpy(halves, src, 6);
+			for (u32 j = 0; j < 3; j++)
+				values[j] = DecodeHalf(halves[j]);
+			break;
+		}
+		case VertexFormat::Unorm16x2:
+		{
+			u16 units[2];
+			memcpy(units, src, 4);
+			values[0] = units[0] / 65535.0f;
+			values[1] = units[1] / 65535.0f;
+			break;
+		}
+		case VertexFormat::Unorm8x4:
+		{
+			for (u32 j = 0; j < 3; j++)
+				values[j] = src[j] / 255.0f;
+			break;
+		}
+		case VertexFormat::Octahedral16x2:
+		{
+			u16 units[2];
+			memcpy(units, src, 4);
+			const Vec3 normal = DecodeOctahedral(Vec2(DecodeSnorm16(units[0]), DecodeSnorm16(units[1])));
+			values[0] = normal.x;
+			values[1] = normal.y;
+			values[2] = normal.z;
+			break;
+		}
+		default:
+			break;
+		}
+		SetComponents(result, (VertexAttribute)(i), values);
+	}
+	return result;
+}
@@ -0,0 +1,384 @@
+#include "Simulation/BoidKernels.hpp"
+
+#include <bit>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define BOID_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Wider kernels are compiled per function so the rest of the binary keeps the baseline instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define BOID_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BOID_TARGET(isa)
+#endif
+
+using namespace Simulation;
+using namespace Maths;
+
+namespace
+{
+	// Far enough for the squared distance to overflow to infinity
+	const f32 PADDING_POSITION = 1e30f;
+
+	template<u32 Width>
+	void ReduceLanes(const f32 *lanes, f32 &out)
+	{
+		for (u32 i = 0; i < Width; i++)
+			out += lanes[i];
+	}
+
+	void BoidKernelScalar(const NeighbourBatch &batch, const Vec3 &position, u32 self, const BoidConstants &constants, BoidAccumulator &out)
+	{
+		const u32 size = batch.GetSize();
+		for (u32 i = 0; i < size; i++)
+		{
+			if (batch.ids[i] == self)
+				continue;
+
+			f32 dx = batch.posX[i] - position.x;
+			f32 dy = batch.posY[i] - position.y;
+			f32 dz = batch.posZ[i] - position.z;
+			f32 distSqr = dx * dx + dy * dy + dz * dz;
+			if (!(distSqr <= constants.distMaxSqr))
+				continue;
+
+			out.globalPos += Vec3(dx, dy, dz);
+			out.globalRot += Vec3(batch.velX[i], batch.velY[i], batch.velZ[i]);
+			out.count++;
+
+			if (distSqr < constants.distMinSqr && distSqr > 0)
+			{
+				f32 dist = sqrtf(distSqr);
+				f32 factor = constants.distMinCube / (dist * dist * dist);
+				out.avoidDir -= Vec3(dx, dy, dz) * factor;
+				out.avoidCount++;
+			}
+		}
+	}
+
+#ifdef BOID_KERNELS_X86
+	void BoidKernelSse2(const NeighbourBatch &batch, const Vec3 &position, u32 self, const BoidConstants &constants, BoidAccumulator &out)
+	{
+		const __m128 px = _mm_set1_ps(position.x);
+		const __m128 py = _mm_set1_ps(position.y);
+		const __m128 pz = _mm_set1_ps(position.z);
+		const __m128i selfId = _mm_set1_epi32((s32)(self));
+		const __m128 maxSqr = _mm_set1_ps(constants.distMaxSqr);
+		const __m128 minSqr = _mm_set1_ps(constants.distMinSqr);
+		const __m128 minCube = _mm_set1_ps(constants.distMinCube);
+		const __m128 zero = _mm_setzero_ps();
+
+		__m128 sumPosX = zero, sumPosY = zero, sumPosZ = zero;
+		__m128 sumVelX = zero, sumVelY = zero, sumVelZ = zero;
+		__m128 sumAvoidX = zero, sumAvoidY = zero, sumAvoidZ = zero;
+
+		const u32 size = batch.GetSize();
+		for (u32 i = 0; i < size; i += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(&batch.posX[i]), px);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(&batch.posY[i]), py);
+			__m128 dz = _mm_sub_ps(_mm_loadu_ps(&batch.posZ[i]), pz);
+			__m128 distSqr = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			__m128i ids = _mm_loadu_si128((const __m128i *)(&batch.ids[i]));
+			__m128 isSelf = _mm_castsi128_ps(_mm_cmpeq_epi32(ids, selfId));
+			__m128 inRange = _mm_andnot_ps(isSelf, _mm_cmple_ps(distSqr, maxSqr));
+			s32 rangeMask = _mm_movemask_ps(inRange);
+			if (rangeMask == 0)
+				continue;
+
+			sumPosX = _mm_add_ps(sumPosX, _mm_and_ps(inRange, dx));
+			sumPosY = _mm_add_ps(sumPosY, _mm_and_ps(inRange, dy));
+			sumPosZ = _mm_add_ps(sumPosZ, _mm_and_ps(inRange, dz));
+			sumVelX = _mm_add_ps(sumVelX, _mm_and_ps(inRange, _mm_loadu_ps(&batch.velX[i])));
+			sumVelY = _mm_add_ps(sumVelY, _mm_and_ps(inRange, _mm_loadu_ps(&batch.velY[i])));
+			sumVelZ = _mm_add_ps(sumVelZ, _mm_and_ps(inRange, _mm_loadu_ps(&batch.velZ[i])));
+			out.count += std::popcount((u32)(rangeMask));
+
+			__m128 avoid = _mm_and_ps(inRange, _mm_and_ps(_mm_cmplt_ps(distSqr, minSqr), _mm_cmpgt_ps(distSqr, zero)));
+			s32 avoidMask = _mm_movemask_ps(avoid);
+			if (avoidMask == 0)
+				continue;
+
+			__m128 dist = _mm_sqrt_ps(distSqr);
+			__m128 factor = _mm_and_ps(avoid, _mm_div_ps(minCube, _mm_mul_ps(_mm_mul_ps(dist, dist), dist)));
+			sumAvoidX = _mm_sub_ps(sumAvoidX, _mm_mul_ps(dx, factor));
+			sumAvoidY = _mm_sub_ps(sumAvoidY, _mm_mul_ps(dy, factor));
+			sumAvoidZ = _mm_sub_ps(sumAvoidZ, _mm_mul_ps(dz, factor));
+			out.avoidCount += std::popcount((u32)(avoidMask));
+		}
+
+		alignas(16) f32 lanes[4];
+		_mm_store_ps(lanes, sumPosX); ReduceLanes<4>(lanes, out.globalPos.x);
+		_mm_store_ps(lanes, sumPosY); ReduceLanes<4>(lanes, out.globalPos.y);
+		_mm_store_ps(lanes, sumPosZ); ReduceLanes<4>(lanes, out.globalPos.z);
+		_mm_store_ps(lanes, sumVelX); ReduceLanes<4>(lanes, out.globalRot.x);
+		_mm_store_ps(lanes, sumVelY); ReduceLanes<4>(lanes, out.globalRot.y);
+		_mm_store_ps(lanes, sumVelZ); ReduceLanes<4>(lanes, out.globalRot.z);
+		_mm_store_ps(lanes, sumAvoidX); ReduceLanes<4>(lanes, out.avoidDir.x);
+		_mm_store_ps(lanes, sumAvoidY); ReduceLanes<4>(lanes, out.avoidDir.y);
+		_mm_store_ps(lanes, sumAvoidZ); ReduceLanes<4>(lanes, out.avoidDir.z);
+	}
+
+	BOID_TARGET("avx2")
+	void BoidKernelAvx2(const NeighbourBatch &batch, const Vec3 &position, u32 self, const BoidConstants &constants, BoidAccumulator &out)
+	{
+		const __m256 px = _mm256_set1_ps(position.x);
+		const __m256 py = _mm256_set1_ps(position.y);
+		const __m256 pz = _mm256_set1_ps(position.z);
+		const __m256i selfId = _mm256_set1_epi32((s32)(self));
+		const __m256 maxSqr = _mm256_set1_ps(constants.distMaxSqr);
+		const __m256 minSqr = _mm256_set1_ps(constants.distMinSqr);
+		const __m256 minCube = _mm256_set1_ps(constants.distMinCube);
+		const __m256 zero = _mm256_setzero_ps();
+
+		__m256 sumPosX = zero, sumPosY = zero, sumPosZ = zero;
+		__m256 sumVelX = zero, sumVelY = zero, sumVelZ = zero;
+		__m256 sumAvoidX = zero, sumAvoidY = zero, sumAvoidZ = zero;
+
+		const u32 size = batch.GetSize();
+		for (u32 i = 0; i < size; i += 8)
+		{
+			__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&batch.posX[i]), px);
+			__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&batch.posY[i]), py);
+			__m256 dz = _mm256_sub_ps(_mm256_loadu_ps(&batch.posZ[i]), pz);
+			__m256 distSqr = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz));
+
+			__m256i ids = _mm256_loadu_si256((const __m256i *)(&batch.ids[i]));
+			__m256 isSelf = _mm256_castsi256_ps(_mm256_cmpeq_epi32(ids, selfId));
+			__m256 inRange = _mm256_andnot_ps(isSelf, _mm256_cmp_ps(distSqr, maxSqr, _CMP_LE_OQ));
+			s32 rangeMask = _mm256_movemask_ps(inRange);
+			if (rangeMask == 0)
+				continue;
+
+			sumPosX = _mm256_add_ps(sumPosX, _mm256_and_ps(inRange, dx));
+			sumPosY = _mm256_add_ps(sumPosY, _mm256_and_ps(inRange, dy));
+			sumPosZ = _mm256_add_ps(sumPosZ, _mm256_and_ps(inRange, dz));
+			sumVelX = _mm256_add_ps(sumVelX, _mm256_and_ps(inRange, _mm256_loadu_ps(&batch.velX[i])));
+			sumVelY = _mm256_add_ps(sumVelY, _mm256_and_ps(inRange, _mm256_loadu_ps(&batch.velY[i])));
+			sumVelZ = _mm256_add_ps(sumVelZ, _mm256_and_ps(inRange, _mm256_loadu_ps(&batch.velZ[i])));
+			out.count += std::popcount((u32)(rangeMask));
+
+			__m256 avoid = _mm256_and_ps(inRange, _mm256_and_ps(_mm256_cmp_ps(distSqr, minSqr, _CMP_LT_OQ), _mm256_cmp_ps(distSqr, zero, _CMP_GT_OQ)));
+			s32 avoidMask = _mm256_movemask_ps(avoid);
+			if (avoidMask == 0)
+				continue;
+
+			__m256 dist = _mm256_sqrt_ps(distSqr);
+			__m256 factor = _mm256_and_ps(avoid, _mm256_div_ps(minCube, _mm256_mul_ps(_mm256_mul_ps(dist, dist), dist)));
+			sumAvoidX = _mm256_sub_ps(sumAvoidX, _mm256_mul_ps(dx, factor));
+			sumAvoidY = _mm256_sub_ps(sumAvoidY, _mm256_mul_ps(dy, factor));
+			sumAvoidZ = _mm256_sub_ps(sumAvoidZ, _mm256_mul_ps(dz, factor));
+			out.avoidCount += std::popcount((u32)(avoidMask));
+		}
+
+		alignas(32) f32 lanes[8];
+		_mm256_store_ps(lanes, sumPosX); ReduceLanes<8>(lanes, out.globalPos.x);
+		_mm256_store_ps(lanes, sumPosY); ReduceLanes<8>(lanes, out.globalPos.y);
+		_mm256_store_ps(lanes, sumPosZ); ReduceLanes<8>(lanes, out.globalPos.z);
+		_mm256_store_ps(lanes, sumVelX); ReduceLanes<8>(lanes, out.globalRot.x);
+		_mm256_store_ps(lanes, sumVelY); ReduceLanes<8>(lanes, out.globalRot.y);
+		_mm256_store_ps(lanes, sumVelZ); ReduceLanes<8>(lanes, out.globalRot.z);
+		_mm256_store_ps(lanes, sumAvoidX); ReduceLanes<8>(lanes, out.avoidDir.x);
+		_mm256_store_ps(lanes, sumAvoidY); ReduceLanes<8>(lanes, out.avoidDir.y);
+		_mm256_store_ps(lanes, sumAvoidZ); ReduceLanes<8>(lanes, out.avoidDir.z);
+	}
+
+#if defined(__GNUC__) && !defined(__clang__)
+	// GCC flags the undefined pass-through operand of its own _mm512_sqrt_ps
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+	BOID_TARGET("avx512f")
+	void BoidKernelAvx512(const NeighbourBatch &batch, const Vec3 &position, u32 self, const BoidConstants &constants, BoidAccumulator &out)
+	{
+		const __m512 px = _mm512_set1_ps(position.x);
+		const __m512 py = _mm512_set1_ps(position.y);
+		const __m512 pz = _mm512_set1_ps(position.z);
+		const __m512i selfId = _mm512_set1_epi32((s32)(self));
+		const __m512 maxSqr = _mm512_set1_ps(constants.distMaxSqr);
+		const __m512 minSqr = _mm512_set1_ps(constants.distMinSqr);
+		const __m512 minCube = _mm512_set1_ps(constants.distMinCube);
+		const __m512 zero = _mm512_setzero_ps();
+
+		__m512 sumPosX = zero, sumPosY = zero, sumPosZ = zero;
+		__m512 sumVelX = zero, sumVelY = zero, sumVelZ = zero;
+		__m512 sumAvoidX = zero, sumAvoidY = zero, sumAvoidZ = zero;
+
+		const u32 size = batch.GetSize();
+		for (u32 i = 0; i < size; i += 16)
+		{
+			__m512 dx = _mm512_sub_ps(_mm512_loadu_ps(&batch.posX[i]), px);
+			__m512 dy = _mm512_sub_ps(_mm512_loadu_ps(&batch.posY[i]), py);
+			__m512 dz = _mm512_sub_ps(_mm512_loadu_ps(&batch.posZ[i]), pz);
+			__m512 distSqr = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)), _mm512_mul_ps(dz, dz));
+
+			__m512i ids = _mm512_loadu_si512(&batch.ids[i]);
+			__mmask16 inRange = _mm512_cmp_ps_mask(distSqr, maxSqr, _CMP_LE_OQ) & ~_mm512_cmpeq_epi32_mask(ids, selfId);
+			if (inRange == 0)
+				continue;
+
+			sumPosX = _mm512_mask_add_ps(sumPosX, inRange, sumPosX, dx);
+			sumPosY = _mm512_mask_add_ps(sumPosY, inRange, sumPosY, dy);
+			sumPosZ = _mm512_mask_add_ps(sumPosZ, inRange, sumPosZ, dz);
+			sumVelX = _mm512_mask_add_ps(sumVelX, inRange, sumVelX, _mm512_loadu_ps(&batch.velX[i]));
+			sumVelY = _mm512_mask_add_ps(sumVelY, inRange, sumVelY, _mm512_loadu_ps(&batch.velY[i]));
+			sumVelZ = _mm512_mask_add_ps(sumVelZ, inRange, sumVelZ, _mm512_loadu_ps(&batch.velZ[i]));
+			out.count += std::popcount((u32)(inRange));
+
+			__mmask16 avoid = inRange & _mm512_cmp_ps_mask(distSqr, minSqr, _CMP_LT_OQ) & _mm512_cmp_ps_mask(distSqr, zero, _CMP_GT_OQ);
+			if (avoid == 0)
+				continue;
+
+			__m512 dist = _mm512_sqrt_ps(distSqr);
+			__m512 factor = _mm512_div_ps(minCube, _mm512_mul_ps(_mm512_mul_ps(dist, dist), dist));
+			sumAvoidX = _mm512_mask_sub_ps(sumAvoidX, avoid, sumAvoidX, _mm512_mul_ps(dx, factor));
+			sumAvoidY = _mm512_mask_sub_ps(sumAvoidY, avoid, sumAvoidY, _mm512_mul_ps(dy, factor));
+			sumAvoidZ = _mm512_mask_sub_ps(sumAvoidZ, avoid, sumAvoidZ, _mm512_mul_ps(dz, factor));
+			out.avoidCount += std::popcount((u32)(avoid));
+		}
+
+		alignas(64) f32 lanes[16];
+		_mm512_store_ps(lanes, sumPosX); ReduceLanes<16>(lanes, out.globalPos.x);
+		_mm512_store_ps(lanes, sumPosY); ReduceLanes<16>(lanes, out.globalPos.y);
+		_mm512_store_ps(lanes, sumPosZ); ReduceLanes<16>(lanes, out.globalPos.z);
+		_mm512_store_ps(lanes, sumVelX); ReduceLanes<16>(lanes, out.globalRot.x);
+		_mm512_store_ps(lanes, sumVelY); ReduceLanes<16>(lanes, out.globalRot.y);
+		_mm512_store_ps(lanes, sumVelZ); ReduceLanes<16>(lanes, out.globalRot.z);
+		_mm512_store_ps(lanes, sumAvoidX); ReduceLanes<16>(lanes, out.avoidDir.x);
+		_mm512_store_ps(lanes, sumAvoidY); ReduceLanes<16>(lanes, out.avoidDir.y);
+		_mm512_store_ps(lanes, sumAvoidZ); ReduceLanes<16>(lanes, out.avoidDir.z);
+	}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+	bool IsKernelSupported(BoidKernel kernel)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		switch (kernel)
+		{
+		case BoidKernel::AVX2:
+			return __builtin_cpu_supports("avx2");
+		case BoidKernel::AVX512:
+			return __builtin_cpu_supports("avx512f");
+		default:
+			return true;
+		}
+#else
+		if (kernel != BoidKernel::AVX2 && kernel != BoidKernel::AVX512)
+			return true;
+
+		s32 info[4];
+		__cpuid(info, 1);
+		// The OS must save the wide registers on context switches
+		bool osSave = (info[2] & (1 << 27)) != 0;
+		if (!osSave)
+			return false;
+		u64 xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+		if (kernel == BoidKernel::AVX2)
+			return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+		return (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+#endif
+	}
+#endif
+}
+
+// -----------------------   NeighbourBatch    -----------------------
+
+void NeighbourBatch::Clear()
+{
+	count = 0;
+}
+
+void NeighbourBatch::Reserve(u32 extra)
+{
+	if (count + extra <= ids.size())
+		return;
+
+	const u32 size = Util::MaxU(Util::MaxU(BOID_BATCH_WIDTH * 16, count + extra), (u32)(ids.size()) * 2);
+	posX.resize(size);
+	posY.resize(size);
+	posZ.resize(size);
+	velX.resize(size);
+	velY.resize(size);
+	velZ.resize(size);
+	ids.resize(size);
+}
+
+void NeighbourBatch::Resize(u32 size)
+{
+	count = 0;
+	Reserve(size);
+	count = size;
+}
+
+void NeighbourBatch::Pad()
+{
+	Reserve(BOID_BATCH_WIDTH);
+	while (count % BOID_BATCH_WIDTH != 0)
+		Push(Vec3(PADDING_POSITION), Vec3(), ~0u);
+}
+
+u32 NeighbourBatch::GetSize() const
+{
+	return count;
+}
+
+// -----------------------   Dispatch    -----------------------
+
+BoidKernelFunc Simulation::GetBoidKernelFunc(BoidKernel kernel)
+{
+	switch (kernel)
+	{
+	case BoidKernel::Scalar:
+		return &BoidKernelScalar;
+#ifdef BOID_KERNELS_X86
+	case BoidKernel::SSE2:
+		return &BoidKernelSse2;
+	case BoidKernel::AVX2:
+		return IsKernelSupported(kernel) ? &BoidKernelAvx2 : nullptr;
+	case BoidKernel::AVX512:
+		return IsKernelSupported(kernel) ? &BoidKernelAvx512 : nullptr;
+#endif
+	default:
+		return nullptr;
+	}
+}
+
+BoidKernel Simulation::GetBestBoidKernel()
+{
+	static const BoidKernel best = []()
+	{
+		for (u32 i = (u32)(BoidKernel::Count); i > 0; i--)
+		{
+			if (GetBoidKernelFunc((BoidKernel)(i - 1)))
+				return (BoidKernel)(i - 1);
+		}
+		return BoidKernel::Scalar;
+	}();
+	return best;
+}
+
+const char *Simulation::GetBoidKernelName(BoidKernel kernel)
+{
+	switch (kernel)
+	{
+	case BoidKernel::Scalar:
+		return "scalar";
+	case BoidKernel::SSE2:
+		return "sse2";
+	case BoidKernel::AVX2:
+		return "avx2";
+	case BoidKernel::AVX512:
+		return "avx512";
+	default:
+		return "unknown";
+	}
+}
@@ -0,0 +1,338 @@
+#include "Simulation/BoidSim.hpp"
+#include "Core/Trace.hpp"
+#include "Maths/Random.hpp"
+
+using namespace Simulation;
+using namespace Maths;
+
+void BoidSim::Init(const SimParams &paramsIn, u32 seed)
+{
+	LoadObjects(paramsIn, GenerateObjects(paramsIn, seed, jobSystem));
+}
+
+void BoidSim::LoadObjects(const SimParams &paramsIn, const std::vector<Vec4> &objects)
+{
+	LoadObjects(paramsIn, objects.data(), (u32)(objects.size() / 4));
+}
+
+void BoidSim::LoadObjects(const SimParams &paramsIn, const Vec4 *objects, u32 objectCount)
+{
+	params = ClampParams(paramsIn);
+
+	const u32 count = Util::MinU(params.objectCount, objectCount);
+	params.objectCount = count;
+	positions.resize(count);
+	velocities.resize(count);
+	accels.resize(count);
+	rotations.resize(count);
+
+	for (u32 i = 0; i < count; i++)
+	{
+		const Vec4 *object = &objects[(size_t)(i) * 4];
+		positions[i] = object[0].GetVector();
+		velocities[i] = object[1].GetVector();
+		accels[i] = object[2].GetVector();
+		rotations[i] = Quat(Vec3(object[3].x, object[3].y, object[3].z), object[3].w);
+	}
+
+	grid.Init(params.chunkCountSide * params.chunkCountSide * params.chunkCountSide);
+}
+
+void BoidSim::WriteObjects(std::vector<Vec4> &objects) const
+{
+	objects.resize((size_t)(params.objectCount) * 4);
+	for (u32 i = 0; i < params.objectCount; i++)
+	{
+		Vec4 *object = &objects[(size_t)(i) * 4];
+		object[0] = Vec4(positions[i], 0);
+		object[1] = Vec4(velocities[i], 0);
+		object[2] = Vec4(accels[i], 0);
+		object[3] = rotations[i].ToVec4();
+	}
+}
+
+std::vector<Vec4> BoidSim::GenerateObjects(const SimParams &params, u32 seed, Core::JobSystem *jobSystem)
+{
+	TRACE_FUNCTION();
+	const Philox rng(seed);
+	std::vector<Vec4> result = std::vector<Vec4>((size_t)(params.objectCount) * 4);
+	auto unitVector = [](const f32 *v) { return (Vec3(v[0], v[1], v[2]) * 2 - 1).Normalize(); };
+
+	// Boid i reads the blocks [i * GENERATE_BLOCKS_PER_OBJECT, (i + 1) * GENERATE_BLOCKS_PER_OBJECT) of the stream
+	auto generate = [&](u32 begin, u32 end)
+	{
+		f32 values[GENERATE_CHUNK_OBJECTS * GENERATE_BLOCKS_PER_OBJECT * Philox::BLOCK_WORDS];
+		for (u32 first = begin; first < end; first += GENERATE_CHUNK_OBJECTS)
+		{
+			const u32 count = Util::MinU(GENERATE_CHUNK_OBJECTS, end - first);
+			rng.GenerateFloats01((u64)(first) * GENERATE_BLOCKS_PER_OBJECT, count * GENERATE_BLOCKS_PER_OBJECT, values);
+			for (u32 i = 0; i < count; i++)
+			{
+				const f32 *v = &values[i * GENERATE_BLOCKS_PER_OBJECT * Philox::BLOCK_WORDS];
+				Vec4 *object = &result[(size_t)(first + i) * 4];
+				object[0] = Vec4(v[0] * params.worldSize, v[1] * params.worldSize, v[2] * params.worldSize, 0);
+				object[1] = Vec4(unitVector(v + 3), 0) * params.maxSpeed * 0.2f * (1/144.0f);
+				object[2] = Vec4();
+				object[3] = Quat::AxisAngle(unitVector(v + 6), (f32)(v[9] * M_PI * 2)).ToVec4();
+			}
+		}
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(params.objectCount, GENERATE_OBJECT_GRAIN, generate);
+	else
+		generate(0, params.objectCount);
+	return result;
+}
+
+SimParams BoidSim::ClampParams(const SimParams &paramsIn)
+{
+	SimParams result = paramsIn;
+	result.objectCount = Util::MaxU(result.objectCount, 1);
+	result.worldSize = Util::MaxF(result.worldSize, 1.0f);
+	result.chunkCountSide = Util::MinU(Util::MaxU(result.chunkCountSide, MIN_CHUNK_COUNT_SIDE), MAX_CHUNK_COUNT_SIDE);
+	return result;
+}
+
+void BoidSim::SetJobSystem(Core::JobSystem *system)
+{
+	jobSystem = system;
+}
+
+bool BoidSim::SetKernel(BoidKernel kernelIn)
+{
+	BoidKernelFunc func = GetBoidKernelFunc(kernelIn);
+	if (!func)
+		return false;
+	kernel = kernelIn;
+	kernelFunc = func;
+	return true;
+}
+
+BoidKernel BoidSim::GetKernel() const
+{
+	return kernel;
+}
+
+void BoidSim::Step(f32 deltaTime)
+{
+	TRACE_FUNCTION();
+	PreUpdate();
+	Update(deltaTime);
+	PostUpdate(deltaTime);
+}
+
+const SimParams &BoidSim::GetParams() const
+{
+	return params;
+}
+
+u32 BoidSim::GetObjectCount() const
+{
+	return params.objectCount;
+}
+
+const std::vector<Vec3> &BoidSim::GetPositions() const
+{
+	return positions;
+}
+
+const std::vector<Vec3> &BoidSim::GetVelocities() const
+{
+	return velocities;
+}
+
+const std::vector<Quat> &BoidSim::GetRotations() const
+{
+	return rotations;
+}
+
+s32 BoidSim::GetCell(IVec3 pos, Vec3 &dt) const
+{
+	const s32 side = (s32)(params.chunkCountSide);
+	const f32 size = params.worldSize;
+	dt = Vec3();
+	for (u32 i = 0; i < 3; i++)
+	{
+		if (pos[i] < 0)
+		{
+			pos[i] += side;
+			dt[i] = -size;
+		}
+		else if (pos[i] >= side)
+		{
+			pos[i] -= side;
+			dt[i] = size;
+		}
+	}
+	return pos.x + ((pos.z * side) + pos.y) * side;
+}
+
+void BoidSim::PreUpdate()
+{
+	const s32 side = (s32)(params.chunkCountSide);
+	const f32 scale = side / params.worldSize;
+	objectCells.resize(params.objectCount);
+	auto cellRange = [&](u32 begin, u32 end)
+	{
+		for (u32 i = begin; i < end; i++)
+		{
+			IVec3 cell = positions[i] * scale;
+			cell.x = Util::IClamp(cell.x, 0, side - 1);
+			cell.y = Util::IClamp(cell.y, 0, side - 1);
+			cell.z = Util::IClamp(cell.z, 0, side - 1);
+			objectCells[i] = cell.x + ((cell.z * side) + cell.y) * side;
+		}
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(params.objectCount, SIM_OBJECT_GRAIN, cellRange);
+	else
+		cellRange(0, params.objectCount);
+
+	grid.Build(objectCells, jobSystem);
+
+	if (!params.reorderByCell)
+		return;
+
+	const auto &sorted = grid.GetSortedObjects();
+	sortedBoids.Resize(params.objectCount);
+	auto reorderRange = [&](u32 begin, u32 end)
+	{
+		for (u32 k = begin; k < end; k++)
+			sortedBoids.Set(k, positions[sorted[k]], velocities[sorted[k]], sorted[k]);
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(params.objectCount, SIM_OBJECT_GRAIN, reorderRange);
+	else
+		reorderRange(0, params.objectCount);
+}
+
+void BoidSim::Update(f32 deltaTime)
+{
+	const u32 side = params.chunkCountSide;
+	auto cellRange = [&](u32 begin, u32 end)
+	{
+		for (u32 c = begin; c < end; c++)
+			ProcessCellUpdate(c % side, (c / side) % side, c / (side * side), deltaTime);
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(side * side * side, SIM_CELL_GRAIN, cellRange);
+	else
+		cellRange(0, side * side * side);
+}
+
+void BoidSim::PostUpdate(f32 deltaTime)
+{
+	auto objectRange = [&](u32 begin, u32 end)
+	{
+		ProcessPostUpdate(begin, end, deltaTime);
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(params.objectCount, SIM_OBJECT_GRAIN, objectRange);
+	else
+		objectRange(0, params.objectCount);
+}
+
+void BoidSim::GatherCells(NeighbourBatch &batch, u32 firstCell, u32 lastCell, const Vec3 &dt) const
+{
+	const u32 begin = grid.GetCellBegin(firstCell);
+	const u32 end = grid.GetCellEnd(lastCell);
+	if (params.reorderByCell)
+	{
+		batch.Append(sortedBoids, begin, end, dt);
+		return;
+	}
+
+	const auto &sorted = grid.GetSortedObjects();
+	batch.Reserve(end - begin);
+	for (u32 k = begin; k < end; k++)
+		batch.Push(positions[sorted[k]] + dt, velocities[sorted[k]], sorted[k]);
+}
+
+void BoidSim::ProcessCellUpdate(s32 cx, s32 cy, s32 cz, f32 deltaTime)
+{
+	BoidConstants constants;
+	constants.distMaxSqr = params.distMax * params.distMax;
+	constants.distMinSqr = params.distMin * params.distMin;
+	constants.distMinCube = constants.distMinSqr * params.distMin;
+
+	const s32 side = (s32)(params.chunkCountSide);
+	const u32 cell = cx + ((cz * side) + cy) * side;
+	const u32 cellBegin = grid.GetCellBegin(cell);
+	const u32 cellEnd = grid.GetCellEnd(cell);
+	if (cellBegin == cellEnd)
+		return;
+
+	// Every boid of the cell sees the same neighbours, gather them once into contiguous lanes
+	static thread_local NeighbourBatch batch;
+	batch.Clear();
+	for (s32 k = -1; k <= 1; k++)
+	{
+		for (s32 j = -1; j <= 1; j++)
+		{
+			Vec3 dt;
+			if (cx > 0 && cx + 1 < side)
+			{
+				// Three neighbours along x are consecutive cells, copy them in one go
+				s32 first = GetCell(IVec3(cx - 1, cy + j, cz + k), dt);
+				GatherCells(batch, first, first + 2, dt);
+				continue;
+			}
+			for (s32 i = -1; i <= 1; i++)
+			{
+				s32 cellId = GetCell(IVec3(cx + i, cy + j, cz + k), dt);
+				GatherCells(batch, cellId, cellId, dt);
+			}
+		}
+	}
+	batch.Pad();
+
+	const auto &sorted = grid.GetSortedObjects();
+	for (u32 index1 = cellBegin; index1 < cellEnd; index1++)
+	{
+		u32 boid1 = sorted[index1];
+
+		BoidAccumulator acc;
+		kernelFunc(batch, positions[boid1], boid1, constants, acc);
+
+		if (acc.count != 0)
+		{
+			accels[boid1] = (acc.globalPos / (f32)(acc.count)) * 700 + (acc.globalRot / (f32)(acc.count)) * 2500;
+			if (acc.avoidCount != 0)
+				accels[boid1] += (acc.avoidDir / (f32)(acc.avoidCount)) * 9000;
+			accels[boid1] *= deltaTime;
+		}
+		else
+			accels[boid1] = velocities[boid1].Normalize() * deltaTime;
+	}
+}
+
+void BoidSim::ProcessPostUpdate(u32 start, u32 end, f32 deltaTime)
+{
+	const f32 size = params.worldSize;
+	for (u32 i = start; i < end; i++)
+	{
+		Vec3 newVel = velocities[i] + accels[i] * deltaTime;
+		f32 len = newVel.Length();
+		if (len > params.maxSpeed)
+		{
+			newVel = newVel.Normalize() * params.maxSpeed;
+		}
+		velocities[i] = newVel;
+
+		Vec3 newPos = positions[i] + velocities[i] * deltaTime;
+		for (u32 j = 0; j < 3; j++)
+		{
+			if (newPos[j] < 0)
+				newPos[j] += size;
+			else if (newPos[j] >= size)
+				newPos[j] -= size;
+		}
+
+		positions[i] = newPos;
+	}
+}
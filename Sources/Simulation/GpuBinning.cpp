@@ -0,0 +1,137 @@
+#include "Simulation/GpuBinning.hpp"
+
+#include <algorithm>
+
+using namespace Simulation;
+using namespace Maths;
+
+namespace
+{
+	// Constants of the fixed capacity lists that sort0/sort1 used before the prefix-sum binning
+	const u32 LEGACY_SORT_THREAD_COUNT = 64;
+}
+
+BinningLayout BinningLayout::Create(u32 objectCount, u32 cellCount)
+{
+	BinningLayout layout;
+	layout.countsOffset = 0;
+	layout.cellOffsetsOffset = layout.countsOffset + cellCount;
+	layout.objectCellsOffset = layout.cellOffsetsOffset + cellCount + 1;
+	layout.ranksOffset = layout.objectCellsOffset + objectCount;
+	layout.sortedOffset = layout.ranksOffset + objectCount;
+	layout.size = layout.sortedOffset + objectCount;
+	return layout;
+}
+
+u32 GpuBinning::GetObjectCell(const Vec4 &position, const SimParams &params)
+{
+	const s32 side = (s32)(params.chunkCountSide);
+	IVec3 cell = position.GetVector() * (side / params.worldSize);
+	cell.x = Util::IClamp(cell.x, 0, side - 1);
+	cell.y = Util::IClamp(cell.y, 0, side - 1);
+	cell.z = Util::IClamp(cell.z, 0, side - 1);
+	return cell.x + ((cell.z * side) + cell.y) * side;
+}
+
+void GpuBinning::Run(const std::vector<Vec4> &objects, const SimParams &params, std::vector<u32> &buffer)
+{
+	const u32 objectCount = Util::MinU(params.objectCount, (u32)(objects.size() / 4));
+	const u32 cellCount = params.chunkCountSide * params.chunkCountSide * params.chunkCountSide;
+	const BinningLayout layout = BinningLayout::Create(objectCount, cellCount);
+	buffer.assign(layout.size, 0);
+
+	// sort0: count
+	for (u32 i = 0; i < objectCount; i++)
+	{
+		u32 cell = GetObjectCell(objects[i * 4], params);
+		buffer[layout.objectCellsOffset + i] = cell;
+		buffer[layout.ranksOffset + i] = buffer[layout.countsOffset + cell]++;
+	}
+
+	// sort1: exclusive scan, then clear the counts
+	u32 offset = 0;
+	for (u32 c = 0; c < cellCount; c++)
+	{
+		buffer[layout.cellOffsetsOffset + c] = offset;
+		offset += buffer[layout.countsOffset + c];
+		buffer[layout.countsOffset + c] = 0;
+	}
+	buffer[layout.cellOffsetsOffset + cellCount] = offset;
+
+	// sort2: scatter
+	for (u32 i = 0; i < objectCount; i++)
+	{
+		u32 cell = buffer[layout.objectCellsOffset + i];
+		buffer[layout.sortedOffset + buffer[layout.cellOffsetsOffset + cell] + buffer[layout.ranksOffset + i]] = i;
+	}
+}
+
+bool GpuBinning::Validate(const std::vector<Vec4> &objects, const SimParams &params, const std::vector<u32> &buffer, std::string &error)
+{
+	std::vector<u32> reference;
+	Run(objects, params, reference);
+	if (buffer.size() < reference.size())
+	{
+		error = "buffer holds " + std::to_string(buffer.size()) + " elements, expected " + std::to_string(reference.size());
+		return false;
+	}
+
+	const u32 objectCount = Util::MinU(params.objectCount, (u32)(objects.size() / 4));
+	const u32 cellCount = params.chunkCountSide * params.chunkCountSide * params.chunkCountSide;
+	const BinningLayout layout = BinningLayout::Create(objectCount, cellCount);
+	for (u32 c = 0; c <= cellCount; c++)
+	{
+		if (buffer[layout.cellOffsetsOffset + c] != reference[layout.cellOffsetsOffset + c])
+		{
+			error = "offset of cell " + std::to_string(c) + " is " + std::to_string(buffer[layout.cellOffsetsOffset + c]) + ", expected " + std::to_string(reference[layout.cellOffsetsOffset + c]);
+			return false;
+		}
+	}
+
+	std::vector<u32> cellObjects;
+	for (u32 c = 0; c < cellCount; c++)
+	{
+		const u32 begin = layout.sortedOffset + reference[layout.cellOffsetsOffset + c];
+		const u32 end = layout.sortedOffset + reference[layout.cellOffsetsOffset + c + 1];
+		// The reference is sorted by index inside each cell
+		cellObjects.assign(buffer.begin() + begin, buffer.begin() + end);
+		std::sort(cellObjects.begin(), cellObjects.end());
+		if (!std::equal(cellObjects.begin(), cellObjects.end(), reference.begin() + begin))
+		{
+			error = "cell " + std::to_string(c) + " does not hold the expected boids";
+			return false;
+		}
+	}
+	return true;
+}
+
+u32 GpuBinning::CountLegacyBinned(const std::vector<Vec4> &objects, const SimParams &params)
+{
+	const u32 objectCount = Util::MinU(params.objectCount, (u32)(objects.size() / 4));
+	const u32 cellCount = params.chunkCountSide * params.chunkCountSide * params.chunkCountSide;
+	const u32 maxObjectsPerChunk = objectCount * 4 / cellCount + 1;
+	const u32 threadObjectsPerChunk = maxObjectsPerChunk / 4 + 1;
+	const u32 objectsPerThread = (objectCount + LEGACY_SORT_THREAD_COUNT - 1) / LEGACY_SORT_THREAD_COUNT;
+
+	// Each sort0 thread kept at most threadObjectsPerChunk - 1 boids per cell, sort1 at most maxObjectsPerChunk - 1
+	std::vector<u32> threadCounts(cellCount);
+	std::vector<u32> merged(cellCount);
+	for (u32 t = 0; t < LEGACY_SORT_THREAD_COUNT; t++)
+	{
+		std::fill(threadCounts.begin(), threadCounts.end(), 0);
+		const u32 last = Util::MinU((t + 1) * objectsPerThread, objectCount);
+		for (u32 i = t * objectsPerThread; i < last; i++)
+		{
+			u32 cell = GetObjectCell(objects[i * 4], params);
+			if (threadCounts[cell] + 1 < threadObjectsPerChunk)
+				threadCounts[cell]++;
+		}
+		for (u32 c = 0; c < cellCount; c++)
+			merged[c] = Util::MinU(merged[c] + threadCounts[c], maxObjectsPerChunk - 1);
+	}
+
+	u32 total = 0;
+	for (u32 c = 0; c < cellCount; c++)
+		total += merged[c];
+	return total;
+}
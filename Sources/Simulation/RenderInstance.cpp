@@ -0,0 +1,57 @@
+#include "Simulation/RenderInstance.hpp"
+
+#include <cmath>
+
+using namespace Simulation;
+using namespace Maths;
+
+namespace
+{
+	u32 PackSnorm16(f32 value)
+	{
+		return (u16)(s16)(lroundf(Util::Clamp(value, -1.0f, 1.0f) * 32767.0f));
+	}
+
+	f32 UnpackSnorm16(u32 value)
+	{
+		return Util::Clamp((s16)(u16)(value) / 32767.0f, -1.0f, 1.0f);
+	}
+}
+
+u32 RenderInstances::PackSnorm2x16(f32 low, f32 high)
+{
+	return PackSnorm16(low) | (PackSnorm16(high) << 16);
+}
+
+void RenderInstances::UnpackSnorm2x16(u32 value, f32 &low, f32 &high)
+{
+	low = UnpackSnorm16(value & 0xffff);
+	high = UnpackSnorm16(value >> 16);
+}
+
+RenderInstance RenderInstances::Pack(const Vec4 *object)
+{
+	const Vec4 &position = object[0];
+	const Vec4 &rotation = object[3];
+	RenderInstance result;
+	result.position[0] = position.x;
+	result.position[1] = position.y;
+	result.position[2] = position.z;
+	result.rotationXY = PackSnorm2x16(rotation.x, rotation.y);
+	result.rotationZW = PackSnorm2x16(rotation.z, rotation.w);
+	return result;
+}
+
+void RenderInstances::Pack(const Vec4 *objects, u32 count, RenderInstance *instances)
+{
+	for (u32 i = 0; i < count; i++)
+		instances[i] = Pack(objects + (size_t)(i) * 4);
+}
+
+Quat RenderInstances::GetRotation(const RenderInstance &instance)
+{
+	Quat result;
+	UnpackSnorm2x16(instance.rotationXY, result.v.x, result.v.y);
+	UnpackSnorm2x16(instance.rotationZW, result.v.z, result.a);
+	return result.Normalize();
+}
@@ -0,0 +1,143 @@
+#include "Simulation/Snapshot.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+using namespace Simulation;
+
+bool Snapshot::Open(const std::string &path, std::string &error)
+{
+	Close();
+	if (!file.Open(path, true))
+	{
+		error = "could not open " + path;
+		return false;
+	}
+	if (file.GetSize() < sizeof(SnapshotHeader))
+	{
+		error = path + " is too small for a snapshot header";
+		Close();
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(SnapshotHeader));
+	if (!Validate(header, file.GetSize(), error))
+	{
+		error = path + ": " + error;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void Snapshot::Close()
+{
+	file.Close();
+	header = SnapshotHeader();
+}
+
+const SnapshotHeader &Snapshot::GetHeader() const
+{
+	return header;
+}
+
+SimParams Snapshot::GetParams() const
+{
+	SimParams params;
+	params.objectCount = header.objectCount;
+	params.chunkCountSide = header.chunkCountSide;
+	params.worldSize = header.worldSize;
+	params.distMax = header.distMax;
+	params.distMin = header.distMin;
+	params.maxSpeed = header.maxSpeed;
+	return params;
+}
+
+const u8 *Snapshot::GetObjects() const
+{
+	return file.IsOpen() ? file.GetData() + header.objectsOffset : nullptr;
+}
+
+bool Snapshot::Write(const std::string &path, const SimParams &params, u64 tick, const void *objects, std::string &error)
+{
+	std::FILE *output = std::fopen(path.c_str(), "wb");
+	if (!output)
+	{
+		error = "could not create " + path;
+		return false;
+	}
+	// The objects are written in one call straight from the caller's memory
+	setvbuf(output, nullptr, _IONBF, 0);
+
+	u8 headerBlock[SNAPSHOT_ALIGNMENT] = {};
+	const SnapshotHeader fileHeader = CreateHeader(params, tick);
+	memcpy(headerBlock, &fileHeader, sizeof(SnapshotHeader));
+	bool success = std::fwrite(headerBlock, sizeof(headerBlock), 1, output) == 1;
+	if (success && fileHeader.objectsSize > 0)
+		success = std::fwrite(objects, (size_t)(fileHeader.objectsSize), 1, output) == 1;
+	success &= std::fclose(output) == 0;
+	if (!success)
+	{
+		error = "could not write " + path;
+		std::remove(path.c_str());
+	}
+	return success;
+}
+
+SnapshotHeader Snapshot::CreateHeader(const SimParams &params, u64 tick)
+{
+	SnapshotHeader result;
+	result.headerSize = sizeof(SnapshotHeader);
+	result.objectCount = params.objectCount;
+	result.chunkCountSide = params.chunkCountSide;
+	result.worldSize = params.worldSize;
+	result.distMax = params.distMax;
+	result.distMin = params.distMin;
+	result.maxSpeed = params.maxSpeed;
+	result.tick = tick;
+	result.objectsOffset = SNAPSHOT_ALIGNMENT;
+	result.objectsSize = (u64)(params.objectCount) * SNAPSHOT_OBJECT_STRIDE;
+	return result;
+}
+
+bool Snapshot::Validate(const SnapshotHeader &header, u64 fileSize, std::string &error)
+{
+	if (header.magic != SNAPSHOT_MAGIC)
+	{
+		error = "not a boid snapshot";
+		return false;
+	}
+	if (header.version != SNAPSHOT_VERSION || header.headerSize != sizeof(SnapshotHeader) || header.objectStride != SNAPSHOT_OBJECT_STRIDE)
+	{
+		error = "snapshot version " + std::to_string(header.version) + " is not supported, expected " + std::to_string(SNAPSHOT_VERSION);
+		return false;
+	}
+	// Negated comparisons so NaN fails them too
+	if (header.objectCount == 0 || header.chunkCountSide < MIN_CHUNK_COUNT_SIDE || header.chunkCountSide > MAX_CHUNK_COUNT_SIDE || !std::isfinite(header.worldSize) || !(header.worldSize >= 1.0f) ||
+		!std::isfinite(header.distMax) || !(header.distMin >= 0.0f) || !(header.distMin <= header.distMax) ||
+		!std::isfinite(header.maxSpeed) || !(header.maxSpeed > 0.0f))
+	{
+		error = "snapshot parameters are out of range";
+		return false;
+	}
+	if (header.objectsOffset % SNAPSHOT_ALIGNMENT != 0 || header.objectsOffset < sizeof(SnapshotHeader) ||
+		header.objectsSize != (u64)(header.objectCount) * SNAPSHOT_OBJECT_STRIDE)
+	{
+		error = "snapshot object array is misplaced";
+		return false;
+	}
+	// The sum could wrap past a crafted offset
+	if (header.objectsOffset > fileSize || header.objectsSize > fileSize - header.objectsOffset)
+	{
+		error = "snapshot is truncated, " + std::to_string(fileSize) + " bytes for " + std::to_string(header.objectCount) + " objects";
+		return false;
+	}
+	return true;
+}
+
+std::string Snapshot::GetPath(const std::string &prefix, u64 tick)
+{
+	char number[32];
+	snprintf(number, sizeof(number), "%08llu", (unsigned long long)(tick));
+	return prefix + number + ".boids";
+}
@@ -0,0 +1,92 @@
+#include "Simulation/SpatialGrid.hpp"
+
+#include <assert.h>
+
+#include "Maths/Maths.hpp"
+
+using namespace Simulation;
+using namespace Maths;
+
+void SpatialGrid::Init(u32 cellCountIn)
+{
+	cellCount = cellCountIn;
+	cellOffsets.assign(cellCount + 1, 0);
+	sortedObjects.clear();
+}
+
+void SpatialGrid::Build(const std::vector<u32> &objectCells, Core::JobSystem *jobSystem)
+{
+	const u32 count = (u32)(objectCells.size());
+	sortedObjects.resize(count);
+
+	u32 blockCount = 1;
+	if (jobSystem && jobSystem->IsRunning())
+		blockCount = Util::MinU(Util::MinU(jobSystem->GetThreadCount(), MAX_GRID_BLOCKS), Util::MaxU(count / GRID_BLOCK_MIN_OBJECTS, 1));
+	const u32 blockSize = (count + blockCount - 1) / blockCount;
+	blockOffsets.assign(blockCount * cellCount, 0);
+
+	auto histogram = [&](u32 begin, u32 end)
+	{
+		for (u32 b = begin; b < end; b++)
+		{
+			u32 *counts = &blockOffsets[b * cellCount];
+			const u32 last = Util::MinU((b + 1) * blockSize, count);
+			for (u32 i = b * blockSize; i < last; i++)
+			{
+				assert(objectCells[i] < cellCount);
+				counts[objectCells[i]]++;
+			}
+		}
+	};
+
+	auto scatter = [&](u32 begin, u32 end)
+	{
+		for (u32 b = begin; b < end; b++)
+		{
+			u32 *offsets = &blockOffsets[b * cellCount];
+			const u32 last = Util::MinU((b + 1) * blockSize, count);
+			for (u32 i = b * blockSize; i < last; i++)
+				sortedObjects[offsets[objectCells[i]]++] = i;
+		}
+	};
+
+	if (jobSystem)
+		jobSystem->ParallelFor(blockCount, 1, histogram);
+	else
+		histogram(0, blockCount);
+
+	// Exclusive scan in (cell, block) order, which keeps the sort stable across blocks
+	u32 offset = 0;
+	for (u32 c = 0; c < cellCount; c++)
+	{
+		cellOffsets[c] = offset;
+		for (u32 b = 0; b < blockCount; b++)
+		{
+			u32 &slot = blockOffsets[b * cellCount + c];
+			u32 objects = slot;
+			slot = offset;
+			offset += objects;
+		}
+	}
+	cellOffsets[cellCount] = offset;
+
+	if (jobSystem)
+		jobSystem->ParallelFor(blockCount, 1, scatter);
+	else
+		scatter(0, blockCount);
+}
+
+u32 SpatialGrid::GetCellCount() const
+{
+	return cellCount;
+}
+
+u32 SpatialGrid::GetObjectCount() const
+{
+	return (u32)(sortedObjects.size());
+}
+
+const std::vector<u32> &SpatialGrid::GetSortedObjects() const
+{
+	return sortedObjects;
+}
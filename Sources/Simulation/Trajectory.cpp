@@ -0,0 +1,333 @@
+#include "Simulation/Trajectory.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+#include "Core/Trace.hpp"
+
+using namespace Simulation;
+using namespace Maths;
+
+u16 Trajectory::QuantizePosition(f32 value, f32 worldSize)
+{
+	return (u16)(Util::Clamp(value / worldSize) * 65535.0f + 0.5f);
+}
+
+f32 Trajectory::DequantizePosition(u16 value, f32 worldSize)
+{
+	return value * (worldSize / 65535.0f);
+}
+
+u16 Trajectory::QuantizeSnorm(f32 value)
+{
+	return (u16)(s16)(lroundf(Util::Clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+f32 Trajectory::DequantizeSnorm(u16 value)
+{
+	return (s16)(value) / 32767.0f;
+}
+
+void Trajectory::EncodeFrame(const u16 *values, const u16 *previous, u32 count, std::vector<u8> &out)
+{
+	// Worst case is 3 bytes per value
+	out.resize((size_t)(count) * 3);
+	u8 *cursor = out.data();
+	for (u32 i = 0; i < count; i++)
+	{
+		const s16 delta = (s16)(u16)(values[i] - (previous ? previous[i] : 0));
+		u32 zigzag = (u16)((delta << 1) ^ (delta >> 15));
+		while (zigzag >= 0x80)
+		{
+			*cursor++ = (u8)(zigzag | 0x80);
+			zigzag >>= 7;
+		}
+		*cursor++ = (u8)(zigzag);
+	}
+	out.resize(cursor - out.data());
+}
+
+bool Trajectory::DecodeFrame(const u8 *data, u32 size, const u16 *previous, u32 count, u16 *values)
+{
+	const u8 *cursor = data;
+	const u8 *end = data + size;
+	for (u32 i = 0; i < count; i++)
+	{
+		u32 zigzag = 0;
+		for (u32 shift = 0; ; shift += 7)
+		{
+			if (cursor == end || shift > 14)
+				return false;
+			const u8 byte = *cursor++;
+			zigzag |= (u32)(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+		const u16 delta = (u16)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+		values[i] = (u16)(delta + (previous ? previous[i] : 0));
+	}
+	return cursor == end;
+}
+
+std::string Trajectory::FormatStats(const TrajectoryStats &stats)
+{
+	const f64 seconds = stats.writeNanoseconds / 1e9;
+	char line[192];
+	snprintf(line, sizeof(line), "%llu frames recorded, %llu dropped, %.1f MB written at %.0f MB/s, %.2fx smaller than quantized",
+		(unsigned long long)(stats.recordedFrames), (unsigned long long)(stats.droppedFrames), stats.writtenBytes / 1e6,
+		seconds > 0 ? stats.writtenBytes / 1e6 / seconds : 0.0, stats.writtenBytes > 0 ? (f64)(stats.rawBytes) / stats.writtenBytes : 0.0);
+	return line;
+}
+
+TrajectoryRecorder::~TrajectoryRecorder()
+{
+	Stop();
+}
+
+bool TrajectoryRecorder::Start(const std::string &path, const SimParams &params, u32 interval, u32 queueCapacity)
+{
+	Stop();
+	file = std::fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	header = TrajectoryHeader();
+	header.objectCount = params.objectCount;
+	header.interval = Util::MaxU(interval, 1);
+	header.worldSize = params.worldSize;
+	if (std::fwrite(&header, sizeof(header), 1, file) != 1)
+	{
+		std::fclose(file);
+		file = nullptr;
+		return false;
+	}
+
+	// Slots are sized once, submitting never allocates
+	slots.resize(Util::MaxU(queueCapacity, 1));
+	for (Slot &slot : slots)
+		slot.values.resize((size_t)(params.objectCount) * TRAJECTORY_COMPONENTS);
+	head = 0;
+	tail = 0;
+	stopping = false;
+	submittedFrames = 0;
+	recordedFrames = 0;
+	droppedFrames = 0;
+	rawBytes = 0;
+	writtenBytes = sizeof(header);
+	writeNanoseconds = 0;
+	writer = std::thread(&TrajectoryRecorder::WriterFunc, this);
+	return true;
+}
+
+void TrajectoryRecorder::Stop()
+{
+	if (!file)
+		return;
+	stopping = true;
+	signal.fetch_add(1, std::memory_order_release);
+	signal.notify_one();
+	writer.join();
+
+	header.frameCount = recordedFrames;
+	std::fseek(file, 0, SEEK_SET);
+	std::fwrite(&header, sizeof(header), 1, file);
+	std::fclose(file);
+	file = nullptr;
+}
+
+bool TrajectoryRecorder::IsRecording() const
+{
+	return file != nullptr;
+}
+
+u32 TrajectoryRecorder::GetInterval() const
+{
+	return header.interval;
+}
+
+bool TrajectoryRecorder::ShouldRecord(u64 tick) const
+{
+	return file && tick % header.interval == 0;
+}
+
+TrajectoryRecorder::Slot *TrajectoryRecorder::AcquireSlot(u32 objectCount)
+{
+	if (!file || objectCount != header.objectCount)
+		return nullptr;
+	submittedFrames++;
+	const u64 h = head.load(std::memory_order_relaxed);
+	if (h - tail.load(std::memory_order_acquire) >= slots.size())
+	{
+		droppedFrames++;
+		return nullptr;
+	}
+	return &slots[h % slots.size()];
+}
+
+void TrajectoryRecorder::CommitSlot(Slot *slot, u64 tick)
+{
+	slot->tick = tick;
+	head.fetch_add(1, std::memory_order_release);
+	signal.fetch_add(1, std::memory_order_release);
+	signal.notify_one();
+}
+
+bool TrajectoryRecorder::Submit(u64 tick, const std::vector<Vec3> &positions, const std::vector<Quat> &rotations)
+{
+	Slot *slot = AcquireSlot((u32)(Util::MinU((u32)(positions.size()), (u32)(rotations.size()))));
+	if (!slot)
+		return false;
+	u16 *out = slot->values.data();
+	for (u32 i = 0; i < header.objectCount; i++, out += TRAJECTORY_COMPONENTS)
+	{
+		out[0] = Trajectory::QuantizePosition(positions[i].x, header.worldSize);
+		out[1] = Trajectory::QuantizePosition(positions[i].y, header.worldSize);
+		out[2] = Trajectory::QuantizePosition(positions[i].z, header.worldSize);
+		out[3] = Trajectory::QuantizeSnorm(rotations[i].v.x);
+		out[4] = Trajectory::QuantizeSnorm(rotations[i].v.y);
+		out[5] = Trajectory::QuantizeSnorm(rotations[i].v.z);
+		out[6] = Trajectory::QuantizeSnorm(rotations[i].a);
+	}
+	CommitSlot(slot, tick);
+	return true;
+}
+
+bool TrajectoryRecorder::SubmitObjects(u64 tick, const Vec4 *objects, u32 objectCount)
+{
+	Slot *slot = AcquireSlot(objectCount);
+	if (!slot)
+		return false;
+	u16 *out = slot->values.data();
+	for (u32 i = 0; i < header.objectCount; i++, out += TRAJECTORY_COMPONENTS)
+	{
+		const Vec4 &position = objects[i * 4];
+		const Vec4 &rotation = objects[i * 4 + 3];
+		out[0] = Trajectory::QuantizePosition(position.x, header.worldSize);
+		out[1] = Trajectory::QuantizePosition(position.y, header.worldSize);
+		out[2] = Trajectory::QuantizePosition(position.z, header.worldSize);
+		out[3] = Trajectory::QuantizeSnorm(rotation.x);
+		out[4] = Trajectory::QuantizeSnorm(rotation.y);
+		out[5] = Trajectory::QuantizeSnorm(rotation.z);
+		out[6] = Trajectory::QuantizeSnorm(rotation.w);
+	}
+	CommitSlot(slot, tick);
+	return true;
+}
+
+TrajectoryStats TrajectoryRecorder::GetStats() const
+{
+	TrajectoryStats stats;
+	stats.submittedFrames = submittedFrames;
+	stats.recordedFrames = recordedFrames;
+	stats.droppedFrames = droppedFrames;
+	stats.rawBytes = rawBytes;
+	stats.writtenBytes = writtenBytes;
+	stats.writeNanoseconds = writeNanoseconds;
+	return stats;
+}
+
+void TrajectoryRecorder::WriterFunc()
+{
+	TRACE_THREAD_NAME("Trajectory Writer");
+	const u32 valueCount = header.objectCount * TRAJECTORY_COMPONENTS;
+	std::vector<u16> previous(valueCount);
+	std::vector<u8> payload;
+	u64 written = 0;
+	bool failed = false;
+	while (true)
+	{
+		// Loaded first so a submit or Stop after the checks below wakes the wait
+		const u64 waitValue = signal.load(std::memory_order_acquire);
+		const u64 t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+		{
+			if (stopping)
+				break;
+			signal.wait(waitValue, std::memory_order_acquire);
+			continue;
+		}
+
+		// A partial frame breaks every delta after it, the rest of the recording is dropped
+		if (failed)
+		{
+			droppedFrames++;
+			tail.store(t + 1, std::memory_order_release);
+			continue;
+		}
+
+		TRACE_SCOPE("WriteTrajectoryFrame");
+		const Slot &slot = slots[t % slots.size()];
+		TrajectoryFrameHeader frame;
+		frame.tick = slot.tick;
+		frame.keyframe = written % TRAJECTORY_KEYFRAME_INTERVAL == 0;
+		Trajectory::EncodeFrame(slot.values.data(), frame.keyframe ? nullptr : previous.data(), valueCount, payload);
+		frame.payloadSize = (u32)(payload.size());
+		memcpy(previous.data(), slot.values.data(), (size_t)(valueCount) * sizeof(u16));
+		// The slot is encoded, the producer may reuse it
+		tail.store(t + 1, std::memory_order_release);
+
+		auto writeStart = std::chrono::steady_clock::now();
+		bool success = std::fwrite(&frame, sizeof(frame), 1, file) == 1;
+		success &= payload.empty() || std::fwrite(payload.data(), payload.size(), 1, file) == 1;
+		writeNanoseconds += (u64)(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - writeStart).count());
+		if (!success)
+		{
+			failed = true;
+			droppedFrames++;
+			continue;
+		}
+		written++;
+		recordedFrames++;
+		rawBytes += (u64)(valueCount) * sizeof(u16);
+		writtenBytes += sizeof(frame) + payload.size();
+	}
+}
+
+bool TrajectoryReader::Open(const std::string &path, std::string &error)
+{
+	hasPrevious = false;
+	if (!file.Open(path, true))
+	{
+		error = "could not open " + path;
+		return false;
+	}
+	if (file.GetSize() < sizeof(TrajectoryHeader))
+	{
+		error = path + " is too small for a trajectory header";
+		return false;
+	}
+	memcpy(&header, file.GetData(), sizeof(header));
+	if (header.magic != TRAJECTORY_MAGIC || header.version != TRAJECTORY_VERSION)
+	{
+		error = path + " is not a trajectory of version " + std::to_string(TRAJECTORY_VERSION);
+		return false;
+	}
+	offset = sizeof(header);
+	previous.assign((size_t)(header.objectCount) * TRAJECTORY_COMPONENTS, 0);
+	return true;
+}
+
+const TrajectoryHeader &TrajectoryReader::GetHeader() const
+{
+	return header;
+}
+
+bool TrajectoryReader::ReadFrame(u64 &tick, std::vector<u16> &values)
+{
+	if (!file.IsOpen() || offset + sizeof(TrajectoryFrameHeader) > file.GetSize())
+		return false;
+	TrajectoryFrameHeader frame;
+	memcpy(&frame, file.GetData() + offset, sizeof(frame));
+	if (offset + sizeof(frame) + frame.payloadSize > file.GetSize() || (!frame.keyframe && !hasPrevious))
+		return false;
+
+	values.resize(previous.size());
+	if (!Trajectory::DecodeFrame(file.GetData() + offset + sizeof(frame), frame.payloadSize, frame.keyframe ? nullptr : previous.data(), (u32)(values.size()), values.data()))
+		return false;
+	offset += sizeof(frame) + frame.payloadSize;
+	previous = values;
+	hasPrevious = true;
+	tick = frame.tick;
+	return true;
+}